@@ -0,0 +1,203 @@
+/*
+ * crypto1.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include "crypto1.h"
+
+#include <string.h>
+
+// Feedback taps of the LFSR, split in the odd and even bits
+#define CRYPTO1_POLY_ODD		(0x29CE5C)
+#define CRYPTO1_POLY_EVEN		(0x870804)
+
+static inline uint8_t crypto1_parity32(uint32_t x) {
+	x ^= x >> 16;
+	x ^= x >> 8;
+	x ^= x >> 4;
+	return (0x6996 >> (x & 0xF)) & 1;
+}
+
+// The two layers of the filter function, applied to the 20 odd bits used
+static inline uint8_t crypto1_filter_odd(uint32_t x) {
+	uint32_t f;
+	f = 0xf22c0 >> (x & 0xf) & 16;
+	f |= 0x6c9c0 >> (x >> 4 & 0xf) & 8;
+	f |= 0x3c8b0 >> (x >> 8 & 0xf) & 4;
+	f |= 0x1e458 >> (x >> 12 & 0xf) & 2;
+	f |= 0x0d938 >> (x >> 16 & 0xf) & 1;
+	return (0xEC57E80A >> f) & 1;
+}
+
+/**
+ * Loads the 6 byte key into the LFSR.
+ */
+void crypto1_init(crypto1_t *crypto1, const uint8_t *key) {
+	uint64_t k = 0;
+	for (int i = 0; i < 6; i++)
+		k = (k << 8) | key[i];
+	crypto1->odd = crypto1->even = 0;
+	for (int i = 47; i > 0; i -= 2) {
+		crypto1->odd = crypto1->odd << 1 | ((k >> ((i - 1) ^ 7)) & 1);
+		crypto1->even = crypto1->even << 1 | ((k >> (i ^ 7)) & 1);
+	}
+}
+
+/**
+ * The next keystream bit, without shifting. Encrypts the parity bit that
+ * follows a byte.
+ */
+uint8_t crypto1_filter(const crypto1_t *crypto1) {
+	return crypto1_filter_odd(crypto1->odd);
+}
+
+/**
+ * Shifts one bit and returns the keystream bit. The input bit is fed into
+ * the LFSR. When encrypted is set, the input is ciphertext and the
+ * keystream bit is removed before feeding it.
+ */
+uint8_t crypto1_bit(crypto1_t *crypto1, uint8_t in, bool encrypted) {
+	uint8_t ret = crypto1_filter_odd(crypto1->odd);
+	uint32_t feedin = (ret & encrypted) ^ !!in;
+	feedin ^= CRYPTO1_POLY_ODD & crypto1->odd;
+	feedin ^= CRYPTO1_POLY_EVEN & crypto1->even;
+	uint32_t t = crypto1->even << 1 | crypto1_parity32(feedin);
+	crypto1->even = crypto1->odd;
+	crypto1->odd = t;
+	return ret;
+}
+
+uint8_t crypto1_byte(crypto1_t *crypto1, uint8_t in, bool encrypted) {
+	uint8_t ret = 0;
+	for (int i = 0; i < 8; i++)
+		ret |= crypto1_bit(crypto1, (in >> i) & 1, encrypted) << i;
+	return ret;
+}
+
+uint32_t crypto1_word(crypto1_t *crypto1, uint32_t in, bool encrypted) {
+	uint32_t ret = 0;
+	for (int i = 0; i < 32; i++)
+		ret |= (uint32_t) crypto1_bit(crypto1, (in >> (i ^ 24)) & 1, encrypted)
+				<< (i ^ 24);
+	return ret;
+}
+
+/**
+ * Advances the 16 bit nonce generator of the PICC by n steps. The reader
+ * answer is the successor 64 of the PICC nonce, the PICC answer the
+ * successor 96.
+ */
+uint32_t crypto1_prng_successor(uint32_t x, uint32_t n) {
+	x = (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+	while (n--)
+		x = x >> 1 | (x >> 16 ^ x >> 18 ^ x >> 19 ^ x >> 21) << 31;
+	return (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+}
+
+/**
+ * Checks whether a nonce can be produced by the 16 bit generator of the
+ * PICC: the last 16 bits follow from the first 16 bits.
+ */
+bool crypto1_prng_valid(uint32_t x) {
+	x = (x >> 24) | ((x >> 8) & 0xFF00) | ((x << 8) & 0xFF0000) | (x << 24);
+	return !((x ^ x >> 2 ^ x >> 3 ^ x >> 5 ^ x >> 16) & 0xFFFF);
+}
+
+uint8_t crypto1_odd_parity(uint8_t byte) {
+	return !crypto1_parity32(byte);
+}
+
+/**
+ * Encrypts a frame in place and calculates the encrypted parity bits.
+ * With feed set, the plaintext is fed into the LFSR, as is done for the
+ * reader nonce.
+ */
+void crypto1_encrypt(crypto1_t *crypto1, uint8_t *data, uint8_t *parity,
+		size_t size, bool feed) {
+	for (size_t i = 0; i < size; i++) {
+		uint8_t plain = data[i];
+		data[i] = plain ^ crypto1_byte(crypto1, feed ? plain : 0, false);
+		parity[i] = crypto1_odd_parity(plain) ^ crypto1_filter(crypto1);
+	}
+}
+
+/**
+ * Decrypts a frame in place. With feed set, the plaintext is fed into the
+ * LFSR, the counterpart of crypto1_encrypt() with feed set.
+ *
+ * @return false when a parity bit does not match
+ */
+bool crypto1_decrypt(crypto1_t *crypto1, uint8_t *data, const uint8_t *parity,
+		size_t size, bool feed) {
+	bool ok = true;
+	for (size_t i = 0; i < size; i++) {
+		data[i] ^= crypto1_byte(crypto1, feed ? data[i] : 0, feed);
+		if (parity && (parity[i] ^ crypto1_filter(crypto1))
+						!= crypto1_odd_parity(data[i]))
+			ok = false;
+	}
+	return ok;
+}
+
+/**
+ * Encrypts or decrypts a 4 bit ACK or NAK.
+ */
+uint8_t crypto1_nibble(crypto1_t *crypto1, uint8_t nibble) {
+	uint8_t ks = 0;
+	for (int i = 0; i < 4; i++)
+		ks |= crypto1_bit(crypto1, 0, false) << i;
+	return (nibble ^ ks) & 0x0F;
+}
+
+/**
+ * Packs bytes and their parity bits into a bit stream, LSB first, every
+ * byte followed by its parity bit.
+ *
+ * @return The number of bits
+ */
+size_t crypto1_pack(const uint8_t *data, const uint8_t *parity, size_t size,
+		uint8_t *raw) {
+	size_t bits = 9 * size;
+	memset(raw, 0, (bits + 7) / 8);
+	for (size_t i = 0; i < size; i++) {
+		size_t pos = 9 * i;
+		uint16_t v = data[i] | ((parity[i] & 1) << 8);
+		raw[pos / 8] |= v << (pos % 8);
+		raw[pos / 8 + 1] |= v >> (8 - pos % 8);
+	}
+	return bits;
+}
+
+/**
+ * Splits a bit stream into bytes and their parity bits.
+ *
+ * @return The number of bytes, 0 when the stream is not a whole number of
+ * 		   bytes with parity
+ */
+size_t crypto1_unpack(const uint8_t *raw, size_t bits, uint8_t *data,
+		uint8_t *parity) {
+	if (!bits || bits % 9)
+		return 0;
+	size_t size = bits / 9;
+	for (size_t i = 0; i < size; i++) {
+		size_t pos = 9 * i;
+		uint16_t v = (raw[pos / 8] | (raw[pos / 8 + 1] << 8)) >> (pos % 8);
+		data[i] = v;
+		parity[i] = (v >> 8) & 1;
+	}
+	return size;
+}
+
+uint32_t crypto1_get_word(const uint8_t *data) {
+	return ((uint32_t) data[0] << 24) | ((uint32_t) data[1] << 16)
+			| ((uint32_t) data[2] << 8) | data[3];
+}
+
+void crypto1_put_word(uint8_t *data, uint32_t word) {
+	data[0] = word >> 24;
+	data[1] = word >> 16;
+	data[2] = word >> 8;
+	data[3] = word;
+}
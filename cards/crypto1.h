@@ -0,0 +1,59 @@
+/*
+ * crypto1.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_CRYPTO1_H_
+#define BSRFID_CARDS_CRYPTO1_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Software implementation of the MIFARE Classic Crypto1 stream cipher, for
+// readers without a Crypto1 unit or with the unit bypassed.
+//
+// The 48 bit LFSR is kept as its odd and even bits, as in the public
+// analysis of the cipher, so the filter function is a few table lookups on
+// one word. Words are in transmission order: the first byte is the most
+// significant, bits within a byte are sent LSB first.
+//
+// An encrypted frame carries encrypted parity bits, so it is exchanged with
+// the parity of the reader IC disabled: every byte is followed by its
+// parity bit. crypto1_pack() and crypto1_unpack() convert between bytes
+// with a parity array and such a bit stream.
+
+typedef struct {
+	uint32_t odd;
+	uint32_t even;
+} crypto1_t;
+
+// Encrypted frame with parity for 16 bytes of data and the CRC
+#define CRYPTO1_FRAME_SIZE			((18 * 9 + 7) / 8)
+
+void crypto1_init(crypto1_t *crypto1, const uint8_t *key);
+uint8_t crypto1_bit(crypto1_t *crypto1, uint8_t in, bool encrypted);
+uint8_t crypto1_byte(crypto1_t *crypto1, uint8_t in, bool encrypted);
+uint32_t crypto1_word(crypto1_t *crypto1, uint32_t in, bool encrypted);
+uint8_t crypto1_filter(const crypto1_t *crypto1);
+uint32_t crypto1_prng_successor(uint32_t x, uint32_t n);
+bool crypto1_prng_valid(uint32_t x);
+uint8_t crypto1_odd_parity(uint8_t byte);
+
+void crypto1_encrypt(crypto1_t *crypto1, uint8_t *data, uint8_t *parity,
+		size_t size, bool feed);
+bool crypto1_decrypt(crypto1_t *crypto1, uint8_t *data, const uint8_t *parity,
+		size_t size, bool feed);
+uint8_t crypto1_nibble(crypto1_t *crypto1, uint8_t nibble);
+
+size_t crypto1_pack(const uint8_t *data, const uint8_t *parity, size_t size,
+		uint8_t *raw);
+size_t crypto1_unpack(const uint8_t *raw, size_t bits, uint8_t *data,
+		uint8_t *parity);
+
+uint32_t crypto1_get_word(const uint8_t *data);
+void crypto1_put_word(uint8_t *data, uint32_t word);
+
+#endif /* BSRFID_CARDS_CRYPTO1_H_ */
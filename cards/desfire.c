@@ -0,0 +1,292 @@
+/*
+ * desfire.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "desfire.h"
+
+int desfire_init(desfire_t *desfire, bs_pdc_t *pdc, picc_t *picc) {
+	memset(desfire, 0, sizeof(desfire_t));
+	desfire->pdc = pdc;
+	desfire->picc = picc;
+	if (!picc->iso14443_4.fsd)
+		return STATUS_INVALID;	// Not activated, see iso14443_4_rats()
+	return STATUS_OK;
+}
+
+// Maps the DESFire status to a result
+static int desfire_result(uint8_t status) {
+	switch (status) {
+	case desfire_status_ok:
+	case desfire_status_no_changes:
+		return STATUS_OK;
+	case desfire_status_authentication_error:
+	case desfire_status_permission_denied:
+		return STATUS_AUTH_ERROR;
+	case desfire_status_length_error:
+	case desfire_status_parameter_error:
+	case desfire_status_boundary_error:
+		return STATUS_INVALID;
+	case desfire_status_out_of_eeprom:
+	case desfire_status_eeprom_error:
+		return STATUS_EEPROM_ERROR;
+	default:
+		return STATUS_ERROR;
+	}
+}
+
+static int desfire_exchange(desfire_t *desfire, desfire_command_t cmd,
+		const void *data, size_t size, iso14443_4_recv_f recv, void *context,
+		size_t *received) {
+	iso14443_4_segment_t segment = { data, size };
+	iso7816_4_command_t command = { .cla = DESFIRE_CLA, .ins = cmd,
+			.data = &segment, .data_count = size ? 1 : 0,
+			.ne = ISO7816_4_NE_SHORT, .flags = iso7816_4_continue_af };
+	iso7816_4_response_t response;
+
+	int result = iso7816_4_transceive(desfire->pdc, desfire->picc, &command,
+			recv, context, &response);
+	desfire->stats.commands++;
+	desfire->stats.exchanges += response.exchanges;
+	if (received)
+		*received = response.size;
+	if (result)
+		return result;
+	if ((response.sw >> 8) != 0x91)
+		return STATUS_ERROR;	// Not a DESFire status word
+	desfire->status = response.sw;
+	return desfire_result(desfire->status);
+}
+
+/**
+ * Sends a native command, wrapped in an APDU. The response data of all
+ * frames is passed to recv, the status is kept in desfire->status.
+ *
+ * @param recv	May be NULL when the command has no response data
+ * @return STATUS_OK, or the mapped DESFire status
+ */
+int desfire_command(desfire_t *desfire, desfire_command_t cmd,
+		const void *data, size_t size, iso14443_4_recv_f recv, void *context) {
+	return desfire_exchange(desfire, cmd, data, size, recv, context, NULL);
+}
+
+// Command with a response of at most size bytes
+static int desfire_command_buffer(desfire_t *desfire, desfire_command_t cmd,
+		const void *data, size_t size, void *response, size_t *response_size) {
+	iso14443_4_buffer_t buffer = { response, *response_size, 0 };
+	int result = desfire_command(desfire, cmd, data, size, iso14443_4_collect,
+			&buffer);
+	*response_size = buffer.received;
+	return result;
+}
+
+static uint32_t desfire_get24(const uint8_t *data) {
+	return data[0] | data[1] << 8 | (uint32_t) data[2] << 16;
+}
+
+static int32_t desfire_get32(const uint8_t *data) {
+	return (int32_t) (data[0] | data[1] << 8 | data[2] << 16
+			| (uint32_t) data[3] << 24);
+}
+
+static void desfire_put24(uint8_t *data, uint32_t value) {
+	data[0] = value;
+	data[1] = value >> 8;
+	data[2] = value >> 16;
+}
+
+int desfire_get_version(desfire_t *desfire, desfire_version_t *version) {
+	uint8_t response[DESFIRE_VERSION_SIZE + 4];	// EV2 adds bytes at the end
+	size_t size = sizeof(response);
+	int result = desfire_command_buffer(desfire, desfire_cmd_get_version, NULL,
+			0, response, &size);
+	if (result)
+		return result;
+	if (size < DESFIRE_VERSION_SIZE)
+		return STATUS_ERROR;
+	memcpy(&version->hardware, response, 7);
+	memcpy(&version->software, response + 7, 7);
+	memcpy(version->uid, response + 14, 7);
+	memcpy(version->batch, response + 21, 5);
+	version->production_week = response[26];
+	version->production_year = response[27];
+	return STATUS_OK;
+}
+
+/**
+ * @param count	In: size of aids, Out: number of applications
+ */
+int desfire_get_application_ids(desfire_t *desfire, uint32_t *aids,
+		size_t *count) {
+	uint8_t response[3 * DESFIRE_MAX_APPLICATIONS];
+	size_t size = sizeof(response);
+	int result = desfire_command_buffer(desfire,
+			desfire_cmd_get_application_ids, NULL, 0, response, &size);
+	if (result)
+		return result;
+	if (size % 3)
+		return STATUS_ERROR;
+	if (size / 3 > *count)
+		return STATUS_NO_ROOM;
+	*count = size / 3;
+	for (size_t i = 0; i < *count; i++)
+		aids[i] = desfire_get24(response + 3 * i);
+	return STATUS_OK;
+}
+
+/**
+ * Selects an application, AID 0 is the PICC level. Nothing is sent when
+ * the application is still selected.
+ */
+int desfire_select_application(desfire_t *desfire, uint32_t aid) {
+	uint8_t data[3];
+
+	if (desfire->selected && desfire->aid == aid
+			&& desfire->epoch == desfire->pdc->picc_epoch)
+		return STATUS_OK;
+	desfire->selected = false;
+	desfire_put24(data, aid);
+	int result = desfire_command(desfire, desfire_cmd_select_application, data,
+			sizeof(data), NULL, NULL);
+	if (result)
+		return result;
+	desfire->aid = aid;
+	desfire->selected = true;
+	desfire->epoch = desfire->pdc->picc_epoch;
+	return STATUS_OK;
+}
+
+/**
+ * @param count	In: size of files, Out: number of files
+ */
+int desfire_get_file_ids(desfire_t *desfire, uint8_t *files, size_t *count) {
+	return desfire_command_buffer(desfire, desfire_cmd_get_file_ids, NULL, 0,
+			files, count);
+}
+
+int desfire_get_file_settings(desfire_t *desfire, uint8_t file,
+		desfire_file_settings_t *settings) {
+	uint8_t response[32];
+	size_t size = sizeof(response);
+	int result = desfire_command_buffer(desfire, desfire_cmd_get_file_settings,
+			&file, 1, response, &size);
+	if (result)
+		return result;
+	if (size < 7)
+		return STATUS_ERROR;
+
+	memset(settings, 0, sizeof(desfire_file_settings_t));
+	settings->type = response[0];
+	settings->communication = response[1];
+	settings->access_rights = response[2] | response[3] << 8;
+	switch (settings->type) {
+	case desfire_file_standard:
+	case desfire_file_backup:
+		settings->data.size = desfire_get24(response + 4);
+		return STATUS_OK;
+	case desfire_file_value:
+		if (size < 17)
+			return STATUS_ERROR;
+		settings->value.lower_limit = desfire_get32(response + 4);
+		settings->value.upper_limit = desfire_get32(response + 8);
+		settings->value.limited_credit = desfire_get32(response + 12);
+		settings->value.limited_credit_enabled = response[16] & 0x01;
+		return STATUS_OK;
+	case desfire_file_linear_record:
+	case desfire_file_cyclic_record:
+		if (size < 13)
+			return STATUS_ERROR;
+		settings->record.record_size = desfire_get24(response + 4);
+		settings->record.max_records = desfire_get24(response + 7);
+		settings->record.records = desfire_get24(response + 10);
+		return STATUS_OK;
+	default:
+		return STATUS_ERROR;
+	}
+}
+
+// ReadData and ReadRecords: one command for the whole range, the PICC
+// continues with ADDITIONAL FRAME until all data is sent
+static int desfire_read(desfire_t *desfire, desfire_command_t cmd,
+		uint8_t file, uint32_t offset, uint32_t length,
+		iso14443_4_recv_f recv, void *context) {
+	bs_pdc_t *pdc = desfire->pdc;
+	uint32_t start_ms = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	unsigned int frames = pdc->frame_count;
+	uint8_t data[7];
+
+	if (offset > DESFIRE_MAX_LENGTH || length > DESFIRE_MAX_LENGTH)
+		return STATUS_INVALID;
+	data[0] = file;
+	desfire_put24(data + 1, offset);
+	desfire_put24(data + 4, length);
+	int result = desfire_exchange(desfire, cmd, data, sizeof(data), recv,
+			context, &desfire->stats.bytes_read);
+	desfire->stats.frames = pdc->frame_count - frames;
+	if (pdc->get_time_ms)
+		desfire->stats.time_ms = pdc->get_time_ms() - start_ms;
+	return result;
+}
+
+/**
+ * Reads from a standard or backup data file, streaming the data to recv
+ * while the frames arrive.
+ *
+ * @param length	0 reads up to the end of the file
+ */
+int desfire_read_data_stream(desfire_t *desfire, uint8_t file,
+		uint32_t offset, uint32_t length, iso14443_4_recv_f recv,
+		void *context) {
+	return desfire_read(desfire, desfire_cmd_read_data, file, offset, length,
+			recv, context);
+}
+
+/**
+ * Reads from a standard or backup data file.
+ *
+ * @param length	0 reads up to the end of the file
+ * @param size		In: size of data, Out: bytes read
+ * @return STATUS_NO_ROOM when the data does not fit, the PICC must then be
+ * 		   deselected.
+ */
+int desfire_read_data(desfire_t *desfire, uint8_t file, uint32_t offset,
+		uint32_t length, void *data, size_t *size) {
+	iso14443_4_buffer_t buffer = { data, *size, 0 };
+	int result = desfire_read(desfire, desfire_cmd_read_data, file, offset,
+			length, iso14443_4_collect, &buffer);
+	*size = buffer.received;
+	return result;
+}
+
+/**
+ * Reads records from a record file, oldest first.
+ *
+ * @param offset	Of the newest record to read, 0 is the latest record
+ * @param count		Records to read, 0 reads all records from offset on
+ * @param size		In: size of data, Out: bytes read
+ */
+int desfire_read_records(desfire_t *desfire, uint8_t file, uint32_t offset,
+		uint32_t count, void *data, size_t *size) {
+	iso14443_4_buffer_t buffer = { data, *size, 0 };
+	int result = desfire_read(desfire, desfire_cmd_read_records, file, offset,
+			count, iso14443_4_collect, &buffer);
+	*size = buffer.received;
+	return result;
+}
+
+int desfire_get_value(desfire_t *desfire, uint8_t file, int32_t *value) {
+	uint8_t response[4];
+	size_t size = sizeof(response);
+	int result = desfire_command_buffer(desfire, desfire_cmd_get_value, &file,
+			1, response, &size);
+	if (result)
+		return result;
+	if (size != 4)
+		return STATUS_ERROR;
+	*value = desfire_get32(response);
+	return STATUS_OK;
+}
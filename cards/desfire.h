@@ -0,0 +1,165 @@
+/*
+ * desfire.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_DESFIRE_H_
+#define BSRFID_CARDS_DESFIRE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+#include "iso7816_4.h"
+
+// MIFARE DESFire EV1/EV2 native commands, ISO 7816-4 wrapped, on an
+// activated ISO 14443-4 PICC.
+//
+// A PICC answers with at most one frame of data per response and
+// continues with ADDITIONAL FRAME (91AF). Every read is therefore sent as
+// a single command for the whole range, the continuation frames are
+// requested right away and the data is streamed to the caller while it
+// arrives. The selected application is remembered while picc_epoch of the
+// PCD is unchanged, selecting it again costs no exchange.
+//
+// Only plain communication is supported, files with MACed or enciphered
+// communication need an authentication that is not implemented here.
+
+#define DESFIRE_CLA					(0x90)
+#define DESFIRE_VERSION_SIZE		(28)
+#define DESFIRE_MAX_APPLICATIONS	(28)
+#define DESFIRE_MAX_FILES			(32)
+// ReadData, ReadRecords: offset and length are 3 bytes
+#define DESFIRE_MAX_LENGTH			(0xFFFFFF)
+
+typedef enum {
+	desfire_cmd_get_version = 0x60,
+	desfire_cmd_get_application_ids = 0x6A,
+	desfire_cmd_select_application = 0x5A,
+	desfire_cmd_get_file_ids = 0x6F,
+	desfire_cmd_get_file_settings = 0xF5,
+	desfire_cmd_read_data = 0xBD,
+	desfire_cmd_read_records = 0xBB,
+	desfire_cmd_get_value = 0x6C,
+	desfire_cmd_additional_frame = 0xAF,
+} desfire_command_t;
+
+// SW2 of a 91xx status word
+typedef enum {
+	desfire_status_ok = 0x00,
+	desfire_status_no_changes = 0x0C,
+	desfire_status_out_of_eeprom = 0x0E,
+	desfire_status_illegal_command = 0x1C,
+	desfire_status_integrity_error = 0x1E,
+	desfire_status_no_such_key = 0x40,
+	desfire_status_length_error = 0x7E,
+	desfire_status_permission_denied = 0x9D,
+	desfire_status_parameter_error = 0x9E,
+	desfire_status_application_not_found = 0xA0,
+	desfire_status_application_integrity_error = 0xA1,
+	desfire_status_authentication_error = 0xAE,
+	desfire_status_additional_frame = 0xAF,
+	desfire_status_boundary_error = 0xBE,
+	desfire_status_picc_integrity_error = 0xC1,
+	desfire_status_command_aborted = 0xCA,
+	desfire_status_picc_disabled = 0xCD,
+	desfire_status_count_error = 0xCE,
+	desfire_status_duplicate_error = 0xDE,
+	desfire_status_eeprom_error = 0xEE,
+	desfire_status_file_not_found = 0xF0,
+	desfire_status_file_integrity_error = 0xF1,
+} desfire_status_t;
+
+typedef enum {
+	desfire_file_standard = 0x00,
+	desfire_file_backup = 0x01,
+	desfire_file_value = 0x02,
+	desfire_file_linear_record = 0x03,
+	desfire_file_cyclic_record = 0x04,
+} desfire_file_type_t;
+
+typedef struct {
+	uint8_t vendor_id;
+	uint8_t type;
+	uint8_t subtype;
+	uint8_t version_major;
+	uint8_t version_minor;
+	uint8_t storage_size;		// 2^(n/2) bytes, n odd: between that and the next
+	uint8_t protocol;
+} desfire_version_part_t;
+
+typedef struct {
+	desfire_version_part_t hardware;
+	desfire_version_part_t software;
+	uint8_t uid[7];
+	uint8_t batch[5];
+	uint8_t production_week;
+	uint8_t production_year;
+} desfire_version_t;
+
+typedef struct {
+	desfire_file_type_t type;
+	uint8_t communication;		// 0 plain, 1 MACed, 3 enciphered
+	uint16_t access_rights;
+	union {
+		struct {
+			uint32_t size;
+		} data;					// Standard and backup files
+		struct {
+			int32_t lower_limit;
+			int32_t upper_limit;
+			int32_t limited_credit;
+			bool limited_credit_enabled;
+		} value;
+		struct {
+			uint32_t record_size;
+			uint32_t max_records;
+			uint32_t records;
+		} record;
+	};
+} desfire_file_settings_t;
+
+typedef struct {
+	unsigned int commands;		// Commands sent
+	unsigned int exchanges;		// Including ADDITIONAL FRAME
+	unsigned int frames;		// Frames of the last read
+	uint32_t time_ms;			// Duration of the last read
+	size_t bytes_read;			// Data of the last read
+} desfire_stats_t;
+
+typedef struct {
+	bs_pdc_t *pdc;
+	picc_t *picc;
+	// The selected application, valid while picc_epoch of the PCD is
+	// unchanged
+	uint32_t aid;
+	bool selected;
+	unsigned int epoch;
+	uint8_t status;				// desfire_status_t of the last command
+	desfire_stats_t stats;
+} desfire_t;
+
+int desfire_init(desfire_t *desfire, bs_pdc_t *pdc, picc_t *picc);
+int desfire_command(desfire_t *desfire, desfire_command_t cmd,
+		const void *data, size_t size, iso14443_4_recv_f recv, void *context);
+int desfire_get_version(desfire_t *desfire, desfire_version_t *version);
+int desfire_get_application_ids(desfire_t *desfire, uint32_t *aids,
+		size_t *count);
+int desfire_select_application(desfire_t *desfire, uint32_t aid);
+int desfire_get_file_ids(desfire_t *desfire, uint8_t *files, size_t *count);
+int desfire_get_file_settings(desfire_t *desfire, uint8_t file,
+		desfire_file_settings_t *settings);
+int desfire_read_data(desfire_t *desfire, uint8_t file, uint32_t offset,
+		uint32_t length, void *data, size_t *size);
+int desfire_read_data_stream(desfire_t *desfire, uint8_t file,
+		uint32_t offset, uint32_t length, iso14443_4_recv_f recv,
+		void *context);
+int desfire_read_records(desfire_t *desfire, uint8_t file, uint32_t offset,
+		uint32_t count, void *data, size_t *size);
+int desfire_get_value(desfire_t *desfire, uint8_t file, int32_t *value);
+
+#endif /* BSRFID_CARDS_DESFIRE_H_ */
@@ -0,0 +1,422 @@
+/*
+ * iso14443_4.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "iso14443_4.h"
+
+// FSDI and FSCI to frame size
+static const uint16_t iso14443_4_frame_sizes[] = { 16, 24, 32, 40, 48, 64, 96,
+		128, 256 };
+
+typedef enum {
+	iso14443_4_send_i,			// The current I-block of the command
+	iso14443_4_send_ack,
+	iso14443_4_send_nak,
+	iso14443_4_send_wtx,
+} iso14443_4_send_t;
+
+static int iso14443_4_set_bitrate(bs_pdc_t *pdc, pdc_bitrate_t tx,
+		pdc_bitrate_t rx) {
+	if (!pdc->SetBitRate || (pdc->tx_bitrate == tx && pdc->rx_bitrate == rx))
+		return STATUS_OK;
+	return pdc->SetBitRate(pdc, tx, rx);
+}
+
+/**
+ * Frame size of an FSDI or FSCI, values above 8 are treated as 8.
+ */
+uint16_t iso14443_4_frame_size(uint8_t fsi) {
+	return iso14443_4_frame_sizes[fsi > 8 ? 8 : fsi];
+}
+
+/**
+ * Largest FSDI of a frame that fits the FIFO of the reader IC.
+ */
+uint8_t iso14443_4_fsdi(const bs_pdc_t *pdc) {
+	uint8_t fsdi = 0;
+	while (fsdi < 8 && iso14443_4_frame_sizes[fsdi + 1] <= pdc->rx_fifo_size)
+		fsdi++;
+	return fsdi;
+}
+
+/**
+ * Starts the block protocol with a PICC that accepted the FSDI, at 106 kbps.
+ * The FSC and the timing must already be in picc->iso14443_4; RATS takes
+ * them from the ATS, ATTRIB of ISO 14443-B from the ATQB.
+ */
+void iso14443_4_begin(picc_t *picc, uint8_t fsdi) {
+	picc->iso14443_4.fsd = iso14443_4_frame_size(fsdi);
+	picc->iso14443_4.dsi = pdc_bitrate_106;
+	picc->iso14443_4.dri = pdc_bitrate_106;
+	picc->iso14443_4.wtx = 0;
+	picc->iso14443_4.retransmissions = 0;
+	picc->iso14443_4_pcb = iso14443_4_pcb_i;
+}
+
+/**
+ * Decodes the frame sizes and timing of the ATS into picc->iso14443_4.
+ * Absent interface bytes take their default values.
+ */
+int iso14443_4_parse_ats(picc_t *picc, const uint8_t *ats, size_t size) {
+	uint8_t fsci = 2, fwi = ISO14443_4_DEFAULT_FWI, sfgi = 0;
+	size_t offset = 2;
+
+	if (!size || ats[0] > size || !ats[0])
+		return STATUS_ERROR;
+	picc->iso14443_4.ta = 0;
+	picc->iso14443_4.tc = 0x02; // CID supported, NAD not supported
+	if (ats[0] > 1) {
+		uint8_t t0 = ats[1];
+		fsci = t0 & 0x0F;
+		if ((t0 & 0x10) && offset < ats[0])
+			picc->iso14443_4.ta = ats[offset++];
+		if ((t0 & 0x20) && offset < ats[0]) {
+			fwi = ats[offset] >> 4;
+			sfgi = ats[offset++] & 0x0F;
+		}
+		if ((t0 & 0x40) && offset < ats[0])
+			picc->iso14443_4.tc = ats[offset++];
+	}
+	if (fwi == 15)	// RFU
+		fwi = ISO14443_4_DEFAULT_FWI;
+	if (sfgi == 15)	// RFU
+		sfgi = 0;
+
+	picc->iso14443_4.fsc = iso14443_4_frame_size(fsci);
+	picc->iso14443_4.fwt_us = ISO14443_4_FWT_us(fwi);
+	picc->iso14443_4.sfgt_us = sfgi ? ISO14443_4_FWT_us(sfgi) : 0;
+	return STATUS_OK;
+}
+
+/**
+ * Activates the selected PICC for ISO 14443-4. The FSD announced is the
+ * largest frame the reader IC can receive. The ATS is stored in picc->rats
+ * and decoded into picc->iso14443_4.
+ */
+int iso14443_4_rats(bs_pdc_t *pdc, picc_t *picc) {
+	uint8_t fsdi = iso14443_4_fsdi(pdc);
+	uint8_t frame[ISO14443_4_MAX_FRAME];
+	size_t size = iso14443_4_frame_size(fsdi);
+	int result;
+
+	// A PICC is activated at 106 kbps
+	result = iso14443_4_set_bitrate(pdc, pdc_bitrate_106, pdc_bitrate_106);
+	if (result)
+		return result;
+	frame[0] = PICC_CMD_RATS;
+	frame[1] = fsdi << 4; // CID 0
+	pdc_set_timeout(pdc,
+			ISO14443_4_FWT_us(ISO14443_4_DEFAULT_FWI) + ISO14443_4_DELTA_FWT_us);
+	result = pdc->TransceiveData(pdc, frame, 2, frame, &size, NULL, 0, NULL,
+			true, true);
+	if (result)
+		return result;
+	result = iso14443_4_parse_ats(picc, frame, size);
+	if (result)
+		return result;
+
+	memset(picc->rats, 0, sizeof(picc->rats));
+	memcpy(picc->rats, frame, size < sizeof(picc->rats) ? size : sizeof(picc->rats));
+	iso14443_4_begin(picc, fsdi);
+	if (picc->iso14443_4.sfgt_us && pdc->delay_ms)
+		pdc->delay_ms((picc->iso14443_4.sfgt_us + 999) / 1000);
+	return STATUS_OK;
+}
+
+// Highest bit rate of a direction in the TA(1) bits (DS or DR 2, 4, 8) and
+// the bit rates of the PCD, not above max
+static pdc_bitrate_t iso14443_4_highest(uint8_t ta_bits, uint8_t pcd,
+		pdc_bitrate_t max) {
+	for (pdc_bitrate_t rate = max; rate > pdc_bitrate_106; rate--)
+		if ((ta_bits & (1 << (rate - 1))) && (pcd & (1 << rate)))
+			return rate;
+	return pdc_bitrate_106;
+}
+
+/**
+ * Negotiates the bit rates with the PICC right after RATS, the highest the
+ * PICC and the PCD both support, up to max. When the PPS fails, the PICC
+ * and the PCD stay at 106 kbps.
+ *
+ * @return STATUS_OK, also when the bit rate remains 106 kbps
+ */
+int iso14443_4_pps(bs_pdc_t *pdc, picc_t *picc, pdc_bitrate_t max) {
+	uint8_t ta = picc->iso14443_4.ta;
+	uint8_t frame[3];
+	size_t size = sizeof(frame);
+	int result;
+
+	if (!picc->iso14443_4.fsd)
+		return STATUS_INVALID;	// Not activated
+	if (!pdc->SetBitRate || max == pdc_bitrate_106)
+		return STATUS_OK;
+	if (max > pdc_bitrate_848)
+		max = pdc_bitrate_848;
+
+	// TA(1): b7..b5 DS 8, 4, 2 (PICC to PCD), b3..b1 DR 8, 4, 2 (PCD to PICC)
+	pdc_bitrate_t dsi = iso14443_4_highest(ta >> 4, pdc->bitrates, max);
+	pdc_bitrate_t dri = iso14443_4_highest(ta, pdc->bitrates, max);
+	if (ta & 0x80) // b8: the same bit rate in both directions
+		dsi = dri = dsi < dri ? dsi : dri;
+	if (dsi == pdc_bitrate_106 && dri == pdc_bitrate_106)
+		return STATUS_OK;
+
+	frame[0] = ISO14443_4_PPSS; // CID 0
+	frame[1] = ISO14443_4_PPS0;
+	frame[2] = dsi << 2 | dri;
+	pdc_set_timeout(pdc, picc->iso14443_4.fwt_us + ISO14443_4_DELTA_FWT_us);
+	result = pdc->TransceiveData(pdc, frame, 3, frame, &size, NULL, 0, NULL,
+			true, true);
+	if (result || size != 1 || frame[0] != ISO14443_4_PPSS)
+		return STATUS_OK;
+
+	// The PICC switched after the PPS response
+	result = iso14443_4_set_bitrate(pdc, dri, dsi);
+	if (result)
+		return result;
+	picc->iso14443_4.dsi = dsi;
+	picc->iso14443_4.dri = dri;
+	return STATUS_OK;
+}
+
+// Copies size bytes of the command, starting at offset, from the segments
+static void iso14443_4_gather(const iso14443_4_segment_t *segments,
+		size_t segment_count, size_t offset, uint8_t *dest, size_t size) {
+	for (size_t i = 0; i < segment_count && size; i++) {
+		if (offset >= segments[i].size) {
+			offset -= segments[i].size;
+			continue;
+		}
+		size_t part = segments[i].size - offset;
+		if (part > size)
+			part = size;
+		memcpy(dest, (const uint8_t*) segments[i].data + offset, part);
+		dest += part;
+		size -= part;
+		offset = 0;
+	}
+}
+
+/**
+ * Exchanges a command with an activated PICC. The command, given in
+ * segments, is sent in as few I-blocks as the FSC and the FIFO allow. The
+ * INF of every I-block of the answer is passed to recv straight from the
+ * frame, so neither the command nor the answer is ever held as a whole.
+ *
+ * @return The result of recv when it aborted the exchange, the PICC is then
+ * 		   still in the middle of the chain and must be deselected.
+ * 		   After an error at a bit rate above 106 kbps, the PICC has been
+ * 		   deselected and must be activated again.
+ */
+int iso14443_4_exchange(bs_pdc_t *pdc, picc_t *picc,
+		const iso14443_4_segment_t *segments, size_t segment_count,
+		iso14443_4_recv_f recv, void *context) {
+	uint8_t frame[ISO14443_4_MAX_FRAME];
+	size_t max_inf = picc->iso14443_4.fsc;
+	size_t send_size = 0;
+	size_t offset = 0;		// Start of the current I-block in the command
+	size_t chunk;			// INF size of the current I-block
+	bool aborted = false;
+	iso14443_4_send_t next = iso14443_4_send_i;
+	iso14443_4_send_t last = iso14443_4_send_i; // Last block that may be repeated
+	uint8_t wtxm = 0;
+	int retries = 0;
+	int result;
+
+	if (!picc->iso14443_4.fsd || !picc->iso14443_4.fsc)
+		return STATUS_INVALID;	// Not activated
+	if (max_inf > picc->iso14443_4.fsd)
+		max_inf = picc->iso14443_4.fsd;	// The FIFO limits the transmission as well
+	max_inf -= ISO14443_4_OVERHEAD;
+	for (size_t i = 0; i < segment_count; i++)
+		send_size += segments[i].size;
+	chunk = send_size < max_inf ? send_size : max_inf;
+	pdc_set_timeout(pdc, picc->iso14443_4.fwt_us + ISO14443_4_DELTA_FWT_us);
+
+	for (;;) {
+		uint8_t block = picc->iso14443_4_pcb & iso14443_4_pcb_block;
+		size_t size = 1;
+
+		switch (next) {
+		case iso14443_4_send_i:
+			frame[0] = iso14443_4_pcb_i | block;
+			if (offset + chunk < send_size)
+				frame[0] |= iso14443_4_pcb_chaining;
+			iso14443_4_gather(segments, segment_count, offset, frame + 1, chunk);
+			size += chunk;
+			break;
+		case iso14443_4_send_ack:
+			frame[0] = iso14443_4_pcb_r_ack | block;
+			break;
+		case iso14443_4_send_nak:
+			frame[0] = iso14443_4_pcb_r_nak | block;
+			break;
+		case iso14443_4_send_wtx:
+			frame[0] = iso14443_4_pcb_s_wtx;
+			frame[1] = wtxm;
+			size++;
+			break;
+		}
+		if (next != iso14443_4_send_nak && next != iso14443_4_send_wtx)
+			last = next;
+
+		size_t frame_size = picc->iso14443_4.fsd;
+		result = pdc->TransceiveData(pdc, frame, size, frame, &frame_size,
+				NULL, 0, NULL, true, true);
+		if (next == iso14443_4_send_wtx) // The extension lasts for one answer
+			pdc_set_timeout(pdc,
+					picc->iso14443_4.fwt_us + ISO14443_4_DELTA_FWT_us);
+		if (!result && !frame_size)
+			result = STATUS_ERROR;
+		if (result) {
+			// Timeout or transmission error: R(NAK), or R(ACK) to ask
+			// for the next block of a chained answer again
+			if (++retries > ISO14443_4_RETRIES)
+				break;
+			picc->iso14443_4.retransmissions++;
+			next = last == iso14443_4_send_ack ?
+					iso14443_4_send_ack : iso14443_4_send_nak;
+			continue;
+		}
+
+		uint8_t pcb = frame[0];
+		if ((pcb & 0xC0) == 0xC0) { // S-block
+			if ((pcb & 0xF7) != iso14443_4_pcb_s_wtx || frame_size < 2
+					|| !(frame[1] & 0x3F)) {
+				result = STATUS_ERROR;
+				break;
+			}
+			uint64_t timeout = (uint64_t) picc->iso14443_4.fwt_us
+					* (frame[1] & 0x3F);
+			if (timeout > ISO14443_4_MAX_FWT_us)
+				timeout = ISO14443_4_MAX_FWT_us;
+			wtxm = frame[1] & 0x3F;
+			picc->iso14443_4.wtx++;
+			pdc_set_timeout(pdc, timeout + ISO14443_4_DELTA_FWT_us);
+			next = iso14443_4_send_wtx;
+			continue;
+		}
+
+		if ((pcb & 0xC0) == 0x80) { // R-block
+			if (pcb & 0x10) { // The PICC never sends R(NAK)
+				result = STATUS_ERROR;
+				break;
+			}
+			if ((pcb & iso14443_4_pcb_block) != block) {
+				// Our last block did not arrive, send it again
+				if (++retries > ISO14443_4_RETRIES) {
+					result = STATUS_ERROR;
+					break;
+				}
+				picc->iso14443_4.retransmissions++;
+				next = last;
+				continue;
+			}
+			if (last != iso14443_4_send_i || offset + chunk >= send_size) {
+				result = STATUS_ERROR;
+				break;
+			}
+			// The chained I-block is acknowledged, send the next one
+			picc->iso14443_4_pcb ^= iso14443_4_pcb_block;
+			offset += chunk;
+			chunk = send_size - offset < max_inf ? send_size - offset : max_inf;
+			retries = 0;
+			next = iso14443_4_send_i;
+			continue;
+		}
+
+		// I-block
+		if ((pcb & 0xE2) != 0x02 || offset + chunk < send_size
+				|| (pcb & iso14443_4_pcb_block) != block) {
+			result = STATUS_ERROR;
+			break;
+		}
+		size_t header = 1 + ((pcb & iso14443_4_pcb_cid) ? 1 : 0)
+				+ ((pcb & iso14443_4_pcb_nad) ? 1 : 0);
+		if (frame_size < header) {
+			result = STATUS_ERROR;
+			break;
+		}
+		picc->iso14443_4_pcb ^= iso14443_4_pcb_block;
+		if (recv && frame_size > header) {
+			result = recv(context, frame + header, frame_size - header);
+			if (result) {
+				aborted = true;
+				break;
+			}
+		}
+		retries = 0;
+		if (!(pcb & iso14443_4_pcb_chaining))
+			break;
+		next = iso14443_4_send_ack;
+	}
+
+	if (result && !aborted
+			&& (picc->iso14443_4.dsi || picc->iso14443_4.dri)) {
+		// Fall back to 106 kbps, the PICC returns to it when deselected
+		picc->iso14443_4.fallbacks++;
+		iso14443_4_deselect(pdc, picc);
+	}
+	return result;
+}
+
+/**
+ * Receive callback that collects the answer in an iso14443_4_buffer_t.
+ *
+ * @return STATUS_NO_ROOM when the answer does not fit
+ */
+int iso14443_4_collect(void *context, const uint8_t *data, size_t size) {
+	iso14443_4_buffer_t *buffer = context;
+	if (buffer->received + size > buffer->size)
+		return STATUS_NO_ROOM;
+	memcpy(buffer->buffer + buffer->received, data, size);
+	buffer->received += size;
+	return STATUS_OK;
+}
+
+/**
+ * Exchanges a command with an activated PICC, the answer is collected in
+ * recv.
+ *
+ * @param recv_size	In: size of recv, Out: size of the answer (INF only)
+ * @return STATUS_NO_ROOM when the answer does not fit recv, the PICC is
+ * 		   then still in the middle of the chain and must be deselected.
+ */
+int iso14443_4_transceive(bs_pdc_t *pdc, picc_t *picc, const void *send,
+		size_t send_size, void *recv, size_t *recv_size) {
+	iso14443_4_segment_t segment = { send, send_size };
+	iso14443_4_buffer_t buffer = { recv, *recv_size, 0 };
+	int result = iso14443_4_exchange(pdc, picc, &segment, 1,
+			iso14443_4_collect, &buffer);
+	*recv_size = buffer.received;
+	return result;
+}
+
+/**
+ * Sends S(DESELECT), the PICC goes to HALT.
+ */
+int iso14443_4_deselect(bs_pdc_t *pdc, picc_t *picc) {
+	uint8_t frame[2] = { iso14443_4_pcb_s_deselect };
+	size_t size = sizeof(frame);
+	int result;
+
+	pdc->picc_epoch++; // Card layers drop their session state
+	pdc_set_timeout(pdc, picc->iso14443_4.fwt_us + ISO14443_4_DELTA_FWT_us);
+	result = pdc->TransceiveData(pdc, frame, 1, frame, &size, NULL, 0, NULL,
+			true, true);
+	iso14443_4_set_bitrate(pdc, pdc_bitrate_106, pdc_bitrate_106);
+	picc->iso14443_4.fsd = 0;
+	picc->iso14443_4.fsc = 0;
+	picc->iso14443_4.dsi = pdc_bitrate_106;
+	picc->iso14443_4.dri = pdc_bitrate_106;
+	if (result)
+		return result;
+	if (size != 1 || frame[0] != iso14443_4_pcb_s_deselect)
+		return STATUS_ERROR;
+	return STATUS_OK;
+}
@@ -0,0 +1,98 @@
+/*
+ * iso14443_4.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_ISO14443_4_H_
+#define BSRFID_CARDS_ISO14443_4_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+
+// ISO 14443-4 (T=CL) half-duplex block transmission protocol.
+//
+// The frame sizes are negotiated in RATS: the FSD announced to the PICC is
+// the largest that fits the reader FIFO, the FSC is taken from the ATS.
+// Commands longer than a frame are sent in chained I-blocks, chained
+// answers are acknowledged and collected. The PCD waits the FWT of the ATS
+// for every answer, extended when the PICC requests a waiting time
+// extension (S(WTX)). Lost or corrupted frames are recovered with R-blocks.
+// CID and NAD are not used.
+//
+// ISO 14443-B PICCs are activated by ATTRIB instead of RATS (iso14443b.h)
+// and use the same block protocol, with CRC_B.
+//
+// After RATS, iso14443_4_pps() raises the bit rate to the highest one that
+// the PICC (TA(1)) and the PCD (SetBitRate) both support. When a block can
+// not be recovered at a raised bit rate, the PICC is deselected and the PCD
+// returns to 106 kbps; the PICC has to be activated again.
+
+// Largest frame, FSDI 8. FSCI values above are treated as 8.
+#define ISO14443_4_MAX_FRAME		(256)
+// Frame overhead: PCB and CRC_A or CRC_B
+#define ISO14443_4_OVERHEAD			(3)
+// Attempts to recover a block before giving up
+#define ISO14443_4_RETRIES			(2)
+// FWT = 256 * 16 / fc * 2^FWI, in µs
+#define ISO14443_4_FWT_us(fwi)		((uint32_t) ((4096ull << (fwi)) * 100 / 1356))
+// Additional time the PCD waits, ΔFWT = 49152 / fc
+#define ISO14443_4_DELTA_FWT_us		(3625)
+// FWI of a PICC that does not specify one
+#define ISO14443_4_DEFAULT_FWI		(4)
+// Largest FWT, FWI 14, also the limit of a waiting time extension
+#define ISO14443_4_MAX_FWT_us		ISO14443_4_FWT_us(14)
+// Start byte of PPS, OR CID, and PPS0 with PPS1 present
+#define ISO14443_4_PPSS				(0xD0)
+#define ISO14443_4_PPS0				(0x11)
+
+typedef enum {
+	iso14443_4_pcb_i = 0x02,			// I-block, OR block number
+	iso14443_4_pcb_r_ack = 0xA2,		// R(ACK), OR block number
+	iso14443_4_pcb_r_nak = 0xB2,		// R(NAK), OR block number
+	iso14443_4_pcb_s_deselect = 0xC2,
+	iso14443_4_pcb_s_wtx = 0xF2,
+	iso14443_4_pcb_chaining = 0x10,
+	iso14443_4_pcb_cid = 0x08,
+	iso14443_4_pcb_nad = 0x04,
+	iso14443_4_pcb_block = 0x01,
+} iso14443_4_pcb_t;
+
+// Part of a command, iso14443_4_exchange() sends the parts back to back
+typedef struct {
+	const void *data;
+	size_t size;
+} iso14443_4_segment_t;
+
+// Receives the INF of every I-block of the answer, in order. A non-zero
+// return aborts the exchange with this result.
+typedef int (*iso14443_4_recv_f)(void *context, const uint8_t *data,
+		size_t size);
+
+// Flat buffer for iso14443_4_collect()
+typedef struct {
+	uint8_t *buffer;
+	size_t size;
+	size_t received;
+} iso14443_4_buffer_t;
+
+uint16_t iso14443_4_frame_size(uint8_t fsi);
+uint8_t iso14443_4_fsdi(const bs_pdc_t *pdc);
+void iso14443_4_begin(picc_t *picc, uint8_t fsdi);
+int iso14443_4_rats(bs_pdc_t *pdc, picc_t *picc);
+int iso14443_4_parse_ats(picc_t *picc, const uint8_t *ats, size_t size);
+int iso14443_4_pps(bs_pdc_t *pdc, picc_t *picc, pdc_bitrate_t max);
+int iso14443_4_exchange(bs_pdc_t *pdc, picc_t *picc,
+		const iso14443_4_segment_t *segments, size_t segment_count,
+		iso14443_4_recv_f recv, void *context);
+int iso14443_4_collect(void *context, const uint8_t *data, size_t size);
+int iso14443_4_transceive(bs_pdc_t *pdc, picc_t *picc, const void *send,
+		size_t send_size, void *recv, size_t *recv_size);
+int iso14443_4_deselect(bs_pdc_t *pdc, picc_t *picc);
+
+#endif /* BSRFID_CARDS_ISO14443_4_H_ */
@@ -0,0 +1,41 @@
+/*
+ * iso14443_crc.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_ISO14443_CRC_H_
+#define BSRFID_CARDS_ISO14443_CRC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// CRC_A and CRC_B of ISO/IEC 14443-3, calculated on the host. Both use the
+// polynomial x^16 + x^12 + x^5 + 1, LSB first. CRC_A starts at 0x6363,
+// CRC_B starts at 0xFFFF and is inverted. The CRC is transmitted LSB first.
+
+// Lookup tables used:
+// 8	Slice-by-8, 8 tables, 4 KiB of const data
+// 1	One table, 512 bytes
+// 0	No tables, bitwise
+#ifndef ISO14443_CRC_SLICES
+#define ISO14443_CRC_SLICES			(8)
+#endif
+
+#define ISO14443_CRC_A_PRESET		(0x6363)
+#define ISO14443_CRC_B_PRESET		(0xFFFF)
+
+uint16_t iso14443_crc_update(uint16_t crc, const void *data, size_t size);
+uint16_t iso14443_crc_bitwise(uint16_t crc, const void *data, size_t size);
+
+uint16_t iso14443_crc_a(const void *data, size_t size);
+uint16_t iso14443_crc_b(const void *data, size_t size);
+
+void iso14443_crc_a_append(void *frame, size_t size);
+void iso14443_crc_b_append(void *frame, size_t size);
+bool iso14443_crc_a_check(const void *frame, size_t size);
+bool iso14443_crc_b_check(const void *frame, size_t size);
+
+#endif /* BSRFID_CARDS_ISO14443_CRC_H_ */
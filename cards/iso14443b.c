@@ -0,0 +1,303 @@
+/*
+ * iso14443b.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include "iso14443b.h"
+#include "iso14443_4.h"
+
+#include <string.h>
+
+// Largest number of slots, n = 4
+#define ISO14443B_MAX_SLOTS		(16)
+
+// n of a number of slots N = 2^n, -1 when N is not 1 to 16
+static int iso14443b_slots_n(uint8_t slots) {
+	for (int n = 0; (1 << n) <= ISO14443B_MAX_SLOTS; n++)
+		if ((1 << n) == slots)
+			return n;
+	return -1;
+}
+
+// Opens a slot: REQB/WUPB for the first one, a slot marker for the others.
+// The ATQB is returned without CRC.
+static int iso14443b_slot(bs_pdc_t *pdc, uint8_t slot, bool wakeup,
+		uint8_t afi, uint8_t n, uint8_t *atqb, size_t *atqb_size) {
+	uint8_t frame[3];
+	size_t size = 0;
+
+	if (slot == 1) {
+		frame[size++] = ISO14443B_CMD_REQB;
+		frame[size++] = afi;
+		frame[size++] = (wakeup ? ISO14443B_PARAM_WUPB : 0) | n;
+	} else {
+		frame[size++] = ISO14443B_SLOT_MARKER(slot);
+	}
+	return pdc->TransceiveData(pdc, frame, size, atqb, atqb_size, NULL, 0,
+			NULL, true, true);
+}
+
+static void iso14443b_parse_atqb(picc_t *picc, const uint8_t *atqb) {
+	memset(picc, 0, sizeof(picc_t));
+	picc->protocol = picc_protocol_iso14443b;
+	picc->uid_size = ISO14443B_PUPI_SIZE;
+	memcpy(picc->uid, atqb + 1, ISO14443B_PUPI_SIZE);
+	memcpy(picc->atqb.app_data, atqb + 5, sizeof(picc->atqb.app_data));
+	memcpy(picc->atqb.prot_info, atqb + 9, sizeof(picc->atqb.prot_info));
+	if (picc->atqb.prot_info[1] & ISO14443B_PROTOCOL_TYPE_ISO14443_4)
+		picc->nfc_type = nfc_type_4;
+}
+
+// FWI of the protocol info, also the waiting time for ATTRIB and HLTB
+static uint32_t iso14443b_fwt_us(const picc_t *picc) {
+	uint8_t fwi = picc->atqb.prot_info[2] >> 4;
+	if (fwi == 15)	// RFU
+		fwi = ISO14443_4_DEFAULT_FWI;
+	return ISO14443_4_FWT_us(fwi);
+}
+
+/**
+ * Sends REQB, or WUPB, with the slots given and opens the slots in turn
+ * until a PICC answers with a valid ATQB. PICCs that chose a later slot
+ * stay ready and answer the next request.
+ *
+ * @param afi		Application family, ISO14443B_AFI_ALL for all PICCs
+ * @param slots		1, 2, 4, 8 or 16
+ * @param stats		Optional, the counters are incremented
+ * @return STATUS_OK with the ATQB in picc, STATUS_COLLISION when slots
+ * 		were answered by several PICCs only, STATUS_TIMEOUT when no PICC
+ * 		answered
+ */
+int iso14443b_request(bs_pdc_t *pdc, picc_t *picc, bool wakeup, uint8_t afi,
+		uint8_t slots, iso14443b_stats_t *stats) {
+	int n = iso14443b_slots_n(slots);
+	bool collision = false;
+	int result;
+
+	if (n < 0)
+		return STATUS_INVALID;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso14443b);
+	if (result)
+		return result;
+	pdc->picc_epoch++; // Card layers drop their session state
+	pdc_set_timeout(pdc, ISO14443B_TIMEOUT_us);
+	if (stats)
+		stats->requests++;
+
+	for (uint8_t slot = 1; slot <= slots; slot++) {
+		uint8_t atqb[ISO14443B_ATQB_SIZE];
+		size_t size = sizeof(atqb);
+
+		if (stats)
+			stats->slots++;
+		result = iso14443b_slot(pdc, slot, wakeup, afi, n, atqb, &size);
+		if (result == STATUS_TIMEOUT)
+			continue;	// Empty slot
+		if (result == STATUS_OK && size == sizeof(atqb)
+				&& atqb[0] == ISO14443B_ATQB) {
+			iso14443b_parse_atqb(picc, atqb);
+			return STATUS_OK;
+		}
+		// Answers that overlap fail the CRC
+		collision = true;
+		if (stats)
+			stats->collisions++;
+	}
+	return collision ? STATUS_COLLISION : STATUS_TIMEOUT;
+}
+
+/**
+ * Selects the PICC of a valid ATQB by its PUPI and activates ISO 14443-4,
+ * at 106 kbps. The FSD announced is the largest frame the reader IC can
+ * receive, the FSC and the FWT are taken from the ATQB. The PICC is then
+ * used with iso14443_4_exchange() and deselected with
+ * iso14443_4_deselect().
+ */
+int iso14443b_attrib(bs_pdc_t *pdc, picc_t *picc) {
+	uint8_t fsdi = iso14443_4_fsdi(pdc);
+	uint8_t frame[1 + ISO14443B_PUPI_SIZE + 4];
+	uint8_t resp[1];
+	size_t size = sizeof(resp);
+	int result;
+
+	if (picc->protocol != picc_protocol_iso14443b)
+		return STATUS_INVALID;
+	if (!(picc->atqb.prot_info[1] & ISO14443B_PROTOCOL_TYPE_ISO14443_4))
+		return STATUS_INVALID;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso14443b);
+	if (result)
+		return result;
+
+	frame[0] = ISO14443B_CMD_ATTRIB;
+	memcpy(frame + 1, picc->uid, ISO14443B_PUPI_SIZE);
+	frame[5] = 0x00;	// Param 1: default TR0, TR1, SOF and EOF
+	frame[6] = fsdi;	// Param 2: 106 kbps both ways
+	frame[7] = ISO14443B_ATTRIB_PARAM3_ISO14443_4;
+	frame[8] = 0x00;	// Param 4: CID 0
+	pdc_set_timeout(pdc, iso14443b_fwt_us(picc) + ISO14443_4_DELTA_FWT_us);
+	result = pdc->TransceiveData(pdc, frame, sizeof(frame), resp, &size,
+			NULL, 0, NULL, true, true);
+	if (result)
+		return result;
+	if (size != 1 || (resp[0] & 0x0F))	// MBLI, CID 0
+		return STATUS_ERROR;
+
+	picc->iso14443_4.fsc = iso14443_4_frame_size(picc->atqb.prot_info[1] >> 4);
+	picc->iso14443_4.fwt_us = iso14443b_fwt_us(picc);
+	picc->iso14443_4.sfgt_us = 0;
+	// The bit rate is selected in ATTRIB, PPS does not apply to type B
+	picc->iso14443_4.ta = 0;
+	// FO: b2 NAD, b1 CID supported, as in TC(1)
+	picc->iso14443_4.tc = (picc->atqb.prot_info[2] & 0x01) << 1
+			| (picc->atqb.prot_info[2] & 0x02) >> 1;
+	iso14443_4_begin(picc, fsdi);
+	return STATUS_OK;
+}
+
+/**
+ * Wakes the PICC of an earlier ATQB with WUPB and activates it with
+ * ATTRIB. Other PICCs woken up stay ready.
+ */
+int iso14443b_activate(bs_pdc_t *pdc, picc_t *picc) {
+	uint8_t atqb[ISO14443B_ATQB_SIZE];
+	size_t size = sizeof(atqb);
+	int result;
+
+	if (picc->protocol != picc_protocol_iso14443b)
+		return STATUS_INVALID;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso14443b);
+	if (result)
+		return result;
+	pdc->picc_epoch++;
+	pdc_set_timeout(pdc, ISO14443B_TIMEOUT_us);
+	result = iso14443b_slot(pdc, 1, true, ISO14443B_AFI_ALL, 0, atqb, &size);
+	if (result == STATUS_TIMEOUT)
+		return result;
+	// Several PICCs answered, ATTRIB selects the one with the PUPI
+	return iso14443b_attrib(pdc, picc);
+}
+
+/**
+ * Sends HLTB, the PICC with the PUPI goes to HALT until WUPB.
+ */
+int iso14443b_halt(bs_pdc_t *pdc, picc_t *picc) {
+	uint8_t frame[1 + ISO14443B_PUPI_SIZE];
+	uint8_t resp[1];
+	size_t size = sizeof(resp);
+	int result;
+
+	if (picc->protocol != picc_protocol_iso14443b)
+		return STATUS_INVALID;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso14443b);
+	if (result)
+		return result;
+	frame[0] = ISO14443B_CMD_HLTB;
+	memcpy(frame + 1, picc->uid, ISO14443B_PUPI_SIZE);
+	pdc_set_timeout(pdc, iso14443b_fwt_us(picc) + ISO14443_4_DELTA_FWT_us);
+	result = pdc->TransceiveData(pdc, frame, sizeof(frame), resp, &size,
+			NULL, 0, NULL, true, true);
+	if (result)
+		return result;
+	return size == 1 && resp[0] == 0x00 ? STATUS_OK : STATUS_ERROR;
+}
+
+static bool iso14443b_known(const picc_t *piccs, size_t count,
+		const uint8_t *pupi) {
+	for (size_t i = 0; i < count; i++)
+		if (!memcmp(piccs[i].uid, pupi, ISO14443B_PUPI_SIZE))
+			return true;
+	return false;
+}
+
+/**
+ * Finds the PICCs in the field. Every round sends REQB and opens all slots,
+ * the PICCs found are halted after the round so that the next round is
+ * left to the PICCs that collided. The slots are doubled, up to 16, after
+ * a round with collisions. PICCs halted before are not found; the field
+ * has to be reset, or the PICCs woken up, for them. The PICCs found in
+ * the last round stay ready for iso14443b_attrib(), the others are
+ * activated with iso14443b_activate().
+ *
+ * @param afi		Application family, ISO14443B_AFI_ALL for all PICCs
+ * @param slots		Slots of the first round, 1, 2, 4, 8 or 16
+ * @param piccs		Receives the ATQB of the PICCs found
+ * @param count		In: size of piccs, Out: number of PICCs found
+ * @param stats		Optional
+ * @return STATUS_OK when a PICC was found, STATUS_COLLISION when PICCs
+ * 		answered but none could be told apart, STATUS_TIMEOUT for an empty
+ * 		field, STATUS_NO_ROOM when there are more PICCs than fit in piccs
+ */
+int iso14443b_inventory(bs_pdc_t *pdc, uint8_t afi, uint8_t slots,
+		picc_t *piccs, size_t *count, iso14443b_stats_t *stats) {
+	size_t max_count = *count;
+	size_t found = 0;
+	bool full = false;
+	bool collision = false;
+	uint32_t begin = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	iso14443b_stats_t scratch;
+	int n = iso14443b_slots_n(slots);
+	int result;
+
+	if (n < 0)
+		return STATUS_INVALID;
+	if (!stats)
+		stats = &scratch;
+	memset(stats, 0, sizeof(iso14443b_stats_t));
+	*count = 0;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso14443b);
+	if (result)
+		return result;
+	pdc->picc_epoch++;
+
+	for (int round = 0; round < ISO14443B_INVENTORY_ROUNDS && !full; round++) {
+		size_t round_begin = found;
+
+		collision = false;
+		pdc_set_timeout(pdc, ISO14443B_TIMEOUT_us);
+		stats->requests++;
+		for (uint8_t slot = 1; slot <= (1 << n); slot++) {
+			uint8_t atqb[ISO14443B_ATQB_SIZE];
+			size_t size = sizeof(atqb);
+
+			stats->slots++;
+			result = iso14443b_slot(pdc, slot, false, afi, n, atqb, &size);
+			if (result == STATUS_TIMEOUT)
+				continue;	// Empty slot
+			if (result == STATUS_OK && size == sizeof(atqb)
+					&& atqb[0] == ISO14443B_ATQB) {
+				if (iso14443b_known(piccs, found, atqb + 1))
+					continue;
+				if (found == max_count) {
+					full = true;
+					continue;	// Complete the slots of the request
+				}
+				iso14443b_parse_atqb(piccs + found, atqb);
+				found++;
+				continue;
+			}
+			collision = true;
+			stats->collisions++;
+		}
+
+		if (!collision)
+			break;
+		// Only the PICCs that collided may answer the next round
+		for (size_t i = round_begin; i < found; i++) {
+			stats->halts++;
+			iso14443b_halt(pdc, piccs + i);
+		}
+		if (n < 4)
+			n++;
+	}
+
+	*count = found;
+	if (pdc->get_time_ms)
+		stats->time_ms = pdc->get_time_ms() - begin;
+	if (full)
+		return STATUS_NO_ROOM;
+	if (found)
+		return STATUS_OK;
+	return collision ? STATUS_COLLISION : STATUS_TIMEOUT;
+}
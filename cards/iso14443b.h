@@ -8,8 +8,78 @@
 #ifndef BSRFID_CARDS_ISO14443B_H_
 #define BSRFID_CARDS_ISO14443B_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
+#include "pdc.h"
+#include "picc.h"
 
+// ISO 14443-3 type B activation.
+//
+// REQB (or WUPB, which also wakes halted PICCs) announces N slots, every
+// PICC picks one of them at random. The first slot follows the REQB, every
+// further slot is opened by a slot marker. A slot answered by a single PICC
+// gives its ATQB: the PUPI, the application data and the protocol info. A
+// slot answered by several PICCs fails its CRC, those PICCs take part in
+// the next REQB again.
+//
+// ATTRIB selects a PICC by its PUPI and activates ISO 14443-4, after which
+// the T=CL layer of iso14443_4.h is used as for type A. HLTB halts a PICC
+// by its PUPI.
+//
+// The frames use CRC_B, the protocol is loaded by pdc_set_protocol(). The
+// field stays on when switching between the protocols, PICCs of type A keep
+// their state while type B is polled and the other way around.
 
+#define ISO14443B_CMD_REQB				(0x05)	// APf, also WUPB and slot marker
+#define ISO14443B_CMD_ATTRIB			(0x1D)
+#define ISO14443B_CMD_HLTB				(0x50)
+#define ISO14443B_ATQB					(0x50)	// First byte of the ATQB
+
+// PARAM of REQB/WUPB: the WUPB bit and the number of slots, N = 2^n
+#define ISO14443B_PARAM_WUPB			(0x08)
+#define ISO14443B_PARAM_SLOTS_MASK		(0x07)
+// Slot marker of slot 2 to 16: APn, the slot number minus 1 in the upper
+// nibble
+#define ISO14443B_SLOT_MARKER(slot)		((((slot) - 1) << 4) | ISO14443B_CMD_REQB)
+
+// AFI 0x00 is answered by the PICCs of all application families
+#define ISO14443B_AFI_ALL				(0x00)
+
+#define ISO14443B_PUPI_SIZE				(4)
+// 0x50, PUPI, application data, protocol info
+#define ISO14443B_ATQB_SIZE				(12)
+
+// Protocol info, second byte: maximum frame size in the upper nibble, the
+// PICC supports ISO 14443-4 when bit 0 of the lower nibble is set
+#define ISO14443B_PROTOCOL_TYPE_ISO14443_4	(0x01)
+// ATTRIB param 3: the PCD is compliant with ISO 14443-4
+#define ISO14443B_ATTRIB_PARAM3_ISO14443_4	(0x01)
+
+// The ATQB starts within FWT_ATQB, 7680/fc, after REQB, WUPB or a slot
+// marker. An empty slot costs this timeout.
+#define ISO14443B_TIMEOUT_us			(600)
+
+// REQB rounds of the inventory, every round runs all slots
+#ifndef ISO14443B_INVENTORY_ROUNDS
+#define ISO14443B_INVENTORY_ROUNDS		(8)
+#endif
+
+typedef struct {
+	unsigned int requests;		// REQB and WUPB sent
+	unsigned int slots;			// Slots, the first slot of a request included
+	unsigned int collisions;	// Slots with an answer that is not valid
+	unsigned int halts;			// HLTB sent
+	uint32_t time_ms;
+} iso14443b_stats_t;
+
+int iso14443b_request(bs_pdc_t *pdc, picc_t *picc, bool wakeup, uint8_t afi,
+		uint8_t slots, iso14443b_stats_t *stats);
+int iso14443b_attrib(bs_pdc_t *pdc, picc_t *picc);
+int iso14443b_activate(bs_pdc_t *pdc, picc_t *picc);
+int iso14443b_halt(bs_pdc_t *pdc, picc_t *picc);
+int iso14443b_inventory(bs_pdc_t *pdc, uint8_t afi, uint8_t slots,
+		picc_t *piccs, size_t *count, iso14443b_stats_t *stats);
 
 #endif /* BSRFID_CARDS_ISO14443B_H_ */
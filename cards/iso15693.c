@@ -0,0 +1,339 @@
+/*
+ * iso15693.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include "iso15693.h"
+
+#include <string.h>
+
+// Largest response handled, flags and data, the CRC is removed by the PCD
+#define ISO15693_FRAME_SIZE		(1 + 256)
+// Block size assumed before GET SYSTEM INFORMATION, as on ICode SLIX
+#define ISO15693_BLOCK_SIZE		(4)
+#define ISO15693_UID_BITS		(8 * ISO15693_UID_SIZE)
+
+// A pending branch of the inventory: the mask, least significant bit first
+typedef struct {
+	uint8_t mask[ISO15693_UID_SIZE];
+	uint8_t length;			// Bits in the mask
+} iso15693_branch_t;
+
+static void iso15693_mask_set(iso15693_branch_t *branch, uint8_t bits,
+		uint8_t value) {
+	for (int i = 0; i < bits; i++, branch->length++) {
+		uint8_t bit = 1 << (branch->length % 8);
+		if (value & (1 << i))
+			branch->mask[branch->length / 8] |= bit;
+		else
+			branch->mask[branch->length / 8] &= ~bit;
+	}
+}
+
+// Sends an inventory request for a branch. The answer of the first slot is
+// returned.
+static int iso15693_inventory_request(bs_pdc_t *pdc, uint8_t slots,
+		const iso15693_branch_t *branch, uint8_t *resp, size_t *resp_size) {
+	uint8_t frame[3 + ISO15693_UID_SIZE];
+	size_t size = 0;
+
+	frame[size++] = ISO15693_FLAG_DATA_RATE | ISO15693_FLAG_INVENTORY
+			| (slots == 1 ? ISO15693_FLAG_NB_SLOTS_1 : 0);
+	frame[size++] = ISO15693_CMD_INVENTORY;
+	frame[size++] = branch->length;
+	memcpy(frame + size, branch->mask, (branch->length + 7) / 8);
+	size += (branch->length + 7) / 8;
+	return pdc->TransceiveData(pdc, frame, size, resp, resp_size, NULL, 0,
+			NULL, true, true);
+}
+
+// Next slot of a 16 slot inventory: an EOF only
+static int iso15693_slot_marker(bs_pdc_t *pdc, uint8_t *resp,
+		size_t *resp_size) {
+	return pdc->TransceiveData(pdc, NULL, 0, resp, resp_size, NULL, 0, NULL,
+			false, true);
+}
+
+static bool iso15693_known(const iso15693_vicc_t *viccs, size_t count,
+		const uint8_t *uid) {
+	for (size_t i = 0; i < count; i++)
+		if (!memcmp(viccs[i].uid, uid, ISO15693_UID_SIZE))
+			return true;
+	return false;
+}
+
+/**
+ * Finds the VICCs in the field.
+ *
+ * @param slots		1 or 16
+ * @param viccs		Receives the UID and DSFID of the VICCs found
+ * @param count		In: size of viccs, Out: number of VICCs found
+ * @param stats		Optional
+ * @return STATUS_OK when a VICC was found, STATUS_TIMEOUT for an empty field,
+ * 		STATUS_NO_ROOM when there are more VICCs than fit in viccs
+ */
+int iso15693_inventory(bs_pdc_t *pdc, uint8_t slots, iso15693_vicc_t *viccs,
+		size_t *count, iso15693_inventory_stats_t *stats) {
+	iso15693_branch_t stack[ISO15693_INVENTORY_STACK_SIZE];
+	int stack_used = 1;
+	size_t max_count = *count;
+	size_t found = 0;
+	bool full = false;
+	uint32_t begin = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	iso15693_inventory_stats_t scratch;
+	int result;
+
+	if (slots != 1 && slots != 16)
+		return STATUS_INVALID;
+	if (!stats)
+		stats = &scratch;
+	memset(stats, 0, sizeof(iso15693_inventory_stats_t));
+	*count = 0;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso15693);
+	if (result)
+		return result;
+	pdc_set_timeout(pdc, ISO15693_TIMEOUT_us);
+
+	memset(stack, 0, sizeof(iso15693_branch_t));
+	while (stack_used && !full) {
+		iso15693_branch_t branch = stack[--stack_used];
+		uint8_t colliding = 0;	// Slots in which VICCs collided, or the bit
+
+		stats->requests++;
+		for (int slot = 0; slot < slots; slot++) {
+			uint8_t resp[2 + ISO15693_UID_SIZE];
+			size_t resp_size = sizeof(resp);
+
+			stats->slots++;
+			if (!slot)
+				result = iso15693_inventory_request(pdc, slots, &branch, resp,
+						&resp_size);
+			else
+				result = iso15693_slot_marker(pdc, resp, &resp_size);
+
+			if (result == STATUS_TIMEOUT)
+				continue;	// Empty slot
+			if (result == STATUS_OK && resp_size == sizeof(resp)
+					&& !(resp[0] & ISO15693_RESPONSE_ERROR)) {
+				if (iso15693_known(viccs, found, resp + 2))
+					continue;
+				if (found == max_count) {
+					full = true;
+					continue;	// Complete the slots of the request
+				}
+				memset(viccs + found, 0, sizeof(iso15693_vicc_t));
+				viccs[found].dsfid = resp[1];
+				memcpy(viccs[found].uid, resp + 2, ISO15693_UID_SIZE);
+				found++;
+				continue;
+			}
+			// Answers that overlap show up as a collision or as a CRC error
+			if (result == STATUS_COLLISION || result == STATUS_CRC_WRONG
+					|| result == STATUS_OK) {
+				stats->collisions++;
+				colliding |= 1 << (slot % 8);
+				if (slots == 16 && stack_used < ISO15693_INVENTORY_STACK_SIZE
+						&& branch.length + 4 <= ISO15693_UID_BITS) {
+					stack[stack_used] = branch;
+					iso15693_mask_set(stack + stack_used, 4, slot);
+					stack_used++;
+				} else if (slots == 16) {
+					stats->overflows++;
+				}
+			} else {
+				stats->errors++;
+			}
+		}
+
+		if (slots == 1 && colliding) {
+			// Both values of the next bit, 0 is inventoried first
+			for (int bit = 1; bit >= 0; bit--) {
+				if (stack_used < ISO15693_INVENTORY_STACK_SIZE
+						&& branch.length < ISO15693_UID_BITS) {
+					stack[stack_used] = branch;
+					iso15693_mask_set(stack + stack_used, 1, bit);
+					stack_used++;
+				} else {
+					stats->overflows++;
+				}
+			}
+		}
+	}
+
+	*count = found;
+	if (pdc->get_time_ms)
+		stats->time_ms = pdc->get_time_ms() - begin;
+	if (full)
+		return STATUS_NO_ROOM;
+	return found ? STATUS_OK : STATUS_TIMEOUT;
+}
+
+// Sends an addressed request, and checks the flags of the response. The
+// flags are not returned.
+static int iso15693_request(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t command, const uint8_t *param, size_t param_size,
+		uint8_t *resp, size_t *resp_size, uint32_t timeout_us) {
+	uint8_t frame[2 + ISO15693_UID_SIZE + 2 + 32];
+	uint8_t answer[ISO15693_FRAME_SIZE];
+	size_t answer_size = resp_size ? *resp_size + 1 : 1;
+	int result;
+
+	if (param_size > 2 + 32 || answer_size > sizeof(answer))
+		return STATUS_NO_ROOM;
+	result = pdc_set_protocol(pdc, pdc_protocol_iso15693);
+	if (result)
+		return result;
+
+	frame[0] = ISO15693_FLAG_DATA_RATE | ISO15693_FLAG_ADDRESS;
+	frame[1] = command;
+	memcpy(frame + 2, vicc->uid, ISO15693_UID_SIZE);
+	memcpy(frame + 2 + ISO15693_UID_SIZE, param, param_size);
+	pdc_set_timeout(pdc, timeout_us);
+	result = pdc->TransceiveData(pdc, frame,
+			2 + ISO15693_UID_SIZE + param_size, answer, &answer_size, NULL, 0,
+			NULL, true, true);
+	if (result)
+		return result;
+	if (!answer_size || (answer[0] & ISO15693_RESPONSE_ERROR))
+		return STATUS_ERROR;
+	if (resp_size) {
+		*resp_size = answer_size - 1;
+		memcpy(resp, answer + 1, *resp_size);
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Sends a VICC to the quiet state, it no longer answers inventory requests
+ * until the field is reset. The VICC does not answer this command.
+ */
+int iso15693_stay_quiet(bs_pdc_t *pdc, const iso15693_vicc_t *vicc) {
+	int result = iso15693_request(pdc, vicc, ISO15693_CMD_STAY_QUIET, NULL, 0,
+			NULL, NULL, ISO15693_TIMEOUT_us);
+	return result == STATUS_TIMEOUT ? STATUS_OK : result;
+}
+
+/**
+ * Reads the memory size, AFI and IC reference into vicc.
+ */
+int iso15693_get_system_info(bs_pdc_t *pdc, iso15693_vicc_t *vicc) {
+	uint8_t resp[1 + ISO15693_UID_SIZE + 5];
+	size_t size = sizeof(resp);
+	int result = iso15693_request(pdc, vicc, ISO15693_CMD_GET_SYSTEM_INFO,
+			NULL, 0, resp, &size, ISO15693_TIMEOUT_us);
+	if (result)
+		return result;
+	if (size < 1 + ISO15693_UID_SIZE)
+		return STATUS_ERROR;
+
+	// Information flags, UID, then only the fields that are flagged
+	uint8_t info = resp[0];
+	size_t offset = 1 + ISO15693_UID_SIZE;
+	if (info & ISO15693_INFO_DSFID && offset < size)
+		vicc->dsfid = resp[offset++];
+	if (info & ISO15693_INFO_AFI && offset < size)
+		vicc->afi = resp[offset++];
+	if (info & ISO15693_INFO_MEMORY_SIZE && offset + 2 <= size) {
+		vicc->block_count = resp[offset] + 1;
+		vicc->block_size = (resp[offset + 1] & 0x1F) + 1;
+		offset += 2;
+	}
+	if (info & ISO15693_INFO_IC_REFERENCE && offset < size)
+		vicc->ic_reference = resp[offset++];
+	return STATUS_OK;
+}
+
+static uint8_t iso15693_block_size(const iso15693_vicc_t *vicc) {
+	return vicc->block_size ? vicc->block_size : ISO15693_BLOCK_SIZE;
+}
+
+int iso15693_read_single_block(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t block, uint8_t *data) {
+	size_t size = iso15693_block_size(vicc);
+	int result = iso15693_request(pdc, vicc, ISO15693_CMD_READ_SINGLE_BLOCK,
+			&block, 1, data, &size, ISO15693_TIMEOUT_us);
+	if (result)
+		return result;
+	return size == iso15693_block_size(vicc) ? STATUS_OK : STATUS_ERROR;
+}
+
+/**
+ * Reads count blocks starting at first in a single request. The answer
+ * must fit the FIFO of the PCD, see iso15693_read() for larger reads.
+ */
+int iso15693_read_multiple_blocks(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t first, uint16_t count, uint8_t *data) {
+	uint8_t param[2] = { first, count - 1 };
+	size_t size = (size_t) count * iso15693_block_size(vicc);
+
+	if (!count || count > 256)
+		return STATUS_INVALID;
+	if (pdc->rx_fifo_size && size + 1 > pdc->rx_fifo_size)
+		return STATUS_NO_ROOM;
+	int result = iso15693_request(pdc, vicc, ISO15693_CMD_READ_MULTIPLE_BLOCKS,
+			param, sizeof(param), data, &size, ISO15693_TIMEOUT_us);
+	if (result)
+		return result;
+	return size == (size_t) count * iso15693_block_size(vicc) ?
+			STATUS_OK : STATUS_ERROR;
+}
+
+int iso15693_write_single_block(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t block, const uint8_t *data) {
+	uint8_t param[1 + 32];
+	uint8_t block_size = iso15693_block_size(vicc);
+
+	if (block_size > 32)
+		return STATUS_INVALID;
+	param[0] = block;
+	memcpy(param + 1, data, block_size);
+	return iso15693_request(pdc, vicc, ISO15693_CMD_WRITE_SINGLE_BLOCK, param,
+			1 + block_size, NULL, NULL, ISO15693_TIMEOUT_WRITE_us);
+}
+
+/**
+ * Reads the whole memory of a VICC, by as few READ MULTIPLE BLOCKS requests
+ * as the FIFO of the PCD allows. The memory size is requested from the VICC
+ * when not known yet.
+ *
+ * @param size	In: size of data, Out: bytes read
+ */
+int iso15693_read(bs_pdc_t *pdc, iso15693_vicc_t *vicc, uint8_t *data,
+		size_t *size) {
+	size_t capacity = *size;
+	int result;
+
+	*size = 0;
+	if (!vicc->block_count) {
+		result = iso15693_get_system_info(pdc, vicc);
+		if (result)
+			return result;
+		if (!vicc->block_count)
+			return STATUS_ERROR;
+	}
+
+	uint8_t block_size = iso15693_block_size(vicc);
+	size_t per_request = (ISO15693_FRAME_SIZE - 1) / block_size;
+	if (pdc->rx_fifo_size && per_request > (pdc->rx_fifo_size - 1) / block_size)
+		per_request = (pdc->rx_fifo_size - 1) / block_size;
+	if (per_request > ISO15693_READ_MULTIPLE_MAX)
+		per_request = ISO15693_READ_MULTIPLE_MAX;
+	if (!per_request)
+		return STATUS_NO_ROOM;
+	if ((size_t) vicc->block_count * block_size > capacity)
+		return STATUS_NO_ROOM;
+
+	for (uint16_t block = 0; block < vicc->block_count; block += per_request) {
+		uint16_t count = vicc->block_count - block;
+		if (count > per_request)
+			count = per_request;
+		result = iso15693_read_multiple_blocks(pdc, vicc, block, count,
+				data + *size);
+		if (result)
+			return result;
+		*size += (size_t) count * block_size;
+	}
+	return STATUS_OK;
+}
@@ -8,8 +8,103 @@
 #ifndef BSRFID_CARDS_ISO15693_H_
 #define BSRFID_CARDS_ISO15693_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
+#include "pdc.h"
 
+// ISO/IEC 15693-3 vicinity cards (VICC), eg. NXP ICode SLIX.
+//
+// The inventory finds the VICCs in the field by their 64 bit UID. A VICC
+// answers an inventory request when the least significant bits of its UID
+// match the mask of the request.
+// - 16 slots: a VICC answers in the slot given by the 4 UID bits following
+//   the mask, the PCD moves to the next slot by an EOF. A slot in which
+//   VICCs collide is inventoried again, with the mask extended by the slot.
+// - 1 slot: all matching VICCs answer at once, a collision extends the mask
+//   by a single bit, both values are inventoried.
+// The masks of the branches do not overlap, a VICC is found once without
+// sending it to the quiet state.
 
+#define ISO15693_UID_SIZE					(8)
+
+// Request flags
+#define ISO15693_FLAG_SUBCARRIER			(0x01)	// Two subcarriers
+#define ISO15693_FLAG_DATA_RATE				(0x02)	// High data rate
+#define ISO15693_FLAG_INVENTORY				(0x04)
+#define ISO15693_FLAG_PROTOCOL_EXTENSION	(0x08)
+// Without ISO15693_FLAG_INVENTORY
+#define ISO15693_FLAG_SELECT				(0x10)
+#define ISO15693_FLAG_ADDRESS				(0x20)
+#define ISO15693_FLAG_OPTION				(0x40)
+// With ISO15693_FLAG_INVENTORY
+#define ISO15693_FLAG_AFI					(0x10)
+#define ISO15693_FLAG_NB_SLOTS_1			(0x20)
+
+// Response flags
+#define ISO15693_RESPONSE_ERROR				(0x01)
+
+#define ISO15693_CMD_INVENTORY				(0x01)
+#define ISO15693_CMD_STAY_QUIET				(0x02)
+#define ISO15693_CMD_READ_SINGLE_BLOCK		(0x20)
+#define ISO15693_CMD_WRITE_SINGLE_BLOCK		(0x21)
+#define ISO15693_CMD_READ_MULTIPLE_BLOCKS	(0x23)
+#define ISO15693_CMD_SELECT					(0x25)
+#define ISO15693_CMD_RESET_TO_READY			(0x26)
+#define ISO15693_CMD_GET_SYSTEM_INFO		(0x2B)
+
+// GET SYSTEM INFORMATION, information flags
+#define ISO15693_INFO_DSFID					(0x01)
+#define ISO15693_INFO_AFI					(0x02)
+#define ISO15693_INFO_MEMORY_SIZE			(0x04)
+#define ISO15693_INFO_IC_REFERENCE			(0x08)
+
+// The VICC answers after t1, 4352/fc, plus its SOF
+#define ISO15693_TIMEOUT_us					(500)
+// WRITE SINGLE BLOCK: the VICC answers once the EEPROM is programmed
+#define ISO15693_TIMEOUT_WRITE_us			(20000)
+
+// Pending branches of the inventory. A branch that does not fit is
+// dropped, and counted in the overflows of the statistics.
+#ifndef ISO15693_INVENTORY_STACK_SIZE
+#define ISO15693_INVENTORY_STACK_SIZE		(16)
+#endif
+// Blocks per READ MULTIPLE BLOCKS, further limited by the FIFO of the PCD
+#ifndef ISO15693_READ_MULTIPLE_MAX
+#define ISO15693_READ_MULTIPLE_MAX			(32)
+#endif
+
+typedef struct {
+	uint8_t uid[ISO15693_UID_SIZE];	// Least significant byte first, as sent
+	uint8_t dsfid;
+	// From GET SYSTEM INFORMATION, 0 when not known
+	uint8_t afi;
+	uint8_t ic_reference;
+	uint16_t block_count;
+	uint8_t block_size;
+} iso15693_vicc_t;
+
+typedef struct {
+	unsigned int requests;		// Inventory requests sent
+	unsigned int slots;			// Slots, the first slot of a request included
+	unsigned int collisions;	// Slots in which VICCs collided
+	unsigned int errors;		// Slots with an answer that is not valid
+	unsigned int overflows;		// Branches dropped, the stack was full
+	uint32_t time_ms;			// Duration of the inventory
+} iso15693_inventory_stats_t;
+
+int iso15693_inventory(bs_pdc_t *pdc, uint8_t slots, iso15693_vicc_t *viccs,
+		size_t *count, iso15693_inventory_stats_t *stats);
+int iso15693_stay_quiet(bs_pdc_t *pdc, const iso15693_vicc_t *vicc);
+int iso15693_get_system_info(bs_pdc_t *pdc, iso15693_vicc_t *vicc);
+int iso15693_read_single_block(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t block, uint8_t *data);
+int iso15693_read_multiple_blocks(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t first, uint16_t count, uint8_t *data);
+int iso15693_write_single_block(bs_pdc_t *pdc, const iso15693_vicc_t *vicc,
+		uint8_t block, const uint8_t *data);
+int iso15693_read(bs_pdc_t *pdc, iso15693_vicc_t *vicc, uint8_t *data,
+		size_t *size);
 
 #endif /* BSRFID_CARDS_ISO15693_H_ */
@@ -0,0 +1,153 @@
+/*
+ * iso7816_4.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "iso7816_4.h"
+
+typedef struct {
+	iso14443_4_recv_f recv;
+	void *context;
+	uint8_t tail[2];		// Last bytes received, the status word at the end
+	size_t tail_size;
+	size_t size;
+} iso7816_4_stream_t;
+
+static int iso7816_4_deliver(iso7816_4_stream_t *stream, const uint8_t *data,
+		size_t size) {
+	if (!size)
+		return STATUS_OK;
+	stream->size += size;
+	return stream->recv ? stream->recv(stream->context, data, size) : STATUS_OK;
+}
+
+// Passes the response on as it arrives, holding back the last two bytes,
+// which are the status word once the response is complete
+static int iso7816_4_stream(void *context, const uint8_t *data, size_t size) {
+	iso7816_4_stream_t *stream = context;
+	int result;
+
+	if (size >= 2) {
+		result = iso7816_4_deliver(stream, stream->tail, stream->tail_size);
+		if (!result)
+			result = iso7816_4_deliver(stream, data, size - 2);
+		memcpy(stream->tail, data + size - 2, 2);
+		stream->tail_size = 2;
+		return result;
+	}
+	if (stream->tail_size < 2) {
+		stream->tail[stream->tail_size++] = data[0];
+		return STATUS_OK;
+	}
+	result = iso7816_4_deliver(stream, stream->tail, 1);
+	stream->tail[0] = stream->tail[1];
+	stream->tail[1] = data[0];
+	return result;
+}
+
+/**
+ * Sends a command APDU and streams the response data to recv. The status
+ * word is not passed to recv. Depending on command->flags, responses
+ * continued with 61xx or 91AF are fetched, recv then receives the data of
+ * all parts as one response.
+ *
+ * @param recv		May be NULL when no response data is expected
+ * @param response	Status word and size of the response, may be NULL
+ * @return STATUS_OK when a status word was received, whatever its value.
+ * 		   The result of recv when it aborted the exchange, the PICC must
+ * 		   then be deselected. STATUS_ERROR when the response is still
+ * 		   continued after ISO7816_4_MAX_EXCHANGES.
+ */
+int iso7816_4_transceive(bs_pdc_t *pdc, picc_t *picc,
+		const iso7816_4_command_t *command, iso14443_4_recv_f recv,
+		void *context, iso7816_4_response_t *response) {
+	iso14443_4_segment_t segments[ISO7816_4_MAX_SEGMENTS + 2];
+	iso7816_4_stream_t stream = { .recv = recv, .context = context };
+	iso7816_4_response_t local;
+	const iso7816_4_command_t *current = command;
+	iso7816_4_command_t follow;		// GET RESPONSE, ADDITIONAL FRAME or retry
+	uint8_t header[7];				// CLA INS P1 P2 and Lc
+	uint8_t trailer[3];				// Le
+	bool retried = false;
+
+	if (command->data_count > ISO7816_4_MAX_SEGMENTS)
+		return STATUS_INVALID;
+	if (!response)
+		response = &local;
+	memset(response, 0, sizeof(iso7816_4_response_t));
+
+	for (;;) {
+		size_t nc = 0, header_size = 0, trailer_size = 0, count = 0;
+		uint32_t ne = current->ne;
+		for (size_t i = 0; i < current->data_count; i++)
+			nc += current->data[i].size;
+		if (nc > 0xFFFF || ne > ISO7816_4_NE_EXTENDED)
+			return STATUS_INVALID;
+		bool extended = nc > 0xFF || ne > ISO7816_4_NE_SHORT;
+
+		header[header_size++] = current->cla;
+		header[header_size++] = current->ins;
+		header[header_size++] = current->p1;
+		header[header_size++] = current->p2;
+		if (nc) {
+			if (extended) {
+				header[header_size++] = 0x00;
+				header[header_size++] = nc >> 8;
+			}
+			header[header_size++] = nc;
+		}
+		if (ne) {
+			// Ne 256 is encoded as 00, Ne 65536 as 0000
+			if (extended) {
+				if (!nc)
+					trailer[trailer_size++] = 0x00;
+				trailer[trailer_size++] = ne >> 8;
+			}
+			trailer[trailer_size++] = ne;
+		}
+		segments[count++] = (iso14443_4_segment_t ) { header, header_size };
+		for (size_t i = 0; i < current->data_count; i++)
+			segments[count++] = current->data[i];
+		segments[count++] = (iso14443_4_segment_t ) { trailer, trailer_size };
+
+		stream.tail_size = 0;
+		int result = iso14443_4_exchange(pdc, picc, segments, count,
+				iso7816_4_stream, &stream);
+		response->exchanges++;
+		response->size = stream.size;
+		if (result)
+			return result;
+		if (stream.tail_size < 2)
+			return STATUS_ERROR;	// No status word
+		response->sw = stream.tail[0] << 8 | stream.tail[1];
+
+		if (stream.tail[0] == 0x61 && (command->flags & iso7816_4_get_response)) {
+			// Proprietary classes use the interindustry class for GET
+			// RESPONSE, the logical channel is kept
+			follow = (iso7816_4_command_t ) { .cla = (command->cla & 0x80) ?
+							0x00 : (command->cla & 0x03),
+					.ins = ISO7816_4_INS_GET_RESPONSE,
+					.ne = stream.tail[1] ? stream.tail[1] : ISO7816_4_NE_SHORT };
+		} else if (stream.tail[0] == 0x6C && !retried
+				&& (command->flags & iso7816_4_retry_le)) {
+			// Wrong Le, the PICC tells the right one
+			follow = *current;
+			follow.ne = stream.tail[1] ? stream.tail[1] : ISO7816_4_NE_SHORT;
+			retried = true;
+		} else if (response->sw == ISO7816_4_SW_DESFIRE_AF
+				&& (command->flags & iso7816_4_continue_af)) {
+			follow = (iso7816_4_command_t ) { .cla = command->cla,
+					.ins = ISO7816_4_INS_DESFIRE_AF,
+					.ne = ISO7816_4_NE_SHORT };
+		} else {
+			return STATUS_OK;
+		}
+		if (response->exchanges >= ISO7816_4_MAX_EXCHANGES)
+			return STATUS_ERROR;
+		current = &follow;
+	}
+}
@@ -0,0 +1,78 @@
+/*
+ * iso7816_4.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_ISO7816_4_H_
+#define BSRFID_CARDS_ISO7816_4_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+#include "iso14443_4.h"
+
+// ISO 7816-4 APDUs over ISO 14443-4.
+//
+// The command data is given as a list of segments, for instance a header
+// in a local buffer followed by the payload in place, and is sent without
+// being assembled. The response data is streamed to a callback while the
+// I-blocks arrive; the status word is split off and returned separately.
+// Commands with more than 255 bytes of data, or expecting more than 256
+// bytes, are sent as extended APDUs. The PICC has to support these.
+//
+// A response that is continued by the PICC, with 61xx (GET RESPONSE) or
+// 91AF (DESFire ADDITIONAL FRAME), is fetched and streamed as one response
+// when the command asks for it. The RAM used does not depend on the size of
+// the response, one frame of the block protocol is buffered.
+
+#define ISO7816_4_MAX_SEGMENTS		(4)
+// Command-response pairs of one iso7816_4_transceive(), bounding the
+// continuations of a PICC that keeps answering 61xx or 91AF. 65536 bytes
+// take 257 exchanges with GET RESPONSE.
+#ifndef ISO7816_4_MAX_EXCHANGES
+#define ISO7816_4_MAX_EXCHANGES		(1024)
+#endif
+// Ne values asking for all available data
+#define ISO7816_4_NE_SHORT			(256)
+#define ISO7816_4_NE_EXTENDED		(65536)
+
+#define ISO7816_4_SW_OK				(0x9000)
+#define ISO7816_4_SW_DESFIRE_OK		(0x9100)
+#define ISO7816_4_SW_DESFIRE_AF		(0x91AF)
+
+#define ISO7816_4_INS_GET_RESPONSE	(0xC0)
+#define ISO7816_4_INS_DESFIRE_AF	(0xAF)
+
+typedef enum {
+	iso7816_4_get_response = 0x01,	// Fetch the remainder on 61xx
+	iso7816_4_retry_le = 0x02,		// Repeat the command with the Le of 6Cxx
+	iso7816_4_continue_af = 0x04,	// Send ADDITIONAL FRAME while 91AF
+} iso7816_4_flags_t;
+
+typedef struct {
+	uint8_t cla;
+	uint8_t ins;
+	uint8_t p1;
+	uint8_t p2;
+	const iso14443_4_segment_t *data;	// Command data, Nc is the total size
+	size_t data_count;				// Up to ISO7816_4_MAX_SEGMENTS
+	uint32_t ne;					// Data expected, 0 when none
+	uint8_t flags;					// iso7816_4_flags_t
+} iso7816_4_command_t;
+
+typedef struct {
+	uint16_t sw;					// Status word of the last response
+	size_t size;					// Data passed to the callback
+	unsigned int exchanges;			// Command-response pairs
+} iso7816_4_response_t;
+
+int iso7816_4_transceive(bs_pdc_t *pdc, picc_t *picc,
+		const iso7816_4_command_t *command, iso14443_4_recv_f recv,
+		void *context, iso7816_4_response_t *response);
+
+#endif /* BSRFID_CARDS_ISO7816_4_H_ */
@@ -0,0 +1,646 @@
+/*
+ * mfc.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "mfc.h"
+#include "iso14443_crc.h"
+
+static uint32_t mfc_next_nonce(mfc_t *mfc) {
+	// xorshift32, nR only needs to differ between authentications
+	uint32_t x = mfc->reader_nonce;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	mfc->reader_nonce = x;
+	return x;
+}
+
+/**
+ * Prepares a MIFARE Classic session with a selected PICC.
+ * A PICC still authenticated by an earlier session expects encrypted
+ * frames: halt and reselect it first (mfc_halt, mfc_reselect).
+ *
+ * @param software	Use the software Crypto1 even when the reader IC has
+ * 					a Crypto1 unit.
+ * @return STATUS_INVALID when the PCD can neither authenticate nor disable
+ * 		   its parity.
+ */
+int mfc_init(mfc_t *mfc, bs_pdc_t *pdc, picc_t *picc, bool software) {
+	memset(mfc, 0, sizeof(mfc_t));
+	mfc->pdc = pdc;
+	mfc->picc = picc;
+	mfc->software = software || !pdc->Crypto1Begin;
+	if (mfc->software && !pdc->SetParity)
+		return STATUS_INVALID;
+	mfc->sector = -1;
+	mfc->reader_nonce = 0x2545F491;
+	if (pdc->get_time_ms)
+		mfc->reader_nonce ^= pdc->get_time_ms();
+	if (!mfc->reader_nonce)
+		mfc->reader_nonce = 1;
+	return STATUS_OK;
+}
+
+/**
+ * The sector of a block. Sectors 0 to 31 have 4 blocks, sectors 32 to 39
+ * of a 4K card 16 blocks.
+ */
+int mfc_sector(uint8_t block) {
+	if (block < 4 * MFC_SMALL_SECTORS)
+		return block / 4;
+	return MFC_SMALL_SECTORS + (block - 4 * MFC_SMALL_SECTORS) / 16;
+}
+
+/**
+ * The first block of a sector.
+ */
+uint8_t mfc_sector_block(int sector) {
+	if (sector < MFC_SMALL_SECTORS)
+		return 4 * sector;
+	return 4 * MFC_SMALL_SECTORS + 16 * (sector - MFC_SMALL_SECTORS);
+}
+
+/**
+ * The number of blocks in a sector, the last one is the sector trailer.
+ */
+int mfc_sector_size(int sector) {
+	return sector < MFC_SMALL_SECTORS ? 4 : 16;
+}
+
+/**
+ * The number of sectors, by the SAK of the PICC.
+ */
+int mfc_sector_count(const picc_t *picc) {
+	switch (picc->sak.as_uint8) {
+	case 0x09:	// MIFARE Mini
+		return 5;
+	case 0x19:	// MIFARE Classic 2K
+		return 32;
+	case 0x18:	// MIFARE Classic 4K
+	case 0x38:
+		return MFC_MAX_SECTORS;
+	default:	// MIFARE Classic 1K
+		return 16;
+	}
+}
+
+/**
+ * Whether a sector is authenticated. A REQA, WUPA or HLTA, switching the
+ * field off or a LPCD measurement ends the session.
+ */
+bool mfc_is_authenticated(const mfc_t *mfc) {
+	return mfc->authenticated && mfc->epoch == mfc->pdc->picc_epoch;
+}
+
+// Stops a session the PICC has left, so the PCD returns to plain frames
+static void mfc_check_session(mfc_t *mfc) {
+	if (mfc->authenticated && mfc->epoch != mfc->pdc->picc_epoch)
+		mfc_stop(mfc);
+}
+
+// Sends a software encrypted frame of whole bytes with their parity bits
+static int mfc_send_raw(mfc_t *mfc, uint8_t *data, uint8_t *parity,
+		size_t size, uint8_t *raw, size_t *raw_size, uint8_t *valid_bits) {
+	uint8_t frame[CRYPTO1_FRAME_SIZE];
+	size_t bits = crypto1_pack(data, parity, size, frame);
+	*valid_bits = bits % 8;
+	return mfc->pdc->TransceiveData(mfc->pdc, frame, (bits + 7) / 8, raw,
+			raw_size, valid_bits, 0, NULL, false, false);
+}
+
+// Bits received, from the number of bytes and the valid bits of the last
+static size_t mfc_received_bits(size_t size, uint8_t valid_bits) {
+	return size ? 8 * size - (valid_bits ? 8 - valid_bits : 0) : 0;
+}
+
+// Exchanges a frame with the authenticated PICC. The CRC_A is added, and
+// checked on the response. A response of 4 bits is an ACK or NAK.
+static int mfc_exchange(mfc_t *mfc, const uint8_t *data, size_t size,
+		uint8_t *back, size_t back_size) {
+	uint8_t frame[MFC_BLOCK_SIZE + 2], parity[MFC_BLOCK_SIZE + 2];
+	uint8_t raw[CRYPTO1_FRAME_SIZE];
+	size_t raw_size = sizeof(raw);
+	uint8_t valid_bits = 0;
+	int result;
+
+	mfc_check_session(mfc);
+	if (!mfc->authenticated)
+		return STATUS_INVALID;
+	if (size > MFC_BLOCK_SIZE)
+		return STATUS_NO_ROOM;
+	memcpy(frame, data, size);
+	iso14443_crc_a_append(frame, size);
+	size += 2;
+
+	if (mfc->software) {
+		crypto1_encrypt(&mfc->crypto1, frame, parity, size, false);
+		result = mfc_send_raw(mfc, frame, parity, size, raw, &raw_size,
+				&valid_bits);
+	} else {
+		result = mfc->pdc->TransceiveData(mfc->pdc, frame, size, raw,
+				&raw_size, &valid_bits, 0, NULL, false, false);
+	}
+	if (result)
+		return result;
+
+	if (raw_size == 1 && valid_bits == 4) {
+		uint8_t ack = raw[0] & 0x0F;
+		if (mfc->software)
+			ack = crypto1_nibble(&mfc->crypto1, ack);
+		return ack == MFC_ACK ? STATUS_OK : STATUS_MIFARE_NACK;
+	}
+	if (!back)
+		return STATUS_ERROR;
+
+	if (mfc->software) {
+		size = crypto1_unpack(raw, mfc_received_bits(raw_size, valid_bits),
+				frame, parity);
+		if (!size || size > sizeof(frame))
+			return STATUS_ERROR;
+		if (!crypto1_decrypt(&mfc->crypto1, frame, parity, size, false))
+			return STATUS_ERROR;
+	} else {
+		if (valid_bits || raw_size > sizeof(frame))
+			return STATUS_ERROR;
+		size = raw_size;
+		memcpy(frame, raw, size);
+	}
+	if (size != back_size + 2)
+		return STATUS_ERROR;
+	if (!iso14443_crc_a_check(frame, size))
+		return STATUS_CRC_WRONG;
+	memcpy(back, frame, back_size);
+	return STATUS_OK;
+}
+
+/**
+ * Exchanges a frame with the authenticated PICC. On failure the PICC has
+ * returned to the idle state, and the session is stopped.
+ *
+ * @param back		Response without CRC_A, NULL when only an ACK is expected
+ * @param timeout_us	Timeout profile of the command, see pdc.h
+ * @param timeout_ok	No answer is expected, a timeout is a success
+ * @return STATUS_OK, STATUS_MIFARE_NACK on a NAK, STATUS_CRC_WRONG,
+ * 		   STATUS_ERROR on a parity error or unexpected response, or the
+ * 		   result of TransceiveData.
+ */
+static int mfc_transceive(mfc_t *mfc, const uint8_t *data, size_t size,
+		uint8_t *back, size_t back_size, uint32_t timeout_us, bool timeout_ok) {
+	pdc_set_timeout(mfc->pdc, timeout_us);
+	int result = mfc_exchange(mfc, data, size, back, back_size);
+	if (result == STATUS_TIMEOUT && timeout_ok)
+		return STATUS_OK;
+	if (result && result != STATUS_INVALID && result != STATUS_NO_ROOM)
+		mfc_stop(mfc);
+	return result;
+}
+
+// Three pass authentication with Crypto1 on the host. A nested
+// authentication, while authenticated, receives an encrypted nT.
+static int mfc_auth_software(mfc_t *mfc, mfc_key_type_t key_type,
+		uint8_t block, const uint8_t *key) {
+	picc_t *picc = mfc->picc;
+	uint8_t data[8], parity[8];
+	uint8_t raw[CRYPTO1_FRAME_SIZE];
+	size_t raw_size = sizeof(raw);
+	uint8_t valid_bits = 0;
+	bool nested = mfc->authenticated;
+	int result;
+
+	if (picc->uid_size < 4)
+		return STATUS_INVALID;
+	uint32_t uid = crypto1_get_word(picc->uid + picc->uid_size - 4);
+
+	data[0] = key_type;
+	data[1] = block;
+	iso14443_crc_a_append(data, 2);
+	if (nested) {
+		crypto1_encrypt(&mfc->crypto1, data, parity, 4, false);
+	} else {
+		for (int i = 0; i < 4; i++)
+			parity[i] = crypto1_odd_parity(data[i]);
+	}
+	mfc->authenticated = false;
+	result = mfc_send_raw(mfc, data, parity, 4, raw, &raw_size, &valid_bits);
+	if (result)
+		return result == STATUS_TIMEOUT ? STATUS_AUTH_ERROR : result;
+	if (crypto1_unpack(raw, mfc_received_bits(raw_size, valid_bits), data,
+			parity) != 4)
+		return STATUS_AUTH_ERROR;
+
+	// nT, shifted in together with the UID
+	uint32_t nt = crypto1_get_word(data);
+	crypto1_init(&mfc->crypto1, key);
+	if (nested)
+		nt ^= crypto1_word(&mfc->crypto1, uid ^ nt, true);
+	else
+		crypto1_word(&mfc->crypto1, uid ^ nt, false);
+
+	// {nR} is shifted in, {aR} = suc64(nT)
+	crypto1_put_word(data, mfc_next_nonce(mfc));
+	crypto1_encrypt(&mfc->crypto1, data, parity, 4, true);
+	crypto1_put_word(data + 4, crypto1_prng_successor(nt, 64));
+	crypto1_encrypt(&mfc->crypto1, data + 4, parity + 4, 4, false);
+	raw_size = sizeof(raw);
+	result = mfc_send_raw(mfc, data, parity, 8, raw, &raw_size, &valid_bits);
+	if (result)
+		return result == STATUS_TIMEOUT ? STATUS_AUTH_ERROR : result;
+
+	// {aT} = suc96(nT) proves the PICC knows the key as well
+	if (crypto1_unpack(raw, mfc_received_bits(raw_size, valid_bits), data,
+			parity) != 4)
+		return STATUS_AUTH_ERROR;
+	if (!crypto1_decrypt(&mfc->crypto1, data, parity, 4, false)
+			|| crypto1_get_word(data) != crypto1_prng_successor(nt, 96))
+		return STATUS_AUTH_ERROR;
+	return STATUS_OK;
+}
+
+static int mfc_auth_pcd(mfc_t *mfc, mfc_key_type_t key_type, uint8_t block,
+		const uint8_t *key) {
+	bs_pdc_t *pdc = mfc->pdc;
+	int result;
+
+	pdc_set_timeout(pdc, PDC_TIMEOUT_COMMAND_us);
+	if (!mfc->software) {
+		picc_t *picc = mfc->picc;
+		picc->mfc_crypto1.key_a_or_b = key_type;
+		picc->mfc_crypto1.block_address = block;
+		memcpy(picc->mfc_crypto1.key, key, MFC_KEY_SIZE);
+		mfc->authenticated = false;
+		result = pdc->Crypto1Begin(pdc, picc);
+		if (result)
+			return result == STATUS_TIMEOUT || result == STATUS_ERROR ?
+					STATUS_AUTH_ERROR : result;
+		mfc->authenticated = true;
+		return STATUS_OK;
+	}
+
+	if (!mfc->authenticated) {
+		result = pdc->SetParity(pdc, false);
+		if (result)
+			return result;
+	}
+	result = mfc_auth_software(mfc, key_type, block, key);
+	if (result) {
+		pdc->SetParity(pdc, true);
+		return result;
+	}
+	mfc->authenticated = true;
+	return STATUS_OK;
+}
+
+/**
+ * Authenticates the sector containing the block. When the sector is
+ * already authenticated with the same key, nothing is sent. While
+ * authenticated, a following authentication is a nested authentication.
+ *
+ * @return STATUS_OK, STATUS_AUTH_ERROR when the PICC rejected the key, the
+ * 		   PICC must then be selected again, see mfc_reselect().
+ */
+int mfc_auth(mfc_t *mfc, mfc_key_type_t key_type, uint8_t block,
+		const uint8_t *key) {
+	int sector = mfc_sector(block);
+
+	if (key_type != mfc_key_a && key_type != mfc_key_b)
+		return STATUS_INVALID;
+	mfc_check_session(mfc);
+	if (mfc->authenticated && mfc->sector == sector
+			&& mfc->key.key_type == key_type
+			&& !memcmp(mfc->key.key, key, MFC_KEY_SIZE)) {
+		mfc->stats.auth_skipped++;
+		return STATUS_OK;
+	}
+
+	mfc->stats.auth_count++;
+	mfc->sector = -1;
+	int result = mfc_auth_pcd(mfc, key_type, block, key);
+	if (result) {
+		mfc->stats.auth_failed++;
+		return result;
+	}
+	mfc->sector = sector;
+	mfc->key.key_type = key_type;
+	memcpy(mfc->key.key, key, MFC_KEY_SIZE);
+	mfc->epoch = mfc->pdc->picc_epoch;
+	return STATUS_OK;
+}
+
+/**
+ * Ends the encrypted session, the PCD returns to plain frames.
+ */
+int mfc_stop(mfc_t *mfc) {
+	bs_pdc_t *pdc = mfc->pdc;
+	mfc->authenticated = false;
+	mfc->sector = -1;
+	if (mfc->software)
+		return pdc->SetParity(pdc, true);
+	if (pdc->Crypto1End)
+		return pdc->Crypto1End(pdc);
+	return STATUS_OK;
+}
+
+/**
+ * Sends an encrypted HLTA and ends the session. The PICC does not answer.
+ */
+int mfc_halt(mfc_t *mfc) {
+	uint8_t cmd[2] = { PICC_CMD_HLTA, 0x00 };
+	int result = mfc_transceive(mfc, cmd, sizeof(cmd), NULL, 0,
+			PDC_TIMEOUT_NAK_us, true);
+	mfc_stop(mfc);
+	return result;
+}
+
+/**
+ * Reads a block of 16 bytes from the authenticated sector.
+ */
+int mfc_read(mfc_t *mfc, uint8_t block, uint8_t *data) {
+	uint8_t cmd[2] = { mfc_cmd_read, block };
+	int result = mfc_transceive(mfc, cmd, sizeof(cmd), data, MFC_BLOCK_SIZE,
+			PDC_TIMEOUT_COMMAND_us, false);
+	if (!result)
+		mfc->stats.blocks_read++;
+	return result;
+}
+
+/**
+ * Writes a block of 16 bytes in the authenticated sector.
+ */
+int mfc_write(mfc_t *mfc, uint8_t block, const uint8_t *data) {
+	uint8_t cmd[2] = { mfc_cmd_write, block };
+	int result = mfc_transceive(mfc, cmd, sizeof(cmd), NULL, 0,
+			PDC_TIMEOUT_COMMAND_us, false);
+	if (result)
+		return result;
+	result = mfc_transceive(mfc, data, MFC_BLOCK_SIZE, NULL, 0,
+			PDC_TIMEOUT_EEPROM_us, false);
+	if (!result)
+		mfc->stats.blocks_written++;
+	return result;
+}
+
+// INCREMENT, DECREMENT and RESTORE: the operand is not acknowledged, a
+// timeout means success. The result is in the transfer buffer of the PICC.
+static int mfc_value_operation(mfc_t *mfc, mfc_command_t command,
+		uint8_t block, int32_t operand) {
+	uint8_t cmd[2] = { command, block };
+	uint8_t data[4];
+	int result = mfc_transceive(mfc, cmd, sizeof(cmd), NULL, 0,
+			PDC_TIMEOUT_COMMAND_us, false);
+	if (result)
+		return result;
+	data[0] = operand;
+	data[1] = operand >> 8;
+	data[2] = operand >> 16;
+	data[3] = operand >> 24;
+	// Only a NAK is sent back
+	return mfc_transceive(mfc, data, sizeof(data), NULL, 0, PDC_TIMEOUT_NAK_us,
+			true);
+}
+
+int mfc_increment(mfc_t *mfc, uint8_t block, int32_t delta) {
+	return mfc_value_operation(mfc, mfc_cmd_increment, block, delta);
+}
+
+int mfc_decrement(mfc_t *mfc, uint8_t block, int32_t delta) {
+	return mfc_value_operation(mfc, mfc_cmd_decrement, block, delta);
+}
+
+int mfc_restore(mfc_t *mfc, uint8_t block) {
+	return mfc_value_operation(mfc, mfc_cmd_restore, block, 0);
+}
+
+/**
+ * Writes the transfer buffer of the PICC to a block.
+ */
+int mfc_transfer(mfc_t *mfc, uint8_t block) {
+	uint8_t cmd[2] = { mfc_cmd_transfer, block };
+	return mfc_transceive(mfc, cmd, sizeof(cmd), NULL, 0, PDC_TIMEOUT_EEPROM_us,
+			false);
+}
+
+/**
+ * Reads a value block.
+ *
+ * @return STATUS_INVALID when the block is not in the value block format
+ */
+int mfc_get_value(mfc_t *mfc, uint8_t block, int32_t *value) {
+	uint8_t data[MFC_BLOCK_SIZE];
+	int result = mfc_read(mfc, block, data);
+	if (result)
+		return result;
+	for (int i = 0; i < 4; i++)
+		if (data[i] != data[i + 8] || (data[i] ^ data[i + 4]) != 0xFF)
+			return STATUS_INVALID;
+	if (data[12] != data[14] || data[13] != data[15]
+			|| (data[12] ^ data[13]) != 0xFF)
+		return STATUS_INVALID;
+	*value = (int32_t) ((uint32_t) data[0] | ((uint32_t) data[1] << 8)
+			| ((uint32_t) data[2] << 16) | ((uint32_t) data[3] << 24));
+	return STATUS_OK;
+}
+
+/**
+ * Formats a block as value block. The address byte is set to the block.
+ */
+int mfc_set_value(mfc_t *mfc, uint8_t block, int32_t value) {
+	uint8_t data[MFC_BLOCK_SIZE];
+	uint32_t v = value;
+	for (int i = 0; i < 4; i++) {
+		data[i] = data[i + 8] = v >> (8 * i);
+		data[i + 4] = ~data[i];
+	}
+	data[12] = data[14] = block;
+	data[13] = data[15] = ~block;
+	return mfc_write(mfc, block, data);
+}
+
+/**
+ * Captures a nested authentication trace for the offline key check. The
+ * session must be authenticated by the software Crypto1, with the key of
+ * any sector: the PICC answers the AUTH with {nT} encrypted by the key of
+ * the requested sector, including the parity bits, which is what the key
+ * check verifies key candidates against. The authentication is not
+ * completed, the session is stopped and the PICC must be selected again.
+ *
+ * @return STATUS_INVALID when not authenticated by the software Crypto1
+ */
+int mfc_capture_nested(mfc_t *mfc, mfc_key_type_t key_type, uint8_t block,
+		mfc_trace_t *trace) {
+	picc_t *picc = mfc->picc;
+	uint8_t data[4], parity[4];
+	uint8_t raw[CRYPTO1_FRAME_SIZE];
+	size_t raw_size = sizeof(raw);
+	uint8_t valid_bits = 0;
+	int result;
+
+	if (!mfc->software || !mfc_is_authenticated(mfc) || picc->uid_size < 4)
+		return STATUS_INVALID;
+	memset(trace, 0, sizeof(mfc_trace_t));
+	trace->type = mfc_trace_nested;
+	trace->key_type = key_type;
+	trace->block = block;
+	trace->uid = crypto1_get_word(picc->uid + picc->uid_size - 4);
+
+	data[0] = key_type;
+	data[1] = block;
+	iso14443_crc_a_append(data, 2);
+	crypto1_encrypt(&mfc->crypto1, data, parity, 4, false);
+	result = mfc_send_raw(mfc, data, parity, 4, raw, &raw_size, &valid_bits);
+	mfc_stop(mfc);
+	if (result)
+		return result;
+	if (crypto1_unpack(raw, mfc_received_bits(raw_size, valid_bits), data,
+			trace->nt_parity) != 4)
+		return STATUS_ERROR;
+	trace->nt = crypto1_get_word(data);
+	return STATUS_OK;
+}
+
+/**
+ * Selects the PICC again, after a failed authentication or an error the
+ * PICC has returned to the idle state. A PICC that is still active, as it
+ * ignored the last frame, returns to the idle state on the first WUPA
+ * without answer, the WUPA is then sent again.
+ */
+int mfc_reselect(mfc_t *mfc) {
+	picc_t *picc = mfc->picc;
+	size_t size = sizeof(picc->atqa);
+	mfc_stop(mfc);
+	int result = PICC_REQA_or_WUPA(mfc->pdc, PICC_CMD_WUPA,
+			(uint8_t*) &picc->atqa, &size);
+	if (result == STATUS_TIMEOUT) {
+		size = sizeof(picc->atqa);
+		result = PICC_REQA_or_WUPA(mfc->pdc, PICC_CMD_WUPA,
+				(uint8_t*) &picc->atqa, &size);
+	}
+	if (result)
+		return result;
+	return PICC_Select(mfc->pdc, picc, 8 * picc->uid_size);
+}
+
+// Orders the blocks by sector, the authenticated sector first, so every
+// sector is authenticated once. Blocks of a sector keep their order.
+static void mfc_order_blocks(const mfc_t *mfc, const uint8_t *blocks,
+		size_t count, uint16_t *order) {
+	int current = mfc_is_authenticated(mfc) ? mfc->sector : -1;
+	for (size_t i = 0; i < count; i++) {
+		int sector = mfc_sector(blocks[i]);
+		sector = sector == current ? -1 : sector;
+		size_t j = i;
+		while (j) {
+			int prev = mfc_sector(blocks[order[j - 1]]);
+			if ((prev == current ? -1 : prev) <= sector)
+				break;
+			order[j] = order[j - 1];
+			j--;
+		}
+		order[j] = i;
+	}
+}
+
+/**
+ * Reads a list of blocks, authenticating with the key of each sector. The
+ * blocks are read grouped by sector, the data is stored in the order of
+ * the list.
+ *
+ * @param keys	The key for every sector, indexed by sector
+ * @param data	16 bytes per block in the list
+ */
+int mfc_read_blocks(mfc_t *mfc, const mfc_key_t *keys, const uint8_t *blocks,
+		size_t count, uint8_t *data) {
+	uint16_t order[MFC_MAX_BLOCKS];
+	if (count > MFC_MAX_BLOCKS)
+		return STATUS_NO_ROOM;
+	mfc_order_blocks(mfc, blocks, count, order);
+	for (size_t i = 0; i < count; i++) {
+		uint8_t block = blocks[order[i]];
+		const mfc_key_t *key = keys + mfc_sector(block);
+		int result = mfc_auth(mfc, key->key_type, block, key->key);
+		if (!result)
+			result = mfc_read(mfc, block, data + MFC_BLOCK_SIZE * order[i]);
+		if (result)
+			return result;
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Writes a list of blocks, grouped by sector as mfc_read_blocks() does.
+ */
+int mfc_write_blocks(mfc_t *mfc, const mfc_key_t *keys,
+		const uint8_t *blocks, size_t count, const uint8_t *data) {
+	uint16_t order[MFC_MAX_BLOCKS];
+	if (count > MFC_MAX_BLOCKS)
+		return STATUS_NO_ROOM;
+	mfc_order_blocks(mfc, blocks, count, order);
+	for (size_t i = 0; i < count; i++) {
+		uint8_t block = blocks[order[i]];
+		const mfc_key_t *key = keys + mfc_sector(block);
+		int result = mfc_auth(mfc, key->key_type, block, key->key);
+		if (!result)
+			result = mfc_write(mfc, block, data + MFC_BLOCK_SIZE * order[i]);
+		if (result)
+			return result;
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Reads the whole card, one authentication per sector. A sector of which
+ * the key is rejected is left zero, the PICC is selected again and the
+ * dump continues. The frames and time used are in mfc->stats.
+ *
+ * @param keys			The key for every sector, indexed by sector
+ * @param sectors_read	Optional, bit n is set when sector n was read
+ * @return STATUS_OK when all sectors were read, STATUS_AUTH_ERROR when a
+ * 		   key was rejected, STATUS_NO_ROOM when data is too small
+ */
+int mfc_dump(mfc_t *mfc, const mfc_key_t *keys, uint8_t *data, size_t size,
+		uint64_t *sectors_read) {
+	bs_pdc_t *pdc = mfc->pdc;
+	int sectors = mfc_sector_count(mfc->picc);
+	size_t blocks = mfc_sector_block(sectors - 1) + mfc_sector_size(sectors - 1);
+	uint32_t start_ms = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	unsigned int frames = pdc->frame_count;
+	uint64_t read = 0;
+	int result = STATUS_OK;
+
+	if (size < MFC_BLOCK_SIZE * blocks)
+		return STATUS_NO_ROOM;
+	memset(data, 0, MFC_BLOCK_SIZE * blocks);
+
+	for (int sector = 0; sector < sectors; sector++) {
+		uint8_t first = mfc_sector_block(sector);
+		int count = mfc_sector_size(sector);
+		int status = mfc_auth(mfc, keys[sector].key_type, first,
+				keys[sector].key);
+		for (int i = 0; !status && i < count; i++)
+			status = mfc_read(mfc, first + i,
+					data + MFC_BLOCK_SIZE * (first + i));
+		if (!status) {
+			read |= 1ull << sector;
+			continue;
+		}
+		memset(data + MFC_BLOCK_SIZE * first, 0, MFC_BLOCK_SIZE * count);
+		result = status == STATUS_MIFARE_NACK ? STATUS_AUTH_ERROR : status;
+		status = mfc_reselect(mfc);
+		if (status) {
+			// The PICC left the field
+			result = status;
+			break;
+		}
+	}
+
+	mfc->stats.frames = pdc->frame_count - frames;
+	if (pdc->get_time_ms)
+		mfc->stats.time_ms = pdc->get_time_ms() - start_ms;
+	if (sectors_read)
+		*sectors_read = read;
+	return result;
+}
@@ -0,0 +1,135 @@
+/*
+ * mfc.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_MFC_H_
+#define BSRFID_CARDS_MFC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+#include "crypto1.h"
+
+// MIFARE Classic session over any PCD.
+//
+// When the reader IC has a Crypto1 unit (Crypto1Begin), the authentication
+// and encryption are done by the reader IC. Otherwise the PCD must be able
+// to disable its parity (SetParity) and Crypto1 runs on the host: the
+// frames, their parity bits and the CRC_A are built and encrypted here and
+// exchanged as raw bit streams through TransceiveData.
+
+#define MFC_BLOCK_SIZE			(16)
+#define MFC_KEY_SIZE			(6)
+#define MFC_ACK					(0x0A)
+// Sectors of 4 blocks, the sectors of a 4K card above are of 16 blocks
+#define MFC_SMALL_SECTORS		(32)
+#define MFC_MAX_SECTORS			(40)
+#define MFC_MAX_BLOCKS			(256)
+
+typedef enum {
+	mfc_key_a = 0x60,
+	mfc_key_b = 0x61,
+} mfc_key_type_t;
+
+typedef enum {
+	mfc_cmd_read = 0x30,
+	mfc_cmd_write = 0xA0,
+	mfc_cmd_decrement = 0xC0,
+	mfc_cmd_increment = 0xC1,
+	mfc_cmd_restore = 0xC2,
+	mfc_cmd_transfer = 0xB0,
+} mfc_command_t;
+
+// An authentication trace, for the offline key check in mfc_keycheck.c.
+// Words are in transmission order, as crypto1_get_word() returns them.
+typedef enum {
+	mfc_trace_auth,		// Sniffed authentication: nT, {nR}, {aR}, {aT}
+	mfc_trace_nested,	// Nested authentication: {nT} with encrypted parity
+} mfc_trace_type_t;
+
+typedef struct {
+	mfc_trace_type_t type;
+	uint8_t key_type;
+	uint8_t block;
+	uint32_t uid;			// Last 4 bytes of the UID
+	uint32_t nt;			// nT, or {nT} for a nested trace
+	uint32_t nr;			// {nR}
+	uint32_t ar;			// {aR}
+	uint32_t at;			// {aT}, when has_at is set
+	uint8_t nt_parity[4];	// Encrypted parity of {nT}, nested trace
+	uint8_t ar_parity[4];	// Encrypted parity of {aR}, when has_parity
+	bool has_at;
+	bool has_parity;
+} mfc_trace_t;
+
+typedef struct {
+	mfc_key_type_t key_type;
+	uint8_t key[MFC_KEY_SIZE];
+} mfc_key_t;
+
+typedef struct {
+	unsigned int auth_count;	// Authentications sent to the PICC
+	unsigned int auth_skipped;	// Sector already authenticated with the key
+	unsigned int auth_failed;
+	unsigned int blocks_read;
+	unsigned int blocks_written;
+	unsigned int frames;		// Frames of the last mfc_dump()
+	uint32_t time_ms;			// Duration of the last mfc_dump()
+} mfc_stats_t;
+
+typedef struct {
+	bs_pdc_t *pdc;
+	picc_t *picc;
+	bool software;			// Crypto1 on the host, parity of the PCD disabled
+	bool authenticated;
+	crypto1_t crypto1;
+	uint32_t reader_nonce;	// Generator of nR
+
+	// The authenticated sector, valid while picc_epoch of the PCD is
+	// unchanged: REQA, WUPA, HLTA and the field going off end the session.
+	int sector;
+	mfc_key_t key;
+	unsigned int epoch;
+
+	mfc_stats_t stats;
+} mfc_t;
+
+int mfc_init(mfc_t *mfc, bs_pdc_t *pdc, picc_t *picc, bool software);
+int mfc_auth(mfc_t *mfc, mfc_key_type_t key_type, uint8_t block,
+		const uint8_t *key);
+int mfc_stop(mfc_t *mfc);
+int mfc_halt(mfc_t *mfc);
+
+int mfc_read(mfc_t *mfc, uint8_t block, uint8_t *data);
+int mfc_write(mfc_t *mfc, uint8_t block, const uint8_t *data);
+int mfc_increment(mfc_t *mfc, uint8_t block, int32_t delta);
+int mfc_decrement(mfc_t *mfc, uint8_t block, int32_t delta);
+int mfc_restore(mfc_t *mfc, uint8_t block);
+int mfc_transfer(mfc_t *mfc, uint8_t block);
+int mfc_get_value(mfc_t *mfc, uint8_t block, int32_t *value);
+int mfc_set_value(mfc_t *mfc, uint8_t block, int32_t value);
+
+int mfc_sector(uint8_t block);
+uint8_t mfc_sector_block(int sector);
+int mfc_sector_size(int sector);
+int mfc_sector_count(const picc_t *picc);
+bool mfc_is_authenticated(const mfc_t *mfc);
+int mfc_reselect(mfc_t *mfc);
+
+int mfc_read_blocks(mfc_t *mfc, const mfc_key_t *keys, const uint8_t *blocks,
+		size_t count, uint8_t *data);
+int mfc_write_blocks(mfc_t *mfc, const mfc_key_t *keys,
+		const uint8_t *blocks, size_t count, const uint8_t *data);
+int mfc_dump(mfc_t *mfc, const mfc_key_t *keys, uint8_t *data, size_t size,
+		uint64_t *sectors_read);
+
+int mfc_capture_nested(mfc_t *mfc, mfc_key_type_t key_type, uint8_t block,
+		mfc_trace_t *trace);
+
+#endif /* BSRFID_CARDS_MFC_H_ */
@@ -0,0 +1,369 @@
+/*
+ * mfc_keycheck.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#ifdef MFC_KEYCHECK_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "mfc_keycheck.h"
+
+#if MFC_KEYCHECK_VECTOR_SIZE > 8
+typedef uint64_t mfc_bs_t __attribute__((vector_size(MFC_KEYCHECK_VECTOR_SIZE)));
+#else
+typedef uint64_t mfc_bs_t;
+#endif
+
+#define MFC_BS_WORDS		(sizeof(mfc_bs_t) / sizeof(uint64_t))
+#define MFC_BS_LANES		(64 * MFC_BS_WORDS)
+// The key, and the bits shifted in for nT, nR and aR
+#define MFC_BS_BITS			(48 + 3 * 32)
+
+#ifdef MFC_KEYCHECK_PTHREAD
+#define MFC_KEYCHECK_FETCH_ADD(p, v)	__atomic_fetch_add(p, v, __ATOMIC_RELAXED)
+#define MFC_KEYCHECK_ADD(p, v)			\
+	do { __atomic_add_fetch(p, v, __ATOMIC_RELAXED); } while (0)
+#define MFC_KEYCHECK_LOAD(p)			__atomic_load_n(p, __ATOMIC_RELAXED)
+#else
+#define MFC_KEYCHECK_FETCH_ADD(p, v)	((*(p) += (v)) - (v))
+#define MFC_KEYCHECK_ADD(p, v)			do { *(p) += (v); } while (0)
+#define MFC_KEYCHECK_LOAD(p)			(*(p))
+#endif
+
+typedef struct {
+	const mfc_trace_t *traces;
+	size_t trace_count;
+	const uint8_t (*keys)[MFC_KEY_SIZE];
+	size_t key_count;
+	size_t next;			// First key of the next chunk
+	size_t found;			// Lowest matching key, key_count when none
+	size_t tested;
+	size_t candidates;
+} mfc_keycheck_job_t;
+
+//------------------------------------------------------------------------------
+// Scalar check
+//------------------------------------------------------------------------------
+
+static bool mfc_trace_check_auth(const mfc_trace_t *trace,
+		const uint8_t *key) {
+	crypto1_t crypto1;
+	uint8_t data[4];
+
+	crypto1_init(&crypto1, key);
+	crypto1_word(&crypto1, trace->uid ^ trace->nt, false);
+	crypto1_word(&crypto1, trace->nr, true);
+	crypto1_put_word(data, trace->ar);
+	if (!crypto1_decrypt(&crypto1, data, trace->has_parity ?
+			trace->ar_parity : NULL, 4, false))
+		return false;
+	if (crypto1_get_word(data) != crypto1_prng_successor(trace->nt, 64))
+		return false;
+	if (!trace->has_at)
+		return true;
+	return (trace->at ^ crypto1_word(&crypto1, 0, false))
+			== crypto1_prng_successor(trace->nt, 96);
+}
+
+static bool mfc_trace_check_nested(const mfc_trace_t *trace,
+		const uint8_t *key) {
+	crypto1_t crypto1;
+	uint8_t uid[4], nt[4];
+
+	crypto1_init(&crypto1, key);
+	crypto1_put_word(uid, trace->uid);
+	crypto1_put_word(nt, trace->nt);
+	for (int i = 0; i < 4; i++) {
+		nt[i] ^= crypto1_byte(&crypto1, uid[i] ^ nt[i], true);
+		if ((trace->nt_parity[i] ^ crypto1_filter(&crypto1))
+				!= crypto1_odd_parity(nt[i]))
+			return false;
+	}
+	return crypto1_prng_valid(crypto1_get_word(nt));
+}
+
+/**
+ * Checks one key against a trace with the scalar cipher.
+ */
+bool mfc_trace_check(const mfc_trace_t *trace, const uint8_t *key) {
+	switch (trace->type) {
+	case mfc_trace_auth:
+		return mfc_trace_check_auth(trace, key);
+	case mfc_trace_nested:
+		return mfc_trace_check_nested(trace, key);
+	default:
+		return false;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Bit-sliced check
+//
+// The LFSR is kept as the stream of bits shifted in: s[0..47] is the key,
+// every clock appends a bit. p points at the newest bit, the bit at LFSR
+// position 47 - a (a clocks old) is p[-a]. The filter takes the 20 bits at
+// even age 0..38, in nibbles of 4, as crypto1_filter() does.
+//------------------------------------------------------------------------------
+
+// The filter functions as gates, synthesised from the tables in crypto1.c
+static inline mfc_bs_t mfc_bs_fa(mfc_bs_t a, mfc_bs_t b, mfc_bs_t c,
+		mfc_bs_t d) {
+	return c ^ ((b | (a ^ c)) & (d ^ (b | c)));
+}
+
+static inline mfc_bs_t mfc_bs_fb(mfc_bs_t a, mfc_bs_t b, mfc_bs_t c,
+		mfc_bs_t d) {
+	return a ^ b ^ ((a ^ c ^ d) | (c ^ (a | b)));
+}
+
+static inline mfc_bs_t mfc_bs_fc(mfc_bs_t a, mfc_bs_t b, mfc_bs_t c,
+		mfc_bs_t d, mfc_bs_t e) {
+	return (a | e) ^ (a & (c | (b & e))) ^ (d & (a ^ ((b ^ e) & (a ^ (c | e)))));
+}
+
+static inline mfc_bs_t mfc_bs_filter(const mfc_bs_t *p) {
+	return mfc_bs_fc(mfc_bs_fb(p[-32], p[-34], p[-36], p[-38]),
+			mfc_bs_fa(p[-24], p[-26], p[-28], p[-30]),
+			mfc_bs_fa(p[-16], p[-18], p[-20], p[-22]),
+			mfc_bs_fb(p[-8], p[-10], p[-12], p[-14]),
+			mfc_bs_fa(p[0], p[-2], p[-4], p[-6]));
+}
+
+// Taps of CRYPTO1_POLY_ODD and CRYPTO1_POLY_EVEN, as age
+static inline mfc_bs_t mfc_bs_feedback(const mfc_bs_t *p) {
+	return p[-4] ^ p[-5] ^ p[-6] ^ p[-8] ^ p[-12] ^ p[-18] ^ p[-20] ^ p[-22]
+			^ p[-23] ^ p[-28] ^ p[-30] ^ p[-32] ^ p[-33] ^ p[-35] ^ p[-37]
+			^ p[-38] ^ p[-42] ^ p[-47];
+}
+
+static inline mfc_bs_t mfc_bs_const(uint32_t word, int bit) {
+	mfc_bs_t zero = { 0 };
+	return zero - (uint64_t) ((word >> bit) & 1);
+}
+
+static inline bool mfc_bs_all(mfc_bs_t x) {
+	const uint64_t *w = (const uint64_t*) &x;
+	uint64_t all = ~0ull;
+	for (size_t i = 0; i < MFC_BS_WORDS; i++)
+		all &= w[i];
+	return all == ~0ull;
+}
+
+// 64 x 64 bit transpose, row r bit c becomes row c bit r
+static void mfc_bs_transpose(uint64_t *a) {
+	uint64_t m = 0x00000000FFFFFFFFull;
+	for (int j = 32; j; j >>= 1, m ^= m << j) {
+		for (int k = 0; k < 64; k = (k + j + 1) & ~j) {
+			uint64_t t = ((a[k] >> j) ^ a[k + j]) & m;
+			a[k] ^= t << j;
+			a[k + j] ^= t;
+		}
+	}
+}
+
+// Loads the keys into the lanes, like crypto1_init(). Lanes without a key
+// repeat the last one.
+static void mfc_bs_load(mfc_bs_t *s, const uint8_t (*keys)[MFC_KEY_SIZE],
+		size_t count) {
+	uint64_t rows[64];
+	for (size_t w = 0; w < MFC_BS_WORDS; w++) {
+		for (size_t l = 0; l < 64; l++) {
+			size_t i = 64 * w + l;
+			const uint8_t *key = keys[i < count ? i : count - 1];
+			uint64_t k = 0;
+			for (int b = 0; b < MFC_KEY_SIZE; b++)
+				k = (k << 8) | key[b];
+			rows[l] = k;
+		}
+		mfc_bs_transpose(rows);
+		for (int j = 0; j < 48; j++)
+			((uint64_t*) &s[j])[w] = rows[(47 - j) ^ 7];
+	}
+}
+
+// Sniffed authentication: nT and {nR} are shifted in, the keystream must
+// decrypt {aR} to suc64(nT). Returns the lanes that failed.
+static mfc_bs_t mfc_bs_check_auth(mfc_bs_t *s, const mfc_trace_t *trace) {
+	mfc_bs_t *p = s + 47;
+	mfc_bs_t err = { 0 };
+	uint32_t ar = crypto1_prng_successor(trace->nt, 64);
+	uint8_t ar_bytes[4];
+
+	for (int i = 0; i < 32; i++, p++)
+		p[1] = mfc_bs_feedback(p) ^ mfc_bs_const(trace->uid ^ trace->nt, i ^ 24);
+	for (int i = 0; i < 32; i++, p++)
+		p[1] = mfc_bs_feedback(p) ^ mfc_bs_filter(p)
+				^ mfc_bs_const(trace->nr, i ^ 24);
+
+	crypto1_put_word(ar_bytes, ar);
+	for (int i = 0; i < 32; i++, p++) {
+		err |= mfc_bs_filter(p) ^ mfc_bs_const(trace->ar ^ ar, i ^ 24);
+		p[1] = mfc_bs_feedback(p);
+		if ((i & 7) == 7) {
+			if (trace->has_parity)
+				err |= mfc_bs_filter(p + 1)
+						^ mfc_bs_const(trace->ar_parity[i / 8]
+								^ crypto1_odd_parity(ar_bytes[i / 8]), 0);
+			if (mfc_bs_all(err))
+				break;
+		}
+	}
+	return err;
+}
+
+// Nested authentication: uid ^ nT is shifted in while decrypting {nT}, the
+// parity bits and the 16 bit nonce generator must match.
+static mfc_bs_t mfc_bs_check_nested(mfc_bs_t *s, const mfc_trace_t *trace) {
+	mfc_bs_t *p = s + 47;
+	mfc_bs_t err = { 0 };
+	mfc_bs_t nt[32];
+	mfc_bs_t ones = mfc_bs_const(1, 0);
+
+	for (int i = 0; i < 32; i++, p++) {
+		mfc_bs_t ks = mfc_bs_filter(p);
+		p[1] = mfc_bs_feedback(p) ^ ks
+				^ mfc_bs_const(trace->uid ^ trace->nt, i ^ 24);
+		nt[i] = ks ^ mfc_bs_const(trace->nt, i ^ 24);
+		if ((i & 7) == 7) {
+			const mfc_bs_t *b = nt + i - 7;
+			err |= mfc_bs_filter(p + 1) ^ ones
+					^ mfc_bs_const(trace->nt_parity[i / 8], 0)
+					^ b[0] ^ b[1] ^ b[2] ^ b[3] ^ b[4] ^ b[5] ^ b[6] ^ b[7];
+			if (mfc_bs_all(err))
+				return err;
+		}
+	}
+	// nt[i] is bit i of the generator state, see crypto1_prng_valid()
+	for (int i = 0; i < 16; i++)
+		err |= nt[i] ^ nt[i + 2] ^ nt[i + 3] ^ nt[i + 5] ^ nt[i + 16];
+	return err;
+}
+
+// Checks a batch of keys, returns true when a key matches all traces
+static bool mfc_keycheck_batch(mfc_keycheck_job_t *job, size_t first,
+		size_t count, size_t *candidates) {
+	mfc_bs_t s[MFC_BS_BITS];
+	mfc_bs_t err;
+	const mfc_trace_t *trace = job->traces;
+
+	mfc_bs_load(s, job->keys + first, count);
+	if (trace->type == mfc_trace_auth)
+		err = mfc_bs_check_auth(s, trace);
+	else
+		err = mfc_bs_check_nested(s, trace);
+	if (mfc_bs_all(err))
+		return false;
+
+	const uint64_t *w = (const uint64_t*) &err;
+	for (size_t i = 0; i < count; i++) {
+		if ((w[i / 64] >> (i % 64)) & 1)
+			continue;
+		(*candidates)++;
+		const uint8_t *key = job->keys[first + i];
+		size_t t;
+		for (t = 0; t < job->trace_count; t++)
+			if (!mfc_trace_check(job->traces + t, key))
+				break;
+		if (t == job->trace_count) {
+			size_t found = first + i;
+			size_t prev = MFC_KEYCHECK_LOAD(&job->found);
+#ifdef MFC_KEYCHECK_PTHREAD
+			while (found < prev
+					&& !__atomic_compare_exchange_n(&job->found, &prev, found,
+							false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				;
+#else
+			if (found < prev)
+				job->found = found;
+#endif
+			return true;
+		}
+	}
+	return false;
+}
+
+static void* mfc_keycheck_worker(void *arg) {
+	mfc_keycheck_job_t *job = arg;
+	size_t candidates = 0, tested = 0;
+	for (;;) {
+		size_t first = MFC_KEYCHECK_FETCH_ADD(&job->next, MFC_KEYCHECK_CHUNK);
+		if (first >= job->key_count || first > MFC_KEYCHECK_LOAD(&job->found))
+			break;
+		size_t end = first + MFC_KEYCHECK_CHUNK;
+		if (end > job->key_count)
+			end = job->key_count;
+		for (size_t i = first; i < end; i += MFC_BS_LANES) {
+			size_t count = end - i < MFC_BS_LANES ? end - i : MFC_BS_LANES;
+			tested += count;
+			if (mfc_keycheck_batch(job, i, count, &candidates))
+				break;
+		}
+	}
+	MFC_KEYCHECK_ADD(&job->tested, tested);
+	MFC_KEYCHECK_ADD(&job->candidates, candidates);
+	return NULL;
+}
+
+/**
+ * The number of keys checked in one pass of the bit-sliced cipher.
+ */
+unsigned int mfc_keycheck_lanes(void) {
+	return MFC_BS_LANES;
+}
+
+/**
+ * Searches a dictionary for the key of the traces. All traces must be of
+ * the same key, the first one is used for the bit-sliced check.
+ *
+ * @param threads	Worker threads, only with MFC_KEYCHECK_PTHREAD
+ * @param key_index	The first key in the dictionary that matches
+ * @return STATUS_OK when found, STATUS_ERROR when no key matches,
+ * 		   STATUS_INVALID without traces or keys
+ */
+int mfc_keycheck(const mfc_trace_t *traces, size_t trace_count,
+		const uint8_t (*keys)[MFC_KEY_SIZE], size_t key_count,
+		unsigned int threads, size_t *key_index, mfc_keycheck_stats_t *stats) {
+	mfc_keycheck_job_t job = { 0 };
+
+	if (!traces || !trace_count || !keys || !key_count)
+		return STATUS_INVALID;
+	job.traces = traces;
+	job.trace_count = trace_count;
+	job.keys = keys;
+	job.key_count = key_count;
+	job.found = key_count;
+
+	if (!threads)
+		threads = 1;
+#ifdef MFC_KEYCHECK_PTHREAD
+	pthread_t workers[MFC_KEYCHECK_MAX_THREADS];
+	unsigned int started = 0;
+	if (threads > MFC_KEYCHECK_MAX_THREADS)
+		threads = MFC_KEYCHECK_MAX_THREADS;
+	for (; started < threads - 1; started++)
+		if (pthread_create(workers + started, NULL, mfc_keycheck_worker, &job))
+			break;
+	mfc_keycheck_worker(&job);
+	for (unsigned int i = 0; i < started; i++)
+		pthread_join(workers[i], NULL);
+	threads = started + 1;
+#else
+	threads = 1;
+	mfc_keycheck_worker(&job);
+#endif
+
+	if (stats) {
+		stats->keys_tested = job.tested;
+		stats->candidates = job.candidates;
+		stats->threads = threads;
+	}
+	if (job.found == key_count)
+		return STATUS_ERROR;
+	*key_index = job.found;
+	return STATUS_OK;
+}
@@ -0,0 +1,59 @@
+/*
+ * mfc_keycheck.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_MFC_KEYCHECK_H_
+#define BSRFID_CARDS_MFC_KEYCHECK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mfc.h"
+
+// Offline key check for MIFARE Classic audits. A dictionary of keys is
+// tested against captured authentication traces, without the card.
+//
+// The first trace is checked bit-sliced: every bit of the Crypto1 state is
+// a word, holding that bit for one key per lane, so one pass of the
+// cipher tests a whole batch of keys. Keys that pass are verified against
+// all traces with the scalar cipher. A nested trace leaves about 20 bits
+// to check, so with large dictionaries use two nested traces of the
+// sector, or a sniffed authentication trace (64 bits).
+//
+// With MFC_KEYCHECK_PTHREAD defined, the dictionary is shared out over
+// worker threads.
+
+// Lane vector, in bytes. With GCC or clang the bit-sliced state uses
+// vector extensions: 16 maps on SSE2 or NEON registers, 32 on AVX2 when
+// built with -mavx2. Define as 8 for plain 64 bit words.
+#ifndef MFC_KEYCHECK_VECTOR_SIZE
+#if defined(__GNUC__)
+#define MFC_KEYCHECK_VECTOR_SIZE	(16)
+#else
+#define MFC_KEYCHECK_VECTOR_SIZE	(8)
+#endif
+#endif
+
+// Keys a worker thread takes from the dictionary at once
+#define MFC_KEYCHECK_CHUNK			(4096)
+#ifndef MFC_KEYCHECK_MAX_THREADS
+#define MFC_KEYCHECK_MAX_THREADS	(64)
+#endif
+
+typedef struct {
+	size_t keys_tested;
+	size_t candidates;		// Keys passing the bit-sliced check
+	unsigned int threads;
+} mfc_keycheck_stats_t;
+
+bool mfc_trace_check(const mfc_trace_t *trace, const uint8_t *key);
+int mfc_keycheck(const mfc_trace_t *traces, size_t trace_count,
+		const uint8_t (*keys)[MFC_KEY_SIZE], size_t key_count,
+		unsigned int threads, size_t *key_index, mfc_keycheck_stats_t *stats);
+unsigned int mfc_keycheck_lanes(void);
+
+#endif /* BSRFID_CARDS_MFC_KEYCHECK_H_ */
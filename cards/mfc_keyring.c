@@ -0,0 +1,262 @@
+/*
+ * mfc_keyring.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "mfc_keyring.h"
+
+void mfc_keyring_init(mfc_keyring_t *ring) {
+	memset(ring, 0, sizeof(mfc_keyring_t));
+}
+
+/**
+ * Adds a candidate key. Keys are tried in the order added until the
+ * key-ring has learned better.
+ *
+ * @return The index of the key, or STATUS_NO_ROOM when the key-ring is full
+ */
+int mfc_keyring_add(mfc_keyring_t *ring, const uint8_t *key) {
+	for (size_t i = 0; i < ring->key_count; i++)
+		if (!memcmp(ring->keys[i].key, key, MFC_KEY_SIZE))
+			return i;
+	if (ring->key_count >= MFC_KEYRING_KEYS)
+		return STATUS_NO_ROOM;
+	memcpy(ring->keys[ring->key_count].key, key, MFC_KEY_SIZE);
+	ring->keys[ring->key_count].hits = 0;
+	return ring->key_count++;
+}
+
+static mfc_keyring_family_t* mfc_keyring_family(mfc_keyring_t *ring,
+		const picc_t *picc, bool create) {
+	mfc_keyring_family_t *family;
+	for (size_t i = 0; i < ring->family_count; i++) {
+		family = ring->families + i;
+		if (family->atqa == picc->atqa.as_uint16
+				&& family->sak == picc->sak.as_uint8
+				&& !memcmp(family->prefix, picc->uid, MFC_KEYRING_UID_PREFIX)) {
+			family->used = ++ring->clock;
+			return family;
+		}
+	}
+	if (!create)
+		return NULL;
+
+	// A free entry, or the least recently used
+	family = ring->families;
+	if (ring->family_count < MFC_KEYRING_FAMILIES)
+		family += ring->family_count++;
+	else
+		for (size_t i = 1; i < MFC_KEYRING_FAMILIES; i++)
+			if (ring->families[i].used < family->used)
+				family = ring->families + i;
+	family->atqa = picc->atqa.as_uint16;
+	family->sak = picc->sak.as_uint8;
+	memcpy(family->prefix, picc->uid, MFC_KEYRING_UID_PREFIX);
+	family->used = ++ring->clock;
+	memset(family->sectors, MFC_KEYRING_UNKNOWN, sizeof(family->sectors));
+	return family;
+}
+
+static mfc_keyring_uid_t* mfc_keyring_uid(mfc_keyring_t *ring,
+		const picc_t *picc, bool create) {
+	mfc_keyring_uid_t *uid;
+	for (size_t i = 0; i < ring->uid_count; i++) {
+		uid = ring->uids + i;
+		if (uid->uid_size == picc->uid_size
+				&& !memcmp(uid->uid, picc->uid, picc->uid_size)) {
+			uid->used = ++ring->clock;
+			return uid;
+		}
+	}
+	if (!create)
+		return NULL;
+
+	uid = ring->uids;
+	if (ring->uid_count < MFC_KEYRING_UIDS)
+		uid += ring->uid_count++;
+	else
+		for (size_t i = 1; i < MFC_KEYRING_UIDS; i++)
+			if (ring->uids[i].used < uid->used)
+				uid = ring->uids + i;
+	memcpy(uid->uid, picc->uid, picc->uid_size);
+	uid->uid_size = picc->uid_size;
+	uid->used = ++ring->clock;
+	memset(uid->sectors, MFC_KEYRING_UNKNOWN, sizeof(uid->sectors));
+	return uid;
+}
+
+/**
+ * Records the key of a sector, for instance a key recovered with
+ * mfc_keycheck(). The key is added to the key-ring when missing.
+ */
+int mfc_keyring_learn(mfc_keyring_t *ring, const picc_t *picc,
+		mfc_key_type_t key_type, int sector, const uint8_t *key) {
+	if (key_type != mfc_key_a && key_type != mfc_key_b)
+		return STATUS_INVALID;
+	if (sector < 0 || sector >= MFC_MAX_SECTORS)
+		return STATUS_INVALID;
+	int index = mfc_keyring_add(ring, key);
+	if (index < 0)
+		return index;
+
+	int type = key_type - mfc_key_a;
+	mfc_keyring_family(ring, picc, true)->sectors[sector][type] = index;
+	mfc_keyring_uid(ring, picc, true)->sectors[sector][type] = index;
+	ring->keys[index].hits++;
+	return STATUS_OK;
+}
+
+// Counts the sectors opened with each key
+static void mfc_keyring_count(const mfc_keyring_sectors_t sectors, int type,
+		uint32_t *counts) {
+	for (int sector = 0; sector < MFC_MAX_SECTORS; sector++)
+		if (sectors[sector][type] != MFC_KEYRING_UNKNOWN)
+			counts[sectors[sector][type]]++;
+}
+
+// Orders the keys to try for a sector, the most likely first
+static void mfc_keyring_order(const mfc_keyring_t *ring,
+		const mfc_keyring_family_t *family, const mfc_keyring_uid_t *uid,
+		int sector, int type, uint8_t *order) {
+	uint32_t score[MFC_KEYRING_KEYS] = { 0 };
+	uint32_t used[MFC_KEYRING_KEYS] = { 0 };
+
+	mfc_keyring_count(family->sectors, type, used);
+	mfc_keyring_count(uid->sectors, type, used);
+	for (size_t i = 0; i < ring->key_count; i++) {
+		uint32_t hits = ring->keys[i].hits;
+		score[i] = hits < 0xFFFFFF ? hits : 0xFFFFFF;
+		if (used[i])
+			score[i] = 1 << 24 | used[i];
+	}
+	if (family->sectors[sector][type] != MFC_KEYRING_UNKNOWN)
+		score[family->sectors[sector][type]] |= 2 << 24;
+	if (uid->sectors[sector][type] != MFC_KEYRING_UNKNOWN)
+		score[uid->sectors[sector][type]] |= 4 << 24;
+
+	// Insertion sort, stable so equal scores keep the order added
+	for (size_t i = 0; i < ring->key_count; i++) {
+		size_t j = i;
+		for (; j > 0 && score[order[j - 1]] < score[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+}
+
+/**
+ * Authenticates a sector with the keys of the key-ring, in the order
+ * learned. After a failed trial the PICC is reselected.
+ *
+ * @param key	The key that opened the sector, may be NULL
+ * @return STATUS_AUTH_ERROR when no key opens the sector, or the error of
+ * 		   the reselect when the PICC was lost.
+ */
+int mfc_keyring_auth(mfc_keyring_t *ring, mfc_t *mfc, mfc_key_type_t key_type,
+		uint8_t block, mfc_key_t *key) {
+	uint8_t order[MFC_KEYRING_KEYS];
+	int sector = mfc_sector(block);
+	int type = key_type - mfc_key_a;
+
+	if (key_type != mfc_key_a && key_type != mfc_key_b)
+		return STATUS_INVALID;
+	if (mfc_is_authenticated(mfc) && mfc->sector == sector
+			&& mfc->key.key_type == key_type) {
+		if (key)
+			*key = mfc->key;
+		return STATUS_OK;
+	}
+
+	mfc_keyring_family_t *family = mfc_keyring_family(ring, mfc->picc, true);
+	mfc_keyring_uid_t *uid = mfc_keyring_uid(ring, mfc->picc, true);
+	mfc_keyring_order(ring, family, uid, sector, type, order);
+	ring->stats.lookups++;
+
+	for (size_t i = 0; i < ring->key_count; i++) {
+		mfc_keyring_key_t *candidate = ring->keys + order[i];
+		ring->stats.trials++;
+		int result = mfc_auth(mfc, key_type, block, candidate->key);
+		if (result) {
+			// The PICC is idle after a failed authentication
+			result = mfc_reselect(mfc);
+			if (result)
+				return result;
+			continue;
+		}
+
+		if (uid->sectors[sector][type] == order[i])
+			ring->stats.uid_hits++;
+		else if (family->sectors[sector][type] == order[i])
+			ring->stats.family_hits++;
+		ring->stats.found++;
+		ring->stats.trials_saved += order[i] - (int) i;
+		family->sectors[sector][type] = order[i];
+		uid->sectors[sector][type] = order[i];
+		candidate->hits++;
+		if (key) {
+			key->key_type = key_type;
+			memcpy(key->key, candidate->key, MFC_KEY_SIZE);
+		}
+		return STATUS_OK;
+	}
+	return STATUS_AUTH_ERROR;
+}
+
+/**
+ * Reads a card as mfc_dump() does, with the keys from the key-ring.
+ *
+ * @param sectors_read	Bit per sector that was read, may be NULL
+ */
+int mfc_keyring_dump(mfc_keyring_t *ring, mfc_t *mfc, mfc_key_type_t key_type,
+		uint8_t *data, size_t size, uint64_t *sectors_read) {
+	bs_pdc_t *pdc = mfc->pdc;
+	int sectors = mfc_sector_count(mfc->picc);
+	size_t blocks = mfc_sector_block(sectors - 1) + mfc_sector_size(sectors - 1);
+	uint32_t start_ms = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	unsigned int frames = pdc->frame_count;
+	uint64_t read = 0;
+	int result = STATUS_OK;
+
+	if (size < MFC_BLOCK_SIZE * blocks)
+		return STATUS_NO_ROOM;
+	memset(data, 0, MFC_BLOCK_SIZE * blocks);
+
+	for (int sector = 0; sector < sectors; sector++) {
+		uint8_t first = mfc_sector_block(sector);
+		int count = mfc_sector_size(sector);
+		int status = mfc_keyring_auth(ring, mfc, key_type, first, NULL);
+		if (status == STATUS_AUTH_ERROR) {
+			result = status;
+			continue;
+		}
+		if (status) {
+			// The PICC left the field
+			result = status;
+			break;
+		}
+		for (int i = 0; !status && i < count; i++)
+			status = mfc_read(mfc, first + i,
+					data + MFC_BLOCK_SIZE * (first + i));
+		if (!status) {
+			read |= 1ull << sector;
+			continue;
+		}
+		memset(data + MFC_BLOCK_SIZE * first, 0, MFC_BLOCK_SIZE * count);
+		result = status;
+		status = mfc_reselect(mfc);
+		if (status) {
+			result = status;
+			break;
+		}
+	}
+
+	mfc->stats.frames = pdc->frame_count - frames;
+	if (pdc->get_time_ms)
+		mfc->stats.time_ms = pdc->get_time_ms() - start_ms;
+	if (sectors_read)
+		*sectors_read = read;
+	return result;
+}
@@ -0,0 +1,102 @@
+/*
+ * mfc_keyring.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_MFC_KEYRING_H_
+#define BSRFID_CARDS_MFC_KEYRING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "mfc.h"
+
+// Key-ring for MIFARE Classic cards of a mixed fleet.
+//
+// Every failed authentication costs a timeout and a reselect of the PICC,
+// so the order in which the candidate keys are tried dominates the time
+// to open a card. The key-ring learns which key opened which sector, per
+// card family (ATQA, SAK and the first bytes of the UID) and per UID, and
+// tries the keys in this order:
+//
+//  1. The key that opened the sector of this UID before
+//  2. The key that opened the sector for cards of this family
+//  3. Keys that opened other sectors of this card or this family
+//  4. The other keys, most successful first, then in the order added
+//
+// All storage is static, sized by the defines below.
+
+#ifndef MFC_KEYRING_KEYS
+#define MFC_KEYRING_KEYS			(64)
+#endif
+#ifndef MFC_KEYRING_FAMILIES
+#define MFC_KEYRING_FAMILIES		(16)
+#endif
+#ifndef MFC_KEYRING_UIDS
+#define MFC_KEYRING_UIDS			(32)
+#endif
+// Bytes of the UID that identify a family. The first byte of a double
+// size UID is the manufacturer, the first bytes of an NUID often identify
+// the batch of cards issued together.
+#ifndef MFC_KEYRING_UID_PREFIX
+#define MFC_KEYRING_UID_PREFIX		(1)
+#endif
+
+#define MFC_KEYRING_UNKNOWN			(0xFF)
+
+typedef struct {
+	uint8_t key[MFC_KEY_SIZE];
+	unsigned int hits;
+} mfc_keyring_key_t;
+
+// Index of the learned key per sector, for key A and key B
+typedef uint8_t mfc_keyring_sectors_t[MFC_MAX_SECTORS][2];
+
+typedef struct {
+	uint16_t atqa;
+	uint8_t sak;
+	uint8_t prefix[MFC_KEYRING_UID_PREFIX];
+	uint32_t used;
+	mfc_keyring_sectors_t sectors;
+} mfc_keyring_family_t;
+
+typedef struct {
+	uint8_t uid[10];
+	uint8_t uid_size;
+	uint32_t used;
+	mfc_keyring_sectors_t sectors;
+} mfc_keyring_uid_t;
+
+typedef struct {
+	unsigned int lookups;		// Sectors searched for a key
+	unsigned int found;
+	unsigned int trials;		// Authentications tried
+	int trials_saved;			// Compared to trying the keys in order
+	unsigned int uid_hits;		// Key known for the UID
+	unsigned int family_hits;	// Key learned for the family
+} mfc_keyring_stats_t;
+
+typedef struct {
+	mfc_keyring_key_t keys[MFC_KEYRING_KEYS];
+	size_t key_count;
+	mfc_keyring_family_t families[MFC_KEYRING_FAMILIES];
+	size_t family_count;
+	mfc_keyring_uid_t uids[MFC_KEYRING_UIDS];
+	size_t uid_count;
+	uint32_t clock;				// Age of the family and UID entries
+	mfc_keyring_stats_t stats;
+} mfc_keyring_t;
+
+void mfc_keyring_init(mfc_keyring_t *ring);
+int mfc_keyring_add(mfc_keyring_t *ring, const uint8_t *key);
+int mfc_keyring_learn(mfc_keyring_t *ring, const picc_t *picc,
+		mfc_key_type_t key_type, int sector, const uint8_t *key);
+int mfc_keyring_auth(mfc_keyring_t *ring, mfc_t *mfc, mfc_key_type_t key_type,
+		uint8_t block, mfc_key_t *key);
+int mfc_keyring_dump(mfc_keyring_t *ring, mfc_t *mfc, mfc_key_type_t key_type,
+		uint8_t *data, size_t size, uint64_t *sectors_read);
+
+#endif /* BSRFID_CARDS_MFC_KEYRING_H_ */
@@ -39,10 +39,7 @@ rc52x_result_t MIFARE_Read(rc52x_t *rc52x, uint8_t blockAddr, ///< MIFARE Classi
 	buffer[0] = PICC_CMD_MF_READ;
 	buffer[1] = blockAddr;
 	// Calculate CRC_A
-	result = PCD_CalculateCRC(buffer, 2, &buffer[2]);
-	if (result != STATUS_OK) {
-		return result;
-	}
+	iso14443_crc_a_append(buffer, 2);
 
 	// Transmit the buffer and receive the response, validate CRC_A.
 	return PCD_TransceiveData(buffer, 4, buffer, bufferSize, nullptr, 0, true);
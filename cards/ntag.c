@@ -32,11 +32,7 @@ rc52x_result_t PCD_NTAG216_AUTH(rc52x_t *rc52x, uint8_t *passuint16_t,
 	for (uint8_t i = 0; i < 4; i++)
 		cmdBuffer[i + 1] = passuint16_t[i];
 
-	result = PCD_CalculateCRC(rc52x, cmdBuffer, 5, &cmdBuffer[5]);
-
-	if (result != STATUS_OK) {
-		return result;
-	}
+	iso14443_crc_a_append(cmdBuffer, 5);
 
 	// Transceive the data, store the reply in cmdBuffer[]
 	uint8_t waitIRq = 0x30;	// RxIRq and IdleIRq
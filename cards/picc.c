@@ -10,14 +10,29 @@
 #include <string.h>
 
 #include "pdc.h"
+#include "iso14443_crc.h"
+#include "iso14443_4.h"
+#include "desfire.h"
+
+// PICCs are activated at 106 kbps, PPS may have raised the bit rate of
+// the PCD for the previous PICC
+static void picc_bitrate_106(bs_pdc_t *pdc) {
+	if (pdc->SetBitRate && (pdc->tx_bitrate || pdc->rx_bitrate))
+		pdc->SetBitRate(pdc, pdc_bitrate_106, pdc_bitrate_106);
+}
 
-pdc_result_t picc_reqa(bs_pdc_t * pdc, picc_t * picc) {
-	//return PICC_RequestA(pdc, picc);
-
+// REQA or WUPA, the ATQA is stored in the picc_t
+static pdc_result_t picc_request(bs_pdc_t *pdc, picc_t *picc, uint8_t command) {
 	uint8_t validBits = 7; // Short Frame
-	uint8_t command = PICC_CMD_REQA;
 	size_t atqa_size = sizeof(picc->atqa);
-	pdc_result_t status = pdc->TransceiveData(pdc, &command, 1, &picc->atqa, &atqa_size,
+	pdc->picc_epoch++; // Card layers drop their session state
+	pdc_result_t status = pdc_set_protocol(pdc, pdc_protocol_iso14443a);
+	if (status)
+		return status;
+	picc_bitrate_106(pdc);
+	// An empty field costs no more than the activation timeout
+	pdc_set_timeout(pdc, PDC_TIMEOUT_ACTIVATION_us);
+	status = pdc->TransceiveData(pdc, &command, 1, &picc->atqa, &atqa_size,
 			&validBits, 0, NULL, false, false);
 	//status = RC52X_TransceiveData(rc52x, &command, 1, bufferATQA, bufferSize, &validBits, 0, false);
 	if (status != STATUS_OK) {
@@ -29,117 +44,287 @@ pdc_result_t picc_reqa(bs_pdc_t * pdc, picc_t * picc) {
 	return status;
 }
 
-// TODO: Implement a new ISO 14443 A AntiCollision
-// 	Replace what PICC_Select does, with proper AntiCollision
-//	Thus detects all the PICCs in the field, up to the number
-//	of picc_t elements in a buffer provided.
-pdc_result_t picc_anticol_iso14443a(bs_pdc_t * pdc, picc_t * picc_array, int *picc_count){
-	uint8_t send_buffer[7];
-	// Zero the picc_array for initial state;
-	memset(picc_array, 0, *picc_count * sizeof(picc_t));
-	int index = 0;
-	pdc_result_t result;
-	// Note that if one or more cards are present, they'll
-	// answer the REQA command. Therefore this may already collide.
-	// Thus, can we even trust any data in the picc->atqa?
-	// As this contains the UID size, but cards of different UID
-	// sizes might be present. Furthermore, the bit frame says
-	// one bit out of 5 must be set. While known cards that
-	// do not implement anti collision, such as Topaz,
-	// set none, according to the specs, setting any
-	// number other then 1 should mean no bitframe anticol.
-	// I don't think we should rely on any
-	// of this and just proceed with anti collision,
-	// and handle something like Topaz separately,
-	// if we even decide to handle those as I haven't
-	// encountered any in the wild, those are rare.
-	// The company appears to be gone, and the NFC Forum
-	// appears to have abandoned NFC Type 1 anyways.
-
-	result = picc_reqa(pdc,picc_array);
-	if (result!=STATUS_OK && result != STATUS_COLLISION)
-		return result;
-
-	// At this point at least one card is present
+pdc_result_t picc_reqa(bs_pdc_t * pdc, picc_t * picc) {
+	//return PICC_RequestA(pdc, picc);
+	return picc_request(pdc, picc, PICC_CMD_REQA);
+}
 
-	// If we cannot assume the length of the UID from the ATQA
-	// when multiple cards are present. We will only look at
-	// SAK responses. Furthermore, I would place the collisionpos/validbits
-	// in the picc_t:
-	// When we have a collision, we copy the picc_t into an empty
-	// position in the array, flipping the colliding bit,
-	// then we repeat with the current known bits in the current
-	// picc_t, and attempt to complete the anticollision,
-	// then we repeat it for the next.
+// A pending branch of the anticollision tree. The UID bits of the completed
+// cascade levels are kept, so the branch can be selected again after a REQA.
+typedef struct {
+	uint8_t level;			// Current cascade level, 0 based
+	uint8_t known_bits;		// Known UID bits in the current cascade level
+	uint8_t cl[3][5];		// UID (or CT) bytes and BCC per cascade level
+} picc_anticol_node_t;
+
+static void picc_anticol_set_bit(uint8_t *cl, int bit, bool value) {
+	if (value)
+		cl[bit / 8] |= 1 << (bit % 8);
+	else
+		cl[bit / 8] &= ~(1 << (bit % 8));
+}
 
-	// Note, up to the complete UID (in the current cascadelevel)
-	// CRC is disabled.
-	// After the UD  a "BCC" is added, XOR'ing the CRC bytes
+// SELECT with all 32 UID bits of a cascade level known.
+static pdc_result_t picc_anticol_select(bs_pdc_t *pdc, int level, uint8_t *cl,
+		uint8_t *sak) {
+	uint8_t buffer[9];
+	uint8_t response[3];
+	size_t response_size = sizeof(response);
+	uint8_t valid_bits = 0;
+	pdc_result_t result;
 
-	char send_buff[7];
-	size_t send_size = 2;
-	char recv_buff[7];
-	size_t recv_size = 7;
-	bool send_crc = false;
-	uint8_t coll_pos = -1;
-	//uint8_t valid_bits = 0;
+	buffer[0] = PICC_CMD_SEL_CL1 + 2 * level;
+	buffer[1] = 0x70; // NVB: Seven whole bytes
+	memcpy(buffer + 2, cl, 4);
+	buffer[6] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+	pdc_set_timeout(pdc, PDC_TIMEOUT_ACTIVATION_us);
+	result = pdc->TransceiveData(pdc, buffer, 7, response, &response_size,
+			&valid_bits, 0, NULL, true, false);
+	if (result)
+		return result;
+	if (response_size != 3 || valid_bits != 0) // SAK + CRC_A
+		return STATUS_ERROR;
+	if (!iso14443_crc_a_check(response, 3))
+		return STATUS_CRC_WRONG;
+	*sak = response[0];
+	return STATUS_OK;
+}
 
-	send_buff[0]= PICC_CMD_SEL_CL1;
-	send_buff[1]= 0x20;
+// ANTICOLLISION with the known bits of the current cascade level.
+// Returns STATUS_OK when all 32 bits of the level are known, or
+// STATUS_COLLISION with the 0 based bit index of the collision in *collision.
+// The bits before the collision are stored in the node.
+static pdc_result_t picc_anticol_step(bs_pdc_t *pdc, picc_anticol_node_t *node,
+		int *collision) {
+	uint8_t *cl = node->cl[node->level];
+	uint8_t known_bytes = node->known_bits / 8;
+	uint8_t tx_last_bits = node->known_bits % 8;
+	uint8_t send_size = 2 + known_bytes + (tx_last_bits ? 1 : 0);
+	uint8_t valid_bits = tx_last_bits;
+	uint8_t buffer[7];
+	uint8_t response[5];
+	size_t expected_size = 5 - known_bytes; // Rest of the UID CLn and BCC
+	size_t response_size = expected_size;
+	uint8_t coll_pos = 0;
+	pdc_result_t result;
 
-	memset(recv_buff,0,sizeof(recv_buff));
+	buffer[0] = PICC_CMD_SEL_CL1 + 2 * node->level;
+	buffer[1] = ((2 + known_bytes) << 4) | tx_last_bits; // NVB
+	memcpy(buffer + 2, cl, send_size - 2);
 
-	result = pdc->TransceiveData(pdc, send_buff, send_size,
-			recv_buff, &recv_size, NULL, 0,
-			&coll_pos, send_crc, false);
+	// The response continues the partial byte, so it is received aligned
+	// to the first unknown bit. CRC is not used up to the complete UID.
+	pdc_set_timeout(pdc, PDC_TIMEOUT_ACTIVATION_us);
+	result = pdc->TransceiveData(pdc, buffer, send_size, response,
+			&response_size, &valid_bits, tx_last_bits, &coll_pos, false, false);
+	if (result != STATUS_OK && result != STATUS_COLLISION)
+		return result;
+	if (!response_size || response_size > expected_size)
+		return STATUS_ERROR;
 
+	// Merge the received bits, the low bits of the first byte were sent by us
+	uint8_t keep = (1 << tx_last_bits) - 1;
+	cl[known_bytes] = (cl[known_bytes] & keep) | (response[0] & ~keep);
+	memcpy(cl + known_bytes + 1, response + 1, response_size - 1);
 
 	if (result == STATUS_COLLISION) {
-		uint8_t valid_bytes = coll_pos / 8;
-		uint8_t valid_bits = coll_pos % 8;
-
+		if (!coll_pos || coll_pos > 40)
+			return STATUS_ERROR; // No valid position, we cannot continue
+		*collision = known_bytes * 8 + coll_pos - 1;
+		if (*collision < node->known_bits || *collision >= 32)
+			return STATUS_ERROR; // No progress - should not happen
+		node->known_bits = *collision;
+		return STATUS_COLLISION;
+	}
 
+	if (response_size != expected_size || valid_bits != 0)
+		return STATUS_ERROR;
+	if ((cl[0] ^ cl[1] ^ cl[2] ^ cl[3]) != cl[4])
+		return STATUS_ERROR; // BCC mismatch
+	node->known_bits = 32;
+	return STATUS_OK;
+}
 
-		send_buff[0]= PICC_CMD_SEL_CL1;
+// Copies the UID of a selected branch into the picc_t
+static void picc_anticol_store(picc_t *picc, picc_anticol_node_t *node,
+		uint8_t sak) {
+	picc->protocol = picc_protocol_iso14443a;
+	picc->uid_size = 3 * (node->level + 1) + 1;
+	for (int level = 0; level < node->level; level++)
+		memcpy(picc->uid + 3 * level, node->cl[level] + 1, 3); // Skip the CT
+	memcpy(picc->uid + 3 * node->level, node->cl[node->level], 4);
+	picc->sak.as_uint8 = sak;
+}
 
-		send_buff[1]= ((2 + valid_bytes) << 4) ;
-		send_buff[1]|= valid_bits;
-		memcpy ( send_buff + 2, recv_buff, valid_bytes + 1);
-		send_size = 3 + valid_bytes;
-		memset(recv_buff,0,sizeof(recv_buff));
+static bool picc_anticol_seen(picc_t *picc_array, int found, picc_t *picc) {
+	for (int i = 0; i < found; i++)
+		if (picc_array[i].uid_size == picc->uid_size
+				&& !memcmp(picc_array[i].uid, picc->uid, picc->uid_size))
+			return true;
+	return false;
+}
 
+/**
+ * Detects all ISO 14443-A PICCs in the field, up to the number of picc_t
+ * elements provided in *picc_count. On return *picc_count holds the number
+ * of PICCs found. Every PICC found has been halted.
+ *
+ * The collision bits are resolved as a depth first walk of the UID tree over
+ * all cascade levels, using a bounded stack of pending branches rather than
+ * recursion. Each branch starts with the wake command, as the PICCs not
+ * matching the last SELECT went back to IDLE (or HALT), and selects the
+ * completed cascade levels of the branch again.
+ *
+ * With PICC_CMD_REQA only the PICCs in IDLE take part. With PICC_CMD_WUPA
+ * the halted PICCs take part as well, eg. to see all PICCs in the field
+ * every poll. The PICCs found are halted again and only answer in the
+ * branches of their own UID, a PICC found twice is stored once.
+ *
+ * A PICC in READY does not answer REQA or WUPA, it returns to IDLE or HALT.
+ * When the caller has sent a REQA or WUPA already, the PICCs have to be
+ * returned to IDLE or HALT first, eg. by a HLTA.
+ *
+ * stats is optional.
+ *
+ * @param wake	PICC_CMD_REQA or PICC_CMD_WUPA
+ *
+ * @return STATUS_OK on success, STATUS_TIMEOUT when there are no PICCs,
+ * 		   STATUS_NO_ROOM when the array is full while more PICCs respond.
+ */
+pdc_result_t picc_anticol_iso14443a(bs_pdc_t *pdc, picc_t *picc_array,
+		int *picc_count, uint8_t wake, picc_anticol_stats_t *stats) {
+	// Note that if one or more cards are present, they'll
+	// answer the REQA command. Therefore this may already collide.
+	// Thus, we cannot trust the UID size from the ATQA, and we only
+	// look at the cascade bit in the SAK responses.
+	picc_anticol_node_t stack[PICC_ANTICOL_STACK_SIZE];
+	int stack_used;
+	int max_count = *picc_count;
+	int found = 0;
+	bool incomplete = true;
+	bool present = false;
+	unsigned int frame_count = pdc->frame_count;
+	uint32_t begin = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	pdc_result_t result;
+	picc_anticol_stats_t scratch;
 
+	if (wake != PICC_CMD_REQA && wake != PICC_CMD_WUPA)
+		return STATUS_INVALID;
+	if (!stats)
+		stats = &scratch;
+	memset(stats, 0, sizeof(picc_anticol_stats_t));
+	memset(picc_array, 0, max_count * sizeof(picc_t));
+
+	for (int round = 0; incomplete && round < PICC_ANTICOL_MAX_ROUNDS;
+			round++) {
+		int found_before = found;
+		if (round)
+			stats->restarts++;
+		incomplete = false;
+		memset(stack, 0, sizeof(picc_anticol_node_t));
+		stack_used = 1;
+
+		while (stack_used && found < max_count) {
+			picc_anticol_node_t node = stack[--stack_used];
+			picc_t *picc = picc_array + found;
+			uint8_t sak;
+
+			result = picc_request(pdc, picc, wake);
+			if (result == STATUS_TIMEOUT) {
+				// No PICC left that is not halted
+				stack_used = 0;
+				incomplete = false;
+				break;
+			}
+			if (result != STATUS_OK && result != STATUS_COLLISION) {
+				stats->errors++;
+				incomplete = true;
+				continue;
+			}
+			present = true;
 
-		result = pdc->TransceiveData(pdc, send_buff, send_size,
-					recv_buff, &recv_size, &valid_bits, 0,
-					&coll_pos, send_crc, false);
+			// Select the completed cascade levels of this branch again
+			result = STATUS_OK;
+			for (int level = 0; level < node.level && !result; level++) {
+				result = picc_anticol_select(pdc, level, node.cl[level], &sak);
+				if (result == STATUS_OK && !(sak & 0x04))
+					result = STATUS_ERROR;
+			}
 
-		// with 2 PICCS in the field, we should now have success
-		// (and a SAK telling us to enter the next cascade level.
+			while (result == STATUS_OK || result == STATUS_COLLISION) {
+				int collision;
+				if (node.known_bits == 32) {
+					result = picc_anticol_select(pdc, node.level,
+							node.cl[node.level], &sak);
+					if (result)
+						break;
+					if (sak & 0x04) { // Cascade bit set - UID not complete yet
+						if (++node.level == 3) {
+							result = STATUS_ERROR;
+							break;
+						}
+						node.known_bits = 0;
+						continue;
+					}
+					picc_anticol_store(picc, &node, sak);
+					PICC_HaltA(pdc);
+					if (!picc_anticol_seen(picc_array, found, picc))
+						found++;
+					break;
+				}
 
-		if (result) {
-			return result;
+				result = picc_anticol_step(pdc, &node, &collision);
+				if (result == STATUS_COLLISION) {
+					// Follow the 0 branch, remember the 1 branch for later
+					stats->collisions++;
+					node.known_bits = collision + 1;
+					if (stack_used < PICC_ANTICOL_STACK_SIZE) {
+						stack[stack_used] = node;
+						picc_anticol_set_bit(stack[stack_used].cl[node.level],
+								collision, true);
+						stack_used++;
+					} else {
+						incomplete = true;
+					}
+					picc_anticol_set_bit(node.cl[node.level], collision, false);
+				}
+			}
+			if (result != STATUS_OK && result != STATUS_TIMEOUT) {
+				// A timeout means the PICCs of this branch left the field
+				stats->errors++;
+				incomplete = true;
+			}
 		}
-		return result;
-
-
-//		// Now we split
-//		// So we get one entry with the collision bit set to 1, and the next set to 0
-//		// TODO, handle the indices so we can handle multiple collisions next
-//		memcpy ( picc_array[0]->uid, recv_buff, valid_bytes + 1);
-//		memcpy ( picc_array[1]->uid, recv_buff, valid_bytes + 1);
-//		picc_array[1]->uid[valid_bytes+1] ^= 1 << valid_bits;
-//		// We should move the valid bytes/bits into the picc
-//		// and make this function recursive
 
+		if (found == max_count)
+			break;
+		if (found == found_before)
+			break; // No progress, retrying won't help
 	}
 
+	// Don't leave the ATQA of a branch without result in the array
+	if (found < max_count)
+		memset(picc_array + found, 0, sizeof(picc_t));
+
+	result = present ? STATUS_OK : STATUS_TIMEOUT;
+	if (found == max_count) {
+		// Are there more PICCs that did not fit? A WUPA would wake the PICCs
+		// found, a pending branch holds at least one more PICC.
+		picc_t picc;
+		pdc_result_t more = wake == PICC_CMD_WUPA ?
+				(stack_used || incomplete ? STATUS_OK : STATUS_TIMEOUT) :
+				picc_reqa(pdc, &picc);
+		if (more == STATUS_OK || more == STATUS_COLLISION)
+			result = STATUS_NO_ROOM;
+	}
 
-
-	return -1;
+	*picc_count = found;
+	stats->frames = pdc->frame_count - frame_count;
+	if (pdc->get_time_ms)
+		stats->time_ms = pdc->get_time_ms() - begin;
+	return result;
 }
 
-
 /**
  * Transmits a REQuest command, Type A. Invites PICCs in state IDLE to go to READY and prepare for anticollision or selection. 7 bit frame.
  * Beware: When two PICCs are in the field at the same time I often get STATUS_TIMEOUT - probably due do bad antenna design.
@@ -149,7 +334,7 @@ pdc_result_t picc_anticol_iso14443a(bs_pdc_t * pdc, picc_t * picc_array, int *pi
 rc52x_result_t PICC_RequestA(bs_pdc_t *pdc, picc_t *picc) {
 	picc->protocol = picc_protocol_iso14443a;
 	size_t size = sizeof(iso14443a_atqa_t);
-	return PICC_REQA_or_WUPA(pdc, PICC_CMD_REQA, &picc->atqa, &size);
+	return PICC_REQA_or_WUPA(pdc, PICC_CMD_REQA, picc->atqa.as_uint8, &size);
 } // End PICC_RequestA()
 
 /**
@@ -162,7 +347,7 @@ rc52x_result_t PICC_WakeupA(bs_pdc_t *pdc, picc_t *picc) {
 	if (picc->protocol != picc_protocol_iso14443a)
 		return STATUS_INVALID;
 	size_t size = sizeof(iso14443a_atqa_t);
-	return PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, &picc->atqa, &size);
+	return PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, picc->atqa.as_uint8, &size);
 } //  // End PICC_WakeupA()
 
 /**
@@ -181,11 +366,17 @@ rc52x_result_t PICC_REQA_or_WUPA(bs_pdc_t *pdc, uint8_t command, ///< The comman
 	if (bufferATQA == NULL || *bufferSize < 2) { // The ATQA response is 2 bytes long.
 		return STATUS_NO_ROOM;
 	}
+	pdc->picc_epoch++; // Card layers drop their session state
+	status = pdc_set_protocol(pdc, pdc_protocol_iso14443a);
+	if (status)
+		return status;
+	picc_bitrate_106(pdc);
 
 	// Do we need to keep this into the port?
 	//RC52X_ClearRegisterBitMask(rc52x, RC52X_REG_CollReg, 0x80);// ValuesAfterColl=1 => Bits received after collision are cleared.
 
 	validBits = 7;// For REQA and WUPA we need the short frame format - transmit only 7 bits of the last (and only) uint8_t. TxLastBits = BitFramingReg[2..0]
+	pdc_set_timeout(pdc, PDC_TIMEOUT_ACTIVATION_us);
 
 	status = pdc->TransceiveData(pdc, &command, 1, bufferATQA, bufferSize,
 			&validBits, 0, NULL, false, false);
@@ -358,6 +549,7 @@ rc52x_result_t PICC_Select(bs_pdc_t *pdc, picc_t *picc, uint8_t validBits) {
 			rxAlign = 0;
 			uint8_t collisionPos;
 			// Transmit the buffer and receive the response.
+			pdc_set_timeout(pdc, PDC_TIMEOUT_ACTIVATION_us);
 			result = pdc->TransceiveData(pdc, buffer, bufferUsed,
 					responseBuffer, &responseLength, &txLastBits, rxAlign,
 					&collisionPos, sendCRC, false);
@@ -400,18 +592,10 @@ rc52x_result_t PICC_Select(bs_pdc_t *pdc, picc_t *picc, uint8_t validBits) {
 			return STATUS_ERROR;
 		}
 
-		/*
-		 // Verify CRC_A - do our own calculation and store the control in buffer[2..3] - those uint8_ts are not needed anymore.
-		 result = RC52X_CalculateCRC(rc52x, responseBuffer, 1, &buffer[2]);
-		 if (result != STATUS_OK) {
-		 return result;
-		 }
-
-		 if ((buffer[2] != responseBuffer[1])
-		 || (buffer[3] != responseBuffer[2])) {
-		 return STATUS_CRC_WRONG;
-		 }
-		 */
+		// Verify CRC_A
+		if (!iso14443_crc_a_check(responseBuffer, 3)) {
+			return STATUS_CRC_WRONG;
+		}
 
 		if (responseBuffer[0] & 0x04) { // Cascade bit set - UID not complete yes
 			cascadeLevel++;
@@ -439,12 +623,14 @@ rc52x_result_t PICC_HaltA(bs_pdc_t *pdc) {
 	// Build command buffer
 	buffer[0] = PICC_CMD_HLTA;
 	buffer[1] = 0;
+	pdc->picc_epoch++; // Card layers drop their session state
 
 	// Send the command.
 	// The standard says:
 	//		If the PICC responds with any modulation during a period of 1 ms after the end of the frame containing the
 	//		HLTA command, this response shall be interpreted as 'not acknowledge'.
 	// We interpret that this way: Only STATUS_TIMEOUT is a success.
+	pdc_set_timeout(pdc, PDC_TIMEOUT_NAK_us);
 	result = pdc->TransceiveData(pdc, buffer, 2, NULL, NULL, NULL, 0, NULL,
 			true, true);
 
@@ -458,49 +644,33 @@ rc52x_result_t PICC_HaltA(bs_pdc_t *pdc) {
 } // End PICC_HaltA()
 
 int PICC_RATS(bs_pdc_t *pdc, picc_t *picc) {
-	int status;
-	uint8_t buffer[4];
-
-	buffer[0] = PICC_CMD_RATS;
-	buffer[1] = 0x00; // 0x00 = 16 bytes
-
-	size_t backsize = 16;
-	status = pdc->TransceiveData(pdc, buffer, 2, &picc->rats, &backsize, NULL,
-			0, NULL, true, true);
-	if (status)
-		return status;
-
-	picc->iso14443_4_pcb = 2;
-	return status;
-
+	return iso14443_4_rats(pdc, picc);
 }
 
+/**
+ * Sends a short APDU over ISO 14443-4. recv_buffer receives the response
+ * APDU, including the status word, without the block protocol header.
+ * Extended APDUs and streamed responses: see iso7816_4_transceive().
+ */
 int PICC_APDU (bs_pdc_t *pdc, picc_t *picc,
 		uint8_t CLA,uint8_t INS,uint8_t P1,uint8_t P2,uint8_t Lc,uint8_t *Data,uint8_t Le,
 		void* recv_buffer, size_t *recv_size) {
-		uint8_t send_buffer[7 + Lc];
-		int offset = 0;
-		send_buffer[offset++] = picc->iso14443_4_pcb;
-		picc->iso14443_4_pcb ^= 1;
-		send_buffer[offset++] = CLA;
-		send_buffer[offset++] = INS;
-		send_buffer[offset++] = P1;
-		send_buffer[offset++] = P2;
-		if (Lc && Data) {
-			send_buffer[offset++] = Lc;
-
-			memcpy(send_buffer + offset++, Data, Lc);
-		}
-		send_buffer[Lc+offset++] = Le;
-		return pdc->TransceiveData(pdc, send_buffer, offset, recv_buffer, recv_size, NULL,
-					0, NULL, true, true);
-
-
+		uint8_t header[5] = { CLA, INS, P1, P2, Lc };
+		bool has_data = Lc && Data;
+		iso14443_4_segment_t segments[] = {
+				{ header, has_data ? 5 : 4 },
+				{ Data, has_data ? Lc : 0 },
+				{ &Le, 1 },
+		};
+		iso14443_4_buffer_t buffer = { recv_buffer, *recv_size, 0 };
+		int result = iso14443_4_exchange(pdc, picc, segments, 3,
+				iso14443_4_collect, &buffer);
+		*recv_size = buffer.received;
+		return result;
 }
 
 int MIFARE_GET_VERSION(bs_pdc_t *pdc, picc_t *picc) {
 	uint8_t buffer[3];
-	int result;
 	// Build command buffer
 	buffer[0] = 0x60;
 	// Calculate CRC_A
@@ -510,81 +680,55 @@ int MIFARE_GET_VERSION(bs_pdc_t *pdc, picc_t *picc) {
 //	}
 	size_t backsize = 10;
 
+	pdc_set_timeout(pdc, PDC_TIMEOUT_COMMAND_us);
 	return pdc->TransceiveData(pdc, buffer, 1, &picc->version_response,
 			&backsize, NULL, 0, NULL, true, true);
 
 }
 
+/**
+ * GetVersion of a DESFire. The hardware part is stored in
+ * picc->version_response, as GET_VERSION of an NTAG stores it.
+ */
 int DESFIRE_GET_VERSION(bs_pdc_t *pdc, picc_t *picc) {
-	rc52x_result_t result;
-//	size_t backsize = 10;
-////	{
-////		uint8_t buffer[7] = { 0x00, 0xA4, 0x00, 0x00, 0x00, 0x00 };
-////
-////
-////
-////
-////		result = pdc->TransceiveData(pdc, buffer, 6,
-////				&picc->version_response, &backsize, NULL, 0, NULL, true, true);
-////
-////	}
-//
-//	{
-//		uint8_t send_buffer[7] = { 0x02, 0x90, 0x60, 0x00, 0x00, 0x00 };
-//
-//		// ADPU must be prefixed with a 0x02
-//		// This is a "Protocol Control Byte"
-//
-//		// Answer will also be prefixed with 0x02
-//		// and suffixed with a status code 0x91 0xAF
-//
-//		uint8_t response_buffer[20];
-//		backsize = sizeof(response_buffer);
-//
-//		result = pdc->TransceiveData(pdc, send_buffer, 6, response_buffer,
-//				&backsize, NULL, 0, NULL, true, true);
-//		if (0 == result && backsize == 10 && response_buffer[8] == 0x91
-//				&& response_buffer[9] == 0xAF) {
-//			memcpy((&picc->version_response) + 1, response_buffer + 1, 9);
-//
-//			send_buffer[2] = 0xAF;
-//
-//			int countdown = 5;
-//			while (response_buffer[9] == 0xAF && backsize == 10) {
-//
-//				send_buffer[0] ^= 1;
-//				backsize = sizeof(response_buffer);
-//				memset (response_buffer, 0, sizeof(response_buffer));
-//				result = pdc->TransceiveData(pdc, send_buffer, 6,
-//						response_buffer, &backsize, NULL, 0, NULL, true, true);
-//
-//				countdown--;
-//				if (!countdown)
-//					break;
-//			}
-//
-//			if (0 == result && backsize == 10 && response_buffer[8] == 0x91
-//					&& response_buffer[9] == 0x00) {
-//				return 0;
-//			}
-//
-//		}
-//
-//	}
-//
-//	return -1;
-	uint8_t response_buffer[20];
-	size_t response_size  = sizeof(response_buffer);
-	result=PICC_APDU(pdc, picc, 0x90, 0x60, 0x00, 0x00, 0x00,NULL, 0x00,  response_buffer, &response_size);
-	 response_size  = sizeof(response_buffer);
-	 result=PICC_APDU(pdc, picc,0x90, 0xAF, 0x00, 0x00, 0x00,NULL, 0x00,  response_buffer, &response_size);
-	 response_size  = sizeof(response_buffer);
-	 result=PICC_APDU(pdc, picc, 0x90, 0xAF, 0x00, 0x00, 0x00,NULL, 0x00,  response_buffer, &response_size);
-	return result;
-
+	desfire_t desfire;
+	desfire_version_t version;
+	int result = desfire_init(&desfire, pdc, picc);
+	if (!result)
+		result = desfire_get_version(&desfire, &version);
+	if (result)
+		return result;
+	picc->version_response.fixed_header = 0x00;
+	memcpy(&picc->version_response.vendor_id, &version.hardware,
+			sizeof(desfire_version_part_t));
+	return STATUS_OK;
 }
 
 
+// Maps the 4 bit NAK of a MIFARE Ultralight / NTAG to a status
+static int picc_mfu_nak(uint8_t nak) {
+	switch (nak) {
+	case 0x0:
+		// invalid argument
+		return STATUS_INVALID;
+	case 0x1:
+		// crc error
+		return STATUS_CRC_WRONG;
+	case 0x4:
+		// auth error
+		return STATUS_AUTH_ERROR;
+	case 0x5:
+		// eeprom error
+		return STATUS_EEPROM_ERROR;
+	case 0xa:
+		// no error
+		// should not get a status when
+		// the read operation is valid
+	default:
+		return STATUS_ERROR;
+	}
+}
+
 int MIFARE_READ(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data) {
 	uint8_t buffer[4];
 	int result;
@@ -595,37 +739,13 @@ int MIFARE_READ(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data) {
 	size_t backsize = 16;
 	uint8_t validBits = 0;
 
+	pdc_set_timeout(pdc, PDC_TIMEOUT_COMMAND_us);
 	result = pdc->TransceiveData(pdc, buffer, 2, data, &backsize, &validBits, 0,
 			NULL, true, true);
 
 	if (STATUS_OK == result && 1 == backsize && 4 == validBits) {
 		// We've received a status in stead of data
-		switch (*data) {
-		case 0x0:
-			// invalid argument
-			result = STATUS_INVALID;
-			break;
-		case 0x1:
-			// crc error
-			result = STATUS_CRC_WRONG;
-			break;
-		case 0x4:
-			// auth error
-			result = STATUS_AUTH_ERROR;
-			break;
-		case 0x5:
-			// eeprom error
-			result = STATUS_EEPROM_ERROR;
-			break;
-		case 0xa:
-			// no error
-			// should not get a status when
-			// the read operation is valid
-		default:
-			result = STATUS_ERROR;
-			break;
-		}
-		return result;
+		return picc_mfu_nak(*data);
 	}
 	if (backsize != 16) {
 		return STATUS_ERROR;
@@ -634,6 +754,88 @@ int MIFARE_READ(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data) {
 
 }
 
+/**
+ * Whether the PICC supports FAST_READ. Requires the GET_VERSION response:
+ * the NTAG21x and MIFARE Ultralight EV1 support it. The original Ultralight
+ * and Ultralight C do not answer GET_VERSION.
+ */
+bool picc_has_fast_read(picc_t *picc) {
+	if (picc->version_response.vendor_id != 0x04)	// NXP
+		return false;
+	switch (picc->version_response.product_type) {
+	case 0x03:	// MIFARE Ultralight EV1
+	case 0x04:	// NTAG
+		return true;
+	default:
+		return false;
+	}
+}
+
+/**
+ * The number of pages a single read frame returns. For FAST_READ this is
+ * limited by the receive FIFO of the reader IC, READ always returns 4 pages.
+ */
+unsigned int picc_read_pages(bs_pdc_t *pdc, picc_t *picc) {
+	if (!picc_has_fast_read(picc) || pdc->rx_fifo_size < 16)
+		return 4;
+	// The page address is a single byte
+	if (pdc->rx_fifo_size >= 4 * 256)
+		return 256;
+	return pdc->rx_fifo_size / 4;
+}
+
+/**
+ * Reads the pages start up to and including end. Uses FAST_READ, in chunks
+ * that fit the receive FIFO of the reader IC, when the PICC supports it.
+ * Otherwise falls back to READ. See picc_has_fast_read().
+ *
+ * @param[out]	data	4 * (end - start + 1) bytes
+ */
+int picc_fast_read(bs_pdc_t *pdc, picc_t *picc, uint8_t start, uint8_t end,
+		uint8_t *data) {
+	unsigned int chunk = picc_read_pages(pdc, picc);
+	bool fast_read = picc_has_fast_read(picc);
+	unsigned int page = start;
+	uint8_t block[16];
+	int result;
+
+	if (start > end)
+		return STATUS_INVALID;
+
+	pdc_set_timeout(pdc, PDC_TIMEOUT_COMMAND_us);
+	while (page <= end) {
+		unsigned int count = end - page + 1;
+		if (count > chunk)
+			count = chunk;
+
+		if (!fast_read) {
+			result = MIFARE_READ(pdc, picc, page, block);
+			if (result)
+				return result;
+			memcpy(data, block, 4 * count);
+		} else {
+			uint8_t buffer[3];
+			buffer[0] = 0x3A;
+			buffer[1] = page;
+			buffer[2] = page + count - 1;
+
+			size_t backsize = 4 * count;
+			uint8_t validBits = 0;
+			result = pdc->TransceiveData(pdc, buffer, 3, data, &backsize,
+					&validBits, 0, NULL, true, true);
+			if (STATUS_OK == result && 1 == backsize && 4 == validBits)
+				return picc_mfu_nak(*data);
+			if (result)
+				return result;
+			if (backsize != 4 * count)
+				return STATUS_ERROR;
+		}
+		data += 4 * count;
+		page += count;
+	}
+	return STATUS_OK;
+}
+
 int MFU_Write(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data) {
 	uint8_t buffer[8];
 	int result;
@@ -646,6 +848,7 @@ int MFU_Write(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data) {
 	size_t backsize = 1;
 	uint8_t validBits = 0;
 
+	pdc_set_timeout(pdc, PDC_TIMEOUT_EEPROM_us);
 	result = pdc->TransceiveData(pdc, buffer, 6, backBuffer, &backsize,
 			&validBits, 0, NULL, true, false);
 
@@ -9,7 +9,6 @@
 #define BSRFID_CARDS_PICC_H_
 
 #include "iso14443a.h"
-#include "iso14443b.h"
 #include "iso15693.h"
 
 #include "pdc.h"
@@ -22,11 +21,21 @@ typedef enum {
 	picc_protocol_jisx_6319_4,  // eg. FeliCa
 } picc_protocol_t;
 
+// Card types, as identified by picc_identify() following NXP AN10833
 typedef enum {
 	picc_type_unknown = 0x00,
-	picc_type_mfc = 0x01,	// Mifare Classic
+	picc_type_mfc = 0x01,	// Mifare Classic 1K
 	picc_type_mfu = 0x02,	// Mifare UltraLight
-	picc_type_ntag = 0x02,	// NTAG
+	picc_type_ntag = 0x03,	// NTAG21x
+	picc_type_mfc_mini = 0x04,
+	picc_type_mfc_4k = 0x05,
+	picc_type_mfu_c = 0x06,
+	picc_type_mfu_ev1 = 0x07,
+	picc_type_mfp = 0x08,	// Mifare Plus in security level 2 or 3
+	picc_type_desfire = 0x09,
+	picc_type_smartmx = 0x0A,	// SmartMX with Mifare Classic emulation
+	picc_type_iso14443_4 = 0x0B,	// Other ISO 14443-4 PICC, eg. JCOP
+	picc_type_tnp3xxx = 0x0C,
 } picc_type_t;
 
 typedef enum {
@@ -55,10 +64,28 @@ typedef struct {
 			iso14443a_atqa_t atqa;
 			iso14443a_anticol_state_t anticol_state;
 		};
+		struct {
+			uint8_t app_data[4];
+			uint8_t prot_info[3];	// Frame size, FWI, ISO 14443-4 support
+		} atqb;	// ISO 14443-B, the PUPI is the UID
 	};
-	picc_type_t card_type;	//TODO
+	picc_type_t card_type;	// See picc_identify()
 	nfc_type_t nfc_type;
-	uint8_t iso14443_4_pcb;
+	uint8_t iso14443_4_pcb;	// PCB of the next I-block, holds the block number
+	// ISO 14443-4 parameters from the ATS, see iso14443_4.h
+	struct {
+		uint16_t fsc;			// Largest frame the PICC accepts, from FSCI
+		uint16_t fsd;			// Largest frame the PCD accepts, sent in RATS
+		uint32_t fwt_us;		// Frame waiting time, from FWI
+		uint32_t sfgt_us;		// Start-up frame guard time, from SFGI
+		uint8_t ta;				// TA(1), bit rates supported by the PICC
+		uint8_t tc;				// TC(1), NAD and CID support
+		uint8_t dsi;			// Bit rate PICC to PCD agreed by PPS
+		uint8_t dri;			// Bit rate PCD to PICC agreed by PPS
+		unsigned int wtx;		// Waiting time extensions granted
+		unsigned int retransmissions;
+		unsigned int fallbacks;	// Returns to 106 kbps after errors
+	} iso14443_4;
 	//union {
 		struct {
 			uint8_t fixed_header;
@@ -70,12 +97,14 @@ typedef struct {
 			uint8_t storage_size;
 			uint8_t protocol_type;
 		} version_response;
-		uint8_t rats[16];
+		uint8_t rats[32];	// ATS, truncated when longer
 	//};
+	// Pages (Type 2) or blocks (Mifare Classic) of the PICC, zero when the
+	// memory is not organised in pages
 	struct {
-		uint8_t page_count;
+		uint16_t page_count;
 		uint8_t page_size;
-		uint8_t page_offset;
+		uint8_t page_offset;	// First user page or data block
 		// NB... for MFC more is needed as we need to skip pages
 	} memory_stucture;
 	union{
@@ -84,17 +113,46 @@ typedef struct {
 			uint8_t block_address;
 			uint8_t key[6];
 		} mfc_crypto1;
-	}
+	};
 } picc_t;
 
+// Size of the stack of pending branches during the anticollision tree walk.
+// When it overflows, the walk is restarted once the stack is exhausted, the
+// PICCs found so far are halted and will no longer participate.
+#ifndef PICC_ANTICOL_STACK_SIZE
+#define PICC_ANTICOL_STACK_SIZE		(16)
+#endif
+#ifndef PICC_ANTICOL_MAX_ROUNDS
+#define PICC_ANTICOL_MAX_ROUNDS		(8)
+#endif
+
+typedef struct {
+	unsigned int frames;		// Frames sent during the inventory
+	unsigned int collisions;	// Collisions resolved
+	unsigned int restarts;		// Tree walks restarted from the root
+	unsigned int errors;		// Branches abandoned due to errors
+	uint32_t time_ms;			// Duration of the inventory
+} picc_anticol_stats_t;
+
+pdc_result_t picc_reqa(bs_pdc_t *pdc, picc_t *picc);
+pdc_result_t picc_anticol_iso14443a(bs_pdc_t *pdc, picc_t *picc_array,
+		int *picc_count, uint8_t wake, picc_anticol_stats_t *stats);
+
 rc52x_result_t PICC_REQA_or_WUPA(bs_pdc_t *pdc, uint8_t command, ///< The command to send - PICC_CMD_REQA or PICC_CMD_WUPA
 		uint8_t *bufferATQA, ///< The buffer to store the ATQA (Answer to request) in
 		size_t *bufferSize///< Buffer uid_size, at least two bytes. Also number of bytes returned if STATUS_OK.
 		);
 
+int MIFARE_GET_VERSION(bs_pdc_t *pdc, picc_t *picc);
 int MIFARE_READ(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data);
 int MFU_Write(bs_pdc_t *pdc, picc_t *picc, int page, uint8_t *data) ;
 
+bool picc_has_fast_read(picc_t *picc);
+unsigned int picc_read_pages(bs_pdc_t *pdc, picc_t *picc);
+int picc_fast_read(bs_pdc_t *pdc, picc_t *picc, uint8_t start, uint8_t end,
+		uint8_t *data);
+
 rc52x_result_t PICC_RequestA(bs_pdc_t *pdc, picc_t *picc);
 rc52x_result_t PICC_Select(bs_pdc_t *pdc, picc_t *picc, uint8_t validBits);
+rc52x_result_t PICC_HaltA(bs_pdc_t *pdc);
 #endif /* BSRFID_CARDS_PICC_H_ */
@@ -0,0 +1,302 @@
+/*
+ * picc_identify.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include "picc_identify.h"
+
+#include <string.h>
+
+#include "iso14443_4.h"
+#include "iso7816_4.h"
+#include "desfire.h"
+#include "t2t.h"
+
+// Blocks of a Mifare Classic, the manufacturer block excluded
+#define PICC_IDENTIFY_MFC_BLOCK_SIZE	(16)
+#define PICC_IDENTIFY_MFC_DATA_BLOCK	(1)
+
+static void picc_identify_memory(picc_t *picc, uint16_t page_count,
+		uint8_t page_size, uint8_t page_offset) {
+	picc->memory_stucture.page_count = page_count;
+	picc->memory_stucture.page_size = page_size;
+	picc->memory_stucture.page_offset = page_offset;
+}
+
+static void picc_identify_mfc(picc_t *picc, picc_type_t type,
+		nfc_type_t nfc_type, uint16_t blocks) {
+	picc->card_type = type;
+	picc->nfc_type = nfc_type;
+	picc_identify_memory(picc, blocks - PICC_IDENTIFY_MFC_DATA_BLOCK,
+			PICC_IDENTIFY_MFC_BLOCK_SIZE, PICC_IDENTIFY_MFC_DATA_BLOCK);
+}
+
+// Sends a probe with a short timeout. A NAK is returned as STATUS_OK with
+// a 4 bit response.
+static int picc_identify_probe(bs_pdc_t *pdc, uint8_t *send, size_t send_size,
+		uint8_t *recv, size_t *recv_size, uint8_t *valid_bits,
+		picc_identify_stats_t *stats) {
+	*valid_bits = 0;
+	pdc_set_timeout(pdc, PICC_IDENTIFY_PROBE_TIMEOUT_us);
+	int result = pdc->TransceiveData(pdc, send, send_size, recv, recv_size,
+			valid_bits, 0, NULL, true, true);
+	stats->probes++;
+	if (result == STATUS_TIMEOUT)
+		stats->timeouts++;
+	return result;
+}
+
+static bool picc_identify_nak(int result, size_t size, uint8_t valid_bits) {
+	return result == STATUS_OK && size == 1 && valid_bits == 4;
+}
+
+// Wakes a PICC that a probe left in IDLE, and selects it again
+static int picc_identify_reactivate(bs_pdc_t *pdc, picc_t *picc,
+		picc_identify_stats_t *stats) {
+	size_t size = sizeof(picc->atqa);
+	stats->reactivations++;
+	int result = PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, (uint8_t*) &picc->atqa,
+			&size);
+	if (result)
+		return result;
+	return PICC_Select(pdc, picc, 8 * picc->uid_size);
+}
+
+// Pages of user memory of a Type 2 PICC, by the storage size of GET_VERSION
+static uint16_t picc_identify_t2t_pages(uint8_t vendor_id, uint8_t storage) {
+	if (vendor_id == 0x04) {	// NXP
+		switch (storage) {
+		case 0x0B:	// MIFARE Ultralight EV1, MF0UL11
+			return 12;
+		case 0x0E:	// MIFARE Ultralight EV1, MF0UL21
+			return 32;
+		case 0x0F:	// NTAG213
+			return 36;
+		case 0x11:	// NTAG215
+			return 126;
+		case 0x13:	// NTAG216
+			return 222;
+		}
+	}
+	// 2^(n/2) bytes, n odd: between that and the next. The page address is
+	// a single byte.
+	storage >>= 1;
+	if (storage >= 10)
+		return 256 - T2T_DATA_PAGE;
+	return (1 << storage) / T2T_PAGE_SIZE;
+}
+
+static int picc_identify_t2t(bs_pdc_t *pdc, picc_t *picc,
+		picc_identify_stats_t *stats) {
+	uint8_t command[2];
+	uint8_t response[16];
+	size_t size = sizeof(response);
+	uint8_t valid_bits;
+
+	picc->nfc_type = nfc_type_2;
+	command[0] = PICC_CMD_GET_VERSION;
+	int result = picc_identify_probe(pdc, command, 1, response, &size,
+			&valid_bits, stats);
+	if (result == STATUS_OK && size == sizeof(picc->version_response)) {
+		memcpy(&picc->version_response, response, size);
+		if (picc->version_response.vendor_id == 0x04) {
+			switch (picc->version_response.product_type) {
+			case 0x03:
+				picc->card_type = picc_type_mfu_ev1;
+				break;
+			case 0x04:
+				picc->card_type = picc_type_ntag;
+				break;
+			}
+		}
+		picc_identify_memory(picc,
+				picc_identify_t2t_pages(picc->version_response.vendor_id,
+						picc->version_response.storage_size),
+				T2T_PAGE_SIZE, T2T_DATA_PAGE);
+		return STATUS_OK;
+	}
+	if (result != STATUS_TIMEOUT && !picc_identify_nak(result, size, valid_bits))
+		return result ? result : STATUS_ERROR;
+
+	// An Ultralight or Ultralight C, which returned to IDLE. The Ultralight
+	// C answers the first authentication step with ek(RndB).
+	result = picc_identify_reactivate(pdc, picc, stats);
+	if (result)
+		return result;
+	command[0] = PICC_CMD_MFU_C_AUTH;
+	command[1] = 0x00;	// Key number
+	size = sizeof(response);
+	result = picc_identify_probe(pdc, command, 2, response, &size,
+			&valid_bits, stats);
+	if (result == STATUS_OK && size == 9 && response[0] == 0xAF) {
+		picc->card_type = picc_type_mfu_c;
+		picc_identify_memory(picc, 36, T2T_PAGE_SIZE, T2T_DATA_PAGE);
+	} else if (result == STATUS_TIMEOUT
+			|| picc_identify_nak(result, size, valid_bits)) {
+		picc->card_type = picc_type_mfu;
+		picc_identify_memory(picc, 12, T2T_PAGE_SIZE, T2T_DATA_PAGE);
+	} else {
+		return result ? result : STATUS_ERROR;
+	}
+	// Either in IDLE or halfway the authentication
+	return picc_identify_reactivate(pdc, picc, stats);
+}
+
+static int picc_identify_iso14443_4(bs_pdc_t *pdc, picc_t *picc,
+		picc_identify_stats_t *stats) {
+	// The first part of the DESFire GetVersion holds the hardware version,
+	// the other parts are not fetched. Other PICCs reject the class.
+	iso7816_4_command_t command = { .cla = DESFIRE_CLA,
+			.ins = desfire_cmd_get_version, .ne = ISO7816_4_NE_SHORT };
+	iso7816_4_response_t response;
+	uint8_t version[32];
+	iso14443_4_buffer_t buffer = { version, sizeof(version), 0 };
+	int result;
+
+	result = iso14443_4_rats(pdc, picc);
+	if (result)
+		return result;
+	picc->card_type = picc_type_iso14443_4;
+	picc->nfc_type = nfc_type_4;
+
+	stats->probes++;
+	result = iso7816_4_transceive(pdc, picc, &command, iso14443_4_collect,
+			&buffer, &response);
+	if (result)
+		return result;
+	if (response.sw != ISO7816_4_SW_DESFIRE_AF
+			|| buffer.received != sizeof(desfire_version_part_t)
+			|| version[0] != 0x04)	// NXP
+		return STATUS_OK;
+
+	// As DESFIRE_GET_VERSION() stores it
+	picc->version_response.fixed_header = 0x00;
+	memcpy(&picc->version_response.vendor_id, version,
+			sizeof(desfire_version_part_t));
+	switch (picc->version_response.product_type) {
+	case 0x01:	// DESFire EV1, EV2, EV3
+	case 0x08:	// DESFire Light
+		picc->card_type = picc_type_desfire;
+		break;
+	case 0x02:	// Plus EV1, EV2, in security level 3
+		picc->card_type = picc_type_mfp;
+		break;
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Identifies a selected ISO 14443-A PICC: sets picc->card_type,
+ * picc->nfc_type and picc->memory_stucture. For Type 2 and DESFire PICCs,
+ * picc->version_response is filled as well, so picc_fast_read() uses
+ * FAST_READ where supported.
+ *
+ * Call it right after the PICC is selected: an ISO 14443-4 PICC is
+ * activated (RATS), the ISO 14443-4 state of picc left by an earlier
+ * activation is cleared first. The PICC stays selected; the protocol state
+ * is as it was, except for an Ultralight C, whose authentication was
+ * started and aborted.
+ *
+ * @param stats	Frames and time spent, may be NULL
+ * @return STATUS_OK, also when the type is unknown, or the error of a probe
+ * 		   or the reactivation after it.
+ */
+int picc_identify(bs_pdc_t *pdc, picc_t *picc, picc_identify_stats_t *stats) {
+	picc_identify_stats_t local;
+	uint32_t start_ms = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	unsigned int frames = pdc->frame_count;
+	int result = STATUS_OK;
+
+	if (!stats)
+		stats = &local;
+	memset(stats, 0, sizeof(picc_identify_stats_t));
+	if (picc->sak.uid_not_complete)
+		return STATUS_INVALID;
+
+	picc->card_type = picc_type_unknown;
+	picc->nfc_type = nfc_type_none;
+	memset(&picc->memory_stucture, 0, sizeof(picc->memory_stucture));
+	memset(&picc->version_response, 0, sizeof(picc->version_response));
+	memset(&picc->iso14443_4, 0, sizeof(picc->iso14443_4));
+
+	// AN10833, table 5
+	switch (picc->sak.as_uint8) {
+	case 0x00:
+		result = picc_identify_t2t(pdc, picc, stats);
+		break;
+	case 0x01:	// Mifare Classic 1K based
+		picc_identify_mfc(picc, picc_type_tnp3xxx, nfc_type_mfc, 64);
+		break;
+	case 0x08:
+	case 0x88:	// Infineon
+		picc_identify_mfc(picc, picc_type_mfc, nfc_type_mfc, 64);
+		break;
+	case 0x09:
+		picc_identify_mfc(picc, picc_type_mfc_mini, nfc_type_mfc, 20);
+		break;
+	case 0x18:
+		picc_identify_mfc(picc, picc_type_mfc_4k, nfc_type_mfc, 256);
+		break;
+	case 0x10:	// Plus 2K, security level 2
+	case 0x11:	// Plus 4K, security level 2
+		picc->card_type = picc_type_mfp;
+		break;
+	case 0x28:
+		picc_identify_mfc(picc, picc_type_smartmx, nfc_type_4, 64);
+		break;
+	case 0x38:
+		picc_identify_mfc(picc, picc_type_smartmx, nfc_type_4, 256);
+		break;
+	default:
+		if (picc->sak.iso14443_4_compliant)
+			result = picc_identify_iso14443_4(pdc, picc, stats);
+		break;
+	}
+
+	stats->frames = pdc->frame_count - frames;
+	if (pdc->get_time_ms)
+		stats->time_ms = pdc->get_time_ms() - start_ms;
+	return result;
+}
+
+/**
+ * Identifies a selected PICC and reads its user memory right away: the
+ * pages of a Type 2 PICC from memory_stucture.page_offset on, in as few
+ * frames as the PICC and the reader IC allow. The memory of other PICCs
+ * requires keys or an application and is not read.
+ *
+ * @param size	In: size of data, Out: bytes read, 0 when the memory of the
+ * 				PICC is not read
+ * @return STATUS_NO_ROOM when the memory does not fit data
+ */
+int picc_identify_read(bs_pdc_t *pdc, picc_t *picc, uint8_t *data,
+		size_t *size, picc_identify_stats_t *stats) {
+	picc_identify_stats_t local;
+	size_t available = *size;
+
+	if (!stats)
+		stats = &local;
+	*size = 0;
+	int result = picc_identify(pdc, picc, stats);
+	if (result)
+		return result;
+	uint16_t pages = picc->memory_stucture.page_count;
+	if (picc->nfc_type != nfc_type_2 || !pages)
+		return STATUS_OK;
+	if (available < (size_t) pages * T2T_PAGE_SIZE)
+		return STATUS_NO_ROOM;
+
+	uint32_t start_ms = pdc->get_time_ms ? pdc->get_time_ms() : 0;
+	unsigned int frames = pdc->frame_count;
+	uint8_t start = picc->memory_stucture.page_offset;
+	result = picc_fast_read(pdc, picc, start, start + pages - 1, data);
+	stats->frames += pdc->frame_count - frames;
+	if (pdc->get_time_ms)
+		stats->time_ms += pdc->get_time_ms() - start_ms;
+	if (result)
+		return result;
+	*size = stats->bytes_read = (size_t) pages * T2T_PAGE_SIZE;
+	return STATUS_OK;
+}
@@ -0,0 +1,53 @@
+/*
+ * picc_identify.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_PICC_IDENTIFY_H_
+#define BSRFID_CARDS_PICC_IDENTIFY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+
+// Identification of a selected ISO 14443-A PICC, following NXP AN10833.
+//
+// The SAK tells most families apart without a single frame. Only where
+// PICCs share a SAK a probe is sent, the one that is answered by the most
+// common family first:
+// - SAK 00, Type 2: GET_VERSION, answered by NTAG21x and Ultralight EV1.
+//   The original Ultralight and the Ultralight C do not answer; they are
+//   told apart by the first step of the Ultralight C authentication.
+// - SAK 20, ISO 14443-4: RATS and the first part of the DESFire
+//   GetVersion, a single exchange.
+// Probes are sent with a short timeout, the probe a family does not answer
+// costs PICC_IDENTIFY_PROBE_TIMEOUT_us rather than PDC_TIMEOUT_COMMAND_us. A
+// PICC that was left in IDLE by a probe is activated again.
+
+// A PICC answers a probe within a few hundred µs
+#ifndef PICC_IDENTIFY_PROBE_TIMEOUT_us
+#define PICC_IDENTIFY_PROBE_TIMEOUT_us	(1000)
+#endif
+
+#define PICC_CMD_GET_VERSION			(0x60)
+#define PICC_CMD_MFU_C_AUTH				(0x1A)
+
+typedef struct {
+	unsigned int frames;		// Frames sent, including the read
+	unsigned int probes;		// Commands sent to tell PICCs with one SAK apart
+	unsigned int timeouts;		// Probes the PICC did not answer
+	unsigned int reactivations;	// WUPA and SELECT after a probe
+	size_t bytes_read;			// Read by picc_identify_read()
+	uint32_t time_ms;			// Duration, including the read
+} picc_identify_stats_t;
+
+int picc_identify(bs_pdc_t *pdc, picc_t *picc, picc_identify_stats_t *stats);
+int picc_identify_read(bs_pdc_t *pdc, picc_t *picc, uint8_t *data,
+		size_t *size, picc_identify_stats_t *stats);
+
+#endif /* BSRFID_CARDS_PICC_IDENTIFY_H_ */
@@ -0,0 +1,126 @@
+/*
+ * t2t.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include "t2t.h"
+
+#include <string.h>
+
+// Reads the data area until the first needed bytes are in the buffer
+static int t2t_read_until(bs_pdc_t *pdc, picc_t *picc, uint8_t *buffer,
+		size_t size, size_t needed, t2t_ndef_info_t *info) {
+	unsigned int chunk = picc_read_pages(pdc, picc);
+	// Beyond page 255 the page address would wrap to the start of the tag
+	size_t data_size = info->data_size;
+	if (data_size > T2T_MAX_DATA_SIZE)
+		data_size = T2T_MAX_DATA_SIZE;
+	if (needed > info->data_size)
+		needed = info->data_size;
+	if (needed > data_size)
+		return STATUS_INVALID;
+	while (info->read_size < needed) {
+		size_t page = info->read_size / T2T_PAGE_SIZE;
+		size_t pages = (needed - info->read_size + T2T_PAGE_SIZE - 1)
+				/ T2T_PAGE_SIZE;
+		// A READ returns 4 pages anyway
+		if (pages < T2T_READ_SIZE / T2T_PAGE_SIZE)
+			pages = T2T_READ_SIZE / T2T_PAGE_SIZE;
+		if (pages > chunk)
+			pages = chunk;
+		if (pages > data_size / T2T_PAGE_SIZE - page)
+			pages = data_size / T2T_PAGE_SIZE - page;
+		if (pages > (size - info->read_size) / T2T_PAGE_SIZE)
+			pages = (size - info->read_size) / T2T_PAGE_SIZE;
+		if (!pages)
+			return STATUS_NO_ROOM;
+
+		int result = picc_fast_read(pdc, picc, T2T_DATA_PAGE + page,
+				T2T_DATA_PAGE + page + pages - 1,
+				buffer + info->read_size);
+		info->frames++;
+		if (result)
+			return result;
+		info->read_size += pages * T2T_PAGE_SIZE;
+	}
+	return STATUS_OK;
+}
+
+/**
+ * Reads the NDEF message from a Type 2 Tag.
+ *
+ * The capability container is read first, together with the first 12 bytes
+ * of the data area. From there on, only the pages needed to cover the TLV
+ * headers and the NDEF message are read, with FAST_READ when the PICC
+ * supports it. For FAST_READ, call MIFARE_GET_VERSION() or picc_identify()
+ * first. Reading stops once the first NDEF message is complete, or at the
+ * terminator TLV.
+ *
+ * @param[out]	buffer	Receives the data area, starting at page 4
+ * @param[out]	info	The CC, the location of the NDEF message in the
+ * 						buffer and the number of frames used
+ * @return STATUS_OK on success, STATUS_INVALID when the tag is not NDEF
+ * 		   formatted, holds malformed data or the message extends beyond
+ * 		   page 255, STATUS_NO_ROOM when the message does not fit the
+ * 		   buffer, or the error of the READ.
+ */
+int t2t_ndef_read(bs_pdc_t *pdc, picc_t *picc, uint8_t *buffer, size_t size,
+		t2t_ndef_info_t *info) {
+	uint8_t block[T2T_READ_SIZE];
+	int result;
+
+	memset(info, 0, sizeof(t2t_ndef_info_t));
+
+	// Pages 3 to 6: the CC and the start of the data area
+	result = MIFARE_READ(pdc, picc, T2T_CC_PAGE, block);
+	info->frames++;
+	if (result)
+		return result;
+	memcpy(&info->cc, block, sizeof(nfc_cc_t));
+	if (info->cc.magic != NFC_CC_MAGIC)
+		return STATUS_INVALID;
+	info->data_size = info->cc.size * 8;
+
+	info->read_size = T2T_READ_SIZE - T2T_PAGE_SIZE;
+	if (info->read_size > info->data_size)
+		info->read_size = info->data_size;
+	if (info->read_size > size)
+		info->read_size = size - size % T2T_PAGE_SIZE;
+	memcpy(buffer, block + T2T_PAGE_SIZE, info->read_size);
+
+	ndef_parser_t parser;
+	ndef_record_t record;
+	ndef_parser_init(&parser, buffer, info->data_size, true);
+	ndef_parser_feed(&parser, info->read_size);
+
+	for (;;) {
+		switch (ndef_parser_next(&parser, &record)) {
+		case ndef_status_record:
+			if (record.mb)
+				info->message_offset = record.offset;
+			if (record.me) {
+				// The parser moved to the end of the NDEF TLV
+				info->message_size = parser.offset - info->message_offset;
+				return STATUS_OK;
+			}
+			break;
+		case ndef_status_end:
+			return STATUS_OK;
+		case ndef_status_need_more: {
+			// Once the TLV length is known, fetch the whole message at once
+			size_t needed = parser.needed;
+			if (parser.in_message && parser.message_end > needed)
+				needed = parser.message_end;
+			result = t2t_read_until(pdc, picc, buffer, size, needed, info);
+			if (result)
+				return result;
+			ndef_parser_feed(&parser, info->read_size);
+			break;
+		}
+		default:
+			return STATUS_INVALID;
+		}
+	}
+}
@@ -0,0 +1,43 @@
+/*
+ * t2t.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_CARDS_T2T_H_
+#define BSRFID_CARDS_T2T_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+#include "ndef.h"
+
+// NFC Forum Type 2 Tag memory layout, 4 byte pages
+#define T2T_PAGE_SIZE			(4)
+#define T2T_CC_PAGE				(3)
+#define T2T_DATA_PAGE			(4)
+// A READ returns 4 pages
+#define T2T_READ_SIZE			(16)
+// Last page an 8-bit page address reaches. Further pages are in the next
+// sector, behind SECTOR_SELECT, which is not supported.
+#define T2T_LAST_PAGE			(0xFF)
+#define T2T_MAX_DATA_SIZE		\
+	((T2T_LAST_PAGE + 1 - T2T_DATA_PAGE) * T2T_PAGE_SIZE)
+
+typedef struct {
+	nfc_cc_t cc;
+	size_t data_size;		// Size of the data area according to the CC
+	size_t read_size;		// Bytes of the data area read into the buffer
+	size_t message_offset;	// First NDEF message in the buffer
+	size_t message_size;	// 0 when the tag holds no NDEF message
+	unsigned int frames;	// Frames used to read the tag
+} t2t_ndef_info_t;
+
+int t2t_ndef_read(bs_pdc_t *pdc, picc_t *picc, uint8_t *buffer, size_t size,
+		t2t_ndef_info_t *info);
+
+#endif /* BSRFID_CARDS_T2T_H_ */
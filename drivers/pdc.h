@@ -35,6 +35,9 @@
 
 typedef int(*delay_ms_f)(int ms);
 typedef int(*get_time_ms_f)(void);
+// Sleeps until the IRQ pin of the reader IC becomes active or the timeout
+// expires. Returns 0 when the IRQ pin was activated.
+typedef int(*wait_irq_f)(void *pdc, int timeout_ms);
 
 
 
@@ -51,6 +54,7 @@ typedef enum {
 	STATUS_MIFARE_NACK		= -9,		// A MIFARE PICC responded with NAK.
 	STATUS_AUTH_ERROR		= -10,
 	STATUS_EEPROM_ERROR		= -11,
+	STATUS_BUSY				= -12,	// The operation is still in progress
 } pdc_result_t;
 typedef pdc_result_t rc52x_result_t;
 
@@ -58,20 +62,176 @@ typedef pdc_result_t rc52x_result_t;
 
 
 
+// Exchanges a frame with the PICC.
+// validBits	In: valid bits in the last byte sent, Out: valid bits in the last
+// 				byte received. 0 means all 8 bits are valid.
+// rxAlign		Bit position in backData[0] where the first received bit is
+// 				stored. Used by the anticollision to continue a partial byte.
+// collisionPos	On STATUS_COLLISION: 1-based position of the first colliding
+// 				bit, counted from bit 0 of backData[0], thus including the
+// 				rxAlign bits. 0 or > 40 when the position is not known.
+// sendCRC		The CRC of the protocol loaded, CRC_A for ISO 14443-A and CRC_B
+// recvCRC		for ISO 14443-B and ISO 15693, is appended, or checked and removed.
+// For ISO 15693, a frame without data (sendLen 0) is an EOF only: the slot
+// marker that moves the 16 slot inventory to its next slot.
 typedef int (*TransceiveData_f)(void *pdc, void *sendData, size_t sendLen,
 		void *backData, size_t *backLen, uint8_t *validBits,
 		uint8_t rxAlign, uint8_t *collisionPos, bool sendCRC, bool recvCRC);
 
+// Split phase TransceiveData. TransceiveStart loads the frame and starts the
+// transmission without waiting for the answer. TransceivePoll returns
+// STATUS_BUSY while the frame is in progress, and then the result with the
+// same semantics as TransceiveData. This allows to drive several readers
+// from one thread, while one waits for its PICC, the bus serves another.
+typedef int (*TransceiveStart_f)(void *pdc, void *sendData, size_t sendLen,
+		uint8_t validBits, uint8_t rxAlign, bool sendCRC, bool recvCRC);
+typedef int (*TransceivePoll_f)(void *pdc, void *backData, size_t *backLen,
+		uint8_t *validBits, uint8_t *collisionPos);
+
 typedef int (*SetBitFraming_f)(void *pdc, int rxAlign, int txLastBits);
 
+// Enables or disables the parity of the reader IC. When disabled, the parity
+// bits are sent and received as data bits, every byte is followed by its
+// parity bit. Used for the encrypted frames of the software Crypto1.
+typedef int (*SetParity_f)(void *pdc, bool enable);
+
+// MIFARE Classic authentication by the Crypto1 unit of the reader IC. picc
+// is a picc_t with mfc_crypto1 filled in. Once authenticated, the frames
+// exchanged by TransceiveData are encrypted by the reader IC.
+typedef int (*Crypto1Begin_f)(void *pdc, void *picc);
+typedef int (*Crypto1End_f)(void *pdc);
+
+// Sets how long the PCD waits for the answer of the PICC, counted from the
+// end of the transmission. 0 restores the default of the driver. The
+// value stays in effect for the following frames.
+typedef int (*SetTimeout_f)(void *pdc, uint32_t timeout_us);
+
+// Timeout profiles, in µs. The card layers program the profile of a command
+// with pdc_set_timeout() before sending it, the driver only writes the
+// timer registers when the profile changes. The timer of the reader IC
+// stops when the answer begins, a profile only has to cover the delay of
+// the PICC, not the length of the answer.
+// REQA, WUPA, anticollision and SELECT: the PICC answers after 1236/fc, 91 µs
+#define PDC_TIMEOUT_ACTIVATION_us	(500)
+// Commands a PICC only answers with a NAK, eg. HLTA: an answer within 1 ms
+// is a NAK
+#define PDC_TIMEOUT_NAK_us			(1000)
+// READ, GET_VERSION and other commands that do not write
+#define PDC_TIMEOUT_COMMAND_us		(5000)
+// WRITE, TRANSFER: the PICC answers once the EEPROM is programmed
+#define PDC_TIMEOUT_EEPROM_us		(10000)
+
+// Bit rates of ISO 14443, as the DSI/DRI values of PPS
+typedef enum {
+	pdc_bitrate_106 = 0,	// fc/128
+	pdc_bitrate_212 = 1,
+	pdc_bitrate_424 = 2,
+	pdc_bitrate_848 = 3,
+} pdc_bitrate_t;
+
+// Sets the bit rate of the transmission (PCD to PICC) and the reception
+// (PICC to PCD), once agreed with the PICC by PPS.
+typedef int (*SetBitRate_f)(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx);
+
+// Protocols of the field
+typedef enum {
+	pdc_protocol_iso14443a = 0,
+	pdc_protocol_iso15693 = 1,
+	pdc_protocol_iso14443b = 2,
+} pdc_protocol_t;
+
+// Loads the modulation, bit rate and CRC of a protocol into the reader IC.
+// The field stays on, the PICCs of other protocols keep their state.
+typedef int (*SetProtocol_f)(void *pdc, pdc_protocol_t protocol);
+
+// Switches the RF field on or off. Switching it off resets the PICCs in the
+// field.
+typedef int (*SetField_f)(void *pdc, bool on);
+
+// Low-power card detection. The field is switched on for a short
+// measurement only. A PICC entering the field detunes the antenna, which
+// moves the measured channels away from their value without PICC, eg. the
+// I and Q channel of the CLRC663. A driver without such a measurement
+// tells presence by a WUPA instead, it measures no channels.
+#define PDC_LPCD_CHANNELS		(2)
+typedef struct {
+	uint8_t channel[PDC_LPCD_CHANNELS];
+	uint8_t channels;		// Channels measured, 0 when only present is known
+	bool present;			// A PICC answered, drivers without channels
+	uint32_t rf_on_us;		// Time the field was on for the measurement
+} pdc_lpcd_sample_t;
+
+// One measurement, started and awaited by the host. The field is off
+// before and after.
+typedef int (*LpcdMeasure_f)(void *pdc, pdc_lpcd_sample_t *sample);
+// Autonomous detection: the reader IC sleeps and repeats the measurement
+// every period_ms without the host, until a channel leaves min..max. It
+// then raises its IRQ pin, see wait_irq. LpcdStop returns the reader IC to
+// normal operation and the last measurement in sample.
+typedef int (*LpcdStart_f)(void *pdc, const uint8_t *min, const uint8_t *max,
+		uint32_t period_ms);
+typedef int (*LpcdStop_f)(void *pdc, pdc_lpcd_sample_t *sample);
+
+// Shadow copy of the registers of the reader IC. Registers that are only
+// written by the host are served from this copy, so masked updates no
+// longer need to read the register from the chip, and writes that do not
+// change the value are skipped. Assign one to bs_pdc_t.reg_cache to enable.
+typedef struct {
+	uint8_t value[128];
+	uint32_t valid[4];
+	bool verify;			// Debug: compare cached values against the chip
+	unsigned int mismatch_count;
+} bs_pdc_reg_cache_t;
+
 typedef struct {
 	bshal_transport_type_t transport_type;
 	bshal_transport_instance_t transport_instance;
 	delay_ms_f delay_ms;
 	get_time_ms_f get_time_ms;
+	wait_irq_f wait_irq;	// Optional, when NULL the driver will poll
+	uint8_t busy_pin;		// PN5180: the BUSY line, read by bshal_gpio_read_pin
 	TransceiveData_f TransceiveData;
+	TransceiveStart_f TransceiveStart;	// Optional, split phase TransceiveData
+	TransceivePoll_f TransceivePoll;
+	SetParity_f SetParity;				// Optional
+	Crypto1Begin_f Crypto1Begin;		// Optional, NULL without Crypto1 unit
+	Crypto1End_f Crypto1End;
+	SetTimeout_f SetTimeout;			// Optional
+	uint32_t timeout_us;	// Set by SetTimeout, 0 for the driver default
+	SetBitRate_f SetBitRate;			// Optional
+	uint8_t bitrates;		// Supported by SetBitRate, bit (1 << pdc_bitrate_t)
+	pdc_bitrate_t tx_bitrate;	// Set by SetBitRate, 106 kbps after init
+	pdc_bitrate_t rx_bitrate;
+	SetField_f SetField;				// Optional
+	SetProtocol_f SetProtocol;			// Optional, ISO 14443-A only when NULL
+	uint8_t protocols;		// Supported by SetProtocol, bit (1 << pdc_protocol_t)
+	pdc_protocol_t protocol;	// Set by SetProtocol, ISO 14443-A after init
+	LpcdMeasure_f LpcdMeasure;			// Optional, see pdc_lpcd.h
+	LpcdStart_f LpcdStart;				// Optional, requires wait_irq
+	LpcdStop_f LpcdStop;
+	size_t rx_fifo_size;	// Largest frame the reader IC can receive, 0 if unknown
+	bs_pdc_reg_cache_t *reg_cache;
+	unsigned int frame_count;	// Number of frames sent by TransceiveData
+	unsigned int picc_epoch;	// Changed when PICC state is lost: REQA, WUPA,
+								// HLTA, field off and LPCD
 } bs_pdc_t;
 
+// Programs the timeout for the next frames, when it differs from the
+// current one
+static inline void pdc_set_timeout(bs_pdc_t *pdc, uint32_t timeout_us) {
+	if (pdc->SetTimeout && pdc->timeout_us != timeout_us)
+		pdc->SetTimeout(pdc, timeout_us);
+}
+
+// Loads a protocol, when it differs from the current one
+static inline int pdc_set_protocol(bs_pdc_t *pdc, pdc_protocol_t protocol) {
+	if (pdc->protocol == protocol)
+		return STATUS_OK;
+	if (!pdc->SetProtocol || !(pdc->protocols & (1 << protocol)))
+		return STATUS_INVALID;
+	return pdc->SetProtocol(pdc, protocol);
+}
+
 
 
 
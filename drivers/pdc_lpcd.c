@@ -0,0 +1,299 @@
+/******************************************************************************
+ File:         pdc_lpcd.c
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements low-power card detection.
+ See pdc_lpcd.h for a description.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "pdc_lpcd.h"
+
+int pdc_lpcd_init(pdc_lpcd_t *lpcd, bs_pdc_t *pdc, uint32_t period_ms,
+		pdc_lpcd_wake_f wake, void *context) {
+	memset(lpcd, 0, sizeof(pdc_lpcd_t));
+	lpcd->pdc = pdc;
+	lpcd->period_ms = period_ms ? period_ms : PDC_LPCD_PERIOD_ms;
+	lpcd->wake = wake;
+	lpcd->context = context;
+	lpcd->threshold = lpcd->threshold_min = PDC_LPCD_THRESHOLD_MIN;
+	if (!pdc->LpcdMeasure || !pdc->get_time_ms || !pdc->delay_ms)
+		return STATUS_INVALID;
+	lpcd->autonomous = pdc->LpcdStart && pdc->LpcdStop && pdc->wait_irq;
+	return STATUS_OK;
+}
+
+/**
+ * Measures the channels in an empty field: the mean becomes the reference,
+ * the threshold is set above the noise seen.
+ *
+ * @return STATUS_ERROR when a driver without channels found a PICC, the
+ * 		   field must be empty
+ */
+int pdc_lpcd_calibrate(pdc_lpcd_t *lpcd) {
+	bs_pdc_t *pdc = lpcd->pdc;
+	pdc_lpcd_sample_t sample;
+	unsigned int sum[PDC_LPCD_CHANNELS] = { 0 };
+	uint8_t min[PDC_LPCD_CHANNELS], max[PDC_LPCD_CHANNELS];
+	uint8_t noise = 0;
+
+	lpcd->calibrated = false;
+	if (pdc->SetField)
+		pdc->SetField(pdc, false);
+	for (int n = 0; n < PDC_LPCD_CALIBRATION_SAMPLES; n++) {
+		int result = pdc->LpcdMeasure(pdc, &sample);
+		if (result)
+			return result;
+		lpcd->stats.rf_on_us += sample.rf_on_us;
+		if (!sample.channels && sample.present)
+			return STATUS_ERROR;
+		lpcd->channels = sample.channels;
+		for (int c = 0; c < sample.channels; c++) {
+			sum[c] += sample.channel[c];
+			if (!n || sample.channel[c] < min[c])
+				min[c] = sample.channel[c];
+			if (!n || sample.channel[c] > max[c])
+				max[c] = sample.channel[c];
+		}
+	}
+
+	for (int c = 0; c < lpcd->channels; c++) {
+		lpcd->reference[c] = (sum[c] + PDC_LPCD_CALIBRATION_SAMPLES / 2)
+				/ PDC_LPCD_CALIBRATION_SAMPLES;
+		if (max[c] - min[c] > noise)
+			noise = max[c] - min[c];
+	}
+	lpcd->threshold_min = noise + PDC_LPCD_MARGIN;
+	if (lpcd->threshold_min < PDC_LPCD_THRESHOLD_MIN)
+		lpcd->threshold_min = PDC_LPCD_THRESHOLD_MIN;
+	if (lpcd->threshold_min > PDC_LPCD_THRESHOLD_MAX)
+		lpcd->threshold_min = PDC_LPCD_THRESHOLD_MAX;
+	lpcd->threshold = lpcd->threshold_min;
+	lpcd->quiet = 0;
+	lpcd->calibrated = true;
+	return STATUS_OK;
+}
+
+static bool pdc_lpcd_changed(pdc_lpcd_t *lpcd, pdc_lpcd_sample_t *sample) {
+	if (!sample->channels)
+		return sample->present;
+	for (int c = 0; c < sample->channels; c++)
+		if (abs(sample->channel[c] - lpcd->reference[c]) >= lpcd->threshold)
+			return true;
+	return false;
+}
+
+// A measurement without change: the reference follows drift that is well
+// within the threshold, and the threshold relaxes after a quiet period
+static void pdc_lpcd_quiet(pdc_lpcd_t *lpcd, pdc_lpcd_sample_t *sample) {
+	for (int c = 0; c < sample->channels; c++) {
+		int diff = sample->channel[c] - lpcd->reference[c];
+		if (2 * abs(diff) > lpcd->threshold)
+			lpcd->reference[c] += diff > 0 ? 1 : -1;
+	}
+	if (++lpcd->quiet >= PDC_LPCD_RELAX_CYCLES) {
+		lpcd->quiet = 0;
+		if (lpcd->threshold > lpcd->threshold_min) {
+			lpcd->threshold--;
+			lpcd->stats.retunes++;
+		}
+	}
+	lpcd->empty_ms = lpcd->pdc->get_time_ms();
+}
+
+/**
+ * A single measurement, started by the host.
+ *
+ * @param detected	Set when the channels changed, or a PICC answered
+ */
+int pdc_lpcd_detect(pdc_lpcd_t *lpcd, bool *detected) {
+	pdc_lpcd_sample_t sample;
+
+	*detected = false;
+	if (!lpcd->calibrated)
+		return STATUS_INVALID;
+	int result = lpcd->pdc->LpcdMeasure(lpcd->pdc, &sample);
+	if (result)
+		return result;
+	lpcd->stats.cycles++;
+	lpcd->stats.rf_on_us += sample.rf_on_us;
+	*detected = pdc_lpcd_changed(lpcd, &sample);
+	if (!*detected)
+		pdc_lpcd_quiet(lpcd, &sample);
+	return STATUS_OK;
+}
+
+// Lets the reader IC measure until a channel leaves the window around the
+// reference, or the timeout expires
+static int pdc_lpcd_sleep(pdc_lpcd_t *lpcd, uint32_t timeout_ms,
+		bool *detected) {
+	bs_pdc_t *pdc = lpcd->pdc;
+	pdc_lpcd_sample_t sample;
+	uint8_t min[PDC_LPCD_CHANNELS], max[PDC_LPCD_CHANNELS];
+
+	for (int c = 0; c < PDC_LPCD_CHANNELS; c++) {
+		int value = lpcd->reference[c] - lpcd->threshold + 1;
+		min[c] = value < 0 ? 0 : value;
+		value = lpcd->reference[c] + lpcd->threshold - 1;
+		max[c] = value > 0xFF ? 0xFF : value;
+	}
+
+	uint32_t begin = pdc->get_time_ms();
+	int result = pdc->LpcdStart(pdc, min, max, lpcd->period_ms);
+	if (result)
+		return result;
+	pdc->wait_irq(pdc, timeout_ms);
+	result = pdc->LpcdStop(pdc, &sample);
+	if (result)
+		return result;
+
+	uint32_t cycles = (pdc->get_time_ms() - begin) / lpcd->period_ms;
+	if (!cycles)
+		cycles = 1;
+	lpcd->stats.cycles += cycles;
+	lpcd->stats.rf_on_us += (uint64_t) cycles * sample.rf_on_us;
+	*detected = pdc_lpcd_changed(lpcd, &sample);
+	if (!*detected) {
+		pdc_lpcd_quiet(lpcd, &sample);
+	} else {
+		// The measurement before this one was empty
+		uint32_t empty_ms = pdc->get_time_ms() - lpcd->period_ms;
+		if ((int32_t) (empty_ms - lpcd->empty_ms) > 0)
+			lpcd->empty_ms = empty_ms;
+	}
+	return STATUS_OK;
+}
+
+// Switches the field on and selects the PICC that caused the wake
+static int pdc_lpcd_activate(pdc_lpcd_t *lpcd, picc_t *picc) {
+	bs_pdc_t *pdc = lpcd->pdc;
+	uint32_t begin = pdc->get_time_ms();
+
+	lpcd->stats.wakes++;
+	if (pdc->SetField)
+		pdc->SetField(pdc, true);
+	pdc->delay_ms(PDC_LPCD_GUARD_ms);
+	memset(picc, 0, sizeof(picc_t));
+	int result = picc_reqa(pdc, picc);
+	if (!result)
+		result = PICC_Select(pdc, picc, 0);
+	uint32_t now = pdc->get_time_ms();
+	lpcd->stats.rf_on_us += 1000 * (now - begin);
+
+	if (result) {
+		// Nothing there: less sensitive from now on
+		lpcd->stats.false_wakes++;
+		if (pdc->SetField)
+			pdc->SetField(pdc, false);
+		if (lpcd->channels && lpcd->threshold < PDC_LPCD_THRESHOLD_MAX) {
+			lpcd->threshold++;
+			lpcd->stats.retunes++;
+		}
+		lpcd->quiet = 0;
+		lpcd->empty_ms = now;
+		return result;
+	}
+
+	lpcd->stats.cards++;
+	lpcd->stats.latency_ms = now - lpcd->empty_ms;
+	lpcd->stats.latency_total_ms += lpcd->stats.latency_ms;
+	if (lpcd->stats.latency_ms > lpcd->stats.latency_max_ms)
+		lpcd->stats.latency_max_ms = lpcd->stats.latency_ms;
+	if (lpcd->wake)
+		lpcd->wake(lpcd->context, pdc, picc);
+	return STATUS_OK;
+}
+
+/**
+ * Switches the field off and measures every period_ms until a PICC is
+ * detected and selected, it is then passed to the wake callback. The field
+ * stays on for the application, calling this again switches it off.
+ *
+ * @param picc	The selected PICC
+ * @return STATUS_TIMEOUT when no PICC was selected within timeout_ms
+ */
+int pdc_lpcd_wait(pdc_lpcd_t *lpcd, picc_t *picc, uint32_t timeout_ms) {
+	bs_pdc_t *pdc = lpcd->pdc;
+	uint32_t begin = pdc->get_time_ms();
+	uint32_t elapsed = 0;
+	int result = STATUS_TIMEOUT;
+
+	if (!lpcd->calibrated)
+		return STATUS_INVALID;
+	if (pdc->SetField)
+		pdc->SetField(pdc, false);
+	lpcd->empty_ms = begin;
+
+	while (elapsed < timeout_ms) {
+		uint32_t cycle_ms = pdc->get_time_ms();
+		bool detected;
+		int error;
+
+		if (lpcd->autonomous)
+			error = pdc_lpcd_sleep(lpcd, timeout_ms - elapsed, &detected);
+		else
+			error = pdc_lpcd_detect(lpcd, &detected);
+		if (error) {
+			result = error;
+			break;
+		}
+		if (detected && !pdc_lpcd_activate(lpcd, picc)) {
+			result = STATUS_OK;
+			break;
+		}
+
+		elapsed = pdc->get_time_ms() - begin;
+		if (!lpcd->autonomous && elapsed < timeout_ms) {
+			// From the start of one measurement to the next
+			uint32_t wait = cycle_ms + lpcd->period_ms - pdc->get_time_ms();
+			if ((int32_t) wait > 0) {
+				if (wait > timeout_ms - elapsed)
+					wait = timeout_ms - elapsed;
+				pdc->delay_ms(wait);
+			}
+			elapsed = pdc->get_time_ms() - begin;
+		}
+	}
+	lpcd->stats.elapsed_ms += pdc->get_time_ms() - begin;
+	return result;
+}
+
+// Share of the time the field was on, in parts per million
+unsigned int pdc_lpcd_duty_cycle_ppm(const pdc_lpcd_t *lpcd) {
+	if (!lpcd->stats.elapsed_ms)
+		return 0;
+	return lpcd->stats.rf_on_us * 1000 / lpcd->stats.elapsed_ms;
+}
+
+uint32_t pdc_lpcd_latency_avg_ms(const pdc_lpcd_t *lpcd) {
+	if (!lpcd->stats.cards)
+		return 0;
+	return lpcd->stats.latency_total_ms / lpcd->stats.cards;
+}
@@ -0,0 +1,119 @@
+/******************************************************************************
+ File:         pdc_lpcd.h
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements low-power card detection on top of the LPCD hooks of the
+ drivers.
+
+ Rather than keeping the field on and sending REQA continuously, the field
+ is off and only switched on for a short measurement every period_ms. A
+ PICC that enters the field detunes the antenna, the measured channels
+ move away from the reference taken by pdc_lpcd_calibrate() in an empty
+ field. Once a channel moved by threshold or more, the field is switched
+ on and the normal REQA and anticollision path selects the PICC, which is
+ passed to the wake callback.
+
+ * The CLRC663 measures its I and Q channel. With a wait_irq hook it does
+   so autonomously in standby, the host sleeps until the IRQ pin signals a
+   change. Otherwise the host starts every measurement.
+ * The MFRC522 cannot measure its antenna, it sends a WUPA in a short pulse
+   of the field instead. No threshold applies.
+
+ The threshold is tuned while running: a wake without a PICC answering
+ raises it by one, after PDC_LPCD_RELAX_CYCLES quiet measurements it is
+ lowered again, down to the value found by the calibration. The reference
+ follows slow drift of the channels, eg. by temperature.
+
+ The statistics give the time the field was on, the duty cycle, and the
+ latency from the last empty measurement to the selection of a PICC, so
+ the period can be chosen between battery life and tap latency.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#ifndef BSRFID_DRIVERS_PDC_LPCD_H_
+#define BSRFID_DRIVERS_PDC_LPCD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+
+#ifndef PDC_LPCD_PERIOD_ms
+#define PDC_LPCD_PERIOD_ms				(250)
+#endif
+#define PDC_LPCD_CALIBRATION_SAMPLES	(8)
+// The threshold is at least the noise seen by the calibration plus the
+// margin, and never below the minimum
+#define PDC_LPCD_MARGIN					(1)
+#define PDC_LPCD_THRESHOLD_MIN			(2)
+#define PDC_LPCD_THRESHOLD_MAX			(16)
+#define PDC_LPCD_RELAX_CYCLES			(1000)
+// Field on to REQA after a wake, ISO 14443-3
+#define PDC_LPCD_GUARD_ms				(5)
+
+typedef void (*pdc_lpcd_wake_f)(void *context, bs_pdc_t *pdc, picc_t *picc);
+
+typedef struct {
+	unsigned int cycles;		// Measurements
+	unsigned int wakes;			// Measurements that detected a change
+	unsigned int false_wakes;	// Wakes without a PICC answering
+	unsigned int cards;			// PICCs selected after a wake
+	unsigned int retunes;		// Threshold changes by the auto-tuning
+	uint64_t rf_on_us;			// Field on, measurements and activations
+	uint32_t elapsed_ms;		// Time spent in pdc_lpcd_wait()
+	uint32_t latency_ms;		// Last empty measurement to selected PICC
+	uint32_t latency_max_ms;
+	uint64_t latency_total_ms;
+} pdc_lpcd_stats_t;
+
+typedef struct {
+	bs_pdc_t *pdc;
+	uint32_t period_ms;
+	bool autonomous;			// Use LpcdStart when the driver has it
+	uint8_t channels;			// Measured by the driver, 0 for presence only
+	uint8_t reference[PDC_LPCD_CHANNELS];	// Channels in an empty field
+	uint8_t threshold;			// Change of a channel that wakes
+	uint8_t threshold_min;		// Found by the calibration
+	bool calibrated;
+	unsigned int quiet;			// Measurements since the last retune
+	uint32_t empty_ms;			// Time of the last empty measurement
+
+	pdc_lpcd_wake_f wake;
+	void *context;
+	pdc_lpcd_stats_t stats;
+} pdc_lpcd_t;
+
+int pdc_lpcd_init(pdc_lpcd_t *lpcd, bs_pdc_t *pdc, uint32_t period_ms,
+		pdc_lpcd_wake_f wake, void *context);
+int pdc_lpcd_calibrate(pdc_lpcd_t *lpcd);
+int pdc_lpcd_detect(pdc_lpcd_t *lpcd, bool *detected);
+int pdc_lpcd_wait(pdc_lpcd_t *lpcd, picc_t *picc, uint32_t timeout_ms);
+
+unsigned int pdc_lpcd_duty_cycle_ppm(const pdc_lpcd_t *lpcd);
+uint32_t pdc_lpcd_latency_avg_ms(const pdc_lpcd_t *lpcd);
+
+#endif /* BSRFID_DRIVERS_PDC_LPCD_H_ */
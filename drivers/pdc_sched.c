@@ -0,0 +1,426 @@
+/******************************************************************************
+ File:         pdc_sched.c
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements a poll scheduler for multiple readers.
+ See pdc_sched.h for a description.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifdef PDC_SCHED_PTHREAD
+#include <sched.h>
+#endif
+
+#include "pdc_sched.h"
+#include "iso14443_crc.h"
+
+void pdc_sched_init(pdc_sched_t *sched, pdc_sched_bus_t *buses,
+		size_t bus_count, pdc_sched_event_f event, void *context) {
+	memset(sched, 0, sizeof(pdc_sched_t));
+	sched->buses = buses;
+	sched->bus_count = bus_count;
+	sched->event = event;
+	sched->context = context;
+	sched->absent_polls = PDC_SCHED_ABSENT_POLLS;
+	for (size_t i = 0; i < bus_count; i++)
+		buses[i].sched = sched;
+}
+
+void pdc_sched_bus_init(pdc_sched_bus_t *bus, pdc_sched_reader_t *readers,
+		size_t reader_count) {
+	memset(bus, 0, sizeof(pdc_sched_bus_t));
+	bus->readers = readers;
+	bus->reader_count = reader_count;
+}
+
+void pdc_sched_reader_init(pdc_sched_reader_t *reader, bs_pdc_t *pdc, int id) {
+	memset(reader, 0, sizeof(pdc_sched_reader_t));
+	reader->pdc = pdc;
+	reader->id = id;
+	reader->state = pdc_sched_state_wait;
+}
+
+//------------------------------------------------------------------------------
+// Frames
+//------------------------------------------------------------------------------
+
+static bool pdc_sched_split_phase(bs_pdc_t *pdc) {
+	return pdc->TransceiveStart && pdc->TransceivePoll;
+}
+
+static int pdc_sched_frame_start(pdc_sched_reader_t *reader, uint8_t *data,
+		size_t size, uint8_t valid_bits, bool send_crc) {
+	bs_pdc_t *pdc = reader->pdc;
+	reader->frame_start_ms = pdc->get_time_ms();
+	reader->stats.frames++;
+	if (pdc_sched_split_phase(pdc))
+		return pdc->TransceiveStart(pdc, data, size, valid_bits, 0, send_crc,
+				false);
+
+	// Without split phase support, the frame completes right here
+	reader->fallback_size = sizeof(reader->fallback_data);
+	reader->fallback_valid_bits = valid_bits;
+	reader->fallback_result = pdc->TransceiveData(pdc, data, size,
+			reader->fallback_data, &reader->fallback_size,
+			&reader->fallback_valid_bits, 0, NULL, send_crc, false);
+	return STATUS_OK;
+}
+
+static int pdc_sched_frame_poll(pdc_sched_reader_t *reader, uint8_t *data,
+		size_t *size, uint8_t *valid_bits) {
+	bs_pdc_t *pdc = reader->pdc;
+	if (!pdc_sched_split_phase(pdc)) {
+		if (reader->fallback_size > *size)
+			return STATUS_NO_ROOM;
+		memcpy(data, reader->fallback_data, reader->fallback_size);
+		*size = reader->fallback_size;
+		*valid_bits = reader->fallback_valid_bits;
+		return reader->fallback_result;
+	}
+
+	int result = pdc->TransceivePoll(pdc, data, size, valid_bits, NULL);
+	if (result == STATUS_BUSY
+			&& (uint32_t) (pdc->get_time_ms() - reader->frame_start_ms)
+					> PDC_SCHED_FRAME_TIMEOUT_ms)
+		return STATUS_TIMEOUT;
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// Card tracking
+//------------------------------------------------------------------------------
+
+static bool pdc_sched_same_picc(const picc_t *a, const picc_t *b) {
+	return a->uid_size == b->uid_size && !memcmp(a->uid, b->uid, a->uid_size);
+}
+
+static void pdc_sched_track(pdc_sched_t *sched, pdc_sched_reader_t *reader) {
+	for (int i = reader->picc_count - 1; i >= 0; i--) {
+		bool seen = false;
+		for (int j = 0; j < reader->found_count && !seen; j++)
+			seen = pdc_sched_same_picc(reader->piccs + i, reader->found + j);
+		if (seen) {
+			reader->missed[i] = 0;
+			continue;
+		}
+		if (++reader->missed[i] < sched->absent_polls)
+			continue;
+		reader->stats.left++;
+		if (sched->event)
+			sched->event(sched->context, reader->id, pdc_sched_event_left,
+					reader->piccs + i);
+		reader->picc_count--;
+		reader->piccs[i] = reader->piccs[reader->picc_count];
+		reader->missed[i] = reader->missed[reader->picc_count];
+	}
+
+	for (int j = 0; j < reader->found_count; j++) {
+		bool known = false;
+		for (int i = 0; i < reader->picc_count && !known; i++)
+			known = pdc_sched_same_picc(reader->piccs + i, reader->found + j);
+		if (known || reader->picc_count >= PDC_SCHED_MAX_PICCS)
+			continue;
+		reader->piccs[reader->picc_count] = reader->found[j];
+		reader->missed[reader->picc_count] = 0;
+		reader->picc_count++;
+		reader->stats.arrived++;
+		if (sched->event)
+			sched->event(sched->context, reader->id, pdc_sched_event_arrived,
+					reader->found + j);
+	}
+}
+
+static void pdc_sched_poll_done(pdc_sched_t *sched,
+		pdc_sched_reader_t *reader) {
+	uint32_t now = reader->pdc->get_time_ms();
+	uint32_t latency = now - reader->poll_start_ms;
+	if (latency >= PDC_SCHED_LATENCY_BUCKETS)
+		latency = PDC_SCHED_LATENCY_BUCKETS - 1;
+	reader->stats.latency[latency]++;
+	reader->stats.polls++;
+	reader->stats.last_ms = now;
+	reader->state = pdc_sched_state_wait;
+	pdc_sched_track(sched, reader);
+}
+
+//------------------------------------------------------------------------------
+// Poll state machine
+//------------------------------------------------------------------------------
+
+static void pdc_sched_frame(pdc_sched_t *sched, pdc_sched_reader_t *reader,
+		pdc_sched_state_t state, uint8_t *data, size_t size,
+		uint8_t valid_bits, bool send_crc) {
+	if (pdc_sched_frame_start(reader, data, size, valid_bits, send_crc)) {
+		reader->stats.errors++;
+		pdc_sched_poll_done(sched, reader);
+		return;
+	}
+	reader->state = state;
+}
+
+static void pdc_sched_start_anticol(pdc_sched_t *sched,
+		pdc_sched_reader_t *reader) {
+	uint8_t buffer[2];
+	buffer[0] = PICC_CMD_SEL_CL1 + 2 * reader->level;
+	buffer[1] = 0x20; // NVB: Two whole bytes
+	pdc_sched_frame(sched, reader, pdc_sched_state_anticol, buffer, 2, 0,
+			false);
+}
+
+static void pdc_sched_start_select(pdc_sched_t *sched,
+		pdc_sched_reader_t *reader) {
+	uint8_t buffer[7];
+	buffer[0] = PICC_CMD_SEL_CL1 + 2 * reader->level;
+	buffer[1] = 0x70; // NVB: Seven whole bytes
+	memcpy(buffer + 2, reader->cl[reader->level], 5);
+	pdc_sched_frame(sched, reader, pdc_sched_state_select, buffer, 7, 0, true);
+}
+
+// Several PICCs answered, resolve them with the blocking inventory
+static void pdc_sched_inventory(pdc_sched_t *sched,
+		pdc_sched_reader_t *reader) {
+	picc_anticol_stats_t stats = { 0 };
+	int count = PDC_SCHED_MAX_PICCS;
+	// The PICCs are in READY after our WUPA, where they would not answer
+	// the WUPA of the inventory. Send them back to IDLE or HALT first.
+	PICC_HaltA(reader->pdc);
+	reader->stats.frames++;
+	// WUPA, as the PICCs seen by the previous polls are halted
+	picc_anticol_iso14443a(reader->pdc, reader->found, &count, PICC_CMD_WUPA,
+			&stats);
+	reader->found_count = count;
+	reader->stats.frames += stats.frames;
+	pdc_sched_poll_done(sched, reader);
+}
+
+static void pdc_sched_store(pdc_sched_reader_t *reader, uint8_t sak) {
+	picc_t *picc = reader->found + reader->found_count++;
+	memset(picc, 0, sizeof(picc_t));
+	picc->protocol = picc_protocol_iso14443a;
+	picc->uid_size = 3 * (reader->level + 1) + 1;
+	for (int level = 0; level < reader->level; level++)
+		memcpy(picc->uid + 3 * level, reader->cl[level] + 1, 3); // Skip the CT
+	memcpy(picc->uid + 3 * reader->level, reader->cl[reader->level], 4);
+	picc->sak.as_uint8 = sak;
+}
+
+/**
+ * Advances the poll of one reader, never waits for the PICC.
+ *
+ * @return true when the reader used the bus
+ */
+static bool pdc_sched_reader_step(pdc_sched_t *sched,
+		pdc_sched_reader_t *reader) {
+	bs_pdc_t *pdc = reader->pdc;
+	uint32_t now = pdc->get_time_ms();
+	uint8_t buffer[5];
+	size_t size = sizeof(buffer);
+	uint8_t valid_bits = 0;
+	int result;
+
+	switch (reader->state) {
+	case pdc_sched_state_wait:
+		if (reader->stats.polls
+				&& (uint32_t) (now - reader->poll_start_ms)
+						< reader->interval_ms)
+			return false;
+		if (!reader->stats.polls)
+			reader->stats.first_ms = now;
+		reader->poll_start_ms = now;
+		reader->found_count = 0;
+		pdc->picc_epoch++; // Card layers drop their session state
+		buffer[0] = PICC_CMD_WUPA;
+		pdc_sched_frame(sched, reader, pdc_sched_state_wupa, buffer, 1, 7,
+				false);
+		return true;
+	case pdc_sched_state_halt:
+		if ((uint32_t) (now - reader->frame_start_ms) < PDC_SCHED_HLTA_ms)
+			return false;
+		pdc_sched_poll_done(sched, reader);
+		return false;
+	default:
+		break;
+	}
+
+	result = pdc_sched_frame_poll(reader, buffer, &size, &valid_bits);
+	if (result == STATUS_BUSY)
+		return true;
+	if (result && result != STATUS_TIMEOUT && result != STATUS_COLLISION)
+		reader->stats.errors++;
+
+	switch (reader->state) {
+	case pdc_sched_state_wupa:
+		if (result == STATUS_COLLISION) {
+			pdc_sched_inventory(sched, reader);
+			break;
+		}
+		if (result || size != 2 || valid_bits) {
+			pdc_sched_poll_done(sched, reader); // No PICC
+			break;
+		}
+		reader->level = 0;
+		pdc_sched_start_anticol(sched, reader);
+		break;
+
+	case pdc_sched_state_anticol:
+		if (result == STATUS_COLLISION) {
+			pdc_sched_inventory(sched, reader);
+			break;
+		}
+		if (result || size != 5 || valid_bits
+				|| (buffer[0] ^ buffer[1] ^ buffer[2] ^ buffer[3])
+						!= buffer[4]) {
+			pdc_sched_poll_done(sched, reader);
+			break;
+		}
+		memcpy(reader->cl[reader->level], buffer, 5);
+		pdc_sched_start_select(sched, reader);
+		break;
+
+	case pdc_sched_state_select:
+		if (result || size != 3 || valid_bits // SAK + CRC_A
+				|| !iso14443_crc_a_check(buffer, 3)) {
+			pdc_sched_poll_done(sched, reader);
+			break;
+		}
+		if (buffer[0] & 0x04) {
+			// Cascade bit set: UID not complete
+			if (++reader->level > 2) {
+				pdc_sched_poll_done(sched, reader);
+				break;
+			}
+			pdc_sched_start_anticol(sched, reader);
+			break;
+		}
+		pdc_sched_store(reader, buffer[0]);
+		pdc->picc_epoch++;
+		buffer[0] = PICC_CMD_HLTA;
+		buffer[1] = 0;
+		pdc_sched_frame(sched, reader, pdc_sched_state_halt, buffer, 2, 0,
+				true);
+		break;
+
+	default:
+		break;
+	}
+	return true;
+}
+
+/**
+ * Gives every reader on the bus a turn.
+ *
+ * @return true when the bus was used, false when all readers are idle
+ */
+bool pdc_sched_bus_step(pdc_sched_t *sched, pdc_sched_bus_t *bus) {
+	bool busy = false;
+	for (size_t i = 0; i < bus->reader_count; i++)
+		busy |= pdc_sched_reader_step(sched, bus->readers + i);
+	return busy;
+}
+
+/**
+ * Gives every reader on every bus a turn, for single threaded use.
+ */
+bool pdc_sched_step(pdc_sched_t *sched) {
+	bool busy = false;
+	for (size_t i = 0; i < sched->bus_count; i++)
+		busy |= pdc_sched_bus_step(sched, sched->buses + i);
+	return busy;
+}
+
+//------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------
+
+/**
+ * @return The number of polls per second
+ */
+unsigned int pdc_sched_poll_rate(pdc_sched_reader_t *reader) {
+	uint32_t elapsed = reader->stats.last_ms - reader->stats.first_ms;
+	if (!elapsed)
+		return 0;
+	return (uint64_t) reader->stats.polls * 1000 / elapsed;
+}
+
+/**
+ * @return The poll latency in ms below which the given percentage of the
+ * 		   polls completed. Latencies beyond the histogram are reported as
+ * 		   PDC_SCHED_LATENCY_BUCKETS - 1.
+ */
+unsigned int pdc_sched_latency_percentile(pdc_sched_reader_t *reader,
+		unsigned int percentile) {
+	uint64_t target = ((uint64_t) reader->stats.polls * percentile + 99) / 100;
+	uint64_t count = 0;
+	if (!target)
+		return 0;
+	for (unsigned int i = 0; i < PDC_SCHED_LATENCY_BUCKETS; i++) {
+		count += reader->stats.latency[i];
+		if (count >= target)
+			return i;
+	}
+	return PDC_SCHED_LATENCY_BUCKETS - 1;
+}
+
+#ifdef PDC_SCHED_PTHREAD
+//------------------------------------------------------------------------------
+// One worker thread per bus
+//------------------------------------------------------------------------------
+
+static void* pdc_sched_worker(void *arg) {
+	pdc_sched_bus_t *bus = arg;
+	while (atomic_load(&bus->running))
+		if (!pdc_sched_bus_step(bus->sched, bus))
+			sched_yield();
+	return NULL;
+}
+
+/**
+ * Starts a worker thread for every bus. The readers of a bus may only be
+ * accessed by its worker until pdc_sched_stop() returns.
+ */
+int pdc_sched_start(pdc_sched_t *sched) {
+	for (size_t i = 0; i < sched->bus_count; i++) {
+		pdc_sched_bus_t *bus = sched->buses + i;
+		atomic_store(&bus->running, true);
+		if (pthread_create(&bus->thread, NULL, pdc_sched_worker, bus)) {
+			atomic_store(&bus->running, false);
+			pdc_sched_stop(sched);
+			return STATUS_ERROR;
+		}
+	}
+	return STATUS_OK;
+}
+
+void pdc_sched_stop(pdc_sched_t *sched) {
+	for (size_t i = 0; i < sched->bus_count; i++)
+		if (atomic_exchange(&sched->buses[i].running, false))
+			pthread_join(sched->buses[i].thread, NULL);
+}
+#endif
@@ -0,0 +1,170 @@
+/******************************************************************************
+ File:         pdc_sched.h
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements a poll scheduler for multiple readers.
+
+ The scheduler owns a number of bs_pdc_t instances, grouped per bus. The
+ readers on a bus are polled round robin, each by a small state machine that
+ uses the split phase TransceiveStart/TransceivePoll hooks. While one reader
+ waits for its PICC, the bus serves the other readers, so the RF waits
+ overlap. Readers without the split phase hooks fall back to the blocking
+ TransceiveData.
+
+ A poll is a WUPA, followed by the anticollision and SELECT for each cascade
+ level, and a HLTA. When several PICCs answer on one reader, the blocking
+ picc_anticol_iso14443a() inventory is used for that poll. It wakes the
+ PICCs with WUPA as well, as the PICCs seen by the previous polls are halted.
+
+ The PICCs found are compared with the previous polls, and card arrived and
+ card left events are delivered through a callback.
+
+ With PDC_SCHED_PTHREAD defined, every bus can be run by its own worker
+ thread. The event callback is then called from the worker threads.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#ifndef BSRFID_DRIVERS_PDC_SCHED_H_
+#define BSRFID_DRIVERS_PDC_SCHED_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef PDC_SCHED_PTHREAD
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
+
+#include "pdc.h"
+#include "picc.h"
+
+// PICCs tracked per reader
+#ifndef PDC_SCHED_MAX_PICCS
+#define PDC_SCHED_MAX_PICCS			(4)
+#endif
+// Latency histogram, 1 ms per bucket, the last bucket collects the rest
+#ifndef PDC_SCHED_LATENCY_BUCKETS
+#define PDC_SCHED_LATENCY_BUCKETS	(64)
+#endif
+// A frame that is not completed in this time is considered lost
+#define PDC_SCHED_FRAME_TIMEOUT_ms	(50)
+// HLTA has no answer, the next frame may start once it is transmitted
+#define PDC_SCHED_HLTA_ms			(1)
+// Polls a PICC may be missing before it is reported as left
+#define PDC_SCHED_ABSENT_POLLS		(2)
+
+typedef enum {
+	pdc_sched_event_arrived,
+	pdc_sched_event_left,
+} pdc_sched_event_t;
+
+typedef void (*pdc_sched_event_f)(void *context, int reader_id,
+		pdc_sched_event_t event, const picc_t *picc);
+
+typedef enum {
+	pdc_sched_state_wait,		// Waiting for the next poll
+	pdc_sched_state_wupa,
+	pdc_sched_state_anticol,
+	pdc_sched_state_select,
+	pdc_sched_state_halt,
+} pdc_sched_state_t;
+
+typedef struct {
+	unsigned int polls;
+	unsigned int frames;
+	unsigned int errors;		// Frames failed other than by a timeout
+	unsigned int arrived;
+	unsigned int left;
+	uint32_t first_ms;			// Start of the first poll
+	uint32_t last_ms;			// End of the last poll
+	uint32_t latency[PDC_SCHED_LATENCY_BUCKETS];
+} pdc_sched_stats_t;
+
+typedef struct {
+	bs_pdc_t *pdc;
+	int id;						// Passed to the event callback
+	unsigned int interval_ms;	// Minimal time between the start of polls
+
+	pdc_sched_state_t state;
+	uint32_t poll_start_ms;
+	uint32_t frame_start_ms;
+	uint8_t level;				// Cascade level, 0 based
+	uint8_t cl[3][5];			// UID (or CT) bytes and BCC per cascade level
+
+	// Result of the blocking fallback for readers without split phase hooks
+	int fallback_result;
+	uint8_t fallback_data[5];
+	size_t fallback_size;
+	uint8_t fallback_valid_bits;
+
+	picc_t found[PDC_SCHED_MAX_PICCS];	// PICCs seen during this poll
+	int found_count;
+	picc_t piccs[PDC_SCHED_MAX_PICCS];	// PICCs present
+	uint8_t missed[PDC_SCHED_MAX_PICCS];
+	int picc_count;
+
+	pdc_sched_stats_t stats;
+} pdc_sched_reader_t;
+
+struct pdc_sched;
+
+typedef struct {
+	pdc_sched_reader_t *readers;
+	size_t reader_count;
+	struct pdc_sched *sched;
+#ifdef PDC_SCHED_PTHREAD
+	pthread_t thread;
+	atomic_bool running;		// Cleared by pdc_sched_stop()
+#endif
+} pdc_sched_bus_t;
+
+typedef struct pdc_sched {
+	pdc_sched_bus_t *buses;
+	size_t bus_count;
+	pdc_sched_event_f event;
+	void *context;
+	unsigned int absent_polls;
+} pdc_sched_t;
+
+void pdc_sched_init(pdc_sched_t *sched, pdc_sched_bus_t *buses,
+		size_t bus_count, pdc_sched_event_f event, void *context);
+void pdc_sched_bus_init(pdc_sched_bus_t *bus, pdc_sched_reader_t *readers,
+		size_t reader_count);
+void pdc_sched_reader_init(pdc_sched_reader_t *reader, bs_pdc_t *pdc, int id);
+
+bool pdc_sched_bus_step(pdc_sched_t *sched, pdc_sched_bus_t *bus);
+bool pdc_sched_step(pdc_sched_t *sched);
+
+unsigned int pdc_sched_poll_rate(pdc_sched_reader_t *reader);
+unsigned int pdc_sched_latency_percentile(pdc_sched_reader_t *reader,
+		unsigned int percentile);
+
+#ifdef PDC_SCHED_PTHREAD
+int pdc_sched_start(pdc_sched_t *sched);
+void pdc_sched_stop(pdc_sched_t *sched);
+#endif
+
+#endif /* BSRFID_DRIVERS_PDC_SCHED_H_ */
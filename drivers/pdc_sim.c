@@ -0,0 +1,2058 @@
+/******************************************************************************
+ File:         pdc_sim.c
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements a software PCD with virtual PICCs in its field.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#include "pdc_sim.h"
+#include "iso14443_crc.h"
+#include "iso15693.h"
+#include "iso14443b.h"
+
+#include <string.h>
+
+#define PDC_SIM_ACK					(0x0A)
+#define PDC_SIM_NAK_INVALID			(0x00)
+#define PDC_SIM_NAK_CRC				(0x01)
+#define PDC_SIM_NAK_AUTH			(0x04)
+
+// DESFire status codes
+#define PDC_SIM_DF_OK				(0x00)
+#define PDC_SIM_DF_ILLEGAL_COMMAND	(0x1C)
+#define PDC_SIM_DF_LENGTH_ERROR		(0x7E)
+#define PDC_SIM_DF_PERMISSION		(0x9D)
+#define PDC_SIM_DF_PARAMETER_ERROR	(0x9E)
+#define PDC_SIM_DF_APP_NOT_FOUND	(0xA0)
+#define PDC_SIM_DF_ADDITIONAL_FRAME	(0xAF)
+#define PDC_SIM_DF_BOUNDARY_ERROR	(0xBE)
+#define PDC_SIM_DF_FILE_NOT_FOUND	(0xF0)
+
+// The DESFire returns at most 59 bytes of data per frame
+#define PDC_SIM_DF_FRAME_DATA		(59)
+
+// ISO 7816-4 status words
+#define PDC_SIM_SW_OK				(0x9000)
+#define PDC_SIM_SW_END_OF_FILE		(0x6282)
+#define PDC_SIM_SW_WRONG_LENGTH		(0x6700)
+#define PDC_SIM_SW_NOT_FOUND		(0x6A82)
+#define PDC_SIM_SW_WRONG_P1P2		(0x6B00)
+#define PDC_SIM_SW_INS_UNKNOWN		(0x6D00)
+// Response data of one ISO 7816-4 response, more is left for GET RESPONSE
+#define PDC_SIM_ISO_RESPONSE_DATA	(512)
+
+// Clock source for pdc_sim_get_time_ms(), the last initialised simulator
+static pdc_sim_t *pdc_sim_clock;
+
+static bool pdc_sim_check_crc(const uint8_t *frame, size_t size) {
+	// At least one byte of data
+	return size >= 3 && iso14443_crc_a_check(frame, size);
+}
+
+static bool pdc_sim_check_crc_b(const uint8_t *frame, size_t size) {
+	return size >= 3 && iso14443_crc_b_check(frame, size);
+}
+
+static bool pdc_sim_is_t2t(pdc_sim_card_t *card) {
+	return card->type <= pdc_sim_card_ultralight;
+}
+
+static bool pdc_sim_is_mfc(pdc_sim_card_t *card) {
+	return card->type == pdc_sim_card_mfc_1k
+			|| card->type == pdc_sim_card_mfc_4k;
+}
+
+static bool pdc_sim_is_iso15693(pdc_sim_card_t *card) {
+	return card->type == pdc_sim_card_icode_slix;
+}
+
+static bool pdc_sim_is_iso14443b(pdc_sim_card_t *card) {
+	return card->type == pdc_sim_card_iso14443b;
+}
+
+// The protocol the PCD has to load to reach the PICC
+static pdc_protocol_t pdc_sim_card_protocol(pdc_sim_card_t *card) {
+	if (pdc_sim_is_iso15693(card))
+		return pdc_protocol_iso15693;
+	if (pdc_sim_is_iso14443b(card))
+		return pdc_protocol_iso14443b;
+	return pdc_protocol_iso14443a;
+}
+
+static void pdc_sim_deactivate(pdc_sim_t *sim, pdc_sim_card_t *card,
+		pdc_sim_state_t state) {
+	card->state = state;
+	card->level = 0;
+	card->auth_sector = -1;
+	card->crypto1_on = false;
+	card->auth_pending = -1;
+	card->pending_cmd = 0;
+	card->pending_native = 0;
+	card->iso_remaining = 0;
+	card->pps_allowed = false;
+	card->dsi = pdc_bitrate_106;
+	card->dri = pdc_bitrate_106;
+	if (sim->active == card)
+		sim->active = NULL;
+}
+
+// An unexpected frame returns a PICC in READY or ACTIVE to IDLE, one woken
+// from HALT by WUPA (READY*, ACTIVE*) to HALT
+static void pdc_sim_fall_back(pdc_sim_t *sim, pdc_sim_card_t *card) {
+	pdc_sim_deactivate(sim, card,
+			card->from_halt ? pdc_sim_state_halt : pdc_sim_state_idle);
+}
+
+//------------------------------------------------------------------------------
+// Card initialisation
+//------------------------------------------------------------------------------
+
+static void pdc_sim_init_t2t(pdc_sim_card_t *card, uint8_t cc_size) {
+	uint8_t *page = card->memory;
+	// Page 0-2: UID, BCC0, BCC1, internal and lock bytes
+	if (card->uid_size == 7) {
+		page[0] = card->uid[0];
+		page[1] = card->uid[1];
+		page[2] = card->uid[2];
+		page[3] = PICC_CMD_CT ^ card->uid[0] ^ card->uid[1] ^ card->uid[2];
+		memcpy(page + 4, card->uid + 3, 4);
+		page[8] = card->uid[3] ^ card->uid[4] ^ card->uid[5] ^ card->uid[6];
+	} else {
+		memcpy(page, card->uid, card->uid_size > 8 ? 8 : card->uid_size);
+	}
+	page[9] = 0x48;
+	// Page 3: Capability Container
+	page[12] = 0xE1;
+	page[13] = 0x10;
+	page[14] = cc_size;
+	page[15] = 0x00;
+	// Page 4: Empty NDEF message TLV and terminator TLV
+	page[16] = 0x03;
+	page[17] = 0x00;
+	page[18] = 0xFE;
+}
+
+static void pdc_sim_init_mfc(pdc_sim_card_t *card) {
+	static const uint8_t trailer[16] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF, 0x07, 0x80, 0x69, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	int blocks = card->memory_size / 16;
+	for (int block = 0; block < blocks; block++) {
+		if ((block < 128 && (block % 4) == 3) || (block >= 128 && (block % 16) == 15))
+			memcpy(card->memory + 16 * block, trailer, 16);
+	}
+	// Block 0: Manufacturer block
+	memcpy(card->memory, card->uid, 4);
+	card->memory[4] = card->uid[0] ^ card->uid[1] ^ card->uid[2] ^ card->uid[3];
+	card->memory[5] = card->sak;
+	card->memory[6] = card->atqa[0];
+	card->memory[7] = card->atqa[1];
+}
+
+/**
+ * Initialises a virtual PICC. When uid is NULL a UID is generated, when
+ * uid_size is 0 the UID size common for the type is used.
+ */
+void pdc_sim_card_init(pdc_sim_card_t *card, pdc_sim_card_type_t type,
+		const uint8_t *uid, uint8_t uid_size) {
+	static uint32_t seed = 0x2F6E2B1;
+	uint8_t default_uid_size = 7;
+	uint8_t cc_size = 0;
+
+	memset(card, 0, sizeof(pdc_sim_card_t));
+	card->type = type;
+	card->present = true;
+	card->auth_sector = -1;
+	card->auth_pending = -1;
+	card->fsd = 16;
+	card->atqa[0] = 0x44;
+
+	switch (type) {
+	case pdc_sim_card_ntag213:
+		card->memory_size = 45 * 4;
+		cc_size = 0x12;
+		break;
+	case pdc_sim_card_ntag215:
+		card->memory_size = 135 * 4;
+		cc_size = 0x3E;
+		break;
+	case pdc_sim_card_ntag216:
+		card->memory_size = 231 * 4;
+		cc_size = 0x6D;
+		break;
+	case pdc_sim_card_ultralight:
+		card->memory_size = 16 * 4;
+		cc_size = 0x06;
+		break;
+	case pdc_sim_card_mfc_1k:
+		card->memory_size = 1024;
+		card->atqa[0] = 0x04;
+		card->sak = 0x08;
+		default_uid_size = 4;
+		break;
+	case pdc_sim_card_mfc_4k:
+		card->memory_size = 4096;
+		card->atqa[0] = 0x02;
+		card->sak = 0x18;
+		default_uid_size = 4;
+		break;
+	case pdc_sim_card_desfire:
+		card->memory_size = PDC_SIM_MEMORY_SIZE;
+		card->atqa[1] = 0x03;
+		card->sak = 0x20;
+		break;
+	case pdc_sim_card_icode_slix:
+		card->memory_size = 28 * 4;
+		card->block_size = 4;
+		break;
+	case pdc_sim_card_iso14443b:
+		card->memory_size = PDC_SIM_MEMORY_SIZE;
+		break;
+	}
+
+	if (pdc_sim_is_iso15693(card))
+		uid_size = 8;
+	else if (pdc_sim_is_iso14443b(card))
+		uid_size = ISO14443B_PUPI_SIZE;
+	else if (uid_size != 4 && uid_size != 7 && uid_size != 10)
+		uid_size = default_uid_size;
+	card->uid_size = uid_size;
+	if (uid) {
+		memcpy(card->uid, uid, uid_size);
+	} else {
+		for (int i = 0; i < uid_size; i++) {
+			// xorshift32
+			seed ^= seed << 13;
+			seed ^= seed >> 17;
+			seed ^= seed << 5;
+			card->uid[i] = seed;
+		}
+		if (pdc_sim_is_iso15693(card)) {
+			// Sent least significant byte first: E0, NXP, ICode SLIX
+			card->uid[7] = 0xE0;
+			card->uid[6] = 0x04;
+			card->uid[5] = 0x01;
+		} else if (pdc_sim_is_iso14443b(card)) {
+			// The PUPI is random
+		} else if (uid_size != 4)
+			card->uid[0] = 0x04; // NXP
+		else if (card->uid[0] == PICC_CMD_CT)
+			card->uid[0] = 0x08;
+	}
+
+	if (pdc_sim_is_iso15693(card)) {
+		for (size_t i = 0; i < card->memory_size; i++)
+			card->memory[i] = i;
+		return;
+	}
+	if (pdc_sim_is_iso14443b(card)) {
+		// Application data: AFI, CRC_B of the AID, one application.
+		// Protocol info: 106 kbps only, FSCI 64 bytes and ISO 14443-4,
+		// FWI 7, CID supported.
+		static const uint8_t atqb[] = { 0x00, 0x00, 0x00, 0x01, 0x00, 0x51,
+				0x71 };
+		memcpy(card->atqb, atqb, sizeof(atqb));
+		return;
+	}
+
+	// Nonce generator of the Crypto1 authentication
+	card->nonce = seed;
+
+	// UID size in the ATQA
+	card->atqa[0] &= 0x3F;
+	card->atqa[0] |= (uid_size == 4 ? 0 : uid_size == 7 ? 1 : 2) << 6;
+
+	// Anticollision data per cascade level
+	card->levels = uid_size == 4 ? 1 : uid_size == 7 ? 2 : 3;
+	for (int level = 0; level < card->levels; level++) {
+		uint8_t *cl = card->cl[level];
+		if (level < card->levels - 1) {
+			cl[0] = PICC_CMD_CT;
+			memcpy(cl + 1, card->uid + 3 * level, 3);
+		} else {
+			memcpy(cl, card->uid + 3 * level, 4);
+		}
+		cl[4] = cl[0] ^ cl[1] ^ cl[2] ^ cl[3];
+	}
+
+	if (pdc_sim_is_t2t(card)) {
+		static const uint8_t version[] = { 0x00, 0x04, 0x04, 0x02, 0x01, 0x00,
+				0x0F, 0x03 };
+		memcpy(card->version, version, sizeof(version));
+		if (type == pdc_sim_card_ntag215)
+			card->version[6] = 0x11;
+		if (type == pdc_sim_card_ntag216)
+			card->version[6] = 0x13;
+		pdc_sim_init_t2t(card, cc_size);
+	}
+	if (pdc_sim_is_mfc(card))
+		pdc_sim_init_mfc(card);
+	if (type == pdc_sim_card_desfire) {
+		// TL, T0 (FSCI 64 bytes), TA, TB, TC, historical byte
+		static const uint8_t ats[] = { 0x06, 0x75, 0x77, 0x81, 0x02, 0x80 };
+		memcpy(card->ats, ats, sizeof(ats));
+	}
+}
+
+int pdc_sim_desfire_add_application(pdc_sim_card_t *card, uint32_t aid) {
+	if (card->type != pdc_sim_card_desfire && !pdc_sim_is_iso14443b(card))
+		return STATUS_INVALID;
+	if (card->app_count >= PDC_SIM_DESFIRE_APPS)
+		return STATUS_NO_ROOM;
+	card->apps[card->app_count].aid = aid;
+	card->apps[card->app_count].file_count = 0;
+	card->app_count++;
+	return STATUS_OK;
+}
+
+static pdc_sim_desfire_app_t* pdc_sim_desfire_app(pdc_sim_card_t *card,
+		uint32_t aid) {
+	for (int i = 0; i < card->app_count; i++)
+		if (card->apps[i].aid == aid)
+			return card->apps + i;
+	return NULL;
+}
+
+static int pdc_sim_desfire_new_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, uint8_t type, const void *data, uint16_t size,
+		uint16_t record_size) {
+	pdc_sim_desfire_app_t *app = pdc_sim_desfire_app(card, aid);
+	if (!app)
+		return STATUS_INVALID;
+	if (app->file_count >= PDC_SIM_DESFIRE_FILES
+			|| card->memory_used + size > card->memory_size)
+		return STATUS_NO_ROOM;
+	pdc_sim_desfire_file_t *file = app->files + app->file_count++;
+	file->file_no = file_no;
+	file->type = type;
+	file->offset = card->memory_used;
+	file->size = size;
+	file->record_size = record_size;
+	memcpy(card->memory + file->offset, data, size);
+	card->memory_used += size;
+	return STATUS_OK;
+}
+
+int pdc_sim_desfire_add_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, const void *data, uint16_t size) {
+	return pdc_sim_desfire_new_file(card, aid, file_no,
+			PDC_SIM_DESFIRE_STANDARD_FILE, data, size, 0);
+}
+
+int pdc_sim_desfire_add_value_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, int32_t value) {
+	uint8_t data[4] = { value, value >> 8, value >> 16, value >> 24 };
+	return pdc_sim_desfire_new_file(card, aid, file_no,
+			PDC_SIM_DESFIRE_VALUE_FILE, data, sizeof(data), 0);
+}
+
+// The records are given oldest first, the file is full
+int pdc_sim_desfire_add_record_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, const void *records, uint16_t record_size,
+		uint16_t count) {
+	if (!record_size)
+		return STATUS_INVALID;
+	return pdc_sim_desfire_new_file(card, aid, file_no,
+			PDC_SIM_DESFIRE_CYCLIC_RECORD_FILE, records, record_size * count,
+			record_size);
+}
+
+static pdc_sim_desfire_file_t* pdc_sim_desfire_file(pdc_sim_card_t *card,
+		uint8_t file_no) {
+	pdc_sim_desfire_app_t *app = pdc_sim_desfire_app(card, card->selected_aid);
+	for (int i = 0; app && i < app->file_count; i++)
+		if (app->files[i].file_no == file_no)
+			return app->files + i;
+	return NULL;
+}
+
+void pdc_sim_field_reset(pdc_sim_t *sim) {
+	for (size_t i = 0; i < sim->card_count; i++) {
+		pdc_sim_deactivate(sim, sim->cards + i, pdc_sim_state_idle);
+		sim->cards[i].from_halt = false;
+	}
+	sim->active = NULL;
+}
+
+void pdc_sim_init(pdc_sim_t *sim, pdc_sim_card_t *cards, size_t card_count) {
+	memset(sim, 0, sizeof(pdc_sim_t));
+	sim->pdc.TransceiveData = pdc_sim_transceive;
+	sim->pdc.SetParity = pdc_sim_set_parity;
+	sim->pdc.SetTimeout = pdc_sim_set_timeout;
+	sim->pdc.SetBitRate = pdc_sim_set_bitrate;
+	sim->pdc.bitrates = 0x0F;
+	sim->pdc.Crypto1Begin = pdc_sim_crypto1_begin;
+	sim->pdc.Crypto1End = pdc_sim_crypto1_end;
+	sim->parity = true;
+	sim->pdc.rx_fifo_size = PDC_SIM_FRAME_SIZE;
+	sim->pdc.get_time_ms = pdc_sim_get_time_ms;
+	sim->pdc.delay_ms = pdc_sim_delay_ms;
+	sim->cards = cards;
+	sim->card_count = card_count;
+	sim->timeout_us = PDC_SIM_TIMEOUT_us;
+	sim->pdc.SetField = pdc_sim_set_field;
+	sim->pdc.SetProtocol = pdc_sim_set_protocol;
+	sim->pdc.protocols = (1 << pdc_protocol_iso14443a)
+			| (1 << pdc_protocol_iso15693) | (1 << pdc_protocol_iso14443b);
+	sim->pdc.LpcdMeasure = pdc_sim_lpcd_measure;
+	sim->lpcd_i = PDC_SIM_LPCD_I;
+	sim->lpcd_q = PDC_SIM_LPCD_Q;
+	sim->lpcd_detune = PDC_SIM_LPCD_DETUNE;
+	sim->lpcd_noise = PDC_SIM_LPCD_NOISE;
+	sim->lpcd_random = 1;
+	sim->slot_random = 1;
+	pdc_sim_clock = sim;
+	pdc_sim_field_reset(sim);
+}
+
+int pdc_sim_get_time_ms(void) {
+	return pdc_sim_clock ? pdc_sim_clock->air_time_ns / 1000000 : 0;
+}
+
+int pdc_sim_delay_ms(int ms) {
+	if (pdc_sim_clock)
+		pdc_sim_clock->air_time_ns += (uint64_t) ms * 1000000;
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+// ISO 14443-3 PICC state machine
+//------------------------------------------------------------------------------
+
+// Responses are bit streams, without the rxAlign offset. A 4 bit ACK/NAK
+// is a 4 bit stream.
+static void pdc_sim_nak(uint8_t *resp, size_t *resp_bits, uint8_t nak) {
+	resp[0] = nak;
+	*resp_bits = 4;
+}
+
+static bool pdc_sim_anticollision(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t frame_bits, uint8_t *resp,
+		size_t *resp_bits, bool *resp_crc) {
+	uint8_t *cl = card->cl[card->level];
+	uint8_t nvb = frame[1];
+
+	if (nvb == 0x70) {
+		// SELECT
+		if (frame_bits != 9 * 8 || !pdc_sim_check_crc(frame, 9))
+			return false;
+		if (memcmp(frame + 2, cl, 5)) {
+			// Another PICC is selected
+			pdc_sim_fall_back(sim, card);
+			return false;
+		}
+		if (card->level + 1 < card->levels) {
+			card->level++;
+			resp[0] = 0x04;	// Cascade bit, UID not complete
+		} else {
+			card->state = pdc_sim_state_active;
+			resp[0] = card->sak;
+		}
+		*resp_bits = 8;
+		*resp_crc = true;
+		return true;
+	}
+
+	// ANTICOLLISION: respond with the remaining bits of UID and BCC
+	int known = ((nvb >> 4) - 2) * 8 + (nvb & 0x07);
+	if (known < 0 || known > 32 || frame_bits != 16 + (size_t) known)
+		return false;
+	for (int bit = 0; bit < known; bit++)
+		if (((frame[2 + bit / 8] ^ cl[bit / 8]) >> (bit % 8)) & 1)
+			return false;
+
+	if (!(known % 8)) {
+		memcpy(resp, cl + known / 8, 5 - known / 8);
+	} else {
+		memset(resp, 0, 5);
+		for (int bit = known; bit < 40; bit++)
+			if ((cl[bit / 8] >> (bit % 8)) & 1)
+				resp[(bit - known) / 8] |= 1 << ((bit - known) % 8);
+	}
+	*resp_bits = 40 - known;
+	*resp_crc = false;
+	return true;
+}
+
+//------------------------------------------------------------------------------
+// NFC Forum Type 2 Tag (NTAG, Ultralight)
+//------------------------------------------------------------------------------
+
+static bool pdc_sim_t2t(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t size, uint8_t *resp, size_t *resp_bits,
+		bool *resp_crc) {
+	size_t pages = card->memory_size / 4;
+	bool ntag = card->type != pdc_sim_card_ultralight;
+
+	if (!pdc_sim_check_crc(frame, size)) {
+		pdc_sim_nak(resp, resp_bits, PDC_SIM_NAK_CRC);
+		return true;
+	}
+	size -= 2;
+	*resp_crc = true;
+
+	switch (frame[0]) {
+	case 0x30: // READ, rolls over at the end of the memory
+		if (size != 2 || frame[1] >= pages)
+			break;
+		for (int i = 0; i < 4; i++)
+			memcpy(resp + 4 * i, card->memory + 4 * ((frame[1] + i) % pages),
+					4);
+		*resp_bits = 16 * 8;
+		return true;
+	case 0xA2: // WRITE
+		if (size != 6 || frame[1] < 2 || frame[1] >= pages)
+			break;
+		memcpy(card->memory + 4 * frame[1], frame + 2, 4);
+		pdc_sim_nak(resp, resp_bits, PDC_SIM_ACK);
+		*resp_crc = false;
+		return true;
+	case 0x60: // GET_VERSION
+		if (!ntag)
+			goto unknown;
+		memcpy(resp, card->version, 8);
+		*resp_bits = 8 * 8;
+		return true;
+	case 0x3A: // FAST_READ
+		if (!ntag)
+			goto unknown;
+		if (size != 3 || frame[1] > frame[2] || frame[2] >= pages)
+			break;
+		memcpy(resp, card->memory + 4 * frame[1], 4 * (frame[2] - frame[1] + 1));
+		*resp_bits = 32 * (frame[2] - frame[1] + 1);
+		return true;
+	case 0x3C: // READ_SIG
+		if (!ntag)
+			goto unknown;
+		memset(resp, 0, 32);
+		*resp_bits = 32 * 8;
+		return true;
+	default:
+		goto unknown;
+	}
+
+	// NAK, the PICC returns to IDLE or HALT
+	pdc_sim_fall_back(sim, card);
+	pdc_sim_nak(resp, resp_bits, PDC_SIM_NAK_INVALID);
+	*resp_crc = false;
+	return true;
+
+	unknown:
+	// Unsupported command, no response
+	pdc_sim_fall_back(sim, card);
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// MIFARE Classic
+// The Crypto1 unit of the PCD is transparent, see pdc_sim_crypto1_begin().
+// Access conditions are not evaluated, any valid key grants full access.
+//------------------------------------------------------------------------------
+
+static int pdc_sim_mfc_sector(int block) {
+	return block < 128 ? block / 4 : 32 + (block - 128) / 16;
+}
+
+static int pdc_sim_mfc_trailer(int sector) {
+	return sector < 32 ? 4 * sector + 3 : 128 + 16 * (sector - 32) + 15;
+}
+
+// Sets the keys of a sector, NULL keeps the key
+int pdc_sim_mfc_set_keys(pdc_sim_card_t *card, int sector,
+		const uint8_t *key_a, const uint8_t *key_b) {
+	if (!pdc_sim_is_mfc(card) || sector < 0)
+		return STATUS_INVALID;
+	int trailer = pdc_sim_mfc_trailer(sector);
+	if ((size_t) trailer >= card->memory_size / 16)
+		return STATUS_INVALID;
+	if (key_a)
+		memcpy(card->memory + 16 * trailer, key_a, 6);
+	if (key_b)
+		memcpy(card->memory + 16 * trailer + 10, key_b, 6);
+	return STATUS_OK;
+}
+
+static bool pdc_sim_mfc_get_value(pdc_sim_card_t *card, int block,
+		int32_t *value) {
+	uint8_t *data = card->memory + 16 * block;
+	uint32_t v0, v1, v2;
+	memcpy(&v0, data, 4);
+	memcpy(&v1, data + 4, 4);
+	memcpy(&v2, data + 8, 4);
+	if (v0 != v2 || v0 != ~v1 || data[12] != data[14]
+			|| (data[12] ^ data[13]) != 0xFF || data[13] != data[15])
+		return false;
+	*value = v0;
+	return true;
+}
+
+static void pdc_sim_mfc_set_value(pdc_sim_card_t *card, int block,
+		int32_t value) {
+	uint8_t *data = card->memory + 16 * block;
+	uint32_t v = value, nv = ~v;
+	memcpy(data, &v, 4);
+	memcpy(data + 4, &nv, 4);
+	memcpy(data + 8, &v, 4);
+	data[12] = data[14] = block;
+	data[13] = data[15] = ~block;
+}
+
+// First step of the authentication: loads the key of the sector into the
+// Crypto1 state and returns nT. In a nested authentication nT is encrypted
+// with the new key, its encrypted parity is kept in card->nonce_parity.
+static void pdc_sim_mfc_auth(pdc_sim_card_t *card, uint8_t cmd, int block,
+		uint8_t *resp) {
+	int sector = pdc_sim_mfc_sector(block);
+	uint8_t *trailer = card->memory + 16 * pdc_sim_mfc_trailer(sector);
+	const uint8_t *uid = card->uid + card->uid_size - 4;
+	bool nested = card->crypto1_on;
+	uint8_t nt[4];
+
+	card->nonce = crypto1_prng_successor(card->nonce, 1021);
+	crypto1_put_word(nt, card->nonce);
+	crypto1_init(&card->crypto1, cmd == 0x60 ? trailer : trailer + 10);
+	for (int i = 0; i < 4; i++) {
+		uint8_t ks = crypto1_byte(&card->crypto1, uid[i] ^ nt[i], false);
+		resp[i] = nested ? nt[i] ^ ks : nt[i];
+		card->nonce_parity[i] = crypto1_odd_parity(nt[i])
+				^ (nested ? crypto1_filter(&card->crypto1) : 0);
+	}
+	card->crypto1_on = false;
+	card->auth_sector = -1;
+	card->auth_pending = sector;
+}
+
+// Second step of the authentication: verifies {nR}{aR}, returns {aT}
+static bool pdc_sim_mfc_auth_answer(pdc_sim_t *sim, pdc_sim_card_t *card,
+		uint8_t *data, uint8_t *parity, size_t size, uint8_t *resp,
+		size_t *resp_bits) {
+	int sector = card->auth_pending;
+	uint32_t nt = card->nonce;
+	card->auth_pending = -1;
+	if (size != 8) {
+		pdc_sim_fall_back(sim, card);
+		return false;
+	}
+	crypto1_decrypt(&card->crypto1, data, NULL, 4, true);
+	if (!crypto1_decrypt(&card->crypto1, data + 4, parity + 4, 4, false)
+			|| crypto1_get_word(data + 4) != crypto1_prng_successor(nt, 64)) {
+		// Wrong key, the PICC remains silent
+		pdc_sim_fall_back(sim, card);
+		return false;
+	}
+	uint8_t at[4], at_parity[4];
+	crypto1_put_word(at, crypto1_prng_successor(nt, 96));
+	crypto1_encrypt(&card->crypto1, at, at_parity, 4, false);
+	*resp_bits = crypto1_pack(at, at_parity, 4, resp);
+	card->auth_sector = sector;
+	card->crypto1_on = true;
+	return true;
+}
+
+static bool pdc_sim_mfc(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t size, uint8_t *resp, size_t *resp_bits,
+		bool *resp_crc) {
+	int blocks = card->memory_size / 16;
+	uint8_t nak = PDC_SIM_NAK_INVALID;
+
+	if (!pdc_sim_check_crc(frame, size)) {
+		pdc_sim_nak(resp, resp_bits, PDC_SIM_NAK_CRC);
+		return true;
+	}
+	size -= 2;
+	*resp_crc = false;
+	card->auth_pending = -1;
+
+	if (card->pending_cmd) {
+		// Second part of WRITE, INCREMENT, DECREMENT or RESTORE
+		uint8_t cmd = card->pending_cmd;
+		int32_t operand;
+		card->pending_cmd = 0;
+		if (cmd == 0xA0) {
+			if (size != 16)
+				goto nak;
+			memcpy(card->memory + 16 * card->pending_block, frame, 16);
+			pdc_sim_nak(resp, resp_bits, PDC_SIM_ACK);
+			return true;
+		}
+		if (size != 4)
+			goto nak;
+		memcpy(&operand, frame, 4);
+		if (cmd == 0xC0)
+			card->transfer_value -= operand;
+		if (cmd == 0xC1)
+			card->transfer_value += operand;
+		// No acknowledge for the operand
+		return false;
+	}
+
+	if (size != 2 || frame[1] >= blocks)
+		goto nak;
+	if (frame[0] == 0x60 || frame[0] == 0x61) {
+		// AUTH with key A or B, answered with nT
+		pdc_sim_mfc_auth(card, frame[0], frame[1], resp);
+		*resp_bits = 4 * 8;
+		return true;
+	}
+	nak = PDC_SIM_NAK_AUTH;
+	if (card->auth_sector != pdc_sim_mfc_sector(frame[1]))
+		goto nak;
+	nak = PDC_SIM_NAK_INVALID;
+
+	switch (frame[0]) {
+	case 0x30: // READ
+		memcpy(resp, card->memory + 16 * frame[1], 16);
+		if (frame[1] == pdc_sim_mfc_trailer(card->auth_sector))
+			memset(resp, 0, 6); // Key A is never readable
+		*resp_bits = 16 * 8;
+		*resp_crc = true;
+		return true;
+	case 0xA0: // WRITE
+		if (frame[1] == 0)
+			goto nak;
+		break;
+	case 0xC0: // DECREMENT
+	case 0xC1: // INCREMENT
+	case 0xC2: // RESTORE
+		if (!pdc_sim_mfc_get_value(card, frame[1], &card->transfer_value))
+			goto nak;
+		break;
+	case 0xB0: // TRANSFER
+		if (frame[1] == 0)
+			goto nak;
+		pdc_sim_mfc_set_value(card, frame[1], card->transfer_value);
+		pdc_sim_nak(resp, resp_bits, PDC_SIM_ACK);
+		return true;
+	default:
+		goto nak;
+	}
+	card->pending_cmd = frame[0];
+	card->pending_block = frame[1];
+	pdc_sim_nak(resp, resp_bits, PDC_SIM_ACK);
+	return true;
+
+	nak:
+	pdc_sim_fall_back(sim, card);
+	pdc_sim_nak(resp, resp_bits, nak);
+	return true;
+}
+
+// A frame sent with the parity of the PCD disabled, every byte followed by
+// its parity bit. When authenticated by the software Crypto1 of the PCD,
+// the frame and the response are encrypted.
+static bool pdc_sim_mfc_raw(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t frame_bits, uint8_t *resp,
+		size_t *resp_bits) {
+	uint8_t data[PDC_SIM_FRAME_SIZE], parity[PDC_SIM_FRAME_SIZE];
+	uint8_t plain[PDC_SIM_FRAME_SIZE];
+	size_t plain_bits = 0;
+	bool plain_crc = false;
+
+	if (frame_bits > 9 * PDC_SIM_FRAME_SIZE)
+		return false;
+	size_t size = crypto1_unpack(frame, frame_bits, data, parity);
+	if (!size)
+		return false;
+	if (card->auth_pending >= 0)
+		return pdc_sim_mfc_auth_answer(sim, card, data, parity, size, resp,
+				resp_bits);
+
+	bool encrypted = card->crypto1_on;
+	if (encrypted) {
+		if (!crypto1_decrypt(&card->crypto1, data, parity, size, false)) {
+			pdc_sim_fall_back(sim, card);
+			return false;
+		}
+	} else {
+		for (size_t i = 0; i < size; i++)
+			if (parity[i] != crypto1_odd_parity(data[i]))
+				return false;
+	}
+
+	if (data[0] == PICC_CMD_HLTA && size == 4 && data[1] == 0) {
+		if (pdc_sim_check_crc(data, size))
+			pdc_sim_deactivate(sim, card, pdc_sim_state_halt);
+		return false;
+	}
+	if (!pdc_sim_mfc(sim, card, data, size, plain, &plain_bits, &plain_crc))
+		return false;
+
+	if (plain_bits == 4) {
+		// ACK or NAK, no parity
+		resp[0] = encrypted ? crypto1_nibble(&card->crypto1, plain[0]) :
+				plain[0];
+		*resp_bits = 4;
+		return true;
+	}
+	size = plain_bits / 8;
+	if (card->auth_pending >= 0) {
+		// nT, encrypted by pdc_sim_mfc_auth() when nested
+		*resp_bits = crypto1_pack(plain, card->nonce_parity, size, resp);
+		return true;
+	}
+	if (plain_crc) {
+		iso14443_crc_a_append(plain, size);
+		size += 2;
+	}
+	if (encrypted) {
+		crypto1_encrypt(&card->crypto1, plain, parity, size, false);
+	} else {
+		for (size_t i = 0; i < size; i++)
+			parity[i] = crypto1_odd_parity(plain[i]);
+	}
+	*resp_bits = crypto1_pack(plain, parity, size, resp);
+	return true;
+}
+
+/**
+ * SetParity for the software PCD. With the parity disabled, the MIFARE
+ * Classic PICCs run Crypto1 on the air, for the software Crypto1 of the
+ * card layer. The other PICCs do not answer raw frames.
+ */
+// The time lost when no PICC answers follows the timeout of the PCD
+int pdc_sim_set_timeout(void *pdc, uint32_t timeout_us) {
+	pdc_sim_t *sim = pdc;
+	sim->pdc.timeout_us = timeout_us;
+	sim->timeout_us = timeout_us ? timeout_us : PDC_SIM_TIMEOUT_us;
+	return STATUS_OK;
+}
+
+int pdc_sim_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx) {
+	pdc_sim_t *sim = pdc;
+	if (tx > pdc_bitrate_848 || rx > pdc_bitrate_848)
+		return STATUS_INVALID;
+	sim->pdc.tx_bitrate = sim->tx_rate = tx;
+	sim->pdc.rx_bitrate = sim->rx_rate = rx;
+	return STATUS_OK;
+}
+
+int pdc_sim_set_field(void *pdc, bool on) {
+	pdc_sim_t *sim = pdc;
+	if (!on) {
+		pdc_sim_field_reset(sim);
+		sim->pdc.picc_epoch++; // PICCs lose their state without field
+	}
+	sim->field_off = !on;
+	return STATUS_OK;
+}
+
+int pdc_sim_set_protocol(void *pdc, pdc_protocol_t protocol) {
+	pdc_sim_t *sim = pdc;
+	if (protocol > pdc_protocol_iso14443b)
+		return STATUS_INVALID;
+	sim->pdc.protocol = sim->protocol = protocol;
+	sim->inventory_slots = 0;
+	return STATUS_OK;
+}
+
+static uint8_t pdc_sim_lpcd_channel(pdc_sim_t *sim, int value) {
+	// Noise of -lpcd_noise to lpcd_noise
+	sim->lpcd_random = sim->lpcd_random * 1103515245 + 12345;
+	value += (int) ((sim->lpcd_random >> 16) % (2 * sim->lpcd_noise + 1))
+			- sim->lpcd_noise;
+	return value < 0 ? 0 : value > 0x3F ? 0x3F : value;
+}
+
+// LPCD measurement: I drops and Q rises with every PICC present
+int pdc_sim_lpcd_measure(void *pdc, pdc_lpcd_sample_t *sample) {
+	pdc_sim_t *sim = pdc;
+	int detune = 0;
+
+	for (size_t i = 0; i < sim->card_count; i++)
+		if (sim->cards[i].present)
+			detune += sim->lpcd_detune;
+	memset(sample, 0, sizeof(pdc_lpcd_sample_t));
+	sample->channel[0] = pdc_sim_lpcd_channel(sim, sim->lpcd_i - detune);
+	sample->channel[1] = pdc_sim_lpcd_channel(sim, sim->lpcd_q + detune);
+	sample->channels = 2;
+	sample->rf_on_us = PDC_SIM_LPCD_MEASURE_us;
+	sim->air_time_ns += PDC_SIM_LPCD_MEASURE_us * 1000;
+	sim->pdc.picc_epoch++; // The field was pulsed
+	return STATUS_OK;
+}
+
+int pdc_sim_set_parity(void *pdc, bool enable) {
+	pdc_sim_t *sim = pdc;
+	sim->parity = enable;
+	return STATUS_OK;
+}
+
+int pdc_sim_crypto1_begin(void *pdc, void *p) {
+	pdc_sim_t *sim = pdc;
+	picc_t *picc = p;
+	pdc_sim_card_t *card = sim->active;
+
+	// Authentication takes 4 frames: AUTH, nT, nR + aR, aT
+	sim->pdc.frame_count += 4;
+	sim->stats.frames += 4;
+	sim->air_time_ns += 4 * (PDC_SIM_FDT_ns + 6 * 9 * PDC_SIM_BIT_ns);
+
+	if (!picc || !card || !card->present || !pdc_sim_is_mfc(card))
+		return STATUS_TIMEOUT;
+	if (memcmp(card->uid + card->uid_size - 4, picc->uid + picc->uid_size - 4,
+			4))
+		return STATUS_ERROR;
+	if (picc->mfc_crypto1.block_address >= card->memory_size / 16)
+		return STATUS_ERROR;
+
+	int sector = pdc_sim_mfc_sector(picc->mfc_crypto1.block_address);
+	uint8_t *trailer = card->memory + 16 * pdc_sim_mfc_trailer(sector);
+	uint8_t *key;
+	switch (picc->mfc_crypto1.key_a_or_b) {
+	case 0x60:
+		key = trailer;
+		break;
+	case 0x61:
+		key = trailer + 10;
+		break;
+	default:
+		return -1;
+	}
+	if (memcmp(key, picc->mfc_crypto1.key, 6)) {
+		// The PICC does not answer {aR}
+		sim->stats.timeouts++;
+		sim->air_time_ns += (uint64_t) sim->timeout_us * 1000;
+		pdc_sim_fall_back(sim, card);
+		return STATUS_ERROR;
+	}
+	card->auth_sector = sector;
+	return STATUS_OK;
+}
+
+int pdc_sim_crypto1_end(void *pdc) {
+	pdc_sim_t *sim = pdc;
+	if (sim->active) {
+		sim->active->auth_sector = -1;
+		sim->active->crypto1_on = false;
+	}
+	return STATUS_OK;
+}
+
+//------------------------------------------------------------------------------
+// DESFire style ISO 14443-4 PICC
+//------------------------------------------------------------------------------
+
+// Processes a native DESFire command, returns the size of the response data,
+// the status is returned in *status.
+static size_t pdc_sim_desfire_command(pdc_sim_card_t *card, uint8_t cmd,
+		const uint8_t *data, size_t size, uint8_t *resp, uint8_t *status,
+		size_t max_data) {
+	static const uint8_t version[2][7] = {
+			{ 0x04, 0x01, 0x01, 0x01, 0x00, 0x18, 0x05 },
+			{ 0x04, 0x01, 0x01, 0x01, 0x04, 0x18, 0x05 } };
+	static const uint8_t production[7] = { 0xBA, 0x44, 0x39, 0xA4, 0x50, 0x31,
+			0x12 };
+	pdc_sim_desfire_app_t *app;
+	pdc_sim_desfire_file_t *file;
+	size_t result = 0;
+
+	*status = PDC_SIM_DF_OK;
+	if (cmd == PDC_SIM_DF_ADDITIONAL_FRAME) {
+		cmd = card->pending_native;
+		if (!cmd) {
+			*status = PDC_SIM_DF_ILLEGAL_COMMAND;
+			return 0;
+		}
+	} else {
+		card->pending_native = 0;
+		card->pending_offset = 0;
+	}
+
+	switch (cmd) {
+	case 0x60: // GetVersion
+		if (card->pending_offset < 2) {
+			memcpy(resp, version[card->pending_offset++], 7);
+			card->pending_native = cmd;
+			*status = PDC_SIM_DF_ADDITIONAL_FRAME;
+			return 7;
+		}
+		memcpy(resp, card->uid, 7);
+		memcpy(resp + 7, production, 7);
+		card->pending_native = 0;
+		return 14;
+	case 0x5A: // SelectApplication
+		if (size != 3) {
+			*status = PDC_SIM_DF_LENGTH_ERROR;
+			return 0;
+		}
+		uint32_t aid = data[0] | data[1] << 8 | data[2] << 16;
+		if (aid && !pdc_sim_desfire_app(card, aid)) {
+			*status = PDC_SIM_DF_APP_NOT_FOUND;
+			return 0;
+		}
+		card->selected_aid = aid;
+		return 0;
+	case 0x6A: // GetApplicationIDs
+		for (int i = 0; i < card->app_count; i++) {
+			resp[result++] = card->apps[i].aid;
+			resp[result++] = card->apps[i].aid >> 8;
+			resp[result++] = card->apps[i].aid >> 16;
+		}
+		return result;
+	case 0x6F: // GetFileIDs
+		app = pdc_sim_desfire_app(card, card->selected_aid);
+		if (!app) {
+			*status = PDC_SIM_DF_PERMISSION;
+			return 0;
+		}
+		for (int i = 0; i < app->file_count; i++)
+			resp[result++] = app->files[i].file_no;
+		return result;
+	case 0xF5: // GetFileSettings
+		file = size == 1 ? pdc_sim_desfire_file(card, data[0]) : NULL;
+		if (!file) {
+			*status = PDC_SIM_DF_FILE_NOT_FOUND;
+			return 0;
+		}
+		resp[result++] = file->type;
+		resp[result++] = 0x00;	// Plain communication
+		resp[result++] = 0xEE;	// Free access
+		resp[result++] = 0xEE;
+		if (file->type == PDC_SIM_DESFIRE_VALUE_FILE) {
+			static const uint8_t limits[] = { 0x00, 0x00, 0x00, 0x80, 0xFF,
+					0xFF, 0xFF, 0x7F, 0x00, 0x00, 0x00, 0x00, 0x00 };
+			memcpy(resp + result, limits, sizeof(limits));
+			return result + sizeof(limits);
+		}
+		if (file->type == PDC_SIM_DESFIRE_CYCLIC_RECORD_FILE) {
+			uint16_t records = file->size / file->record_size;
+			resp[result++] = file->record_size;
+			resp[result++] = file->record_size >> 8;
+			resp[result++] = 0;
+			for (int i = 0; i < 2; i++) { // Maximum and current records
+				resp[result++] = records;
+				resp[result++] = records >> 8;
+				resp[result++] = 0;
+			}
+			return result;
+		}
+		resp[result++] = file->size;
+		resp[result++] = file->size >> 8;
+		resp[result++] = 0;
+		return result;
+	case 0x6C: // GetValue
+		file = size == 1 ? pdc_sim_desfire_file(card, data[0]) : NULL;
+		if (!file) {
+			*status = PDC_SIM_DF_FILE_NOT_FOUND;
+			return 0;
+		}
+		if (file->type != PDC_SIM_DESFIRE_VALUE_FILE) {
+			*status = PDC_SIM_DF_PARAMETER_ERROR;
+			return 0;
+		}
+		memcpy(resp, card->memory + file->offset, 4);
+		return 4;
+	case 0xBB: // ReadRecords
+	case 0xBD: // ReadData
+		if (!card->pending_native) {
+			if (size != 7) {
+				*status = PDC_SIM_DF_LENGTH_ERROR;
+				return 0;
+			}
+			file = pdc_sim_desfire_file(card, data[0]);
+			if (!file) {
+				*status = PDC_SIM_DF_FILE_NOT_FOUND;
+				return 0;
+			}
+			if ((cmd == 0xBB) != (file->type == PDC_SIM_DESFIRE_CYCLIC_RECORD_FILE)
+					|| file->type == PDC_SIM_DESFIRE_VALUE_FILE) {
+				*status = PDC_SIM_DF_PARAMETER_ERROR;
+				return 0;
+			}
+			size_t offset = data[1] | data[2] << 8 | data[3] << 16;
+			size_t length = data[4] | data[5] << 8 | data[6] << 16;
+			size_t unit = cmd == 0xBB ? file->record_size : 1;
+			size_t units = file->size / unit;
+			if (!length && offset <= units)
+				length = units - offset;
+			if (offset + length > units) {
+				*status = PDC_SIM_DF_BOUNDARY_ERROR;
+				return 0;
+			}
+			if (cmd == 0xBB) // Offset 0 is the newest record, sent last
+				offset = units - offset - length;
+			card->pending_offset = file->offset + offset * unit;
+			card->pending_end = card->pending_offset + length * unit;
+		}
+		result = card->pending_end - card->pending_offset;
+		if (result > max_data) {
+			result = max_data;
+			card->pending_native = cmd;
+			*status = PDC_SIM_DF_ADDITIONAL_FRAME;
+		} else {
+			card->pending_native = 0;
+		}
+		memcpy(resp, card->memory + card->pending_offset, result);
+		card->pending_offset += result;
+		return result;
+	default:
+		*status = PDC_SIM_DF_ILLEGAL_COMMAND;
+		return 0;
+	}
+}
+
+// Queues response data of READ BINARY or GET RESPONSE, with 61xx when data
+// is left for GET RESPONSE
+static size_t pdc_sim_iso7816_response(pdc_sim_card_t *card, uint8_t *resp,
+		uint16_t *sw) {
+	size_t size = card->iso_remaining;
+	if (size > PDC_SIM_ISO_RESPONSE_DATA)
+		size = PDC_SIM_ISO_RESPONSE_DATA;
+	memcpy(resp, card->memory + card->iso_offset, size);
+	card->iso_offset += size;
+	card->iso_remaining -= size;
+	if (card->iso_remaining)
+		*sw = 0x6100 | (card->iso_remaining > 0xFF ? 0 : card->iso_remaining);
+	return size;
+}
+
+// Processes an interindustry command on the first file of the selected
+// application: READ BINARY, UPDATE BINARY and GET RESPONSE, short or
+// extended. Returns the size of the response data, the status word is
+// returned in *sw.
+static size_t pdc_sim_iso7816_command(pdc_sim_card_t *card,
+		const uint8_t *apdu, size_t size, uint8_t *resp, uint16_t *sw) {
+	const uint8_t *data = NULL;
+	size_t nc = 0, ne = 0;
+	bool end_of_file = false;
+
+	*sw = PDC_SIM_SW_OK;
+	if (size == 5) {
+		ne = apdu[4] ? apdu[4] : 256;
+	} else if (size > 5 && apdu[4]) {
+		nc = apdu[4];
+		data = apdu + 5;
+		if (size == 6 + nc)
+			ne = apdu[size - 1] ? apdu[size - 1] : 256;
+		else if (size != 5 + nc)
+			nc = SIZE_MAX;
+	} else if (size == 7) {
+		ne = (apdu[5] << 8 | apdu[6]) ? (apdu[5] << 8 | apdu[6]) : 65536;
+	} else if (size > 7) {
+		nc = apdu[5] << 8 | apdu[6];
+		data = apdu + 7;
+		if (size == 9 + nc)
+			ne = (apdu[size - 2] << 8 | apdu[size - 1]) ?
+					(apdu[size - 2] << 8 | apdu[size - 1]) : 65536;
+		else if (size != 7 + nc)
+			nc = SIZE_MAX;
+	}
+	if (nc == SIZE_MAX || size < 4) {
+		*sw = PDC_SIM_SW_WRONG_LENGTH;
+		return 0;
+	}
+
+	if (apdu[1] == 0xC0) { // GET RESPONSE
+		if (!card->iso_remaining) {
+			*sw = PDC_SIM_SW_WRONG_P1P2;
+			return 0;
+		}
+		return pdc_sim_iso7816_response(card, resp, sw);
+	}
+	card->iso_remaining = 0;
+
+	pdc_sim_desfire_app_t *app = pdc_sim_desfire_app(card, card->selected_aid);
+	if (!app || !app->file_count) {
+		*sw = PDC_SIM_SW_NOT_FOUND;
+		return 0;
+	}
+	pdc_sim_desfire_file_t *file = app->files;
+	size_t offset = apdu[2] << 8 | apdu[3];
+	if (offset > file->size) {
+		*sw = PDC_SIM_SW_WRONG_P1P2;
+		return 0;
+	}
+
+	switch (apdu[1]) {
+	case 0xB0: // READ BINARY
+		if (!ne) {
+			*sw = PDC_SIM_SW_WRONG_LENGTH;
+			return 0;
+		}
+		if (ne > file->size - offset) {
+			ne = file->size - offset;
+			end_of_file = true;
+		}
+		card->iso_offset = file->offset + offset;
+		card->iso_remaining = ne;
+		size = pdc_sim_iso7816_response(card, resp, sw);
+		if (end_of_file && !card->iso_remaining)
+			*sw = PDC_SIM_SW_END_OF_FILE;
+		return size;
+	case 0xD6: // UPDATE BINARY
+		if (!nc || offset + nc > file->size) {
+			*sw = PDC_SIM_SW_WRONG_LENGTH;
+			return 0;
+		}
+		memcpy(card->memory + file->offset + offset, data, nc);
+		return 0;
+	default:
+		*sw = PDC_SIM_SW_INS_UNKNOWN;
+		return 0;
+	}
+}
+
+// Builds the next I-block of the answer, returns its size
+static size_t pdc_sim_iso14443_4_inf(pdc_sim_card_t *card, uint8_t *resp,
+		size_t header) {
+	size_t size = card->inf_size - card->inf_offset;
+	size_t max = card->fsd - header - 2;
+	uint8_t pcb = 0x02 | (resp[0] & 0x08) | card->block;
+	if (size > max) {
+		size = max;
+		pcb |= 0x10;
+	}
+	resp[0] = pcb;
+	memcpy(resp + header, card->inf + card->inf_offset, size);
+	card->inf_offset += size;
+	return header + size;
+}
+
+static bool pdc_sim_iso14443_4_sent(pdc_sim_card_t *card, const uint8_t *resp,
+		size_t size, size_t *resp_bits) {
+	memcpy(card->last_response, resp, size);
+	card->last_response_size = size;
+	*resp_bits = 8 * size;
+	return true;
+}
+
+// Enters the block protocol, after RATS or ATTRIB
+static void pdc_sim_iso14443_4_begin(pdc_sim_card_t *card, uint8_t fsdi) {
+	static const uint16_t fsdi_to_fsd[] = { 16, 24, 32, 40, 48, 64, 96, 128,
+			256 };
+	card->fsd = fsdi_to_fsd[fsdi > 8 ? 8 : fsdi];
+	if (card->fsd > sizeof(card->last_response))
+		card->fsd = sizeof(card->last_response);
+	card->state = pdc_sim_state_protocol;
+	card->last_response_size = 0;
+	card->block = 1;
+	card->chain_size = 0;
+	card->inf_size = 0;
+	card->inf_offset = 0;
+	card->wtx_pending = 0;
+}
+
+static bool pdc_sim_iso14443_4(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t size, uint8_t *resp, size_t *resp_bits,
+		bool *resp_crc) {
+	if (pdc_sim_is_iso14443b(card) ?
+			!pdc_sim_check_crc_b(frame, size) : !pdc_sim_check_crc(frame, size))
+		return false; // Transmission errors are ignored by the PICC
+	size -= 2;
+	*resp_crc = true;
+
+	if (card->state == pdc_sim_state_active) {
+		if (frame[0] != PICC_CMD_RATS || size != 2) {
+			pdc_sim_fall_back(sim, card);
+			return false;
+		}
+		pdc_sim_iso14443_4_begin(card, frame[1] >> 4);
+		card->pps_allowed = true;
+		memcpy(resp, card->ats, card->ats[0]);
+		*resp_bits = 8 * card->ats[0];
+		return true;
+	}
+
+	uint8_t pcb = frame[0];
+	size_t header = 1 + ((pcb & 0x08) ? 1 : 0); // CID following
+	size_t offset;
+	bool pps_allowed = card->pps_allowed;
+
+	card->pps_allowed = false;
+	if ((pcb & 0xF0) == 0xD0) { // PPSS, CID in the lower nibble
+		uint8_t ta = (card->ats[0] > 2 && (card->ats[1] & 0x10)) ?
+				card->ats[2] : 0;
+		if (!pps_allowed || size != 3 || frame[1] != 0x11)
+			return false;
+		pdc_bitrate_t dsi = (frame[2] >> 2) & 3, dri = frame[2] & 3;
+		// TA(1): b7..b5 DS 8, 4, 2, b3..b1 DR 8, 4, 2, b8 same D required
+		if ((dsi && !(ta & (0x10 << (dsi - 1))))
+				|| (dri && !(ta & (0x01 << (dri - 1))))
+				|| ((ta & 0x80) && dsi != dri))
+			return false;
+		resp[0] = pcb;
+		*resp_bits = 8;
+		// The PICC switches after sending PPS response
+		card->dsi = dsi;
+		card->dri = dri;
+		return true;
+	}
+
+	if (size < header)
+		return false;
+	memcpy(resp, frame, header); // The CID, when present, is echoed
+
+	if ((pcb & 0xC0) == 0xC0) { // S-block
+		if ((pcb & 0x30) == 0x00) { // DESELECT
+			*resp_bits = 8 * header;
+			pdc_sim_deactivate(sim, card, pdc_sim_state_halt);
+			return true;
+		}
+		if ((pcb & 0x30) == 0x30 && card->wtx_pending) { // WTX response
+			if (--card->wtx_pending) {
+				resp[header] = 0x01; // WTXM
+				offset = header + 1;
+			} else {
+				offset = pdc_sim_iso14443_4_inf(card, resp, header);
+			}
+			return pdc_sim_iso14443_4_sent(card, resp, offset, resp_bits);
+		}
+		return false;
+	}
+
+	if ((pcb & 0xC0) == 0x80) { // R-block
+		if ((pcb & 0x01) == card->block) {
+			// The last block was lost, retransmit it
+			if (!card->last_response_size)
+				return false;
+			memcpy(resp, card->last_response, card->last_response_size);
+			*resp_bits = 8 * card->last_response_size;
+			return true;
+		}
+		if (pcb & 0x10) { // R(NAK): answer R(ACK)
+			resp[0] = 0xA2 | (pcb & 0x08) | card->block;
+			return pdc_sim_iso14443_4_sent(card, resp, header, resp_bits);
+		}
+		// R(ACK): continue the chain of the answer
+		if (card->inf_offset >= card->inf_size)
+			return false;
+		card->block ^= 1;
+		offset = pdc_sim_iso14443_4_inf(card, resp, header);
+		return pdc_sim_iso14443_4_sent(card, resp, offset, resp_bits);
+	}
+
+	// I-block, the PICC takes over the block number
+	card->block = pcb & 0x01;
+	if (pcb & 0x04) // NAD following
+		header++;
+	if (size < header || card->chain_size + size - header > sizeof(card->chain))
+		return false;
+	memcpy(card->chain + card->chain_size, frame + header, size - header);
+	card->chain_size += size - header;
+	if (pcb & 0x10) { // Chaining, acknowledge
+		resp[0] = 0xA2 | (pcb & 0x08) | card->block;
+		return pdc_sim_iso14443_4_sent(card, resp, 1 + ((pcb & 0x08) ? 1 : 0),
+				resp_bits);
+	}
+
+	const uint8_t *inf = card->chain;
+	size_t inf_size = card->chain_size;
+	card->chain_size = 0;
+	if (!inf_size)
+		return false;
+	if (inf[0] == 0x00 && inf_size >= 4) { // Interindustry command
+		uint16_t sw;
+		offset = pdc_sim_iso7816_command(card, inf, inf_size, card->inf, &sw);
+		card->inf[offset++] = sw >> 8;
+		card->inf[offset++] = sw;
+	} else {
+		bool wrapped = inf[0] == 0x90 && inf_size >= 5;
+		size_t data_offset = wrapped ? 5 : 1;
+		size_t data_size = wrapped ? (inf_size > 5 ? inf[4] : 0) : inf_size - 1;
+		uint8_t cmd = wrapped ? inf[1] : inf[0];
+		uint8_t status;
+
+		if (data_offset + data_size > inf_size)
+			data_size = 0;
+
+		offset = wrapped ? 0 : 1;
+		offset += pdc_sim_desfire_command(card, cmd, inf + data_offset,
+				data_size, card->inf + offset, &status,
+				PDC_SIM_DF_FRAME_DATA);
+		if (wrapped) {
+			card->inf[offset++] = 0x91;
+			card->inf[offset++] = status;
+		} else {
+			card->inf[0] = status;
+		}
+	}
+	// The answer is chained when it exceeds the FSD
+	card->inf_size = offset;
+	card->inf_offset = 0;
+
+	header = 1 + ((pcb & 0x08) ? 1 : 0);
+	if (card->wtx) {
+		card->wtx_pending = card->wtx;
+		resp[0] = 0xF2 | (pcb & 0x08);
+		resp[header] = 0x01; // WTXM
+		return pdc_sim_iso14443_4_sent(card, resp, header + 1, resp_bits);
+	}
+	offset = pdc_sim_iso14443_4_inf(card, resp, header);
+	return pdc_sim_iso14443_4_sent(card, resp, offset, resp_bits);
+}
+
+//------------------------------------------------------------------------------
+// ISO 15693 VICC
+//------------------------------------------------------------------------------
+
+static void pdc_sim_iso15693_error(uint8_t *resp, size_t *resp_size,
+		uint8_t error) {
+	resp[0] = ISO15693_RESPONSE_ERROR;
+	resp[1] = error;
+	*resp_size = 2;
+}
+
+// Whether the VICC answers in the current slot of the inventory
+static bool pdc_sim_iso15693_inventory(pdc_sim_t *sim, pdc_sim_card_t *card) {
+	uint8_t length = sim->inventory_mask_length;
+	if (card->state == pdc_sim_state_quiet)
+		return false;
+	for (int bit = 0; bit < length; bit++)
+		if (((card->uid[bit / 8] ^ sim->inventory_mask[bit / 8]) >> (bit % 8))
+				& 1)
+			return false;
+	if (sim->inventory_slots == 1)
+		return true;
+	// The slot is the 4 bits of the UID following the mask
+	uint8_t slot = 0;
+	for (int bit = 0; bit < 4; bit++)
+		slot |= ((card->uid[(length + bit) / 8] >> ((length + bit) % 8)) & 1)
+				<< bit;
+	return slot == sim->inventory_slot;
+}
+
+// A request other than the inventory, CRC removed. Returns whether the VICC
+// answers.
+static bool pdc_sim_iso15693_frame(pdc_sim_card_t *card, const uint8_t *frame,
+		size_t size, uint8_t *resp, size_t *resp_size) {
+	uint8_t flags = frame[0];
+	uint8_t cmd = frame[1];
+	const uint8_t *param = frame + 2;
+	size_t param_size = size - 2;
+	size_t blocks = card->memory_size / card->block_size;
+
+	if (flags & ISO15693_FLAG_ADDRESS) {
+		if (param_size < ISO15693_UID_SIZE
+				|| memcmp(param, card->uid, ISO15693_UID_SIZE)) {
+			// Selecting another VICC deselects this one
+			if (cmd == ISO15693_CMD_SELECT
+					&& card->state == pdc_sim_state_selected)
+				card->state = pdc_sim_state_ready;
+			return false;
+		}
+		param += ISO15693_UID_SIZE;
+		param_size -= ISO15693_UID_SIZE;
+	} else if (flags & ISO15693_FLAG_SELECT) {
+		if (card->state != pdc_sim_state_selected)
+			return false;
+	} else if (card->state == pdc_sim_state_quiet) {
+		return false;
+	}
+
+	resp[0] = 0x00;
+	*resp_size = 1;
+	switch (cmd) {
+	case ISO15693_CMD_STAY_QUIET:
+		if (flags & ISO15693_FLAG_ADDRESS)
+			card->state = pdc_sim_state_quiet;
+		return false;
+	case ISO15693_CMD_SELECT:
+		card->state = pdc_sim_state_selected;
+		return true;
+	case ISO15693_CMD_RESET_TO_READY:
+		card->state = pdc_sim_state_ready;
+		return true;
+	case ISO15693_CMD_GET_SYSTEM_INFO:
+		resp[1] = ISO15693_INFO_DSFID | ISO15693_INFO_AFI
+				| ISO15693_INFO_MEMORY_SIZE | ISO15693_INFO_IC_REFERENCE;
+		memcpy(resp + 2, card->uid, ISO15693_UID_SIZE);
+		resp[10] = card->dsfid;
+		resp[11] = card->afi;
+		resp[12] = blocks - 1;
+		resp[13] = card->block_size - 1;
+		resp[14] = 0x01; // IC reference
+		*resp_size = 15;
+		return true;
+	case ISO15693_CMD_READ_SINGLE_BLOCK:
+	case ISO15693_CMD_READ_MULTIPLE_BLOCKS: {
+		size_t first = param_size ? param[0] : blocks;
+		size_t count = 1;
+		if (cmd == ISO15693_CMD_READ_MULTIPLE_BLOCKS)
+			count = param_size > 1 ? (size_t) param[1] + 1 : blocks;
+		if (first + count > blocks
+				|| 1 + count * card->block_size > PDC_SIM_FRAME_SIZE) {
+			pdc_sim_iso15693_error(resp, resp_size, 0x10); // Not available
+			return true;
+		}
+		memcpy(resp + 1, card->memory + first * card->block_size,
+				count * card->block_size);
+		*resp_size += count * card->block_size;
+		return true;
+	}
+	case ISO15693_CMD_WRITE_SINGLE_BLOCK:
+		if (param_size != 1u + card->block_size || param[0] >= blocks) {
+			pdc_sim_iso15693_error(resp, resp_size, 0x10);
+			return true;
+		}
+		memcpy(card->memory + param[0] * card->block_size, param + 1,
+				card->block_size);
+		return true;
+	default:
+		pdc_sim_iso15693_error(resp, resp_size, 0x01); // Not supported
+		return true;
+	}
+}
+
+// Takes the inventory request apart, starts the first slot
+static bool pdc_sim_iso15693_inventory_request(pdc_sim_t *sim,
+		const uint8_t *frame, size_t size) {
+	// Flags, INVENTORY, [AFI], mask length, mask
+	size_t offset = (frame[0] & ISO15693_FLAG_AFI) ? 3 : 2;
+	if (offset >= size)
+		return false;
+	uint8_t length = frame[offset];
+	uint8_t slots = (frame[0] & ISO15693_FLAG_NB_SLOTS_1) ? 1 : 16;
+	if (length + (slots == 16 ? 4 : 0) > 64
+			|| offset + 1 + (length + 7) / 8 != size)
+		return false;
+	memset(sim->inventory_mask, 0, sizeof(sim->inventory_mask));
+	memcpy(sim->inventory_mask, frame + offset + 1, (length + 7) / 8);
+	sim->inventory_mask_length = length;
+	sim->inventory_slots = slots;
+	sim->inventory_slot = 0;
+	return true;
+}
+
+/**
+ * TransceiveData for the software PCD once ISO 15693 is loaded. An inventory
+ * request starts the first slot, a frame without data is the EOF that moves
+ * to the next slot. The answers of several VICCs collide on the first bit in
+ * which they differ.
+ */
+static int pdc_sim_iso15693_transceive(pdc_sim_t *sim, const uint8_t *data,
+		size_t size, void *backData, size_t *backLen, uint8_t *collisionPos,
+		bool sendCRC, bool recvCRC) {
+	uint8_t frame[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t resp[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t merged[PDC_SIM_FRAME_SIZE + 2];
+	size_t resp_size = 0, merged_size = 0;
+	size_t responders = 0;
+	size_t coll = SIZE_MAX;
+	bool inventory = false;
+
+	if (size > PDC_SIM_FRAME_SIZE)
+		return STATUS_NO_ROOM;
+	if (!size) {
+		// Slot marker
+		sim->air_time_ns += PDC_SIM_VCD_EOF_ns;
+		if (sim->inventory_slots == 16 && sim->inventory_slot < 15) {
+			sim->inventory_slot++;
+			inventory = true;
+		} else {
+			sim->inventory_slots = 0;
+		}
+	} else {
+		memcpy(frame, data, size);
+		if (sendCRC) {
+			uint16_t crc = iso14443_crc_b(frame, size);
+			frame[size++] = crc;
+			frame[size++] = crc >> 8;
+		}
+		sim->air_time_ns += PDC_SIM_VCD_SOF_ns + 8 * size * PDC_SIM_VCD_BIT_ns
+				+ PDC_SIM_VCD_EOF_ns;
+		sim->inventory_slots = 0;
+		if (size < 4 || !iso14443_crc_b_check(frame, size))
+			size = 0;	// Not received by the VICCs
+		else
+			size -= 2;
+		if (size && (frame[0] & ISO15693_FLAG_INVENTORY)) {
+			inventory = frame[1] == ISO15693_CMD_INVENTORY
+					&& pdc_sim_iso15693_inventory_request(sim, frame, size);
+			size = 0;
+		}
+	}
+
+	for (size_t i = 0; i < sim->card_count; i++) {
+		pdc_sim_card_t *card = sim->cards + i;
+		if (!card->present || sim->field_off
+				|| pdc_sim_card_protocol(card) != pdc_protocol_iso15693)
+			continue;
+		if (inventory) {
+			if (!pdc_sim_iso15693_inventory(sim, card))
+				continue;
+			resp[0] = 0x00;
+			resp[1] = card->dsfid;
+			memcpy(resp + 2, card->uid, ISO15693_UID_SIZE);
+			resp_size = 2 + ISO15693_UID_SIZE;
+		} else if (size < 2
+				|| !pdc_sim_iso15693_frame(card, frame, size, resp,
+						&resp_size)) {
+			continue;
+		}
+		uint16_t crc = iso14443_crc_b(resp, resp_size);
+		resp[resp_size++] = crc;
+		resp[resp_size++] = crc >> 8;
+
+		if (!responders) {
+			memcpy(merged, resp, resp_size);
+			merged_size = resp_size;
+		} else {
+			size_t common = resp_size < merged_size ? resp_size : merged_size;
+			size_t bit = 8 * common;
+			for (size_t b = 0; b < common; b++) {
+				uint8_t diff = merged[b] ^ resp[b];
+				if (diff) {
+					bit = 8 * b;
+					while (!(diff & 1)) {
+						diff >>= 1;
+						bit++;
+					}
+					break;
+				}
+			}
+			if (bit < coll && (bit < 8 * common || resp_size != merged_size))
+				coll = bit;
+			if (resp_size > merged_size)
+				merged_size = resp_size;
+		}
+		responders++;
+	}
+
+	if (!responders) {
+		sim->stats.timeouts++;
+		sim->air_time_ns += (uint64_t) sim->timeout_us * 1000;
+		return STATUS_TIMEOUT;
+	}
+	sim->air_time_ns += PDC_SIM_T1_ns + PDC_SIM_VICC_SOF_ns
+			+ 8 * merged_size * PDC_SIM_VICC_BIT_ns + PDC_SIM_VICC_EOF_ns
+			+ PDC_SIM_T2_ns;
+
+	if (coll != SIZE_MAX) {
+		// Only the bits before the collision are valid
+		sim->stats.collisions++;
+		if (backData && backLen) {
+			size_t bytes = coll / 8 + 1;
+			if (bytes > *backLen)
+				bytes = *backLen;
+			memcpy(backData, merged, bytes);
+			*backLen = bytes;
+		}
+		if (collisionPos)
+			*collisionPos = coll + 1 > 0xFF ? 0xFF : coll + 1;
+		return STATUS_COLLISION;
+	}
+
+	if (recvCRC)
+		merged_size -= 2;	// Checked and removed by the PCD
+	if (backData && backLen) {
+		if (merged_size > *backLen)
+			return STATUS_NO_ROOM;
+		memcpy(backData, merged, merged_size);
+		*backLen = merged_size;
+	}
+	return STATUS_OK;
+}
+
+//------------------------------------------------------------------------------
+// ISO 14443-B PICC
+//------------------------------------------------------------------------------
+
+static void pdc_sim_iso14443b_atqb(pdc_sim_card_t *card, uint8_t *resp,
+		size_t *resp_size) {
+	resp[0] = ISO14443B_ATQB;
+	memcpy(resp + 1, card->uid, ISO14443B_PUPI_SIZE);
+	memcpy(resp + 1 + ISO14443B_PUPI_SIZE, card->atqb, sizeof(card->atqb));
+	*resp_size = ISO14443B_ATQB_SIZE;
+	card->slot = 0;	// READY-DECLARED
+}
+
+// A frame with its CRC_B. Returns whether the PICC answers, the answer is
+// returned without CRC.
+static bool pdc_sim_iso14443b_frame(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t size, uint8_t *resp, size_t *resp_size) {
+	if (card->state == pdc_sim_state_protocol) {
+		// Only the block protocol until S(DESELECT)
+		size_t resp_bits = 0;
+		bool resp_crc;
+		if (card != sim->active
+				|| !pdc_sim_iso14443_4(sim, card, frame, size, resp,
+						&resp_bits, &resp_crc))
+			return false;
+		*resp_size = resp_bits / 8;
+		return true;
+	}
+	if (!pdc_sim_check_crc_b(frame, size))
+		return false;
+	size -= 2;
+
+	if (frame[0] == ISO14443B_CMD_REQB && size == 3) {
+		uint8_t afi = frame[1], param = frame[2];
+		uint8_t n = param & ISO14443B_PARAM_SLOTS_MASK;
+		if (card->state == pdc_sim_state_halt
+				&& !(param & ISO14443B_PARAM_WUPB))
+			return false;
+		// AFI: all families, all of a family, or the sub-family
+		if (afi && ((afi >> 4) != (card->afi >> 4)
+				|| ((afi & 0x0F) && afi != card->afi)))
+			return false;
+		pdc_sim_deactivate(sim, card, pdc_sim_state_ready);
+		// xorshift32
+		sim->slot_random ^= sim->slot_random << 13;
+		sim->slot_random ^= sim->slot_random >> 17;
+		sim->slot_random ^= sim->slot_random << 5;
+		card->slot = 1 + sim->slot_random % (1 << (n > 4 ? 4 : n));
+		if (card->slot != 1)
+			return false;
+		pdc_sim_iso14443b_atqb(card, resp, resp_size);
+		return true;
+	}
+	if ((frame[0] & 0x0F) == ISO14443B_CMD_REQB && size == 1) {
+		// Slot marker, for the PICCs that did not answer yet
+		if (card->state != pdc_sim_state_ready || !card->slot
+				|| card->slot != (frame[0] >> 4) + 1)
+			return false;
+		pdc_sim_iso14443b_atqb(card, resp, resp_size);
+		return true;
+	}
+	if (size < 1 + ISO14443B_PUPI_SIZE
+			|| memcmp(frame + 1, card->uid, ISO14443B_PUPI_SIZE))
+		return false;
+	if (frame[0] == ISO14443B_CMD_ATTRIB && size >= 9
+			&& card->state == pdc_sim_state_ready && !card->slot) {
+		// Param 2: the FSDI, the bit rates stay 106 kbps
+		pdc_sim_iso14443_4_begin(card, frame[6] & 0x0F);
+		sim->active = card;
+		resp[0] = frame[8] & 0x0F; // MBLI not given, CID
+		*resp_size = 1;
+		return true;
+	}
+	if (frame[0] == ISO14443B_CMD_HLTB && size == 1 + ISO14443B_PUPI_SIZE
+			&& card->state == pdc_sim_state_ready) {
+		pdc_sim_deactivate(sim, card, pdc_sim_state_halt);
+		resp[0] = 0x00;
+		*resp_size = 1;
+		return true;
+	}
+	return false;
+}
+
+/*
+ * TransceiveData with ISO 14443-B loaded. There is no bitwise anticollision,
+ * answers of several PICCs overlap and fail the CRC.
+ */
+static int pdc_sim_iso14443b_transceive(pdc_sim_t *sim, const uint8_t *data,
+		size_t size, void *backData, size_t *backLen, bool sendCRC,
+		bool recvCRC) {
+	uint8_t frame[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t resp[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t merged[PDC_SIM_FRAME_SIZE + 2];
+	size_t resp_size = 0, merged_size = 0;
+	size_t responders = 0;
+	bool collision = false;
+
+	if (size > PDC_SIM_FRAME_SIZE || !size)
+		return STATUS_NO_ROOM;
+	memcpy(frame, data, size);
+	if (sendCRC) {
+		uint16_t crc = iso14443_crc_b(frame, size);
+		frame[size++] = crc;
+		frame[size++] = crc >> 8;
+	}
+	sim->air_time_ns += PDC_SIM_B_SOF_ns + 10 * size * PDC_SIM_B_ETU_ns
+			+ PDC_SIM_B_EOF_ns;
+
+	for (size_t i = 0; i < sim->card_count && size >= 3; i++) {
+		pdc_sim_card_t *card = sim->cards + i;
+		if (!card->present || sim->field_off
+				|| pdc_sim_card_protocol(card) != pdc_protocol_iso14443b)
+			continue;
+		if (!pdc_sim_iso14443b_frame(sim, card, frame, size, resp,
+				&resp_size))
+			continue;
+		uint16_t crc = iso14443_crc_b(resp, resp_size);
+		resp[resp_size++] = crc;
+		resp[resp_size++] = crc >> 8;
+
+		if (!responders) {
+			memcpy(merged, resp, resp_size);
+			merged_size = resp_size;
+		} else if (resp_size != merged_size
+				|| memcmp(merged, resp, resp_size)) {
+			collision = true;
+			if (resp_size > merged_size)
+				merged_size = resp_size;
+		}
+		responders++;
+	}
+
+	if (!responders) {
+		sim->stats.timeouts++;
+		sim->air_time_ns += (uint64_t) sim->timeout_us * 1000;
+		return STATUS_TIMEOUT;
+	}
+	sim->air_time_ns += PDC_SIM_B_TR_ns + PDC_SIM_B_SOF_ns
+			+ 10 * merged_size * PDC_SIM_B_ETU_ns + PDC_SIM_B_EOF_ns;
+	if (collision) {
+		sim->stats.collisions++;
+		return STATUS_CRC_WRONG;
+	}
+
+	if (recvCRC)
+		merged_size -= 2;	// Checked and removed by the PCD
+	if (backData && backLen) {
+		if (merged_size > *backLen)
+			return STATUS_NO_ROOM;
+		memcpy(backData, merged, merged_size);
+		*backLen = merged_size;
+	}
+	return STATUS_OK;
+}
+
+//------------------------------------------------------------------------------
+// PCD
+//------------------------------------------------------------------------------
+
+static bool pdc_sim_card_frame(pdc_sim_t *sim, pdc_sim_card_t *card,
+		const uint8_t *frame, size_t frame_bits, uint8_t *resp,
+		size_t *resp_bits, bool *resp_crc) {
+	size_t size = (frame_bits + 7) / 8;
+	*resp_crc = false;
+
+	if (!sim->parity)
+		return card == sim->active && pdc_sim_is_mfc(card)
+				&& pdc_sim_mfc_raw(sim, card, frame, frame_bits, resp,
+						resp_bits);
+
+	// A PICC does not receive, or is not heard, at other bit rates
+	if (card->dri != sim->tx_rate || card->dsi != sim->rx_rate)
+		return false;
+
+	// ISO 14443-3 6.3: REQA is only answered in IDLE, WUPA also in HALT. A
+	// PICC in READY or ACTIVE takes them as unexpected frames.
+	if (frame_bits == 7) {
+		if (card->state == pdc_sim_state_ready
+				|| card->state == pdc_sim_state_active) {
+			pdc_sim_fall_back(sim, card);
+			return false;
+		}
+		if (frame[0] == PICC_CMD_REQA && card->state == pdc_sim_state_idle) {
+			card->from_halt = false;
+		} else if (frame[0] == PICC_CMD_WUPA
+				&& (card->state == pdc_sim_state_idle
+						|| card->state == pdc_sim_state_halt)) {
+			card->from_halt = card->state == pdc_sim_state_halt;
+		} else {
+			return false;
+		}
+		pdc_sim_deactivate(sim, card, pdc_sim_state_ready);
+		memcpy(resp, card->atqa, 2);
+		*resp_bits = 16;
+		return true;
+	}
+
+	if (frame[0] == PICC_CMD_SEL_CL1 || frame[0] == PICC_CMD_SEL_CL2
+			|| frame[0] == PICC_CMD_SEL_CL3) {
+		if (card->state == pdc_sim_state_active
+				|| (card->state == pdc_sim_state_ready
+						&& card->level != (frame[0] - PICC_CMD_SEL_CL1) / 2)) {
+			pdc_sim_fall_back(sim, card);
+			return false;
+		}
+		if (card->state != pdc_sim_state_ready || frame_bits < 16)
+			return false;
+		bool result = pdc_sim_anticollision(sim, card, frame, frame_bits,
+				resp, resp_bits, resp_crc);
+		if (card->state == pdc_sim_state_active)
+			sim->active = card;
+		return result;
+	}
+
+	// Other frames are for the selected PICC. A PICC still in READY takes
+	// them as unexpected frames.
+	if (card != sim->active) {
+		if (card->state == pdc_sim_state_ready)
+			pdc_sim_fall_back(sim, card);
+		return false;
+	}
+	if (frame_bits % 8)
+		return false;
+
+	if (frame[0] == PICC_CMD_HLTA && size == 4 && frame[1] == 0
+			&& card->state == pdc_sim_state_active) {
+		if (pdc_sim_check_crc(frame, size))
+			pdc_sim_deactivate(sim, card, pdc_sim_state_halt);
+		return false;
+	}
+
+	if (pdc_sim_is_t2t(card))
+		return pdc_sim_t2t(sim, card, frame, size, resp, resp_bits, resp_crc);
+	if (pdc_sim_is_mfc(card))
+		return pdc_sim_mfc(sim, card, frame, size, resp, resp_bits, resp_crc);
+	return pdc_sim_iso14443_4(sim, card, frame, size, resp, resp_bits,
+			resp_crc);
+}
+
+/**
+ * TransceiveData for the software PCD. The frame is offered to the PICCs in
+ * the field. The responses are merged bitwise: bits on which the responding
+ * PICCs differ are reported as a collision, like a PCD would detect them.
+ */
+int pdc_sim_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
+	pdc_sim_t *sim = pdc;
+	uint8_t frame[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t resp[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t merged_or[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t merged_and[PDC_SIM_FRAME_SIZE + 2];
+	uint8_t tx_last_bits = validBits ? *validBits : 0;
+	size_t responders = 0, bits_min = 0, bits_max = 0;
+	size_t frame_bits;
+	bool resp_crc = false;
+
+	sim->pdc.frame_count++;
+	sim->stats.frames++;
+
+	if (sim->protocol == pdc_protocol_iso15693)
+		return pdc_sim_iso15693_transceive(sim, sendData, sendLen, backData,
+				backLen, collisionPos, sendCRC, recvCRC);
+	if (sim->protocol == pdc_protocol_iso14443b)
+		return pdc_sim_iso14443b_transceive(sim, sendData, sendLen, backData,
+				backLen, sendCRC, recvCRC);
+	if (sendLen > PDC_SIM_FRAME_SIZE || !sendLen)
+		return STATUS_NO_ROOM;
+	memcpy(frame, sendData, sendLen);
+	if (sendCRC) {
+		uint16_t crc = iso14443_crc_a(frame, sendLen);
+		frame[sendLen++] = crc;
+		frame[sendLen++] = crc >> 8;
+	}
+	frame_bits = 8 * sendLen - (tx_last_bits ? 8 - tx_last_bits : 0);
+	sim->air_time_ns += ((sim->parity ? 9 * sendLen : frame_bits) + 2)
+			* (PDC_SIM_BIT_ns >> sim->tx_rate) + PDC_SIM_FDT_ns;
+
+	// Every PICC in the field receives the frame. Only the selected PICC
+	// answers frames other than REQA, WUPA and anticollision, the others
+	// may change state, see pdc_sim_card_frame().
+	if (sim->active && !sim->active->present)
+		sim->active = NULL;
+
+	for (size_t i = 0; i < sim->card_count; i++) {
+		pdc_sim_card_t *card = sim->cards + i;
+		size_t resp_bits = 0;
+		if (!card->present || sim->field_off
+				|| pdc_sim_card_protocol(card) != pdc_protocol_iso14443a)
+			continue;
+		if (!pdc_sim_card_frame(sim, card, frame, frame_bits, resp,
+				&resp_bits, &resp_crc))
+			continue;
+		if (resp_crc) {
+			uint16_t crc = iso14443_crc_a(resp, resp_bits / 8);
+			resp[resp_bits / 8] = crc;
+			resp[resp_bits / 8 + 1] = crc >> 8;
+			resp_bits += 16;
+		}
+		size_t bytes = (resp_bits + 7) / 8;
+		if (resp_bits % 8)
+			resp[bytes - 1] &= (1 << (resp_bits % 8)) - 1;
+		if (!responders) {
+			memcpy(merged_or, resp, bytes);
+			memcpy(merged_and, resp, bytes);
+			bits_min = bits_max = resp_bits;
+		} else {
+			size_t known = (bits_max + 7) / 8;
+			for (size_t b = 0; b < bytes; b++) {
+				if (b < known) {
+					merged_or[b] |= resp[b];
+					merged_and[b] &= resp[b];
+				} else {
+					merged_or[b] = resp[b];
+					merged_and[b] = 0;
+				}
+			}
+			for (size_t b = bytes; b < known; b++)
+				merged_and[b] = 0;
+			if (resp_bits < bits_min)
+				bits_min = resp_bits;
+			if (resp_bits > bits_max)
+				bits_max = resp_bits;
+		}
+		responders++;
+	}
+
+	if (!responders) {
+		sim->stats.timeouts++;
+		sim->air_time_ns += (uint64_t) sim->timeout_us * 1000;
+		return STATUS_TIMEOUT;
+	}
+
+	// Find the first colliding bit
+	size_t bits = bits_max;
+	bool collision = false;
+	if (responders > 1) {
+		size_t coll = bits_min < bits_max ? bits_min : bits_max;
+		for (size_t b = 0; b < (bits_max + 7) / 8; b++) {
+			uint8_t diff = merged_or[b] ^ merged_and[b];
+			if (diff) {
+				size_t bit = 8 * b;
+				while (!(diff & 1)) {
+					diff >>= 1;
+					bit++;
+				}
+				if (bit < coll)
+					coll = bit;
+				break;
+			}
+		}
+		if (coll < bits_max) {
+			// The bits after the collision are cleared (ValuesAfterColl = 0)
+			collision = true;
+			bits = coll + 1;
+			merged_and[coll / 8] &= (1 << (coll % 8)) - 1;
+			sim->stats.collisions++;
+		}
+	}
+	merged_and[(bits + 7) / 8] = 0;
+	sim->air_time_ns += ((sim->parity ? 9 * ((bits + 7) / 8) : bits) + 2)
+			* (PDC_SIM_BIT_ns >> sim->rx_rate);
+
+	if (recvCRC && resp_crc && !collision && bits >= 16)
+		bits -= 16;	// Checked and removed by the PCD
+
+	if (backData && backLen) {
+		uint8_t *out = backData;
+		size_t bytes = (rxAlign + bits + 7) / 8;
+		if (bytes > *backLen)
+			return STATUS_NO_ROOM;
+		if (!rxAlign) {
+			memcpy(out, merged_and, bytes);
+		} else {
+			out[0] = merged_and[0] << rxAlign;
+			for (size_t b = 1; b < bytes; b++)
+				out[b] = (merged_and[b] << rxAlign)
+						| (merged_and[b - 1] >> (8 - rxAlign));
+		}
+		*backLen = bytes;
+		if (validBits)
+			*validBits = (rxAlign + bits) % 8;
+	}
+
+	if (collision) {
+		if (collisionPos)
+			*collisionPos = rxAlign + bits;
+		return STATUS_COLLISION;
+	}
+	return STATUS_OK;
+}
@@ -0,0 +1,273 @@
+/******************************************************************************
+ File:         pdc_sim.h
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements a software PCD with virtual PICCs in its field.
+
+ It implements TransceiveData against the virtual PICCs at frame level, so
+ the card layer can be exercised and benchmarked on a host without a reader
+ attached. Supported virtual PICCs:
+
+ * NTAG213/215/216
+ * MIFARE Ultralight
+ * MIFARE Classic 1K/4K (the Crypto1 unit of the PCD is considered
+   transparent, as with the hardware, authentication is by key comparison)
+ * DESFire style ISO 14443-4 PICC, with block chaining both ways,
+   optional waiting time extensions and PPS up to 848 kbps. Besides the
+   native and wrapped commands, the first file of an application can be
+   accessed with READ BINARY and UPDATE BINARY, short or extended, with
+   GET RESPONSE for answers above 512 bytes
+ * ICode SLIX, ISO 15693, once SetProtocol loaded ISO 15693. The inventory
+   with 1 or 16 slots, where an EOF moves to the next slot, and the
+   addressed commands to read and write blocks
+ * ISO 14443-B PICC, once SetProtocol loaded ISO 14443-B, as used for
+   transit cards. REQB/WUPB with slot markers, where every PICC picks a
+   random slot, ATTRIB and HLTB. After ATTRIB the PICC runs the ISO 14443-4
+   and DESFire model above, with CRC_B. Answers of several PICCs in one slot
+   fail the CRC
+
+ The PICCs of one protocol keep their state while another protocol is
+ loaded, the field is only reset by SetField.
+
+ For low-power card detection the field can be switched off, and the I and
+ Q channel of an LPCD measurement are modelled: every PICC present detunes
+ them by lpcd_detune, on top of noise of up to lpcd_noise.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#ifndef BSRFID_DRIVERS_PDC_SIM_H_
+#define BSRFID_DRIVERS_PDC_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pdc.h"
+#include "picc.h"
+#include "crypto1.h"
+
+#define PDC_SIM_MEMORY_SIZE			(8192)
+#define PDC_SIM_FRAME_SIZE			(1024)
+#define PDC_SIM_DESFIRE_APPS		(4)
+#define PDC_SIM_DESFIRE_FILES		(4)
+
+// Air time at 106 kbps, one bit is 128/fc. Halved for every step of the
+// bit rate.
+#define PDC_SIM_BIT_ns				(9440)
+// Frame delay time PCD to PICC, 1172/fc
+#define PDC_SIM_FDT_ns				(86430)
+#define PDC_SIM_TIMEOUT_us			(1000)
+// ISO 15693 at the high data rate. PCD to VICC 1 out of 4 coding, 2 bits
+// per 75.52 µs, VICC to PCD a single subcarrier at 26.48 kbps.
+#define PDC_SIM_VCD_BIT_ns			(37760)
+#define PDC_SIM_VCD_SOF_ns			(75520)
+#define PDC_SIM_VCD_EOF_ns			(37760)
+#define PDC_SIM_VICC_BIT_ns			(37760)
+#define PDC_SIM_VICC_SOF_ns			(56640)
+#define PDC_SIM_VICC_EOF_ns			(56640)
+// VICC response delay t1, 4352/fc, and the wait of the PCD after an
+// answer, t2, 4192/fc
+#define PDC_SIM_T1_ns				(320900)
+#define PDC_SIM_T2_ns				(309100)
+// ISO 14443-B at 106 kbps: characters of 10 etu, the SOF and EOF, and the
+// minimal TR0 + TR1, 1024/fc + 1280/fc, before the answer of the PICC
+#define PDC_SIM_B_ETU_ns			(9440)
+#define PDC_SIM_B_SOF_ns			(122720)
+#define PDC_SIM_B_EOF_ns			(103840)
+#define PDC_SIM_B_TR_ns				(169900)
+// LPCD: I and Q without PICC, the change per PICC and the peak noise
+#define PDC_SIM_LPCD_I				(40)
+#define PDC_SIM_LPCD_Q				(24)
+#define PDC_SIM_LPCD_DETUNE			(6)
+#define PDC_SIM_LPCD_NOISE			(1)
+#define PDC_SIM_LPCD_MEASURE_us		(150)
+
+typedef enum {
+	pdc_sim_card_ntag213,
+	pdc_sim_card_ntag215,
+	pdc_sim_card_ntag216,
+	pdc_sim_card_ultralight,
+	pdc_sim_card_mfc_1k,
+	pdc_sim_card_mfc_4k,
+	pdc_sim_card_desfire,
+	pdc_sim_card_icode_slix,	// ISO 15693
+	pdc_sim_card_iso14443b,		// ISO 14443-B, ISO 14443-4 as the DESFire
+} pdc_sim_card_type_t;
+
+typedef enum {
+	pdc_sim_state_idle,
+	pdc_sim_state_ready,
+	pdc_sim_state_active,
+	pdc_sim_state_halt,
+	pdc_sim_state_protocol,		// ISO 14443-4 after RATS
+	pdc_sim_state_quiet,		// ISO 15693, after STAY QUIET
+	pdc_sim_state_selected,		// ISO 15693, after SELECT
+} pdc_sim_state_t;
+
+#define PDC_SIM_DESFIRE_STANDARD_FILE		(0x00)
+#define PDC_SIM_DESFIRE_VALUE_FILE			(0x02)
+#define PDC_SIM_DESFIRE_CYCLIC_RECORD_FILE	(0x04)
+
+typedef struct {
+	uint8_t file_no;
+	uint8_t type;
+	uint16_t offset;			// Offset of the data in the card memory
+	uint16_t size;
+	uint16_t record_size;		// Record files, the records fill the file
+} pdc_sim_desfire_file_t;
+
+typedef struct {
+	uint32_t aid;
+	uint8_t file_count;
+	pdc_sim_desfire_file_t files[PDC_SIM_DESFIRE_FILES];
+} pdc_sim_desfire_app_t;
+
+typedef struct {
+	pdc_sim_card_type_t type;
+	bool present;				// In the field
+	pdc_sim_state_t state;
+	bool from_halt;				// READY* or ACTIVE*, woken from HALT by WUPA
+
+	uint8_t uid[10];
+	uint8_t uid_size;
+	uint8_t atqa[2];
+	uint8_t sak;
+	uint8_t version[8];			// GET_VERSION response, T2T only
+	uint8_t levels;				// Cascade levels
+	uint8_t level;				// Current cascade level
+	uint8_t cl[3][5];			// Anticollision data per cascade level
+
+	uint8_t memory[PDC_SIM_MEMORY_SIZE];
+	size_t memory_size;
+	uint8_t block_size;			// ISO 15693
+	uint8_t dsfid;
+	uint8_t afi;				// ISO 15693 and ISO 14443-B
+	uint8_t atqb[7];			// ISO 14443-B: application data, protocol info
+	uint8_t slot;				// ISO 14443-B: slot of the REQB, 0 once answered
+
+	// MIFARE Classic
+	int auth_sector;			// -1 when not authenticated
+	uint8_t pending_cmd;		// Second part of a two part command
+	uint8_t pending_block;
+	int32_t transfer_value;
+	// Crypto1 on the air, when the PCD runs the software Crypto1
+	crypto1_t crypto1;
+	bool crypto1_on;			// Frames are encrypted
+	int auth_pending;			// Sector of the authentication in progress
+	uint32_t nonce;				// nT of the authentication in progress
+	uint8_t nonce_parity[4];	// Encrypted parity of nT for a nested auth
+
+	// ISO 14443-4 / DESFire
+	uint8_t ats[8];
+	bool pps_allowed;			// PPS is only accepted right after the ATS
+	pdc_bitrate_t dsi;			// Bit rate PICC to PCD
+	pdc_bitrate_t dri;			// Bit rate PCD to PICC
+	uint8_t last_response[64];	// Last block sent, for retransmission
+	size_t last_response_size;
+	size_t fsd;
+	uint8_t block;				// Block number of the PICC
+	uint8_t chain[PDC_SIM_FRAME_SIZE];	// INF of chained I-blocks received
+	size_t chain_size;
+	uint8_t inf[PDC_SIM_FRAME_SIZE];	// INF of the answer, chained above FSD
+	size_t inf_size;
+	size_t inf_offset;
+	unsigned int wtx;			// S(WTX) requests before every answer
+	unsigned int wtx_pending;
+	uint32_t selected_aid;
+	uint8_t pending_native;		// Command continued with 0xAF
+	size_t pending_offset;
+	size_t pending_end;
+	size_t iso_offset;			// Data left for GET RESPONSE
+	size_t iso_remaining;
+	uint16_t memory_used;
+	uint8_t app_count;
+	pdc_sim_desfire_app_t apps[PDC_SIM_DESFIRE_APPS];
+} pdc_sim_card_t;
+
+typedef struct {
+	unsigned int frames;
+	unsigned int collisions;
+	unsigned int timeouts;
+} pdc_sim_stats_t;
+
+// The bs_pdc_t must be the first member, pass &sim->pdc to the card layer.
+typedef struct {
+	bs_pdc_t pdc;
+	pdc_sim_card_t *cards;
+	size_t card_count;
+	pdc_sim_card_t *active;		// The selected PICC, if any
+	bool parity;				// Disabled: parity bits are sent as data bits
+	pdc_bitrate_t tx_rate;		// A PICC only answers at the rates it agreed
+	pdc_bitrate_t rx_rate;
+	uint64_t air_time_ns;		// Simulated time spent on the air
+	unsigned int timeout_us;	// Time lost when no PICC answers
+	bool field_off;				// Switched off by SetField, no PICC answers
+	pdc_protocol_t protocol;
+	// ISO 15693 inventory in progress, the slot markers follow the request
+	uint8_t inventory_slots;	// 0 when none
+	uint8_t inventory_slot;
+	uint8_t inventory_mask[8];
+	uint8_t inventory_mask_length;
+	uint32_t slot_random;		// Slots picked by the ISO 14443-B PICCs
+	uint8_t lpcd_i;				// LPCD channels without PICC
+	uint8_t lpcd_q;
+	uint8_t lpcd_detune;		// Channel change per PICC present
+	uint8_t lpcd_noise;
+	uint32_t lpcd_random;
+	pdc_sim_stats_t stats;
+} pdc_sim_t;
+
+void pdc_sim_init(pdc_sim_t *sim, pdc_sim_card_t *cards, size_t card_count);
+void pdc_sim_card_init(pdc_sim_card_t *card, pdc_sim_card_type_t type,
+		const uint8_t *uid, uint8_t uid_size);
+void pdc_sim_field_reset(pdc_sim_t *sim);
+
+int pdc_sim_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC);
+int pdc_sim_set_parity(void *pdc, bool enable);
+int pdc_sim_set_timeout(void *pdc, uint32_t timeout_us);
+int pdc_sim_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx);
+int pdc_sim_set_field(void *pdc, bool on);
+int pdc_sim_set_protocol(void *pdc, pdc_protocol_t protocol);
+int pdc_sim_lpcd_measure(void *pdc, pdc_lpcd_sample_t *sample);
+int pdc_sim_crypto1_begin(void *pdc, void *picc);
+int pdc_sim_crypto1_end(void *pdc);
+
+int pdc_sim_mfc_set_keys(pdc_sim_card_t *card, int sector,
+		const uint8_t *key_a, const uint8_t *key_b);
+int pdc_sim_desfire_add_application(pdc_sim_card_t *card, uint32_t aid);
+int pdc_sim_desfire_add_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, const void *data, uint16_t size);
+int pdc_sim_desfire_add_value_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, int32_t value);
+int pdc_sim_desfire_add_record_file(pdc_sim_card_t *card, uint32_t aid,
+		uint8_t file_no, const void *records, uint16_t record_size,
+		uint16_t count);
+
+int pdc_sim_get_time_ms(void);
+int pdc_sim_delay_ms(int ms);
+
+#endif /* BSRFID_DRIVERS_PDC_SIM_H_ */
@@ -31,197 +31,333 @@
  ********************************************************************************
 
 
- Placeholder for planned future implementation.
+ The ISO 14443-A exchange by the transceive state of the PN5180. Every
+ frame costs a fixed number of SPI frames: one WRITE_REGISTER_MULTIPLE with
+ the settings of the frame, SEND_DATA, a READ_REGISTER_MULTIPLE for every
+ poll of IRQ_STATUS and RX_STATUS, and READ_DATA. The BUSY line paces the
+ SPI frames, rather than fixed delays.
+
+ ISO 15693 and ISO 14443-B use the same exchange once their RF
+ configuration is loaded by SetProtocol, the CRC unit follows the
+ configuration. The autonomous inventory of the PN5180, EPC_INVENTORY, is
+ ISO 18000-3M3 only, the ISO 15693 inventory is run by the card layer. A
+ slot marker is a SEND_DATA with TX_DATA_ENABLE cleared, the EOF alone.
 
  *******************************************************************************/
 
 #include "pn5180.h"
-
-int pn5180_get_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t *value) {
-	pn5180_request_t req = { 0 };
-	req.command = PN5180_CMD_READ_REGISTER;
-	req.reg.address = reg;
-	int result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 2,
-			false);
-	if (result)
-		return result;
-	bshal_delay_ms(1);
-	result = bshal_spim_receive(pn5180->transport_instance.spim, value,
-			sizeof(uint32_t), false);
-	return result;
-}
-
-int pn5180_set_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) {
-	pn5180_request_t req = { 0 };
-	req.command = PN5180_CMD_WRITE_REGISTER;
-	req.reg.address = reg;
-	req.reg.value = value;
-	int result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 6,
-			false);
-	return result;
-}
-
-int pn5180_or_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) {
-	pn5180_request_t req = { 0 };
-	req.command = PN5180_CMD_WRITE_REGISTER_OR_MASK;
-	req.reg.address = reg;
-	req.reg.value = value;
-	int result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 6,
-			false);
-	return result;
+#include "pn5180_transport.h"
+
+#include <string.h>
+
+// Air time of a byte at 106 kbps, 9 bits of 9.44 µs
+#define PN5180_BYTE_us			(86)
+// ISO 15693, 8 bits of 37.76 µs. The CRC, SOF and EOF of a frame, and the
+// response time t1, add to either direction.
+#define PN5180_BYTE_15693_us	(302)
+#define PN5180_FRAME_15693_us	(1050)
+// ISO 14443-B, 10 etu of 9.44 µs. The CRC, SOF and EOF of a frame, and the
+// minimal TR0 and TR1 before the answer.
+#define PN5180_BYTE_14443B_us	(94)
+#define PN5180_FRAME_14443B_us	(620)
+
+/**
+ * Reads from the EEPROM, eg. the die identifier and the versions at
+ * address 0, see pn5180_eeprom_info.
+ */
+int pn5180_read_eeprom(pn5180_t *pn5180, uint8_t address, void *data,
+		size_t size) {
+	uint8_t frame[3] = { PN5180_CMD_READ_EEPROM, address, size };
+	if (size > 0xFF)
+		return STATUS_INVALID;
+	return pn5180_command(pn5180, frame, sizeof(frame), data, size);
 }
-int pn5180_and_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) {
-	pn5180_request_t req = { 0 };
-	req.command = PN5180_CMD_WRITE_REGISTER_AND_MASK;
-	req.reg.address = reg;
-	req.reg.value = value;
-	int result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 6,
-			false);
-	return result;
-
-}
-
-int pn5180_test(pn5180_t *pdc) {
-	pn5180_eeprom_info eeprom = { 0 };
-	pn5180_request_t req = { 0 };
-	req.command = PN5180_CMD_READ_EEPROM;
-	req.read_eeprom.start_address = 0;
-	req.read_eeprom.number_of_bytes = sizeof(pn5180_eeprom_info);
-
-	// While the datasheet says I should keep the chip select low during a transaction
-	// I actually must toggle it between read and write to get a result.
-	// Otherwise it results all 0xFF
-	//int result = bshal_spim_transmit(pdc->transport_instance.spim, &req, 3, true);
-	int result = bshal_spim_transmit(pdc->transport_instance.spim, &req, 3,
-			false);
-	bshal_delay_ms(1);
-	if (result)
-		return result;
-	result = bshal_spim_receive(pdc->transport_instance.spim, &eeprom,
-			sizeof(pn5180_eeprom_info), false);
-	bshal_delay_ms(1);
-
-
-	return result;
 
+/**
+ * Loads the register settings of a protocol and bit rate from the EEPROM,
+ * for transmission and reception.
+ */
+int pn5180_load_rf_config(pn5180_t *pn5180, uint8_t tx, uint8_t rx) {
+	uint8_t frame[3] = { PN5180_CMD_LOAD_RF_CONFIG, tx, rx };
+	return pn5180_send(pn5180, frame, sizeof(frame));
 }
 
-void PN5180_Init(pn5180_t *pn5180) {
-	pn5180_request_t req = { 0 };
+int pn5180_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
+	pn5180_t *pn5180 = pdc;
+	uint8_t txLastBits = validBits ? *validBits : 0;
+	uint8_t frame[2 + PN5180_TX_BUFFER_SIZE];
+	pn5180_reg_batch_t batch;
 	int result;
-	//  AN12650 - "Using the PN5180 without library"1
-	//	1: sendSPI(0x11, 0x00, 0x80);
-	//  1: Loads the ISO 14443 - 106 protocol into the RF registers
-	req.command = PN5180_CMD_LOAD_RF_CONFIG;
-	req.raw[0] = 0x00;
-	req.raw[1] = 0x80;
-	result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 3,
-			false);
+
+	if (sendLen > PN5180_TX_BUFFER_SIZE)
+		return STATUS_NO_ROOM;
+	pn5180->frame_count++;
+
+	// The settings of the frame, in one SPI frame. Idle ends a frame still
+	// waiting for its answer, the transceive state is entered from idle.
+	pn5180_reg_batch_init(&batch);
+	pn5180_reg_batch_add(&batch, PN5180_REG_SYSTEM_CONFIG,
+			PN5180_REG_ACTION_AND, ~PN5180_SYSTEM_CONFIG_COMMAND_MASK);
+	pn5180_reg_batch_add(&batch, PN5180_REG_IRQ_CLEAR, PN5180_REG_ACTION_WRITE,
+			PN5180_IRQ_ALL);
+	if (sendCRC)
+		pn5180_reg_batch_add(&batch, PN5180_REG_CRC_TX_CONFIG,
+				PN5180_REG_ACTION_OR, PN5180_CRC_ENABLE);
+	else
+		pn5180_reg_batch_add(&batch, PN5180_REG_CRC_TX_CONFIG,
+				PN5180_REG_ACTION_AND, ~PN5180_CRC_ENABLE);
+	pn5180_reg_batch_add(&batch, PN5180_REG_CRC_RX_CONFIG,
+			PN5180_REG_ACTION_AND,
+			~(PN5180_CRC_ENABLE | PN5180_CRC_RX_BIT_ALIGN_MASK));
+	if (recvCRC || rxAlign)
+		pn5180_reg_batch_add(&batch, PN5180_REG_CRC_RX_CONFIG,
+				PN5180_REG_ACTION_OR,
+				(recvCRC ? PN5180_CRC_ENABLE : 0)
+						| ((rxAlign & 0x07) << PN5180_CRC_RX_BIT_ALIGN_SHIFT));
+	if (pn5180->protocol == pdc_protocol_iso15693) {
+		// No data: the slot marker
+		if (sendLen)
+			pn5180_reg_batch_add(&batch, PN5180_REG_TX_CONFIG,
+					PN5180_REG_ACTION_OR, PN5180_TX_CONFIG_DATA_ENABLE);
+		else
+			pn5180_reg_batch_add(&batch, PN5180_REG_TX_CONFIG,
+					PN5180_REG_ACTION_AND, ~PN5180_TX_CONFIG_DATA_ENABLE);
+	}
+	pn5180_reg_batch_add(&batch, PN5180_REG_SYSTEM_CONFIG, PN5180_REG_ACTION_OR,
+			PN5180_SYSTEM_CONFIG_COMMAND_TRANSCEIVE);
+	result = pn5180_reg_batch_send(pn5180, &batch);
 	if (result)
 		return result;
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
-
 
-	pn5180_or_reg32(pn5180, 0x04, 0x01);
-	bshal_delay_ms(1);
-
-
-	//	2: sendSPI(0x16, 0x00);
-	//  2: Switches the RF field ON.
-	//  So after turning the RF field on, it stops responding
-	//  Could we have a brownout problem?
-	req.command = PN5180_CMD_RF_ON;
-	req.raw[0] = 0x00;
-	result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 2,
-			false);
+	// The parameter of SEND_DATA is the number of valid bits in the last
+	// byte, 0 when all 8 are
+	frame[0] = PN5180_CMD_SEND_DATA;
+	frame[1] = txLastBits & 0x07;
+	memcpy(frame + 2, sendData, sendLen);
+	result = pn5180_send(pn5180, frame, 2 + sendLen);
 	if (result)
 		return result;
-	bshal_delay_ms(10);
-	pn5180_test(pn5180);
-
-
-
-
-
-
-	//	3: sendSPI(0x02, 0x19, 0xFE, 0xFF, 0xFF, 0xFF);
-	//  3: Switches the CRC extension off in Tx direction
-	// Note assuming little endian host
-	// TODO: register defines
-	pn5180_and_reg32(pn5180, 0x19, 0xFFFFFFFE);
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
-
-	//	4: sendSPI(0x02, 0x12, 0xFE, 0xFF, 0xFF, 0xFF);
-	//  4: Switches the CRC extension off in Rx direction
-	// Note assuming little endian host
-	// TODO: register defines
-	pn5180_and_reg32(pn5180, 0x12, 0xFFFFFFFE);
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
 
+	// The wait is ended by the MCU: the timeout of the PCD plus the air time
+	// of the frames. One more ms as the tick may advance right away. An
+	// answer has begun by the end of the timeout, without its SOF the wait
+	// ends there, eg. the empty slots of an inventory.
+	uint32_t frame_us = PN5180_BYTE_us, overhead_us = 0;
+	if (pn5180->protocol == pdc_protocol_iso15693) {
+		frame_us = PN5180_BYTE_15693_us;
+		overhead_us = PN5180_FRAME_15693_us;
+	} else if (pn5180->protocol == pdc_protocol_iso14443b) {
+		frame_us = PN5180_BYTE_14443B_us;
+		overhead_us = PN5180_FRAME_14443B_us;
+	}
+	uint32_t answer_us = (pn5180->timeout_us ?
+			pn5180->timeout_us : PN5180_TIMEOUT_us)
+			+ overhead_us + frame_us * sendLen;
+	uint32_t timeout_us = answer_us + overhead_us
+			+ frame_us * (backLen ? *backLen : 0);
+	uint32_t answer_ms = (answer_us + 999) / 1000 + 1;
+	uint32_t timeout_ms = (timeout_us + 999) / 1000 + 1;
+	uint32_t begin = pn5180->get_time_ms();
+
+	if (pn5180->wait_irq)
+		pn5180->wait_irq(pn5180, answer_ms);
+
+	static const uint8_t status_regs[2] = { PN5180_REG_IRQ_STATUS,
+			PN5180_REG_RX_STATUS };
+	uint32_t status[2];
+	for (;;) {
+		result = pn5180_get_reg32_multiple(pn5180, status_regs, status, 2);
+		if (result)
+			return result;
+		if (status[0] & (PN5180_IRQ_RX | PN5180_IRQ_GENERAL_ERROR))
+			break;
+		// Nothing received. The next frame starts from idle again.
+		uint32_t elapsed = pn5180->get_time_ms() - begin;
+		if (elapsed >= timeout_ms)
+			return STATUS_TIMEOUT;
+		if (!(status[0] & PN5180_IRQ_RX_SOF_DET)) {
+			if (elapsed >= answer_ms)
+				return STATUS_TIMEOUT;
+		} else if (pn5180->wait_irq) {
+			// Receiving, until the end of the longest answer
+			pn5180->wait_irq(pn5180, timeout_ms - elapsed);
+		}
+	}
+	if (status[0] & PN5180_IRQ_GENERAL_ERROR)
+		return STATUS_ERROR;
+
+	uint32_t rx_status = status[1];
+	if (rx_status & PN5180_RX_STATUS_PROTOCOL_ERROR)
+		return STATUS_ERROR;
+	size_t bytes = rx_status & PN5180_RX_STATUS_BYTES_MASK;
+	uint8_t lastBits = (rx_status >> PN5180_RX_STATUS_LAST_BITS_SHIFT)
+			& PN5180_RX_STATUS_LAST_BITS_MASK;
+
+	if (backData && backLen) {
+		if (bytes > *backLen)
+			return STATUS_NO_ROOM;
+		if (bytes) {
+			frame[0] = PN5180_CMD_READ_DATA;
+			frame[1] = 0x00;
+			result = pn5180_command(pn5180, frame, 2, backData, bytes);
+			if (result)
+				return result;
+		}
+		*backLen = bytes;
+		if (validBits)
+			*validBits = lastBits;
+	}
 
+	if (rx_status & PN5180_RX_STATUS_COLLISION) {
+		// The PN5180 counts from 0, we report the first bit as position 1,
+		// like the MFRC522.
+		if (collisionPos)
+			*collisionPos = ((rx_status >> PN5180_RX_STATUS_COLL_POS_SHIFT)
+					& PN5180_RX_STATUS_COLL_POS_MASK) + 1;
+		return STATUS_COLLISION;
+	}
 
-	uint32_t irq_status = 0;
-	result = pn5180_get_reg32(pn5180, 0x02, &irq_status);
-
-
+	if (recvCRC) {
+		// A MIFARE NAK has 4 bits and no CRC
+		if (bytes == 1 && lastBits == 4)
+			return STATUS_MIFARE_NACK;
+		if (rx_status & PN5180_RX_STATUS_INTEGRITY_ERROR)
+			return STATUS_CRC_WRONG;
+	} else if (rx_status & PN5180_RX_STATUS_INTEGRITY_ERROR) {
+		return STATUS_ERROR;	// Parity
+	}
 
-	//	5: sendSPI(0x00, 0x03, 0xFF, 0xFF, 0x0F, 0x00);
-	//  5: Clears the interrupt register IRQ_STATUS
-	// Note assuming little endian host
-	// TODO: register defines
-	pn5180_set_reg32(pn5180, 0x03, 0x000fffff);
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
+	return STATUS_OK;
+}
 
-	//	6: sendSPI(0x02, 0x00, 0xF8, 0xFF, 0xFF, 0xFF);
-	//  6: Sets the PN5180 into IDLE state
-	// Note assuming little endian host
-	// TODO: register defines
-	pn5180_and_reg32(pn5180, 0x00, 0xfffffff8);
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
+/**
+ * Sets how long to wait for the answer of the PICC. The wait is ended by
+ * the MCU, like the THM3060, the timers of the PN5180 are left at the
+ * settings of the RF configuration.
+ *
+ * @param timeout_us	0 restores the default of PN5180_TIMEOUT_us
+ */
+int pn5180_set_timeout(void *pdc, uint32_t timeout_us) {
+	pn5180_t *pn5180 = pdc;
+	pn5180->timeout_us = timeout_us;
+	return STATUS_OK;
+}
 
-	//	7: sendSPI(0x01, 0x00, 0x03, 0x00, 0x00, 0x00);
-	//  7: Activates TRANSCEIVE routine
-	// Note assuming little endian host
-	// TODO: register defines
-	pn5180_or_reg32(pn5180, 0x00, 0x00000003);
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
+/**
+ * Sets the bit rates agreed with the PICC, by loading the RF configuration
+ * of the bit rate. The configurations of ISO 14443-A and ISO 14443-B are
+ * numbered by bit rate, 106 to 848 kbps.
+ */
+int pn5180_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx) {
+	pn5180_t *pn5180 = pdc;
+	uint8_t tx_config, rx_config;
+
+	if (tx > pdc_bitrate_848 || rx > pdc_bitrate_848)
+		return STATUS_INVALID;
+	switch (pn5180->protocol) {
+	case pdc_protocol_iso14443a:
+		tx_config = PN5180_RF_CONFIG_ISO14443A_TX;
+		rx_config = PN5180_RF_CONFIG_ISO14443A_RX;
+		break;
+	case pdc_protocol_iso14443b:
+		tx_config = PN5180_RF_CONFIG_ISO14443B_TX;
+		rx_config = PN5180_RF_CONFIG_ISO14443B_RX;
+		break;
+	default:
+		return STATUS_INVALID;
+	}
+	if (pn5180_load_rf_config(pn5180, tx_config + tx, rx_config + rx))
+		return STATUS_ERROR;
+	pn5180->tx_bitrate = tx;
+	pn5180->rx_bitrate = rx;
+	return STATUS_OK;
+}
 
+int pn5180_set_field(void *pdc, bool on) {
+	pn5180_t *pn5180 = pdc;
+	uint8_t frame[2] = { on ? PN5180_CMD_RF_ON : PN5180_CMD_RF_OFF, 0x00 };
+	if (!on)
+		pn5180->picc_epoch++; // PICCs lose their state without field
+	return pn5180_send(pn5180, frame, sizeof(frame));
+}
 
-	//	8: sendSPI(0x09, 0x07, 0x26);
-	//  8: Sends REQA command
-	req.command = PN5180_CMD_SEND_DATA;
-	req.raw[0] = 0x07;
-	req.raw[1] = 0x26;
-	result = bshal_spim_transmit(pn5180->transport_instance.spim, &req, 3,
-			false);
+/**
+ * Loads the RF configuration of a protocol, while the field stays on. ISO
+ * 14443-A and ISO 14443-B start at 106 kbps.
+ */
+int pn5180_set_protocol(void *pdc, pdc_protocol_t protocol) {
+	pn5180_t *pn5180 = pdc;
+	int result;
+	switch (protocol) {
+	case pdc_protocol_iso14443a:
+		result = pn5180_load_rf_config(pn5180, PN5180_RF_CONFIG_ISO14443A_TX,
+				PN5180_RF_CONFIG_ISO14443A_RX);
+		break;
+	case pdc_protocol_iso15693:
+		result = pn5180_load_rf_config(pn5180, PN5180_RF_CONFIG_ISO15693_TX,
+				PN5180_RF_CONFIG_ISO15693_RX);
+		break;
+	case pdc_protocol_iso14443b:
+		result = pn5180_load_rf_config(pn5180, PN5180_RF_CONFIG_ISO14443B_TX,
+				PN5180_RF_CONFIG_ISO14443B_RX);
+		break;
+	default:
+		return STATUS_INVALID;
+	}
 	if (result)
 		return result;
-	bshal_delay_ms(1);
-	pn5180_test(pn5180);
-
-	//	9: waitForCardResponse();
-	//  9: Waits until a Card has responded via checking the IRQ_STATUS register
-	irq_status = 0;
-	while (!irq_status) {
-		result = pn5180_get_reg32(pn5180, 0x02, &irq_status);
-		if (result)
-			return result;
-		bshal_delay_ms(1);
-		pn5180_test(pn5180);
-	}
+	pn5180->protocol = protocol;
+	pn5180->tx_bitrate = pdc_bitrate_106;
+	pn5180->rx_bitrate = pdc_bitrate_106;
+	return STATUS_OK;
+}
 
-	return 0;
+/**
+ * Initializes the PN5180 for ISO 14443-A at 106 kbps, and switches the
+ * field on. Following AN12650, "Using the PN5180 without library".
+ */
+int PN5180_Init(pn5180_t *pn5180) {
+	pn5180_reg_batch_t batch;
+	int result;
 
-	//	10: sendSPI(0x0A, 0x00);
-	//  10: Reads the reception buffer. (ATQA)
+	if (!pn5180 || !pn5180->get_time_ms)
+		return STATUS_INVALID;
+
+	pn5180->TransceiveData = pn5180_transceive;
+	pn5180->SetTimeout = pn5180_set_timeout;
+	pn5180->timeout_us = 0;
+	pn5180->SetBitRate = pn5180_set_bitrate;
+	pn5180->bitrates = 0x0F;	// 106 to 848 kbps
+	pn5180->tx_bitrate = pdc_bitrate_106;
+	pn5180->rx_bitrate = pdc_bitrate_106;
+	pn5180->SetField = pn5180_set_field;
+	pn5180->SetProtocol = pn5180_set_protocol;
+	pn5180->protocols = (1 << pdc_protocol_iso14443a)
+			| (1 << pdc_protocol_iso15693) | (1 << pdc_protocol_iso14443b);
+	pn5180->protocol = pdc_protocol_iso14443a;
+	pn5180->rx_fifo_size = PN5180_RX_BUFFER_SIZE;
+
+	// Loads the ISO 14443-A 106 kbps protocol into the RF registers
+	result = pn5180_load_rf_config(pn5180, PN5180_RF_CONFIG_ISO14443A_TX,
+			PN5180_RF_CONFIG_ISO14443A_RX);
+	if (result)
+		return result;
 
+	// Idle, no pending interrupts, and the IRQ pin raised by the end of the
+	// reception when there is a wait_irq hook
+	pn5180_reg_batch_init(&batch);
+	pn5180_reg_batch_add(&batch, PN5180_REG_SYSTEM_CONFIG,
+			PN5180_REG_ACTION_AND, ~PN5180_SYSTEM_CONFIG_COMMAND_MASK);
+	pn5180_reg_batch_add(&batch, PN5180_REG_IRQ_ENABLE, PN5180_REG_ACTION_WRITE,
+			pn5180->wait_irq ?
+					PN5180_IRQ_RX | PN5180_IRQ_GENERAL_ERROR : 0);
+	pn5180_reg_batch_add(&batch, PN5180_REG_IRQ_CLEAR, PN5180_REG_ACTION_WRITE,
+			PN5180_IRQ_ALL);
+	result = pn5180_reg_batch_send(pn5180, &batch);
+	if (result)
+		return result;
 
-	//	11: sendSPI(0x17, 0x00);
-	//  11: Switches the RF field OFF.
+	return pn5180_set_field(pn5180, true);
 }
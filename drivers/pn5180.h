@@ -32,16 +32,34 @@ SOFTWARE.
 ********************************************************************************
 
 
-Placeholder for planned future implementation.
+The PN5180 is driven by commands over SPI, rather than by register access
+like the MFRC522. Every command is a frame of its own, and the BUSY line
+tells when the PN5180 is ready for the next one. A command that returns
+data is followed by a second frame that clocks out the response.
+
+The ISO 14443-A exchange uses the transceive state of the PN5180: the CRC
+and bit framing settings, clearing the interrupts and starting the state
+are a single WRITE_REGISTER_MULTIPLE frame, followed by SEND_DATA. The
+answer is awaited by reading IRQ_STATUS and RX_STATUS with a single
+READ_REGISTER_MULTIPLE, and then fetched by READ_DATA.
+
+The BUSY line is read through bs_pdc_t.busy_pin, it must be connected.
 
 *******************************************************************************/
 
+#ifndef BSRFID_DRIVERS_PN5180_H_
+#define BSRFID_DRIVERS_PN5180_H_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #include "pdc.h"
 typedef bs_pdc_t pn5180_t ;
 
+#define PN5180_TX_BUFFER_SIZE		(260)
+#define PN5180_RX_BUFFER_SIZE		(508)
+
 #define PN5180_CMD_WRITE_REGISTER				(0x00)
 #define PN5180_CMD_WRITE_REGISTER_OR_MASK		(0x01)
 #define PN5180_CMD_WRITE_REGISTER_AND_MASK		(0x02)
@@ -70,6 +88,82 @@ typedef bs_pdc_t pn5180_t ;
 #define PN5180_CMD_CONFIGURE_TESTBUS_DIGITAL		(0x18)
 #define PN5180_CMD_CONFIGURE_TESTBUS_ANALOG			(0x19)
 
+// Actions of the entries of WRITE_REGISTER_MULTIPLE
+#define PN5180_REG_ACTION_WRITE					(0x01)
+#define PN5180_REG_ACTION_OR					(0x02)
+#define PN5180_REG_ACTION_AND					(0x03)
+
+#define PN5180_REG_SYSTEM_CONFIG		(0x00)
+#define PN5180_REG_IRQ_ENABLE			(0x01)
+#define PN5180_REG_IRQ_STATUS			(0x02)
+#define PN5180_REG_IRQ_CLEAR			(0x03)
+#define PN5180_REG_TRANSCEIVE_CONTROL	(0x04)
+#define PN5180_REG_TIMER1_RELOAD		(0x0C)
+#define PN5180_REG_TIMER1_CONFIG		(0x0F)
+#define PN5180_REG_RX_WAIT_CONFIG		(0x11)
+#define PN5180_REG_CRC_RX_CONFIG		(0x12)
+#define PN5180_REG_RX_STATUS			(0x13)
+#define PN5180_REG_TX_WAIT_CONFIG		(0x17)
+#define PN5180_REG_TX_CONFIG			(0x18)
+#define PN5180_REG_CRC_TX_CONFIG		(0x19)
+#define PN5180_REG_RF_STATUS			(0x1D)
+#define PN5180_REG_SYSTEM_STATUS		(0x24)
+
+// SYSTEM_CONFIG
+#define PN5180_SYSTEM_CONFIG_COMMAND_MASK		(0x00000007)
+#define PN5180_SYSTEM_CONFIG_COMMAND_IDLE		(0x00000000)
+#define PN5180_SYSTEM_CONFIG_COMMAND_TRANSCEIVE	(0x00000003)
+
+// IRQ_STATUS, IRQ_ENABLE and IRQ_CLEAR
+#define PN5180_IRQ_RX					(1U << 0)
+#define PN5180_IRQ_TX					(1U << 1)
+#define PN5180_IRQ_IDLE					(1U << 2)
+#define PN5180_IRQ_TX_RFON				(1U << 9)
+#define PN5180_IRQ_RX_SOF_DET			(1U << 14)
+#define PN5180_IRQ_GENERAL_ERROR		(1U << 17)
+#define PN5180_IRQ_ALL					(0x000FFFFF)
+
+// TX_CONFIG: cleared, SEND_DATA sends an EOF only, the ISO 15693 slot marker
+#define PN5180_TX_CONFIG_DATA_ENABLE	(1U << 10)
+
+// CRC_RX_CONFIG and CRC_TX_CONFIG
+#define PN5180_CRC_ENABLE				(1U << 0)
+#define PN5180_CRC_RX_BIT_ALIGN_SHIFT	(6)
+#define PN5180_CRC_RX_BIT_ALIGN_MASK	(0x7U << PN5180_CRC_RX_BIT_ALIGN_SHIFT)
+
+// RX_STATUS
+#define PN5180_RX_STATUS_BYTES_MASK			(0x000001FF)
+#define PN5180_RX_STATUS_LAST_BITS_SHIFT	(13)
+#define PN5180_RX_STATUS_LAST_BITS_MASK		(0x7)
+#define PN5180_RX_STATUS_INTEGRITY_ERROR	(1U << 16)
+#define PN5180_RX_STATUS_PROTOCOL_ERROR		(1U << 17)
+#define PN5180_RX_STATUS_COLLISION			(1U << 18)
+#define PN5180_RX_STATUS_COLL_POS_SHIFT		(19)
+#define PN5180_RX_STATUS_COLL_POS_MASK		(0x7F)
+
+// RF configurations of LOAD_RF_CONFIG, ISO 14443-A, by pdc_bitrate_t
+#define PN5180_RF_CONFIG_ISO14443A_TX	(0x00)
+#define PN5180_RF_CONFIG_ISO14443A_RX	(0x80)
+// ISO 15693, ASK 100%, 26 kbps
+#define PN5180_RF_CONFIG_ISO15693_TX	(0x0D)
+#define PN5180_RF_CONFIG_ISO15693_RX	(0x8D)
+// ISO 14443-B, by pdc_bitrate_t
+#define PN5180_RF_CONFIG_ISO14443B_TX	(0x04)
+#define PN5180_RF_CONFIG_ISO14443B_RX	(0x84)
+
+// A command is processed within a few ms, RF_ON and LOAD_RF_CONFIG take
+// longest. A BUSY line that stays high longer is a hardware error.
+#define PN5180_BUSY_TIMEOUT_ms			(10)
+// Default wait for the answer of the PICC
+#define PN5180_TIMEOUT_us				(25000)
+
+// Register updates collected into one WRITE_REGISTER_MULTIPLE frame
+#define PN5180_REG_BATCH_MAX			(8)
+typedef struct {
+	uint8_t frame[1 + 6 * PN5180_REG_BATCH_MAX];
+	size_t size;
+} pn5180_reg_batch_t;
+
 #pragma pack(push,1)
 
 typedef struct {
@@ -96,9 +190,33 @@ typedef struct {
 
 
 
+#pragma pack(pop)
+
 int pn5180_get_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t *value) ;
 int pn5180_set_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) ;
 
 int pn5180_or_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) ;
 int pn5180_and_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) ;
-#pragma pack(pop)
+int pn5180_get_reg32_multiple(pn5180_t *pn5180, const uint8_t *regs,
+		uint32_t *values, size_t count);
+
+void pn5180_reg_batch_init(pn5180_reg_batch_t *batch);
+int pn5180_reg_batch_add(pn5180_reg_batch_t *batch, uint8_t reg,
+		uint8_t action, uint32_t value);
+int pn5180_reg_batch_send(pn5180_t *pn5180, pn5180_reg_batch_t *batch);
+
+int pn5180_read_eeprom(pn5180_t *pn5180, uint8_t address, void *data,
+		size_t size);
+int pn5180_load_rf_config(pn5180_t *pn5180, uint8_t tx, uint8_t rx);
+
+int pn5180_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC);
+int pn5180_set_timeout(void *pdc, uint32_t timeout_us);
+int pn5180_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx);
+int pn5180_set_field(void *pdc, bool on);
+int pn5180_set_protocol(void *pdc, pdc_protocol_t protocol);
+
+int PN5180_Init(pn5180_t *pn5180);
+
+#endif /* BSRFID_DRIVERS_PN5180_H_ */
@@ -27,3 +27,170 @@
  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
  SOFTWARE.
  *******************************************************************************/
+
+#include "pn5180.h"
+#include "pn5180_transport.h"
+
+#include "bshal_spim.h"
+#include "bshal_gpio.h"
+
+#include <string.h>
+
+/**
+ * Waits until the PN5180 is ready to accept a frame. The PN5180 raises BUSY
+ * once the chip select is released, and lowers it when it has processed the
+ * command, or has the response ready to be clocked out.
+ *
+ * @return STATUS_OK, or STATUS_HARD_ERROR when BUSY stays high
+ */
+int pn5180_wait_busy(pn5180_t *pn5180) {
+	if (!bshal_gpio_read_pin(pn5180->busy_pin))
+		return STATUS_OK;
+	uint32_t begin = pn5180->get_time_ms();
+	while (bshal_gpio_read_pin(pn5180->busy_pin)) {
+		if ((uint32_t) (pn5180->get_time_ms() - begin) > PN5180_BUSY_TIMEOUT_ms)
+			return STATUS_HARD_ERROR;
+	}
+	return STATUS_OK;
+}
+
+int pn5180_send(pn5180_t *pn5180, const void *frame, size_t size) {
+	if (!pn5180->transport_instance.raw)
+		return -1;
+	if (pn5180->transport_type != bshal_transport_spi)
+		return -1;
+	int result = pn5180_wait_busy(pn5180);
+	if (result)
+		return result;
+	return bshal_spim_transmit(pn5180->transport_instance.spim, (void*) frame,
+			size, false);
+}
+
+// The response is clocked out by a frame of its own. While the datasheet
+// says the chip select may stay low during a transaction, it must be
+// toggled between the command and the response. Otherwise the response
+// reads as all 0xFF.
+int pn5180_recv(pn5180_t *pn5180, void *data, size_t size) {
+	if (!pn5180->transport_instance.raw)
+		return -1;
+	if (pn5180->transport_type != bshal_transport_spi)
+		return -1;
+	int result = pn5180_wait_busy(pn5180);
+	if (result)
+		return result;
+	memset(data, 0xFF, size);
+	return bshal_spim_transceive(pn5180->transport_instance.spim, data, size,
+			false);
+}
+
+/**
+ * Sends a command frame, and reads its response when response_size is not
+ * 0.
+ */
+int pn5180_command(pn5180_t *pn5180, const void *frame, size_t size,
+		void *response, size_t response_size) {
+	int result = pn5180_send(pn5180, frame, size);
+	if (result || !response_size)
+		return result;
+	return pn5180_recv(pn5180, response, response_size);
+}
+
+// Register values are sent least significant byte first
+static void pn5180_put_le32(uint8_t *data, uint32_t value) {
+	data[0] = value;
+	data[1] = value >> 8;
+	data[2] = value >> 16;
+	data[3] = value >> 24;
+}
+
+static uint32_t pn5180_get_le32(const uint8_t *data) {
+	return data[0] | (data[1] << 8) | ((uint32_t) data[2] << 16)
+			| ((uint32_t) data[3] << 24);
+}
+
+int pn5180_get_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t *value) {
+	uint8_t frame[2] = { PN5180_CMD_READ_REGISTER, reg };
+	uint8_t data[4];
+	int result = pn5180_command(pn5180, frame, sizeof(frame), data,
+			sizeof(data));
+	if (result)
+		return result;
+	*value = pn5180_get_le32(data);
+	return STATUS_OK;
+}
+
+static int pn5180_write_reg32(pn5180_t *pn5180, uint8_t command, uint8_t reg,
+		uint32_t value) {
+	uint8_t frame[6] = { command, reg };
+	pn5180_put_le32(frame + 2, value);
+	return pn5180_send(pn5180, frame, sizeof(frame));
+}
+
+int pn5180_set_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) {
+	return pn5180_write_reg32(pn5180, PN5180_CMD_WRITE_REGISTER, reg, value);
+}
+
+int pn5180_or_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) {
+	return pn5180_write_reg32(pn5180, PN5180_CMD_WRITE_REGISTER_OR_MASK, reg,
+			value);
+}
+
+int pn5180_and_reg32(pn5180_t *pn5180, uint8_t reg, uint32_t value) {
+	return pn5180_write_reg32(pn5180, PN5180_CMD_WRITE_REGISTER_AND_MASK, reg,
+			value);
+}
+
+/**
+ * Reads several registers by one READ_REGISTER_MULTIPLE frame.
+ *
+ * @param regs		Addresses of the registers
+ * @param values	Receives the values, in the order of regs
+ * @param count		Number of registers, at most 18
+ */
+int pn5180_get_reg32_multiple(pn5180_t *pn5180, const uint8_t *regs,
+		uint32_t *values, size_t count) {
+	uint8_t frame[1 + 18];
+	uint8_t data[4 * 18];
+	if (count > 18)
+		return STATUS_INVALID;
+	frame[0] = PN5180_CMD_READ_REGISTER_MULTIPLE;
+	memcpy(frame + 1, regs, count);
+	int result = pn5180_command(pn5180, frame, 1 + count, data, 4 * count);
+	if (result)
+		return result;
+	for (size_t i = 0; i < count; i++)
+		values[i] = pn5180_get_le32(data + 4 * i);
+	return STATUS_OK;
+}
+
+void pn5180_reg_batch_init(pn5180_reg_batch_t *batch) {
+	batch->frame[0] = PN5180_CMD_WRITE_REGISTER_MULTIPLE;
+	batch->size = 1;
+}
+
+/**
+ * Adds a register update to a batch. The PN5180 applies the updates in the
+ * order they were added, thus an AND and an OR of the same register replace
+ * a field of it.
+ *
+ * @param action	PN5180_REG_ACTION_WRITE, _OR or _AND
+ * @return STATUS_OK, or STATUS_NO_ROOM when the batch is full
+ */
+int pn5180_reg_batch_add(pn5180_reg_batch_t *batch, uint8_t reg,
+		uint8_t action, uint32_t value) {
+	if (batch->size + 6 > sizeof(batch->frame))
+		return STATUS_NO_ROOM;
+	uint8_t *entry = batch->frame + batch->size;
+	entry[0] = reg;
+	entry[1] = action;
+	pn5180_put_le32(entry + 2, value);
+	batch->size += 6;
+	return STATUS_OK;
+}
+
+// Sends the updates in one SPI frame. An empty batch sends nothing.
+int pn5180_reg_batch_send(pn5180_t *pn5180, pn5180_reg_batch_t *batch) {
+	if (batch->size <= 1)
+		return STATUS_OK;
+	return pn5180_send(pn5180, batch->frame, batch->size);
+}
@@ -0,0 +1,19 @@
+/*
+ * pn5180_transport.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_DRIVERS_PN5180_TRANSPORT_H_
+#define BSRFID_DRIVERS_PN5180_TRANSPORT_H_
+
+#include "pn5180.h"
+
+int pn5180_wait_busy(pn5180_t *pn5180);
+int pn5180_send(pn5180_t *pn5180, const void *frame, size_t size);
+int pn5180_recv(pn5180_t *pn5180, void *data, size_t size);
+int pn5180_command(pn5180_t *pn5180, const void *frame, size_t size,
+		void *response, size_t response_size);
+
+#endif /* BSRFID_DRIVERS_PN5180_TRANSPORT_H_ */
@@ -70,59 +70,76 @@ rc52x_ref_status_t rc52x_self_test(rc52x_t *rc52x) {
 	if (result)
 		return rc52x_ref_status_error;
 
-	const uint8_t* ref = NULL;
-	switch (chip_id) {
+	const uint8_t *ref = rc52x_ref_get(chip_id);
+	if (!ref)
+		return rc52x_ref_status_unknown;
 
-	case 0x80:
-		// "PN512 V1";
-		ref = rc52x_ref_pn512_v1;
-		break;
+	// Self test procedure as described in the datasheet, 16.1.1
+	// 1. Perform a soft reset.
+	rc52x_reset(rc52x);
 
-	case 0x82:
-		// "PN512 V2";
-		ref = rc52x_ref_pn512_v2;
-		break;
+	// 2. Clear the internal buffer by writing 25 bytes of 00h and implement
+	// the Config command.
+	uint8_t buffer[RC52X_REF_SIZE] = { 0 };
+	rc52x_set_reg8(rc52x, RC52X_REG_FIFOLevelReg, 0x80);
+	mfrc522_send(rc52x, RC52X_REG_FIFODataReg, buffer, 25);
+	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Configure);
 
-	case 0x88:
-		// Note: this is not in the datasheet
-		// "FM17522";
-		ref = rc52x_ref_fm17522;
-		break;
-		// TODO Chip ID for FM17550
+	// 3. Enable the self test by writing 09h to the AutoTestReg register.
+	rc52x_set_reg8(rc52x, RC52X_REG_AutoTestReg, 0x09);
 
-	case 0x90:
-		// "MFRC522 V0";
-		ref = rc52x_ref_mfrc522_V0;
-		break;
-	case 0x91:
-		// "MFRC522 V1";
-		ref = rc52x_ref_mfrc522_V1;
-				break;
-	case 0x92:
-		// "MFRC522 V2";
-		ref = rc52x_ref_mfrc522_V2;
-		break;
+	// 4. Write 00h to the FIFO buffer.
+	rc52x_set_reg8(rc52x, RC52X_REG_FIFODataReg, 0x00);
 
-	case 0xB1:
-		// "MRFC523 V1";
-		ref = rc52x_ref_mfrc523_V1;
-				break;
-	case 0xB2:
-		// "MRFC523 V2";
-		ref = rc52x_ref_mfrc523_V2;
-		break;
+	// 5. Start the self test with the CalcCRC command.
+	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_CalcCRC);
 
-	default:
-		break;
+	// 6. The self test is initiated, wait for the 64 bytes result.
+	uint8_t level = 0;
+	uint32_t begin = rc52x->get_time_ms();
+	while ((uint32_t) (rc52x->get_time_ms() - begin) < RC52X_TIMEOUT_ms) {
+		result = rc52x_get_reg8(rc52x, RC52X_REG_FIFOLevelReg, &level);
+		if (result || level >= RC52X_REF_SIZE)
+			break;
 	}
-	if (!ref)
-		return rc52x_ref_status_unknown;
+	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Idle);
+
+	// 7. Read the 64 bytes from the FIFO buffer.
+	if (!result && level >= RC52X_REF_SIZE)
+		result = mfrc522_recv(rc52x, RC52X_REG_FIFODataReg, buffer,
+				RC52X_REF_SIZE);
 
-	// TODO Perform the self test
-	// https://github.com/miguelbalboa/rfid/blob/b2ff919438c2c2924092de8348b19049359dddd0/src/MFRC522.cpp#L326
+	// Disable the self test, and restore the configuration
+	rc52x_set_reg8(rc52x, RC52X_REG_AutoTestReg, 0x00);
+	rc52x_init(rc52x);
 
-	return rc52x_ref_status_unknown;
+	if (result)
+		return rc52x_ref_status_error;
+	if (level < RC52X_REF_SIZE)
+		return rc52x_ref_status_fail;
+	return memcmp(buffer, ref, RC52X_REF_SIZE) ?
+			rc52x_ref_status_fail : rc52x_ref_status_success;
+}
 
+// TPreScaler and TReloadVal for a timeout. With the prescaler of 25 µs the
+// timer covers 1.6 s, longer timeouts, up to the FWT of 4.9 s with WTX, use
+// the largest prescaler. 0 is the default of RC52X_TIMER_us.
+static uint16_t rc52x_timer_reload(uint32_t timeout_us, uint16_t *prescaler) {
+	uint64_t ticks;
+
+	*prescaler = 0x0A9;	// f_timer = 13.56 MHz / (2*169+1) = 40 kHz
+	if (!timeout_us)
+		timeout_us = RC52X_TIMER_us;
+	ticks = ((uint64_t) timeout_us * 1356 + 100 * (2 * *prescaler + 1) - 1)
+			/ (100 * (2 * *prescaler + 1));
+	if (ticks > 0x10000) {
+		*prescaler = 0xFFF;
+		ticks = ((uint64_t) timeout_us * 1356 + 100 * (2 * *prescaler + 1) - 1)
+				/ (100 * (2 * *prescaler + 1));
+		if (ticks > 0x10000)
+			ticks = 0x10000;
+	}
+	return ticks - 1;	// The timer period is TReloadVal + 1
 }
 
 /**
@@ -137,6 +154,20 @@ void rc52x_init(rc52x_t *rc52x) {
 		return;
 
 	rc52x->TransceiveData = rc52x_transceive;
+	rc52x->TransceiveStart = rc52x_transceive_start;
+	rc52x->TransceivePoll = rc52x_transceive_poll;
+	rc52x->SetParity = rc52x_set_parity;
+	rc52x->Crypto1Begin = rc52x_crypto1_begin;
+	rc52x->Crypto1End = rc52x_crypto1_end;
+	rc52x->SetTimeout = rc52x_set_timeout;
+	rc52x->timeout_us = 0;
+	rc52x->SetBitRate = rc52x_set_bitrate;
+	rc52x->bitrates = 0x0F;	// 106 to 848 kbps
+	rc52x->tx_bitrate = pdc_bitrate_106;
+	rc52x->rx_bitrate = pdc_bitrate_106;
+	rc52x->rx_fifo_size = RC52X_FIFO_SIZE;
+	rc52x->SetField = rc52x_set_field;
+	rc52x->LpcdMeasure = rc52x_lpcd_measure;
 	//rc52x->SetBitFraming = rc52x_set_bit_framing;
 	rc52x_reset(rc52x);
 
@@ -149,10 +180,13 @@ void rc52x_init(rc52x_t *rc52x) {
 	// When communicating with a PICC we need a timeout if something goes wrong.
 	// f_timer = 13.56 MHz / (2*TPreScaler+1) where TPreScaler = [TPrescaler_Hi:TPrescaler_Lo].
 	// TPrescaler_Hi are the four low bits in TModeReg. TPrescaler_Lo is TPrescalerReg.
-	rc52x_set_reg8(rc52x, RC52X_REG_TModeReg, 0x80);// TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
-	rc52x_set_reg8(rc52x, RC52X_REG_TPrescalerReg, 0xA9);// TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25μs.
-	rc52x_set_reg8(rc52x, RC52X_REG_TReloadReg_Hi, 0x03);// Reload timer with 0x3E8 = 1000, ie 25ms before timeout.
-	rc52x_set_reg8(rc52x, RC52X_REG_TReloadReg_Lo, 0xE8);
+	// The card layers program the timeout per command, see rc52x_set_timeout().
+	uint16_t prescaler;
+	uint16_t reload = rc52x_timer_reload(0, &prescaler);
+	rc52x_set_reg8(rc52x, RC52X_REG_TModeReg, 0x80 | (prescaler >> 8));// TAuto=1; timer starts automatically at the end of the transmission in all communication modes at all speeds
+	rc52x_set_reg8(rc52x, RC52X_REG_TPrescalerReg, prescaler & 0xFF);// TPreScaler = TModeReg[3..0]:TPrescalerReg, ie 0x0A9 = 169 => f_timer=40kHz, ie a timer period of 25μs.
+	rc52x_set_reg8(rc52x, RC52X_REG_TReloadReg_Hi, reload >> 8);// Reload timer with 999, ie 25ms before timeout.
+	rc52x_set_reg8(rc52x, RC52X_REG_TReloadReg_Lo, reload & 0xFF);
 
 	rc52x_set_reg8(rc52x, RC52X_REG_TxASKReg, 0x40);// Default 0x00. Force a 100 % ASK modulation independent of the ModGsPReg register setting
 	rc52x_set_reg8(rc52x, RC52X_REG_ModeReg, 0x3D);	// Default 0x3F. Set the preset value for the CRC coprocessor for the CalcCRC command to 0x6363 (ISO 14443-3 part 6.2.4)
@@ -161,6 +195,11 @@ void rc52x_init(rc52x_t *rc52x) {
 	// Set Bit 4 in ControlReg: Set to logic 1, the PN512 acts as initiator, otherwise it acts as target
 	rc52x_set_reg8(rc52x, RC52X_REG_ControlReg, 0x10);
 
+	// When the IRQ pin is connected, drive it push-pull and active high.
+	// The interrupt sources are enabled per command in ComIEnReg.
+	if (rc52x->wait_irq)
+		rc52x_set_reg8(rc52x, RC52X_REG_DivlEnReg, RC52X_DIVIRQ_IRQPushPull);
+
 	// testing
 	// RC52X_SetAntennaGain(rc52x,RxGain_48dB);
 
@@ -172,6 +211,7 @@ void rc52x_init(rc52x_t *rc52x) {
  */
 void rc52x_reset(rc52x_t *rc52x) {
 	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_SoftReset); // Issue the SoftReset command.
+	rc52x_reg_cache_invalidate(rc52x); // All registers are back at their reset values
 	// The datasheet does not mention how long the SoftRest command takes to complete.
 	// But the MFRC522 might have been in soft power-down mode (triggered by bit 4 of CommandReg)
 	// Section 8.8.2 in the datasheet says the oscillator start-up time is the start up time of the crystal + 37,74μs. Let us be generous: 50ms.
@@ -199,65 +239,110 @@ void rc52x_antenna_on(rc52x_t *rc52x) {
  * Turns the antenna off by disabling pins TX1 and TX2.
  */
 void rc52x_antenna_off(rc52x_t *rc52x) {
+	rc52x->picc_epoch++; // PICCs lose their state without field
 	rc52x_set_reg8(rc52x, RC52X_REG_TxControlReg, 0x80);
 } // End RC52X_AntennaOff()
 
-rc52x_result_t rc52x_transceive(rc52x_t *rc52x, uint8_t *sendData, ///< Pointer to the data to transfer to the FIFO.
-		size_t sendLen,		///< Number of uint8_ts to transfer to the FIFO.
-		uint8_t *backData,///< nullptr or pointer to buffer if data should be read back after executing the command.
-		size_t *backLen,///< In: Max number of uint8_ts to write to *backData. Out: The number of uint8_ts returned.
-		uint8_t *validBits,	///< In/Out: The number of valid bits in the last uint8_t. 0 for 8 valid bits. Default nullptr.
-		uint8_t rxAlign,///< In: Defines the bit position in backData[0] for the first bit received. Default 0.
-		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
-	uint8_t waitIRq = 0x30;		// RxIRq and IdleIRq
+/**
+ * Waits for the command to complete, that is until one of the interrupts in
+ * wait_irq or the timer interrupt is set in ComIrqReg.
+ *
+ * When a wait_irq hook is provided we sleep until the IRQ pin is raised,
+ * otherwise, or after a spurious wake up, ComIrqReg is polled.
+ *
+ * @return STATUS_OK with the ComIrqReg value in *irq, STATUS_??? otherwise.
+ */
+static rc52x_result_t rc52x_wait_for_irq(rc52x_t *rc52x, uint8_t wait_irq,
+		uint8_t *irq) {
+	int result;
+	uint32_t timeout_ms = RC52X_TIMEOUT_ms;
+	// The chip timer ends the command, this is the safety net when the
+	// communication with the chip is down
+	if (rc52x->timeout_us > RC52X_TIMER_us)
+		timeout_ms += (rc52x->timeout_us - RC52X_TIMER_us + 999) / 1000;
+	uint32_t begin = rc52x->get_time_ms();
+
+	wait_irq |= RC52X_IRQ_Timer;
+	if (rc52x->wait_irq) {
+		rc52x->wait_irq(rc52x, timeout_ms);
+		result = rc52x_get_reg8(rc52x, RC52X_REG_ComIrqReg, irq);
+		if (result)
+			return STATUS_ERROR;
+		if (*irq & wait_irq)
+			return STATUS_OK;
+	}
+
+	while ((uint32_t) (rc52x->get_time_ms() - begin) < timeout_ms) {
+		result = rc52x_get_reg8(rc52x, RC52X_REG_ComIrqReg, irq);
+		if (result)
+			return STATUS_ERROR;
+		if (*irq & wait_irq)
+			return STATUS_OK;
+	}
+	return STATUS_TIMEOUT;
+}
+
+/**
+ * Starts a Transceive command: the frame is loaded into the FIFO and the
+ * transmission is started. Does not wait for the answer, see
+ * rc52x_transceive_poll().
+ */
+int rc52x_transceive_start(void *pdc, void *sendData, size_t sendLen,
+		uint8_t txLastBits, uint8_t rxAlign, bool sendCRC, bool recvCRC) {
+	rc52x_t *rc52x = pdc;
 	// Prepare values for BitFramingReg
-	uint8_t txLastBits = validBits ? *validBits : 0;
 	uint8_t bitFraming = (rxAlign << 4) + txLastBits;// RxAlign = BitFramingReg[6..4]. TxLastBits = BitFramingReg[2..0]
 
 	int result;
+	rc52x_batch_t batch;
+	rc52x_batch_begin(&batch, rc52x);
+	rc52x->frame_count++;
+
 	if (sendCRC) {
-		rc52x_or_reg8(rc52x, RC52X_REG_TxModeReg, 0x80);
+		rc52x_batch_or_reg8(&batch, RC52X_REG_TxModeReg, 0x80);
 	} else {
-		rc52x_and_reg8(rc52x, RC52X_REG_TxModeReg, ~0x80);
+		rc52x_batch_and_reg8(&batch, RC52X_REG_TxModeReg, (uint8_t)~0x80);
 	}
 
 	if (recvCRC) {
-		rc52x_or_reg8(rc52x, RC52X_REG_RxModeReg, 0x80);
+		rc52x_batch_or_reg8(&batch, RC52X_REG_RxModeReg, 0x80);
 	} else {
-		rc52x_and_reg8(rc52x, RC52X_REG_RxModeReg, ~0x80);
+		rc52x_batch_and_reg8(&batch, RC52X_REG_RxModeReg, (uint8_t)~0x80);
 	}
 
-	rc52x_and_reg8(rc52x, RC52X_REG_CollReg, ~0x80);
-
-	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Idle);// Stop any active command.
-	rc52x_set_reg8(rc52x, RC52X_REG_ComIrqReg, 0x7F);// Clear all seven interrupt request bits
-	rc52x_set_reg8(rc52x, RC52X_REG_FIFOLevelReg, 0x80);// FlushBuffer = 1, FIFO initialization
-	mfrc522_send(rc52x, RC52X_REG_FIFODataReg, sendData, sendLen);// Write sendData to the FIFO
-	rc52x_set_reg8(rc52x, RC52X_REG_BitFramingReg, bitFraming);	// Bit adjustments
-	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Transceive);// Execute the command
+	rc52x_batch_and_reg8(&batch, RC52X_REG_CollReg, (uint8_t)~0x80);
 
-	rc52x_or_reg8(rc52x, RC52X_REG_BitFramingReg, 0x80);// StartSend=1, transmission of data starts
+	rc52x_batch_set_reg8(&batch, RC52X_REG_CommandReg, RC52X_CMD_Idle);// Stop any active command.
+	rc52x_batch_set_reg8(&batch, RC52X_REG_ComIrqReg, 0x7F);// Clear all seven interrupt request bits
+	if (rc52x->wait_irq)
+		rc52x_batch_set_reg8(&batch, RC52X_REG_ComlEnReg,
+				RC52X_IRQ_Rx | RC52X_IRQ_Idle | RC52X_IRQ_Timer);
+	rc52x_batch_set_reg8(&batch, RC52X_REG_FIFOLevelReg, 0x80);// FlushBuffer = 1, FIFO initialization
+	rc52x_batch_send(&batch, RC52X_REG_FIFODataReg, sendData, sendLen);// Write sendData to the FIFO
+	rc52x_batch_set_reg8(&batch, RC52X_REG_BitFramingReg, bitFraming);	// Bit adjustments
+	rc52x_batch_set_reg8(&batch, RC52X_REG_CommandReg, RC52X_CMD_Transceive);// Execute the command
 
-	// Wait for the command to complete.
-	// In RC52X_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
+	rc52x_batch_or_reg8(&batch, RC52X_REG_BitFramingReg, 0x80);// StartSend=1, transmission of data starts
 
-	uint8_t regval;
+	result = rc52x_batch_flush(&batch);
+	if (result)
+		return STATUS_ERROR;
 
-	uint32_t timeout = rc52x->get_time_ms() + RC52X_TIMEOUT_ms;
+	// In RC52X_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
+	return STATUS_OK;
+}
 
-	while ((rc52x->get_time_ms()) < timeout) {
-		result = rc52x_get_reg8(rc52x, RC52X_REG_ComIrqReg, &regval);
-		if (result)
-			return STATUS_ERROR;
-		if (regval & waitIRq) {	// One of the interrupts that signal success has been set.
-			break;
-		}
-		if (regval & 0x01) {	// Timer interrupt - nothing received in 25ms
-			return STATUS_TIMEOUT;
-		}
-	}
+/**
+ * Reads the result of a completed Transceive command. regval is the value
+ * of ComIrqReg that signalled the completion.
+ */
+static rc52x_result_t rc52x_transceive_result(rc52x_t *rc52x, uint8_t regval,
+		uint8_t *backData, size_t *backLen, uint8_t *validBits,
+		uint8_t *collisionPos) {
+	uint8_t waitIRq = RC52X_IRQ_Rx | RC52X_IRQ_Idle;
+	int result;
 
-	if (rc52x->get_time_ms() >= timeout) {
+	if (!(regval & waitIRq)) {	// Timer interrupt - nothing received in 25ms
 		return STATUS_TIMEOUT;
 	}
 
@@ -334,6 +419,46 @@ rc52x_result_t rc52x_transceive(rc52x_t *rc52x, uint8_t *sendData, ///< Pointer
 //	}
 
 	return STATUS_OK;
+}
+
+/**
+ * Checks whether the Transceive command started by rc52x_transceive_start()
+ * has completed. Costs a single register read while it is in progress.
+ *
+ * @return STATUS_BUSY while in progress, otherwise the result of the frame.
+ */
+int rc52x_transceive_poll(void *pdc, void *backData, size_t *backLen,
+		uint8_t *validBits, uint8_t *collisionPos) {
+	rc52x_t *rc52x = pdc;
+	uint8_t regval;
+	int result = rc52x_get_reg8(rc52x, RC52X_REG_ComIrqReg, &regval);
+	if (result)
+		return STATUS_ERROR;
+	if (!(regval & (RC52X_IRQ_Rx | RC52X_IRQ_Idle | RC52X_IRQ_Timer)))
+		return STATUS_BUSY;
+	return rc52x_transceive_result(rc52x, regval, backData, backLen, validBits,
+			collisionPos);
+}
+
+int rc52x_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
+	rc52x_t *rc52x = pdc;
+	uint8_t waitIRq = 0x30;		// RxIRq and IdleIRq
+	uint8_t txLastBits = validBits ? *validBits : 0;
+
+	int result = rc52x_transceive_start(rc52x, sendData, sendLen, txLastBits,
+			rxAlign, sendCRC, recvCRC);
+	if (result)
+		return result;
+
+	// Wait for the command to complete.
+	uint8_t regval;
+	result = rc52x_wait_for_irq(rc52x, waitIRq, &regval);
+	if (result)
+		return result;
+	return rc52x_transceive_result(rc52x, regval, backData, backLen, validBits,
+			collisionPos);
 } // End RC52X_CommunicateWithPICC()
 
 rc52x_result_t rc52x_set_bit_framing(bs_pdc_t *pdc, int rxAlign, int txLastBits) {
@@ -341,11 +466,120 @@ rc52x_result_t rc52x_set_bit_framing(bs_pdc_t *pdc, int rxAlign, int txLastBits)
 			(rxAlign << 4) | txLastBits); // RxAlign = BitFramingReg[6..4]. TxLastBits = BitFramingReg[2..0]
 }
 
-rc52x_result_t rc52x_crypto1_end(bs_pdc_t *pdc) {
-	return rc52x_and_reg8(pdc, RC52X_REG_Status2Reg, ~0x08);
+int rc52x_set_parity(void *pdc, bool enable) {
+	rc52x_t *rc52x = pdc;
+	// MfRxReg ParityDisable also disables the parity for transmission
+	if (enable)
+		return rc52x_and_reg8(rc52x, RC52X_REG_MfRxReg, (uint8_t)~0x10);
+	return rc52x_or_reg8(rc52x, RC52X_REG_MfRxReg, 0x10);
+}
+
+/**
+ * Programs the timer that ends the reception when the PICC does not answer.
+ * The timer starts at the end of the transmission (TAuto) and stops at the
+ * start of the answer. Only the registers that differ from the timeout
+ * programmed before are written, the prescaler rarely changes, so a new
+ * timeout costs at most two register writes.
+ *
+ * @param timeout_us	0 restores the default of RC52X_TIMER_us
+ */
+int rc52x_set_timeout(void *pdc, uint32_t timeout_us) {
+	rc52x_t *rc52x = pdc;
+	uint16_t prescaler, current_prescaler;
+	uint16_t reload = rc52x_timer_reload(timeout_us, &prescaler);
+	uint16_t current = rc52x_timer_reload(rc52x->timeout_us, &current_prescaler);
+
+	rc52x->timeout_us = timeout_us;
+	if (prescaler != current_prescaler
+			&& (rc52x_set_reg8(rc52x, RC52X_REG_TModeReg, 0x80 | (prescaler >> 8))
+					|| rc52x_set_reg8(rc52x, RC52X_REG_TPrescalerReg,
+							prescaler & 0xFF)))
+		return STATUS_ERROR;
+	if ((reload >> 8) != (current >> 8)
+			&& rc52x_set_reg8(rc52x, RC52X_REG_TReloadReg_Hi, reload >> 8))
+		return STATUS_ERROR;
+	if ((reload & 0xFF) != (current & 0xFF)
+			&& rc52x_set_reg8(rc52x, RC52X_REG_TReloadReg_Lo, reload & 0xFF))
+		return STATUS_ERROR;
+	return STATUS_OK;
+}
+
+/**
+ * Sets the bit rates agreed with the PICC by PPS. The modulation width is
+ * adjusted to the transmission bit rate, see MFRC522Extended::PICC_PPS.
+ */
+int rc52x_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx) {
+	rc52x_t *rc52x = pdc;
+	static const uint8_t mod_width[] = { 0x26, 0x15, 0x0A, 0x05 };
+	uint8_t tx_mode, rx_mode;
+
+	if (tx > pdc_bitrate_848 || rx > pdc_bitrate_848)
+		return STATUS_INVALID;
+	if (rc52x_get_reg8(rc52x, RC52X_REG_TxModeReg, &tx_mode)
+			|| rc52x_get_reg8(rc52x, RC52X_REG_RxModeReg, &rx_mode))
+		return STATUS_ERROR;
+	// TxSpeed and RxSpeed, bits 6..4, the CRC enables are kept
+	tx_mode = (tx_mode & ~0x70) | tx << 4;
+	rx_mode = (rx_mode & ~0x70) | rx << 4;
+	if (rc52x_set_reg8(rc52x, RC52X_REG_TxModeReg, tx_mode)
+			|| rc52x_set_reg8(rc52x, RC52X_REG_RxModeReg, rx_mode)
+			|| rc52x_set_reg8(rc52x, RC52X_REG_ModWidthReg, mod_width[tx]))
+		return STATUS_ERROR;
+	rc52x->tx_bitrate = tx;
+	rc52x->rx_bitrate = rx;
+	return STATUS_OK;
+}
+
+int rc52x_set_field(void *pdc, bool on) {
+	rc52x_t *rc52x = pdc;
+	if (!on)
+		rc52x->picc_epoch++; // PICCs lose their state without field
+	return rc52x_set_reg8(rc52x, RC52X_REG_TxControlReg, on ? 0x83 : 0x80);
+}
+
+/**
+ * Low-power card detection by a pulse of the field: the field is switched
+ * on, a WUPA is sent, also answered by a HALTed PICC, and the field is
+ * switched off again, which returns the PICC to IDLE. An ATQA, or a
+ * collision of several, counts as present, no answer as absent. Other
+ * errors are returned, they are not taken for a PICC.
+ */
+int rc52x_lpcd_measure(void *pdc, pdc_lpcd_sample_t *sample) {
+	rc52x_t *rc52x = pdc;
+	uint8_t wupa = PICC_CMD_WUPA;
+	uint8_t atqa[2];
+	size_t size = sizeof(atqa);
+	uint8_t valid_bits = 7;
+
+	memset(sample, 0, sizeof(pdc_lpcd_sample_t));
+	if (rc52x_set_field(rc52x, true))
+		return STATUS_ERROR;
+	rc52x->delay_ms(RC52X_LPCD_GUARD_ms);
+	pdc_set_timeout(rc52x, PDC_TIMEOUT_ACTIVATION_us);
+	rc52x->picc_epoch++; // Card layers drop their session state
+	int result = rc52x_transceive(rc52x, &wupa, 1, atqa, &size, &valid_bits, 0,
+			NULL, false, false);
+	if (rc52x_set_field(rc52x, false))
+		return STATUS_ERROR;
+
+	if (result == STATUS_OK && (size != sizeof(atqa) || valid_bits))
+		return STATUS_ERROR;
+	if (result && result != STATUS_COLLISION && result != STATUS_TIMEOUT)
+		return result;
+	sample->present = result != STATUS_TIMEOUT;
+	sample->rf_on_us = 1000 * RC52X_LPCD_GUARD_ms + RC52X_LPCD_FRAMES_us
+			+ (sample->present ? 0 : PDC_TIMEOUT_ACTIVATION_us);
+	return STATUS_OK;
+}
+
+int rc52x_crypto1_end(void *pdc) {
+	rc52x_t *rc52x = pdc;
+	return rc52x_and_reg8(rc52x, RC52X_REG_Status2Reg, ~0x08);
 }
 
-rc52x_result_t rc52x_crypto1_begin(bs_pdc_t *rc52x, picc_t *picc) {
+int rc52x_crypto1_begin(void *pdc, void *p) {
+	rc52x_t *rc52x = pdc;
+	picc_t *picc = p;
 	if (!picc)
 		return -1;
 	rc52x_result_t result;
@@ -360,39 +594,35 @@ rc52x_result_t rc52x_crypto1_begin(bs_pdc_t *rc52x, picc_t *picc) {
 		return -1;
 	}
 
-	rc52x_set_reg8(rc52x, RC52X_REG_ComIrqReg, 0x7F); // Clear all seven interrupt request bits
-	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Idle); // Stop any active command.
-	rc52x_set_reg8(rc52x, RC52X_REG_FIFOLevelReg, 0x80); // FlushBuffer = 1,
-
 	uint8_t buffer[12];
 	memcpy(buffer, &picc->mfc_crypto1, 8);
 	memcpy(buffer + 8, picc->uid + picc->uid_size - 4, 4);
 
-	mfrc522_send(rc52x, RC52X_REG_FIFODataReg, buffer, 12);
-
-	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_MFAuthent);
+	rc52x_batch_t batch;
+	rc52x_batch_begin(&batch, rc52x);
+	rc52x_batch_set_reg8(&batch, RC52X_REG_ComIrqReg, 0x7F); // Clear all seven interrupt request bits
+	rc52x_batch_set_reg8(&batch, RC52X_REG_CommandReg, RC52X_CMD_Idle); // Stop any active command.
+	if (rc52x->wait_irq)
+		rc52x_batch_set_reg8(&batch, RC52X_REG_ComlEnReg,
+				RC52X_IRQ_Idle | RC52X_IRQ_Timer);
+	rc52x_batch_set_reg8(&batch, RC52X_REG_FIFOLevelReg, 0x80); // FlushBuffer = 1,
+	rc52x_batch_send(&batch, RC52X_REG_FIFODataReg, buffer, 12);
+	rc52x_batch_set_reg8(&batch, RC52X_REG_CommandReg, RC52X_CMD_MFAuthent);
+	result = rc52x_batch_flush(&batch);
+	if (result)
+		return STATUS_ERROR;
 
-	uint32_t timeout = rc52x->get_time_ms() + RC52X_TIMEOUT_ms;
 	uint8_t regval;
 
-	while ((rc52x->get_time_ms()) < timeout) {
-		result = rc52x_get_reg8(rc52x, RC52X_REG_ComIrqReg, &regval);
-		if (result)
-			return STATUS_ERROR;
-		if (regval & 0x10) {
-
-			result = rc52x_get_reg8(rc52x, RC52X_REG_Status2Reg, &regval);
-
-			if (regval & 0x08) {
-				return STATUS_OK;
-			}
-			break;
-
-		}
-		if (regval & 0x01) {	// Timer interrupt - nothing received in 25ms
-			rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Idle); // Stop any active command.
-			return STATUS_TIMEOUT;
+	result = rc52x_wait_for_irq(rc52x, RC52X_IRQ_Idle, &regval);
+	if (result == STATUS_OK && (regval & RC52X_IRQ_Idle)) {
+		result = rc52x_get_reg8(rc52x, RC52X_REG_Status2Reg, &regval);
+		if (!result && (regval & 0x08)) {
+			return STATUS_OK;
 		}
+	} else if (result == STATUS_OK) {	// Timer interrupt - nothing received in 25ms
+		rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Idle); // Stop any active command.
+		return STATUS_TIMEOUT;
 	}
 
 	rc52x_set_reg8(rc52x, RC52X_REG_CommandReg, RC52X_CMD_Idle); // Stop any active command.
@@ -62,10 +62,22 @@
 #include "iso14443b.h"
 
 #include "rc52x_transport.h"
+#include "rc52x_ref.h"
 
 #include "pdc.h"
 typedef bs_pdc_t rc52x_t;
 
+#define RC52X_FIFO_SIZE		(64)
+
+// Low-power card detection. The MFRC522 cannot measure its antenna, a PICC
+// is detected by a WUPA in a short pulse of the field. ISO 14443-3 gives
+// the PICC 5 ms to get ready, in practice they are within 1 ms.
+#ifndef RC52X_LPCD_GUARD_ms
+#define RC52X_LPCD_GUARD_ms	(1)
+#endif
+// Air time of the WUPA and of the ATQA
+#define RC52X_LPCD_FRAMES_us	(200)
+
 //------------------------------------------------------------------------------
 // Regisers
 // -----------------------------------------------------------------------------
@@ -162,7 +174,66 @@ typedef bs_pdc_t rc52x_t;
 #define RC52X_CMD_MFAuthent          (0b1110)
 #define RC52X_CMD_SoftReset          (0b1111)
 
+// Interrupt bits in ComIEnReg / ComIrqReg
+#define RC52X_IRQ_IRqInv             (0x80)
+#define RC52X_IRQ_Tx                 (0x40)
+#define RC52X_IRQ_Rx                 (0x20)
+#define RC52X_IRQ_Idle               (0x10)
+#define RC52X_IRQ_HiAlert            (0x08)
+#define RC52X_IRQ_LoAlert            (0x04)
+#define RC52X_IRQ_Err                (0x02)
+#define RC52X_IRQ_Timer              (0x01)
+
+// DivIEnReg
+#define RC52X_DIVIRQ_IRQPushPull     (0x80)
+
 #define RC52X_TIMEOUT_ms			(40)
+// Default of the timer that ends the reception, 1000 periods of 25 µs
+#define RC52X_TIMER_us				(25000)
+
+//------------------------------------------------------------------------------
+// Register batch
+// -----------------------------------------------------------------------------
+// Register writes and masked updates can be queued and flushed together.
+// When flushing, all registers needed for the masked updates are read in a
+// single chip select burst (SPI), registers whose value is already known
+// from an earlier write in the same batch are not read at all, and masked
+// updates that would not change the register are skipped.
+// Note: masked updates use the value of the register at the time of the
+// flush, so do not queue masked updates to registers the chip modifies
+// while the batch is being flushed.
+// -----------------------------------------------------------------------------
+
+#define RC52X_BATCH_SIZE			(16)
+
+typedef enum {
+	rc52x_batch_op_set,
+	rc52x_batch_op_or,
+	rc52x_batch_op_and,
+	rc52x_batch_op_send,
+} rc52x_batch_op_t;
+
+typedef struct {
+	rc52x_batch_op_t op;
+	uint8_t reg;
+	uint8_t value;
+	uint8_t *data;
+	size_t amount;
+} rc52x_batch_entry_t;
+
+typedef struct {
+	rc52x_t *rc52x;
+	size_t count;
+	rc52x_batch_entry_t entries[RC52X_BATCH_SIZE];
+} rc52x_batch_t;
+
+void rc52x_batch_begin(rc52x_batch_t *batch, rc52x_t *rc52x);
+int rc52x_batch_set_reg8(rc52x_batch_t *batch, uint8_t reg, uint8_t value);
+int rc52x_batch_or_reg8(rc52x_batch_t *batch, uint8_t reg, uint8_t value);
+int rc52x_batch_and_reg8(rc52x_batch_t *batch, uint8_t reg, uint8_t value);
+int rc52x_batch_send(rc52x_batch_t *batch, uint8_t reg, uint8_t *data,
+		size_t amount);
+int rc52x_batch_flush(rc52x_batch_t *batch);
 
 uint8_t rc52x_communicate_with_picc(rc52x_t *rc52x, uint8_t command, ///< The command to execute. One of the RC52X_Command enums.
 		uint8_t waitIRq, ///< The bits in the ComIrqReg register that signals successful completion of the command.
@@ -179,18 +250,29 @@ int rc52x_set_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value);
 int rc52x_get_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t *value);
 int rc52x_and_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value);
 int rc52x_or_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value);
+void rc52x_reg_cache_invalidate(rc52x_t *rc52x);
 
 void rc52x_init(rc52x_t *rc52x) ;
 
 
 rc52x_result_t rc52x_set_bit_framing(bs_pdc_t *pdc, int rxAlign,
 		int txLastBits);
+int rc52x_set_parity(void *pdc, bool enable);
+int rc52x_set_timeout(void *pdc, uint32_t timeout_us);
+int rc52x_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx);
+int rc52x_crypto1_begin(void *pdc, void *p);
+int rc52x_crypto1_end(void *pdc);
+int rc52x_set_field(void *pdc, bool on);
+int rc52x_lpcd_measure(void *pdc, pdc_lpcd_sample_t *sample);
 
 int mfrc522_recv(rc52x_t *rc52x, uint8_t reg, uint8_t *data, size_t amount);
+int mfrc522_recv_multi(rc52x_t *rc52x, uint8_t *regs, uint8_t *values,
+		size_t amount);
 int mfrc522_send(rc52x_t *rc52x, uint8_t reg, uint8_t *data, size_t amount);
 void rc52x_reset(rc52x_t *rc52x);
 int rc52x_get_chip_version(rc52x_t *rc52x, uint8_t *chip_id);
 const char* rc52x_get_chip_name(rc52x_t *rc52x);
+rc52x_ref_status_t rc52x_self_test(rc52x_t *rc52x);
 
 
 
@@ -267,9 +349,13 @@ void RC52X_SoftPowerUp(rc52x_t *rc52x);
 /////////////////////////////////////////////////////////////////////////////////////
 // Functions for communicating with PICCs
 /////////////////////////////////////////////////////////////////////////////////////
-rc52x_result_t rc52x_transceive(rc52x_t *rc52x, uint8_t *sendData,
-		size_t sendLen, uint8_t *backData, size_t *backLen, uint8_t *validBits,
-		uint8_t rxAlign, uint8_t *collisionPos, bool sendCRC, bool recvCRC);
+int rc52x_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC);
+int rc52x_transceive_start(void *pdc, void *sendData, size_t sendLen,
+		uint8_t txLastBits, uint8_t rxAlign, bool sendCRC, bool recvCRC);
+int rc52x_transceive_poll(void *pdc, void *backData, size_t *backLen,
+		uint8_t *validBits, uint8_t *collisionPos);
 rc52x_result_t RC52X_CommunicateWithPICC(rc52x_t *rc52x, uint8_t command,
 		uint8_t waitIRq, uint8_t *sendData, size_t sendLen, uint8_t *backData,
 		size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
@@ -0,0 +1,645 @@
+/******************************************************************************
+ File:         rc52x_emu.c
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements a register level emulator of the MFRC522/PN512 family.
+ See rc52x_emu.h for the emulated features.
+
+ When RC52X_EMU_BSHAL_SPIM is defined, this file also provides the
+ bshal_spim_transmit/receive/transceive functions, so a host build links the
+ rc52x driver against the emulator instead of a SPI peripheral.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "rc52x_emu.h"
+#include "rc52x_ref.h"
+#include "iso14443_crc.h"
+
+// The chip runs from a 13.56 MHz clock, one cycle is 1000/13.56 ns
+#define RC52X_EMU_CLK_ns(cycles)	((uint64_t)(cycles) * 100000 / 1356)
+
+// Bits in the status and error registers
+#define RC52X_EMU_STATUS1_CRCOk		(0x40)
+#define RC52X_EMU_STATUS1_CRCReady	(0x20)
+#define RC52X_EMU_STATUS1_IRq		(0x10)
+#define RC52X_EMU_STATUS1_TRunning	(0x08)
+#define RC52X_EMU_STATUS1_HiAlert	(0x02)
+#define RC52X_EMU_STATUS1_LoAlert	(0x01)
+#define RC52X_EMU_STATUS2_Crypto1On	(0x08)
+#define RC52X_EMU_ERROR_BufferOvfl	(0x10)
+#define RC52X_EMU_ERROR_CollErr		(0x08)
+#define RC52X_EMU_ERROR_CRCErr		(0x04)
+#define RC52X_EMU_COLL_PosNotValid	(0x20)
+#define RC52X_EMU_DIVIRQ_CRCIRq		(0x04)
+
+// All emulated chips share one clock, as they live in the same world
+static uint64_t rc52x_emu_time;
+
+// Reset values, datasheet chapter 9.2
+static const uint8_t rc52x_emu_reset_values[0x40] = {
+		[RC52X_REG_CommandReg] = 0x20,
+		[RC52X_REG_ComlEnReg] = 0x80,
+		[RC52X_REG_ComIrqReg] = 0x14,
+		[RC52X_REG_WaterLevelReg] = 0x08,
+		[RC52X_REG_ControlReg] = 0x10,
+		[RC52X_REG_CollReg] = 0x80,
+		[RC52X_REG_ModeReg] = 0x3F,
+		[RC52X_REG_TxControlReg] = 0x80,
+		[RC52X_REG_TxSelReg] = 0x10,
+		[RC52X_REG_RxSelReg] = 0x84,
+		[RC52X_REG_RxThresholdReg] = 0x84,
+		[RC52X_REG_DemodReg] = 0x4D,
+		[RC52X_REG_MfTxReg] = 0x62,
+		[RC52X_REG_SerialSpeedReg] = 0xEB,
+		[RC52X_REG_CRCResultReg_Hi] = 0xFF,
+		[RC52X_REG_CRCResultReg_Lo] = 0xFF,
+		[RC52X_REG_GsNOffReg] = 0x88,
+		[RC52X_REG_ModWidthReg] = 0x26,
+		[RC52X_REG_RFCfgReg] = 0x48,
+		[RC52X_REG_GsNOnReg] = 0x88,
+		[RC52X_REG_CWGsPReg] = 0x20,
+		[RC52X_REG_ModGsPReg] = 0x20,
+		[RC52X_REG_TestPinEnReg] = 0x80,
+		[RC52X_REG_AutoTestReg] = 0x40,
+};
+
+//------------------------------------------------------------------------------
+// Time keeping
+//------------------------------------------------------------------------------
+
+// Makes the interrupts of a completed command visible
+static void rc52x_emu_update(rc52x_emu_t *emu) {
+	if (!(emu->pending_com_irq | emu->pending_div_irq))
+		return;
+	if (rc52x_emu_time < emu->done_ns)
+		return;
+	emu->regs[RC52X_REG_ComIrqReg] |= emu->pending_com_irq;
+	emu->regs[RC52X_REG_DivIrqReg] |= emu->pending_div_irq;
+	if (emu->pending_com_irq & RC52X_IRQ_Idle)
+		emu->regs[RC52X_REG_CommandReg] &= 0xF0;
+	emu->pending_com_irq = 0;
+	emu->pending_div_irq = 0;
+}
+
+static void rc52x_emu_complete(rc52x_emu_t *emu, uint64_t duration_ns,
+		uint8_t com_irq, uint8_t div_irq) {
+	emu->done_ns = rc52x_emu_time + duration_ns;
+	emu->pending_com_irq = com_irq;
+	emu->pending_div_irq = div_irq;
+	rc52x_emu_update(emu);
+}
+
+static void rc52x_emu_advance(rc52x_emu_t *emu, uint64_t ns) {
+	rc52x_emu_time += ns;
+	if (emu)
+		rc52x_emu_update(emu);
+}
+
+// Timer period: (TReloadVal + 1) * (2 * TPreScaler + 1) / 13.56 MHz
+static uint64_t rc52x_emu_timer_ns(rc52x_emu_t *emu) {
+	uint32_t prescaler = ((emu->regs[RC52X_REG_TModeReg] & 0x0F) << 8)
+			| emu->regs[RC52X_REG_TPrescalerReg];
+	uint32_t reload = (emu->regs[RC52X_REG_TReloadReg_Hi] << 8)
+			| emu->regs[RC52X_REG_TReloadReg_Lo];
+	return RC52X_EMU_CLK_ns((uint64_t )(reload + 1) * (2 * prescaler + 1));
+}
+
+uint64_t rc52x_emu_time_ns(void) {
+	return rc52x_emu_time;
+}
+
+int rc52x_emu_get_time_ms(void) {
+	return rc52x_emu_time / 1000000;
+}
+
+int rc52x_emu_delay_ms(int ms) {
+	rc52x_emu_advance(NULL, (uint64_t) ms * 1000000);
+	return 0;
+}
+
+bool rc52x_emu_irq_pin(rc52x_emu_t *emu) {
+	rc52x_emu_update(emu);
+	bool irq = (emu->regs[RC52X_REG_ComIrqReg] & emu->regs[RC52X_REG_ComlEnReg]
+			& 0x7F)
+			|| (emu->regs[RC52X_REG_DivIrqReg] & emu->regs[RC52X_REG_DivlEnReg]
+					& 0x1F);
+	// IRqInv, the pin is active low by default
+	return (emu->regs[RC52X_REG_ComlEnReg] & RC52X_IRQ_IRqInv) ? !irq : irq;
+}
+
+/**
+ * wait_irq hook: sleeps until the interrupt of the running command, or until
+ * the timeout passed. The emulated time advances accordingly.
+ */
+int rc52x_emu_wait_irq(void *pdc, int timeout_ms) {
+	rc52x_emu_t *emu = (rc52x_emu_t*) ((bs_pdc_t*) pdc)->transport_instance.spim;
+	if (!emu)
+		return -1;
+	uint8_t enabled = emu->regs[RC52X_REG_ComlEnReg] & 0x7F;
+	uint8_t div_enabled = emu->regs[RC52X_REG_DivlEnReg] & 0x1F;
+	uint64_t timeout_ns = rc52x_emu_time + (uint64_t) timeout_ms * 1000000;
+	if (((emu->pending_com_irq & enabled) || (emu->pending_div_irq & div_enabled))
+			&& emu->done_ns < timeout_ns)
+		timeout_ns = emu->done_ns;
+	if (timeout_ns > rc52x_emu_time)
+		rc52x_emu_advance(emu, timeout_ns - rc52x_emu_time);
+	return 0;
+}
+
+//------------------------------------------------------------------------------
+// FIFO and CRC coprocessor
+//------------------------------------------------------------------------------
+
+static void rc52x_emu_fifo_push(rc52x_emu_t *emu, uint8_t value) {
+	if (emu->fifo_level >= RC52X_EMU_FIFO_SIZE) {
+		emu->regs[RC52X_REG_ErrorReg] |= RC52X_EMU_ERROR_BufferOvfl;
+		return;
+	}
+	emu->fifo[emu->fifo_level++] = value;
+}
+
+static uint8_t rc52x_emu_fifo_pop(rc52x_emu_t *emu) {
+	if (!emu->fifo_level)
+		return 0;
+	uint8_t value = emu->fifo[0];
+	emu->fifo_level--;
+	memmove(emu->fifo, emu->fifo + 1, emu->fifo_level);
+	return value;
+}
+
+static void rc52x_emu_fifo_flush(rc52x_emu_t *emu) {
+	emu->fifo_level = 0;
+	emu->regs[RC52X_REG_ErrorReg] &= ~RC52X_EMU_ERROR_BufferOvfl;
+}
+
+// CRC coprocessor, the preset is selected by ModeReg CRCPreset
+static uint16_t rc52x_emu_crc(rc52x_emu_t *emu, const uint8_t *data,
+		size_t size) {
+	static const uint16_t preset[] = { 0x0000, 0x6363, 0xA671, 0xFFFF };
+	return iso14443_crc_update(preset[emu->regs[RC52X_REG_ModeReg] & 0x03],
+			data, size);
+}
+
+//------------------------------------------------------------------------------
+// Commands
+//------------------------------------------------------------------------------
+
+static void rc52x_emu_cmd_mem(rc52x_emu_t *emu) {
+	// With data in the FIFO, 25 bytes go to the internal buffer, with an
+	// empty FIFO the internal buffer is copied to the FIFO.
+	if (emu->fifo_level >= RC52X_EMU_MEM_SIZE) {
+		for (int i = 0; i < RC52X_EMU_MEM_SIZE; i++)
+			emu->mem[i] = rc52x_emu_fifo_pop(emu);
+	} else if (!emu->fifo_level) {
+		for (int i = 0; i < RC52X_EMU_MEM_SIZE; i++)
+			rc52x_emu_fifo_push(emu, emu->mem[i]);
+	}
+	rc52x_emu_complete(emu, RC52X_EMU_CLK_ns(8 * RC52X_EMU_MEM_SIZE),
+			RC52X_IRQ_Idle, 0);
+}
+
+static void rc52x_emu_cmd_random_id(rc52x_emu_t *emu) {
+	for (int i = 0; i < 10; i++) {
+		emu->random = emu->random * 1103515245 + 12345;
+		emu->mem[i] = emu->random >> 16;
+	}
+	rc52x_emu_complete(emu, 1000, RC52X_IRQ_Idle, 0);
+}
+
+static void rc52x_emu_cmd_calc_crc(rc52x_emu_t *emu) {
+	if ((emu->regs[RC52X_REG_AutoTestReg] & 0x0F) == 0x09) {
+		// Digital self test. The algorithm of the chip is not published, the
+		// expected digest of the emulated chip is returned instead.
+		const uint8_t *ref = rc52x_ref_get(emu->regs[RC52X_REG_VersionReg]);
+		rc52x_emu_fifo_flush(emu);
+		for (int i = 0; i < RC52X_REF_SIZE; i++)
+			rc52x_emu_fifo_push(emu, ref ? ref[i] : 0);
+		rc52x_emu_complete(emu, RC52X_EMU_CLK_ns(8 * 64 * RC52X_REF_SIZE), 0,
+				RC52X_EMU_DIVIRQ_CRCIRq);
+		return;
+	}
+
+	// The CRC is calculated over the FIFO contents, the command keeps
+	// running until another command is started.
+	uint8_t data[RC52X_EMU_FIFO_SIZE];
+	size_t size = emu->fifo_level;
+	for (size_t i = 0; i < size; i++)
+		data[i] = rc52x_emu_fifo_pop(emu);
+	uint16_t crc = rc52x_emu_crc(emu, data, size);
+	emu->regs[RC52X_REG_CRCResultReg_Hi] = crc >> 8;
+	emu->regs[RC52X_REG_CRCResultReg_Lo] = crc;
+	rc52x_emu_complete(emu, RC52X_EMU_CLK_ns(8 * size), 0,
+			RC52X_EMU_DIVIRQ_CRCIRq);
+}
+
+static void rc52x_emu_cmd_mfauthent(rc52x_emu_t *emu) {
+	picc_t picc = { 0 };
+	uint8_t buffer[12];
+	uint64_t air_time = emu->field.air_time_ns;
+
+	for (int i = 0; i < 12; i++)
+		buffer[i] = rc52x_emu_fifo_pop(emu);
+	memcpy(&picc.mfc_crypto1, buffer, 8);
+	memcpy(picc.uid, buffer + 8, 4);
+	picc.uid_size = 4;
+
+	int result = STATUS_TIMEOUT;
+	if (emu->regs[RC52X_REG_TxControlReg] & 0x03)
+		result = pdc_sim_crypto1_begin(&emu->field.pdc, &picc);
+	air_time = emu->field.air_time_ns - air_time;
+
+	if (result == STATUS_OK) {
+		emu->regs[RC52X_REG_Status2Reg] |= RC52X_EMU_STATUS2_Crypto1On;
+		rc52x_emu_complete(emu, air_time, RC52X_IRQ_Idle, 0);
+	} else {
+		// The PICC stops answering, the command runs until the timer expires
+		rc52x_emu_complete(emu, air_time + rc52x_emu_timer_ns(emu),
+				RC52X_IRQ_Timer, 0);
+	}
+}
+
+// Transmits the FIFO contents, and for Transceive, receives the answer
+static void rc52x_emu_cmd_transceive(rc52x_emu_t *emu, bool receive) {
+	uint8_t send[RC52X_EMU_FIFO_SIZE];
+	uint8_t back[RC52X_EMU_FIFO_SIZE];
+	size_t send_size = emu->fifo_level;
+	size_t back_size = sizeof(back);
+	uint8_t bit_framing = emu->regs[RC52X_REG_BitFramingReg];
+	uint8_t valid_bits = bit_framing & 0x07;
+	uint8_t rx_align = (bit_framing >> 4) & 0x07;
+	uint8_t coll_pos = 0;
+	bool tx_crc = emu->regs[RC52X_REG_TxModeReg] & 0x80;
+	bool rx_crc = emu->regs[RC52X_REG_RxModeReg] & 0x80;
+	uint64_t air_time = emu->field.air_time_ns;
+	int result;
+
+	for (size_t i = 0; i < send_size; i++)
+		send[i] = rc52x_emu_fifo_pop(emu);
+	emu->regs[RC52X_REG_ErrorReg] = 0;
+	emu->regs[RC52X_REG_CollReg] |= RC52X_EMU_COLL_PosNotValid;
+	// MfRxReg ParityDisable, the parity bits are part of the data
+	emu->field.parity = !(emu->regs[RC52X_REG_MfRxReg] & 0x10);
+	// TxModeReg TxSpeed and RxModeReg RxSpeed
+	emu->field.tx_rate = (emu->regs[RC52X_REG_TxModeReg] >> 4) & 3;
+	emu->field.rx_rate = (emu->regs[RC52X_REG_RxModeReg] >> 4) & 3;
+
+	if (!(emu->regs[RC52X_REG_TxControlReg] & 0x03) || !send_size) {
+		// Antenna off, nothing is transmitted, nobody answers
+		result = STATUS_TIMEOUT;
+	} else if (!receive) {
+		// Transmit only, a PICC answer is lost
+		result = pdc_sim_transceive(&emu->field.pdc, send, send_size, NULL,
+				NULL, &valid_bits, 0, NULL, tx_crc, false);
+		air_time = emu->field.air_time_ns - air_time;
+		rc52x_emu_complete(emu, air_time, RC52X_IRQ_Tx | RC52X_IRQ_Idle, 0);
+		return;
+	} else {
+		result = pdc_sim_transceive(&emu->field.pdc, send, send_size, back,
+				&back_size, &valid_bits, rx_align, &coll_pos, tx_crc, rx_crc);
+	}
+	air_time = emu->field.air_time_ns - air_time;
+
+	switch (result) {
+	case STATUS_OK:
+	case STATUS_COLLISION:
+		for (size_t i = 0; i < back_size; i++)
+			rc52x_emu_fifo_push(emu, back[i]);
+		emu->regs[RC52X_REG_ControlReg] = (emu->regs[RC52X_REG_ControlReg]
+				& 0xF8) | (valid_bits & 0x07);
+		if (result == STATUS_COLLISION) {
+			// CollPos 1..32, where 32 is encoded as 0
+			emu->regs[RC52X_REG_ErrorReg] |= RC52X_EMU_ERROR_CollErr;
+			if (coll_pos && coll_pos <= 32)
+				emu->regs[RC52X_REG_CollReg] =
+						(emu->regs[RC52X_REG_CollReg] & 0x80)
+								| (coll_pos & 0x1F);
+		}
+		// A frame that is not a whole number of bytes, eg. a 4 bit ACK,
+		// has no CRC
+		if (rx_crc && result == STATUS_OK && valid_bits)
+			emu->regs[RC52X_REG_ErrorReg] |= RC52X_EMU_ERROR_CRCErr;
+		rc52x_emu_complete(emu, air_time,
+				RC52X_IRQ_Tx | RC52X_IRQ_Rx
+						| (emu->regs[RC52X_REG_ErrorReg] ? RC52X_IRQ_Err : 0),
+				0);
+		break;
+	case STATUS_NO_ROOM:
+		emu->regs[RC52X_REG_ErrorReg] |= RC52X_EMU_ERROR_BufferOvfl;
+		rc52x_emu_complete(emu, air_time,
+				RC52X_IRQ_Tx | RC52X_IRQ_Rx | RC52X_IRQ_Err, 0);
+		break;
+	default:
+		// No answer, TAuto starts the timer at the end of the transmission.
+		// The PICC timeout of the software PCD is replaced by our timer.
+		rc52x_emu_complete(emu, air_time + rc52x_emu_timer_ns(emu),
+				RC52X_IRQ_Tx | RC52X_IRQ_Timer, 0);
+		break;
+	}
+}
+
+static void rc52x_emu_start_command(rc52x_emu_t *emu, uint8_t command) {
+	emu->pending_com_irq = 0;
+	emu->pending_div_irq = 0;
+	emu->stats.commands++;
+
+	switch (command) {
+	case RC52X_CMD_Idle:
+		break;
+	case RC52X_CMD_Configure:
+		rc52x_emu_cmd_mem(emu);
+		break;
+	case RC52X_CMD_GenerateRandomID:
+		rc52x_emu_cmd_random_id(emu);
+		break;
+	case RC52X_CMD_CalcCRC:
+		rc52x_emu_cmd_calc_crc(emu);
+		break;
+	case RC52X_CMD_Transmit:
+		rc52x_emu_cmd_transceive(emu, false);
+		break;
+	case RC52X_CMD_Transceive:
+		// Waits for StartSend
+		emu->stats.commands--;
+		break;
+	case RC52X_CMD_MFAuthent:
+		rc52x_emu_cmd_mfauthent(emu);
+		break;
+	case RC52X_CMD_SoftReset:
+		rc52x_emu_reset(emu);
+		break;
+	default:
+		break;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Register file
+//------------------------------------------------------------------------------
+
+static uint8_t rc52x_emu_read_reg(rc52x_emu_t *emu, uint8_t reg) {
+	uint8_t value;
+	rc52x_emu_update(emu);
+	emu->stats.reg_reads++;
+
+	switch (reg) {
+	case RC52X_REG_FIFODataReg:
+		return rc52x_emu_fifo_pop(emu);
+	case RC52X_REG_FIFOLevelReg:
+		return emu->fifo_level;
+	case RC52X_REG_Status1Reg:
+		value = 0;
+		if (emu->fifo_level >= RC52X_EMU_FIFO_SIZE
+				- emu->regs[RC52X_REG_WaterLevelReg])
+			value |= RC52X_EMU_STATUS1_HiAlert;
+		if (emu->fifo_level <= emu->regs[RC52X_REG_WaterLevelReg])
+			value |= RC52X_EMU_STATUS1_LoAlert;
+		if (emu->pending_com_irq & RC52X_IRQ_Timer)
+			value |= RC52X_EMU_STATUS1_TRunning;
+		if (!(emu->pending_div_irq & RC52X_EMU_DIVIRQ_CRCIRq))
+			value |= RC52X_EMU_STATUS1_CRCReady;
+		if (!(emu->regs[RC52X_REG_ErrorReg] & RC52X_EMU_ERROR_CRCErr))
+			value |= RC52X_EMU_STATUS1_CRCOk;
+		if ((emu->regs[RC52X_REG_ComIrqReg] & emu->regs[RC52X_REG_ComlEnReg]
+				& 0x7F)
+				|| (emu->regs[RC52X_REG_DivIrqReg]
+						& emu->regs[RC52X_REG_DivlEnReg] & 0x1F))
+			value |= RC52X_EMU_STATUS1_IRq;
+		return value;
+	case RC52X_REG_TCounterVal_Hi:
+	case RC52X_REG_TCounterVal_Lo:
+		// The timer counts down from the reload value while it runs
+		value = 0;
+		if ((emu->pending_com_irq & RC52X_IRQ_Timer)
+				&& emu->done_ns > rc52x_emu_time) {
+			uint64_t period = rc52x_emu_timer_ns(emu);
+			uint32_t reload = (emu->regs[RC52X_REG_TReloadReg_Hi] << 8)
+					| emu->regs[RC52X_REG_TReloadReg_Lo];
+			uint32_t count = period ? (emu->done_ns - rc52x_emu_time)
+					* (reload + 1) / period : 0;
+			if (count > reload)
+				count = reload;
+			value = reg == RC52X_REG_TCounterVal_Hi ? count >> 8 : count;
+		}
+		return value;
+	default:
+		return emu->regs[reg & 0x3F];
+	}
+}
+
+static void rc52x_emu_write_reg(rc52x_emu_t *emu, uint8_t reg, uint8_t value) {
+	rc52x_emu_update(emu);
+	emu->stats.reg_writes++;
+
+	switch (reg) {
+	case RC52X_REG_CommandReg:
+		emu->regs[reg] = value;
+		rc52x_emu_start_command(emu, value & 0x0F);
+		break;
+	case RC52X_REG_ComIrqReg:
+	case RC52X_REG_DivIrqReg:
+		// Set1: the marked bits are set when 1, cleared when 0
+		if (value & 0x80)
+			emu->regs[reg] |= value & 0x7F;
+		else
+			emu->regs[reg] &= ~value;
+		break;
+	case RC52X_REG_ErrorReg:
+	case RC52X_REG_Status1Reg:
+	case RC52X_REG_VersionReg:
+		// Read only
+		break;
+	case RC52X_REG_Status2Reg:
+		if ((emu->regs[reg] & RC52X_EMU_STATUS2_Crypto1On)
+				&& !(value & RC52X_EMU_STATUS2_Crypto1On))
+			pdc_sim_crypto1_end(&emu->field.pdc);
+		// Only MFCrypto1On can be cleared by software
+		emu->regs[reg] = (value & 0xC0)
+				| (emu->regs[reg] & value & RC52X_EMU_STATUS2_Crypto1On);
+		break;
+	case RC52X_REG_FIFODataReg:
+		rc52x_emu_fifo_push(emu, value);
+		break;
+	case RC52X_REG_FIFOLevelReg:
+		if (value & 0x80)
+			rc52x_emu_fifo_flush(emu);
+		break;
+	case RC52X_REG_ControlReg:
+		emu->regs[reg] = (emu->regs[reg] & 0x07) | (value & 0x30);
+		break;
+	case RC52X_REG_BitFramingReg:
+		emu->regs[reg] = value & 0x77;
+		if ((value & 0x80)
+				&& (emu->regs[RC52X_REG_CommandReg] & 0x0F)
+						== RC52X_CMD_Transceive) {
+			emu->stats.commands++;
+			rc52x_emu_cmd_transceive(emu, true);
+		}
+		break;
+	case RC52X_REG_TxControlReg:
+		// Switching the field off resets the PICCs
+		if ((emu->regs[reg] & 0x03) && !(value & 0x03)) {
+			pdc_sim_field_reset(&emu->field);
+			emu->regs[RC52X_REG_Status2Reg] &= ~RC52X_EMU_STATUS2_Crypto1On;
+		}
+		emu->regs[reg] = value;
+		break;
+	default:
+		emu->regs[reg & 0x3F] = value;
+		break;
+	}
+}
+
+//------------------------------------------------------------------------------
+// SPI interface, datasheet chapter 8.1.2
+//------------------------------------------------------------------------------
+
+void rc52x_emu_spi_select(rc52x_emu_t *emu, bool selected) {
+	if (selected && !emu->spi_selected)
+		emu->stats.transactions++;
+	emu->spi_selected = selected;
+	emu->spi_state = rc52x_emu_spi_idle;
+	emu->read_reg = -1;
+}
+
+/**
+ * Clocks a byte over the SPI bus. The address byte is (reg << 1) with bit 7
+ * set for a read. During a read, MISO carries the register addressed by the
+ * previous byte, so the FIFO is popped when the byte is actually shifted out.
+ * A read is terminated with 00h, a write continues with data bytes for the
+ * same register.
+ */
+uint8_t rc52x_emu_spi_byte(rc52x_emu_t *emu, uint8_t mosi) {
+	uint8_t miso = 0;
+	emu->stats.bus_bytes++;
+	rc52x_emu_advance(emu, 8000000 / emu->spi_khz);
+
+	switch (emu->spi_state) {
+	case rc52x_emu_spi_idle:
+		if (mosi & 0x80) {
+			emu->spi_state = rc52x_emu_spi_read;
+			emu->read_reg = (mosi >> 1) & 0x3F;
+		} else {
+			emu->spi_state = rc52x_emu_spi_write;
+			emu->write_reg = (mosi >> 1) & 0x3F;
+		}
+		break;
+	case rc52x_emu_spi_read:
+		if (emu->read_reg >= 0)
+			miso = rc52x_emu_read_reg(emu, emu->read_reg);
+		emu->read_reg = (mosi & 0x80) ? (mosi >> 1) & 0x3F : -1;
+		break;
+	case rc52x_emu_spi_write:
+		rc52x_emu_write_reg(emu, emu->write_reg, mosi);
+		break;
+	}
+	return miso;
+}
+
+//------------------------------------------------------------------------------
+// Set up
+//------------------------------------------------------------------------------
+
+void rc52x_emu_reset(rc52x_emu_t *emu) {
+	uint8_t version = emu->regs[RC52X_REG_VersionReg];
+	bool crypto1 = emu->regs[RC52X_REG_Status2Reg] & RC52X_EMU_STATUS2_Crypto1On;
+	memcpy(emu->regs, rc52x_emu_reset_values, sizeof(emu->regs));
+	emu->regs[RC52X_REG_VersionReg] = version;
+	emu->fifo_level = 0;
+	emu->pending_com_irq = 0;
+	emu->pending_div_irq = 0;
+	if (crypto1)
+		pdc_sim_crypto1_end(&emu->field.pdc);
+	// The antenna drivers are off after a reset
+	pdc_sim_field_reset(&emu->field);
+}
+
+void rc52x_emu_init(rc52x_emu_t *emu, uint8_t version, pdc_sim_card_t *cards,
+		size_t card_count) {
+	memset(emu, 0, sizeof(rc52x_emu_t));
+	pdc_sim_init(&emu->field, cards, card_count);
+	// The timer of the emulated chip determines the timeout
+	emu->field.timeout_us = 0;
+	emu->regs[RC52X_REG_VersionReg] = version;
+	emu->read_reg = -1;
+	emu->random = 0x5EED;
+	emu->spi_khz = RC52X_EMU_SPI_kHz;
+	rc52x_emu_reset(emu);
+}
+
+/**
+ * Connects a rc52x_t to the emulator: SPI transport and the time hooks.
+ * The wait_irq hook is left as is, set it to rc52x_emu_wait_irq to emulate
+ * a connected IRQ pin.
+ */
+void rc52x_emu_attach(rc52x_emu_t *emu, rc52x_t *rc52x) {
+	rc52x->transport_type = bshal_transport_spi;
+	rc52x->transport_instance.spim = &emu->spim;
+	rc52x->get_time_ms = rc52x_emu_get_time_ms;
+	rc52x->delay_ms = rc52x_emu_delay_ms;
+}
+
+#ifdef RC52X_EMU_BSHAL_SPIM
+//------------------------------------------------------------------------------
+// Fake SPI master, the instance is the emulator
+//------------------------------------------------------------------------------
+
+static void rc52x_emu_spim_transfer(bshal_spim_instance_t *spim, uint8_t *data,
+		size_t amount, bool nostop, bool keep_mosi) {
+	rc52x_emu_t *emu = (rc52x_emu_t*) spim;
+	if (!emu->spi_selected)
+		rc52x_emu_spi_select(emu, true);
+	for (size_t i = 0; i < amount; i++) {
+		uint8_t miso = rc52x_emu_spi_byte(emu, data[i]);
+		if (!keep_mosi)
+			data[i] = miso;
+	}
+	if (!nostop)
+		rc52x_emu_spi_select(emu, false);
+}
+
+int bshal_spim_transmit(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop) {
+	rc52x_emu_spim_transfer(spim, data, amount, nostop, true);
+	return 0;
+}
+
+int bshal_spim_receive(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop) {
+	memset(data, 0, amount);
+	rc52x_emu_spim_transfer(spim, data, amount, nostop, false);
+	return 0;
+}
+
+int bshal_spim_transceive(bshal_spim_instance_t *spim, void *data,
+		size_t amount, bool nostop) {
+	rc52x_emu_spim_transfer(spim, data, amount, nostop, false);
+	return 0;
+}
+#endif
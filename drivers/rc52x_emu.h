@@ -0,0 +1,118 @@
+/******************************************************************************
+ File:         rc52x_emu.h
+ Author:       André van Schoubroeck
+ License:      MIT
+
+ This implements a register level emulator of the MFRC522/PN512 family.
+
+ The emulator sits behind the SPI transport, so the rc52x driver, including
+ the address encoding in rc52x_transport.c, runs unmodified on a host. The
+ RF side is provided by a pdc_sim_t with its virtual PICCs. Emulated are
+
+ * The register file with the reset values from the datasheet
+ * The FIFO buffer, FIFOLevelReg, WaterLevelReg and BufferOvfl
+ * ComIrqReg/DivIrqReg with the Set1 semantics, Status1Reg IRq
+ * ErrorReg and CollReg (CollErr, CollPos, CollPosNotValid)
+ * The timer (TModeReg, TPrescalerReg, TReloadReg) as receive timeout
+ * The CRC coprocessor (CalcCRC with the ModeReg preset)
+ * The commands Mem, GenerateRandomID, CalcCRC, Transmit, Transceive,
+   MFAuthent and SoftReset
+ * The digital self test, which returns the digest from rc52x_ref.c
+
+ Timing is cycle approximate: time advances with the bytes clocked over SPI
+ and with the air time of the frames. Interrupt bits become visible once the
+ emulated time passed the end of the command.
+
+ ********************************************************************************
+ MIT License
+
+ Copyright (c) 2020-2023 André van Schoubroeck <andre@blaatschaap.be>
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ *******************************************************************************/
+
+#ifndef BSRFID_DRIVERS_RC52X_EMU_H_
+#define BSRFID_DRIVERS_RC52X_EMU_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bshal_spim.h"
+
+#include "rc52x.h"
+#include "pdc_sim.h"
+
+#define RC52X_EMU_FIFO_SIZE			(64)
+#define RC52X_EMU_MEM_SIZE			(25)
+#define RC52X_EMU_SPI_kHz			(10000)
+
+typedef enum {
+	rc52x_emu_spi_idle,			// Chip select just asserted
+	rc52x_emu_spi_read,
+	rc52x_emu_spi_write,
+} rc52x_emu_spi_state_t;
+
+typedef struct {
+	unsigned int bus_bytes;		// Bytes clocked over SPI, address included
+	unsigned int transactions;	// Chip select assertions
+	unsigned int reg_reads;
+	unsigned int reg_writes;
+	unsigned int commands;		// Commands started, StartSend included
+} rc52x_emu_stats_t;
+
+// The bshal_spim_instance_t must be the first member, the fake SPI master
+// casts the instance back to the emulator.
+typedef struct {
+	bshal_spim_instance_t spim;
+	uint8_t regs[0x40];
+	uint8_t fifo[RC52X_EMU_FIFO_SIZE];
+	uint8_t fifo_level;
+	uint8_t mem[RC52X_EMU_MEM_SIZE];	// Internal buffer of the Mem command
+	uint32_t random;
+
+	pdc_sim_t field;			// The RF side
+
+	rc52x_emu_spi_state_t spi_state;
+	bool spi_selected;
+	uint8_t write_reg;
+	int read_reg;				// Register to shift out next, -1 for none
+
+	uint64_t done_ns;			// Pending interrupts become visible at
+	uint8_t pending_com_irq;
+	uint8_t pending_div_irq;
+	unsigned int spi_khz;
+
+	rc52x_emu_stats_t stats;
+} rc52x_emu_t;
+
+void rc52x_emu_init(rc52x_emu_t *emu, uint8_t version, pdc_sim_card_t *cards,
+		size_t card_count);
+void rc52x_emu_attach(rc52x_emu_t *emu, rc52x_t *rc52x);
+void rc52x_emu_reset(rc52x_emu_t *emu);
+
+uint8_t rc52x_emu_spi_byte(rc52x_emu_t *emu, uint8_t mosi);
+void rc52x_emu_spi_select(rc52x_emu_t *emu, bool selected);
+bool rc52x_emu_irq_pin(rc52x_emu_t *emu);
+
+int rc52x_emu_wait_irq(void *pdc, int timeout_ms);
+uint64_t rc52x_emu_time_ns(void);
+int rc52x_emu_get_time_ms(void);
+int rc52x_emu_delay_ms(int ms);
+
+#endif /* BSRFID_DRIVERS_RC52X_EMU_H_ */
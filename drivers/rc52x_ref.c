@@ -6,6 +6,9 @@
  */
 
 #include <stdint.h>
+#include <stddef.h>
+
+#include "rc52x_ref.h"
 
 //----------------------------------------------------------------------------
 // Version 0.0 (0x90)
@@ -88,4 +91,39 @@ const uint8_t rc52x_ref_fm17522[] = { 0x00, 0xD6, 0x78, 0x8C, 0xE2, 0xAA, 0x0C,
 		0x2A, 0xD0, 0x75, 0xDE, 0x9E, 0x51, 0x64, 0xAB, 0x3E, 0xE9, 0x15, 0xB5,
 		0xAB, 0x56, 0x9A, 0x98, 0x82, 0x26, 0xEA, 0x2A, 0x62 };
 
-//--------------
+//----------------------------------------------------------------------------
+
+// Returns the expected self-test result for the chip id found in VersionReg,
+// NULL when unknown.
+const uint8_t* rc52x_ref_get(uint8_t chip_id) {
+	switch (chip_id) {
+	case 0x80:
+		// "PN512 V1";
+		return rc52x_ref_pn512_v1;
+	case 0x82:
+		// "PN512 V2";
+		return rc52x_ref_pn512_v2;
+	case 0x88:
+		// Note: this is not in the datasheet
+		// "FM17522";
+		return rc52x_ref_fm17522;
+		// TODO Chip ID for FM17550
+	case 0x90:
+		// "MFRC522 V0";
+		return rc52x_ref_mfrc522_V0;
+	case 0x91:
+		// "MFRC522 V1";
+		return rc52x_ref_mfrc522_V1;
+	case 0x92:
+		// "MFRC522 V2";
+		return rc52x_ref_mfrc522_V2;
+	case 0xB1:
+		// "MRFC523 V1";
+		return rc52x_ref_mfrc523_V1;
+	case 0xB2:
+		// "MRFC523 V2";
+		return rc52x_ref_mfrc523_V2;
+	default:
+		return NULL;
+	}
+}
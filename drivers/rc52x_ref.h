@@ -26,4 +26,8 @@ typedef enum {
 	rc52x_ref_status_error,
 } rc52x_ref_status_t;
 
+#define RC52X_REF_SIZE	(64)
+
+const uint8_t* rc52x_ref_get(uint8_t chip_id);
+
 #endif /* BSRFID_DRIVERS_RC52X_REF_H_ */
@@ -44,6 +44,69 @@
 
 #include "rc52x.h"
 
+#define RC52X_REG_BIT(reg)	(1ULL << ((reg) & 0x3F))
+
+// Registers modified by the chip itself. These are never cached.
+static const uint64_t rc52x_volatile_regs = RC52X_REG_BIT(RC52X_REG_CommandReg)
+		| RC52X_REG_BIT(RC52X_REG_ComIrqReg) | RC52X_REG_BIT(RC52X_REG_DivIrqReg)
+		| RC52X_REG_BIT(RC52X_REG_ErrorReg) | RC52X_REG_BIT(RC52X_REG_Status1Reg)
+		| RC52X_REG_BIT(RC52X_REG_Status2Reg)
+		| RC52X_REG_BIT(RC52X_REG_FIFODataReg)
+		| RC52X_REG_BIT(RC52X_REG_FIFOLevelReg)
+		| RC52X_REG_BIT(RC52X_REG_ControlReg)
+		| RC52X_REG_BIT(RC52X_REG_CRCResultReg_Hi)
+		| RC52X_REG_BIT(RC52X_REG_CRCResultReg_Lo)
+		| RC52X_REG_BIT(RC52X_REG_TCounterVal_Hi)
+		| RC52X_REG_BIT(RC52X_REG_TCounterVal_Lo) | 0xFFFF000000000000ULL; // Test registers
+
+// Registers with both host written and chip status bits. The host written
+// part is cached for masked updates, but reads always go to the chip.
+static const uint64_t rc52x_mixed_regs = RC52X_REG_BIT(RC52X_REG_BitFramingReg)
+		| RC52X_REG_BIT(RC52X_REG_CollReg);
+
+void rc52x_reg_cache_invalidate(rc52x_t *rc52x) {
+	if (rc52x->reg_cache)
+		memset(rc52x->reg_cache->valid, 0, sizeof(rc52x->reg_cache->valid));
+}
+
+static bool rc52x_reg_cache_lookup(rc52x_t *rc52x, uint8_t reg, uint8_t *value,
+		bool for_update) {
+	bs_pdc_reg_cache_t *cache = rc52x->reg_cache;
+	if (!cache || reg >= 0x40)
+		return false;
+	if (rc52x_volatile_regs & RC52X_REG_BIT(reg))
+		return false;
+	if (!for_update && (rc52x_mixed_regs & RC52X_REG_BIT(reg)))
+		return false;
+	if (!(cache->valid[reg / 32] & (UINT32_C(1) << (reg % 32))))
+		return false;
+	*value = cache->value[reg];
+	return true;
+}
+
+static void rc52x_reg_cache_store(rc52x_t *rc52x, uint8_t reg, uint8_t value) {
+	bs_pdc_reg_cache_t *cache = rc52x->reg_cache;
+	if (!cache || reg >= 0x40)
+		return;
+	if (rc52x_volatile_regs & RC52X_REG_BIT(reg))
+		return;
+	cache->value[reg] = value;
+	cache->valid[reg / 32] |= UINT32_C(1) << (reg % 32);
+}
+
+// Debug mode: compare the cached value against the chip
+static void rc52x_reg_cache_verify(rc52x_t *rc52x, uint8_t reg, uint8_t value) {
+	uint8_t chip_value;
+	if (rc52x_mixed_regs & RC52X_REG_BIT(reg))
+		return;
+	if (mfrc522_recv(rc52x, reg, &chip_value, 1))
+		return;
+	if (chip_value != value) {
+		rc52x->reg_cache->mismatch_count++;
+		rc52x_reg_cache_store(rc52x, reg, chip_value);
+	}
+}
+
 int mfrc522_recv(rc52x_t *rc52x, uint8_t reg, uint8_t *data, size_t amount) {
 	uint8_t addr;
 	int result = 0;
@@ -74,7 +137,7 @@ int mfrc522_recv(rc52x_t *rc52x, uint8_t reg, uint8_t *data, size_t amount) {
 			return -1;
 
 		int tmpval;
-		for (int i = 0; i < amount; i++) {
+		for (size_t i = 0; i < amount; i++) {
 			switch (rc52x->transport_type) {
 			case bshal_transport_spi:
 				tmpval = (((reg & 0x3f) + i) << MFRC522_SPI_REG_SHIFT)
@@ -123,6 +186,9 @@ int mfrc522_send(rc52x_t *rc52x, uint8_t reg, uint8_t *data, size_t amount) {
 	if (!rc52x->transport_instance.raw)
 		return -1;
 
+	if (amount)
+		rc52x_reg_cache_store(rc52x, reg, data[amount - 1]);
+
 	switch (rc52x->transport_type) {
 	case bshal_transport_spi:
 		addr = (reg << MFRC522_SPI_REG_SHIFT) | MFRC522_DIR_SEND;
@@ -148,18 +214,91 @@ int mfrc522_send(rc52x_t *rc52x, uint8_t reg, uint8_t *data, size_t amount) {
 	return -1;
 }
 
+// Reads a list of (not necessarily sequential) registers. On SPI this is
+// done in a single chip select burst, the address of the next register is
+// clocked out while the value of the previous register is clocked in.
+int mfrc522_recv_multi(rc52x_t *rc52x, uint8_t *regs, uint8_t *values,
+		size_t amount) {
+	uint8_t addr;
+	int result = 0;
+	if (!rc52x->transport_instance.raw)
+		return -1;
+	if (!amount)
+		return 0;
+
+	switch (rc52x->transport_type) {
+	case bshal_transport_spi:
+		addr = (regs[0] << MFRC522_SPI_REG_SHIFT) | MFRC522_DIR_RECV;
+		for (size_t i = 1; i < amount; i++)
+			values[i - 1] = (regs[i] << MFRC522_SPI_REG_SHIFT)
+					| MFRC522_DIR_RECV;
+		values[amount - 1] = 0x00;
+		result = bshal_spim_transmit(rc52x->transport_instance.spim, &addr, 1,
+				true);
+		if (result)
+			return result;
+		return bshal_spim_transceive(rc52x->transport_instance.spim, values,
+				amount, false);
+		break;
+	default:
+		for (size_t i = 0; i < amount; i++) {
+			result = mfrc522_recv(rc52x, regs[i], values + i, 1);
+			if (result)
+				return result;
+		}
+		return result;
+	}
+}
+
 int rc52x_get_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t *value) {
-	return mfrc522_recv(rc52x, reg, value, 1);
+	if (rc52x_reg_cache_lookup(rc52x, reg, value, false)) {
+		if (rc52x->reg_cache->verify) {
+			rc52x_reg_cache_verify(rc52x, reg, *value);
+			*value = rc52x->reg_cache->value[reg];
+		}
+		return 0;
+	}
+	int result = mfrc522_recv(rc52x, reg, value, 1);
+	if (!result && !(rc52x_mixed_regs & RC52X_REG_BIT(reg)))
+		rc52x_reg_cache_store(rc52x, reg, *value);
+	return result;
 }
 
 int rc52x_set_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value) {
+	uint8_t cached;
+	if (rc52x_reg_cache_lookup(rc52x, reg, &cached, true) && cached == value)
+		return 0; // Register already holds this value
+	if (reg == RC52X_REG_CommandReg && (value & 0x0F) == RC52X_CMD_SoftReset)
+		rc52x_reg_cache_invalidate(rc52x);
+	rc52x_reg_cache_store(rc52x, reg, value);
+
+	if (rc52x->transport_type == bshal_transport_spi
+			&& rc52x->transport_instance.raw) {
+		// Address and value in a single transfer
+		uint8_t frame[2] = { (reg << MFRC522_SPI_REG_SHIFT) | MFRC522_DIR_SEND,
+				value };
+		return bshal_spim_transmit(rc52x->transport_instance.spim, frame, 2,
+				false);
+	}
 	return mfrc522_send(rc52x, reg, &value, 1);
 }
 
+static int rc52x_get_reg8_for_update(rc52x_t *rc52x, uint8_t reg,
+		uint8_t *value) {
+	if (rc52x_reg_cache_lookup(rc52x, reg, value, true)) {
+		if (rc52x->reg_cache->verify) {
+			rc52x_reg_cache_verify(rc52x, reg, *value);
+			*value = rc52x->reg_cache->value[reg];
+		}
+		return 0;
+	}
+	return mfrc522_recv(rc52x, reg, value, 1);
+}
+
 int rc52x_or_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value) {
 	uint8_t tmpval;
 	int result;
-	result = rc52x_get_reg8(rc52x, reg, &tmpval);
+	result = rc52x_get_reg8_for_update(rc52x, reg, &tmpval);
 	if (result)
 		return result;
 	tmpval |= value;
@@ -169,10 +308,129 @@ int rc52x_or_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value) {
 int rc52x_and_reg8(rc52x_t *rc52x, uint8_t reg, uint8_t value) {
 	uint8_t tmpval;
 	int result;
-	result = rc52x_get_reg8(rc52x, reg, &tmpval);
+	result = rc52x_get_reg8_for_update(rc52x, reg, &tmpval);
 	if (result)
 		return result;
 	tmpval &= value;
 	return rc52x_set_reg8(rc52x, reg, tmpval);
 }
 
+
+void rc52x_batch_begin(rc52x_batch_t *batch, rc52x_t *rc52x) {
+	batch->rc52x = rc52x;
+	batch->count = 0;
+}
+
+static int rc52x_batch_add(rc52x_batch_t *batch, rc52x_batch_op_t op,
+		uint8_t reg, uint8_t value, uint8_t *data, size_t amount) {
+	int result = 0;
+	if (batch->count >= RC52X_BATCH_SIZE) {
+		// Queue is full, flush what we have got so far
+		result = rc52x_batch_flush(batch);
+		if (result)
+			return result;
+	}
+	rc52x_batch_entry_t *entry = batch->entries + batch->count++;
+	entry->op = op;
+	entry->reg = reg;
+	entry->value = value;
+	entry->data = data;
+	entry->amount = amount;
+	return result;
+}
+
+int rc52x_batch_set_reg8(rc52x_batch_t *batch, uint8_t reg, uint8_t value) {
+	return rc52x_batch_add(batch, rc52x_batch_op_set, reg, value, NULL, 0);
+}
+
+int rc52x_batch_or_reg8(rc52x_batch_t *batch, uint8_t reg, uint8_t value) {
+	return rc52x_batch_add(batch, rc52x_batch_op_or, reg, value, NULL, 0);
+}
+
+int rc52x_batch_and_reg8(rc52x_batch_t *batch, uint8_t reg, uint8_t value) {
+	return rc52x_batch_add(batch, rc52x_batch_op_and, reg, value, NULL, 0);
+}
+
+int rc52x_batch_send(rc52x_batch_t *batch, uint8_t reg, uint8_t *data,
+		size_t amount) {
+	return rc52x_batch_add(batch, rc52x_batch_op_send, reg, 0, data, amount);
+}
+
+int rc52x_batch_flush(rc52x_batch_t *batch) {
+	rc52x_t *rc52x = batch->rc52x;
+	uint8_t regs[RC52X_BATCH_SIZE];
+	uint8_t values[RC52X_BATCH_SIZE];
+	size_t read_count = 0;
+	uint64_t known = 0;
+	uint8_t shadow[0x40];
+	int result;
+
+	// Collect the registers we need to know the current value of
+	for (size_t i = 0; i < batch->count; i++) {
+		rc52x_batch_entry_t *entry = batch->entries + i;
+		uint64_t bit = 1ULL << (entry->reg & 0x3F);
+		switch (entry->op) {
+		case rc52x_batch_op_set:
+			known |= bit;
+			break;
+		case rc52x_batch_op_or:
+		case rc52x_batch_op_and:
+			if (!(known & bit)) {
+				known |= bit;
+				if (rc52x_reg_cache_lookup(rc52x, entry->reg,
+						&shadow[entry->reg & 0x3F], true)
+						&& !rc52x->reg_cache->verify)
+					break;
+				regs[read_count++] = entry->reg;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+
+	result = mfrc522_recv_multi(rc52x, regs, values, read_count);
+	if (result) {
+		batch->count = 0;
+		return result;
+	}
+	for (size_t i = 0; i < read_count; i++) {
+		if (rc52x->reg_cache && rc52x->reg_cache->verify
+				&& rc52x_reg_cache_lookup(rc52x, regs[i], &shadow[0x3F & regs[i]],
+						true) && shadow[0x3F & regs[i]] != values[i])
+			rc52x->reg_cache->mismatch_count++;
+		shadow[regs[i] & 0x3F] = values[i];
+		if (!(rc52x_mixed_regs & RC52X_REG_BIT(regs[i])))
+			rc52x_reg_cache_store(rc52x, regs[i], values[i]);
+	}
+
+	// Execute the queued operations in order
+	for (size_t i = 0; i < batch->count && !result; i++) {
+		rc52x_batch_entry_t *entry = batch->entries + i;
+		uint8_t reg = entry->reg & 0x3F;
+		uint8_t value;
+		switch (entry->op) {
+		case rc52x_batch_op_set:
+			shadow[reg] = entry->value;
+			known |= 1ULL << reg;
+			result = rc52x_set_reg8(rc52x, entry->reg, entry->value);
+			break;
+		case rc52x_batch_op_or:
+		case rc52x_batch_op_and:
+			value = entry->op == rc52x_batch_op_or ?
+					shadow[reg] | entry->value : shadow[reg] & entry->value;
+			if (value == shadow[reg])
+				break; // Nothing changes, skip the write
+			shadow[reg] = value;
+			result = rc52x_set_reg8(rc52x, entry->reg, value);
+			break;
+		case rc52x_batch_op_send:
+			result = mfrc522_send(rc52x, entry->reg, entry->data,
+					entry->amount);
+			break;
+		}
+	}
+
+	batch->count = 0;
+	return result;
+}
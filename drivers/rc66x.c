@@ -24,6 +24,7 @@ void rc66x_antenna_on(rc66x_t *rc66x) {
 
 }
 void rc66x_antenna_off(rc66x_t *rc66x) {
+	rc66x->picc_epoch++; // PICCs lose their state without field
 	rc66x_and_reg8(rc66x, RC66X_REG_DrvMode, ~0x03);
 }
 
@@ -35,9 +36,61 @@ void rc66x_reset(rc66x_t *rc66x) {
 	rc66x->delay_ms(1);
 	bshal_gpio_write_pin(rc66x->transport_instance.spim->rs_pin,
 			!rc66x->transport_instance.spim->rs_pol);
+	rc66x_reg_cache_invalidate(rc66x); // All registers are back at their reset values
 
 }
 
+// Reload value of timer 0 for a timeout, counting 4.72 µs ticks, or 1 ms
+// periods of timer 1 when cascaded. 0 is the default of RC66X_TIMER_us.
+static uint16_t rc66x_timer_reload(uint32_t timeout_us, bool *cascade) {
+	uint64_t ticks;
+
+	if (!timeout_us)
+		timeout_us = RC66X_TIMER_us;
+	ticks = ((uint64_t) timeout_us * 1000 + RC66X_TIMER_TICK_ns - 1)
+			/ RC66X_TIMER_TICK_ns;
+	*cascade = ticks > 0x10000;
+	if (*cascade) {
+		ticks = (timeout_us + 999) / 1000;
+		if (ticks > 0x10000)
+			ticks = 0x10000;
+	}
+	return ticks - 1;	// The timer underflows after reload + 1 ticks
+}
+
+// Writes the timer registers for the timeout: all of them, or only those
+// that differ from the timeout programmed before
+static rc66x_result_t rc66x_program_timer(bs_pdc_t *pdc, uint32_t timeout_us,
+		bool all) {
+	bool cascade, current_cascade;
+	uint16_t reload = rc66x_timer_reload(timeout_us, &cascade);
+	uint16_t current = rc66x_timer_reload(pdc->timeout_us, &current_cascade);
+	int result = STATUS_OK;
+
+	pdc->timeout_us = timeout_us;
+	if (all || cascade != current_cascade) {
+		if (cascade) {
+			// Timer 1 runs freely, timer 0 counts its underflows
+			result |= rc66x_set_reg8(pdc, RC66X_REG_T1ReloadHi,
+					(RC66X_TIMER_1ms_TICKS - 1) >> 8);
+			result |= rc66x_set_reg8(pdc, RC66X_REG_T1ReloadLo,
+					(RC66X_TIMER_1ms_TICKS - 1) & 0xFF);
+			result |= rc66x_set_reg8(pdc, RC66X_REG_T1Control,
+					RC66X_TCONTROL_StartTxEnd | RC66X_TCONTROL_AutoRestart
+							| RC66X_TCONTROL_Clk211kHz);
+		}
+		result |= rc66x_set_reg8(pdc, RC66X_REG_T0Control,
+				RC66X_TCONTROL_StopRx | RC66X_TCONTROL_StartTxEnd
+						| (cascade ? RC66X_TCONTROL_ClkUnderflow :
+								RC66X_TCONTROL_Clk211kHz));
+	}
+	if (all || (reload >> 8) != (current >> 8))
+		result |= rc66x_set_reg8(pdc, RC66X_REG_T0ReloadHi, reload >> 8);
+	if (all || (reload & 0xFF) != (current & 0xFF))
+		result |= rc66x_set_reg8(pdc, RC66X_REG_T0ReloadLo, reload & 0xFF);
+	return result ? STATUS_ERROR : STATUS_OK;
+}
+
 void rc66x_init(rc66x_t *rc66x) {
 	if (!rc66x)
 		return;
@@ -46,6 +99,27 @@ void rc66x_init(rc66x_t *rc66x) {
 	if (!rc66x->delay_ms)
 		return;
 	rc66x->TransceiveData = rc66x_transceive;
+	rc66x->SetParity = rc66x_set_parity;
+	rc66x->Crypto1Begin = rc66x_crypto1_begin;
+	rc66x->Crypto1End = rc66x_crypto1_end;
+	rc66x->SetTimeout = rc66x_set_timeout;
+	rc66x->timeout_us = 0;
+	rc66x->SetBitRate = rc66x_set_bitrate;
+	rc66x->bitrates = 0x0F;	// 106 to 848 kbps
+	rc66x->SetProtocol = rc66x_set_protocol;
+	rc66x->protocols = (1 << pdc_protocol_iso14443a)
+			| (1 << pdc_protocol_iso14443b);
+	rc66x->protocol = pdc_protocol_iso14443a;
+	rc66x->tx_bitrate = pdc_bitrate_106;
+	rc66x->rx_bitrate = pdc_bitrate_106;
+	rc66x->rx_fifo_size = RC66X_FIFO_SIZE;
+	rc66x->SetField = rc66x_set_field;
+	rc66x->LpcdMeasure = rc66x_lpcd_measure;
+	if (rc66x->wait_irq) {
+		// The host sleeps until the IRQ pin signals a PICC
+		rc66x->LpcdStart = rc66x_lpcd_start;
+		rc66x->LpcdStop = rc66x_lpcd_stop;
+	}
 	rc66x_reset(rc66x);
 
 	// Translated from AN12657  4.1.1
@@ -79,18 +153,67 @@ void rc66x_init(rc66x_t *rc66x) {
 	// 9. Switches the CRC extention OFF in rx direction
 	rc66x_set_reg8(rc66x, RC66X_REG_RxCrcPreset, 0x18);
 
+	// When the IRQ pin is connected, drive it push-pull and active high.
+	// The interrupt sources are enabled per command.
+	if (rc66x->wait_irq) {
+		rc66x_set_reg8(rc66x, RC66X_REG_IRQ0En, 0x00);
+		rc66x_set_reg8(rc66x, RC66X_REG_IRQ1En,
+				RC66X_IRQ1_IRQPushPull | RC66X_IRQ1_IRQPinEn);
+	}
+
+	// Timer 0 ends the reception when the PICC does not answer
+	rc66x_program_timer(rc66x, 0, true);
+
 	// The rest will go to the communicate with picc stuff
 
 }
 
-rc52x_result_t rc66x_transceive(rc66x_t *rc66x, uint8_t *sendData,
-		uint8_t sendLen, uint8_t *recv_data, uint8_t *recv_size,
-		uint8_t *validBits, uint8_t rxAlign, uint8_t *collpos, bool sendCRC,
-		bool recvCRC) {
+/**
+ * Waits until one of the interrupts in wait_irq0 or the timer 0 interrupt
+ * has been set. When a wait_irq hook is provided we sleep until the IRQ pin
+ * is raised, otherwise, or after a spurious wake up, IRQ0/IRQ1 are polled.
+ *
+ * @return STATUS_OK with the IRQ0/IRQ1 values in irq0/irq1,
+ * 		   STATUS_TIMEOUT otherwise.
+ */
+static rc66x_result_t rc66x_wait_for_irq(rc66x_t *rc66x, uint8_t wait_irq0,
+		uint8_t *irq0, uint8_t *irq1) {
+	uint32_t begin = rc66x->get_time_ms();
+	uint32_t timeout_ms = RC66X_TIMEOUT_ms;
+	if (rc66x->timeout_us)
+		timeout_ms = (rc66x->timeout_us + 999) / 1000 + RC66X_TIMEOUT_ms;
+
+	if (rc66x->wait_irq) {
+		rc66x->wait_irq(rc66x, timeout_ms);
+		rc66x_get_reg8(rc66x, RC66X_REG_IRQ0, irq0);
+		rc66x_get_reg8(rc66x, RC66X_REG_IRQ1, irq1);
+		if ((*irq0 & wait_irq0) || (*irq1 & RC66X_IRQ1_Timer0))
+			return STATUS_OK;
+	}
+
+	while ((rc66x->get_time_ms() - begin) < timeout_ms) {
+		rc66x_get_reg8(rc66x, RC66X_REG_IRQ0, irq0);
+		rc66x_get_reg8(rc66x, RC66X_REG_IRQ1, irq1);
+		if ((*irq0 & wait_irq0) || (*irq1 & RC66X_IRQ1_Timer0))
+			return STATUS_OK;
+	}
+	return STATUS_TIMEOUT;
+}
+
+// The TransceiveData hook. Frames are limited by the FIFO: a longer frame to
+// send, or an answer longer than *recv_size, fails with STATUS_NO_ROOM
+// instead of being truncated.
+int rc66x_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *recv_data, size_t *recv_size, uint8_t *validBits,
+		uint8_t rxAlign, uint8_t *collpos, bool sendCRC, bool recvCRC) {
+	rc66x_t *rc66x = pdc;
 	uint8_t waitIRq = 0b00010110;		// RxIRq and IdleIRq + ErrIRQ
 
 	// Prepare values for BitFramingReg
 	uint8_t txLastBits = validBits ? *validBits : 0;
+	if (sendLen > RC66X_FIFO_SIZE)
+		return STATUS_NO_ROOM;
+	rc66x->frame_count++;
 
 	rc66x_set_reg8(rc66x, RC66X_REG_Command, RC66X_CMD_Idle);// Stop any active command.
 
@@ -101,27 +224,26 @@ rc52x_result_t rc66x_transceive(rc66x_t *rc66x, uint8_t *sendData,
 	rc66x_set_reg8(rc66x, RC66X_REG_TxDataNum, 0x08 | txLastBits);
 	rc66x_set_reg8(rc66x, RC66X_REG_RxBitCtrl, 0x80 | ((0x7 & rxAlign) << 4));
 
-	rc66x_set_reg8(rc66x, RC66X_REG_TxCrcPreset, sendCRC ? 0x19 : 0x00);
-	rc66x_set_reg8(rc66x, RC66X_REG_RxCrcPreset, recvCRC ? 0x19 : 0x00);
+	uint8_t crc_preset = rc66x->protocol == pdc_protocol_iso14443b ?
+			RC66X_CRC_PRESET_ISO14443B : RC66X_CRC_PRESET_ISO14443A;
+	rc66x_set_reg8(rc66x, RC66X_REG_TxCrcPreset,
+			sendCRC ? crc_preset | RC66X_CRC_EN : 0x00);
+	rc66x_set_reg8(rc66x, RC66X_REG_RxCrcPreset,
+			recvCRC ? crc_preset | RC66X_CRC_EN : 0x00);
+
+	if (rc66x->wait_irq) {
+		rc66x_set_reg8(rc66x, RC66X_REG_IRQ0En, waitIRq);
+		rc66x_set_reg8(rc66x, RC66X_REG_IRQ1En,
+				RC66X_IRQ1_IRQPushPull | RC66X_IRQ1_IRQPinEn | RC66X_IRQ1_Timer0);
+	}
 
 	rc66x_set_reg8(rc66x, RC66X_REG_Command, RC66X_CMD_Transceive);	// Execute the command
 
-	uint32_t begin = rc66x->get_time_ms();
-
 	uint8_t irq0, irq1;
-	while ((rc66x->get_time_ms() - begin) < RC66X_TIMEOUT_ms) {
-		rc66x_get_reg8(rc66x, RC66X_REG_IRQ0, &irq0);
-		rc66x_get_reg8(rc66x, RC66X_REG_IRQ1, &irq1);
-		if (irq0 & waitIRq) {// One of the interrupts that signal success has been set.
-			break;
-		}
-		if (irq1 & 0x01) {		// Timer interrupt - nothing received in 25ms
-			return STATUS_TIMEOUT;
-		}
-	}
-
-	// 35.7ms and nothing happend. Communication with the MFRC522 might be down.
-	if ((rc66x->get_time_ms() - begin) >= RC66X_TIMEOUT_ms) {
+	// 40ms and nothing happend. Communication with the CLRC663 might be down.
+	if (rc66x_wait_for_irq(rc66x, waitIRq, &irq0, &irq1))
+		return STATUS_TIMEOUT;
+	if (!(irq0 & waitIRq)) { // Timer interrupt - nothing received
 		return STATUS_TIMEOUT;
 	}
 
@@ -144,8 +266,9 @@ rc52x_result_t rc66x_transceive(rc66x_t *rc66x, uint8_t *sendData,
 			// if not valid, set to 0
 			*collpos = 0;
 		} else {
-			// if valid, strip valid bit
-			*collpos &= 0x7F;
+			// if valid, strip valid bit. The CLRC663 counts from 0,
+			// we report the first bit as position 1, like the MFRC522.
+			*collpos = (*collpos & 0x7F) + 1;
 		}
 	}
 
@@ -160,10 +283,10 @@ rc52x_result_t rc66x_transceive(rc66x_t *rc66x, uint8_t *sendData,
 	if (recv_data && recv_size) {
 		uint8_t fifo_data_len;
 		rc66x_get_reg8(rc66x, RC66X_REG_FIFOLength, &fifo_data_len);// Number of bytes in the FIFO
-		*recv_size = fifo_data_len;
 		if (fifo_data_len > *recv_size) {
 			return STATUS_NO_ROOM;
 		}
+		*recv_size = fifo_data_len;
 		rc66x_recv(rc66x, RC66X_REG_FIFOData, recv_data, *recv_size);
 	}
 
@@ -187,14 +310,107 @@ rc52x_result_t rc66x_transceive(rc66x_t *rc66x, uint8_t *sendData,
 	return STATUS_OK;
 } // End RC52X_CommunicateWithPICC()
 
-rc66x_result_t rc66x_crypto1_end(bs_pdc_t *pdc) {
-	return rc66x_set_reg8(pdc, RC66X_REG_Status, ~(1 << 5));
+/**
+ * Sets how long to wait for the answer of the PICC. Timer 0 starts at the
+ * end of the transmission and stops when the answer starts, its underflow
+ * ends the Transceive command. Only the registers that change are written,
+ * usually the two reload registers.
+ *
+ * @param timeout_us	0 restores the default of RC66X_TIMER_us
+ */
+int rc66x_set_timeout(void *pdc, uint32_t timeout_us) {
+	rc66x_t *rc66x = pdc;
+	return rc66x_program_timer(rc66x, timeout_us, false);
+}
+
+// LoadProtocol, first the protocol number of the reception, then the one of
+// the transmission
+static rc66x_result_t rc66x_load_protocol(bs_pdc_t *pdc, uint8_t rx,
+		uint8_t tx) {
+	uint8_t load_protocol_parameters[] = { rx, tx };
+	uint8_t irq0, irq1;
+
+	rc66x_set_reg8(pdc, RC66X_REG_Command, RC66X_CMD_Idle);
+	rc66x_set_reg8(pdc, RC66X_REG_FIFOControl, 0xB0);
+	rc66x_set_reg8(pdc, RC66X_REG_IRQ0, 0x7F);
+	rc66x_send(pdc, RC66X_REG_FIFOData, load_protocol_parameters,
+			sizeof(load_protocol_parameters));
+	rc66x_set_reg8(pdc, RC66X_REG_Command, RC66X_CMD_LoadProtocol);
+	if (rc66x_wait_for_irq(pdc, RC66X_IRQ0_Idle, &irq0, &irq1))
+		return STATUS_TIMEOUT;
+	rc66x_set_reg8(pdc, RC66X_REG_FIFOControl, 0xB0);
+	if (irq0 & RC66X_IRQ0_Err)
+		return STATUS_ERROR;
+	return STATUS_OK;
+}
+
+/**
+ * Loads the protocol for the bit rates agreed with the PICC, by PPS for
+ * ISO 14443-A. The protocol numbers of LoadProtocol are 0x00 to 0x03 for
+ * 106 to 848 kbps of ISO 14443-A, 0x04 to 0x07 for ISO 14443-B.
+ */
+int rc66x_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx) {
+	rc66x_t *rc66x = pdc;
+	uint8_t base = rc66x->protocol == pdc_protocol_iso14443b ?
+			RC66X_PROTOCOL_ISO14443B : RC66X_PROTOCOL_ISO14443A;
+	rc66x_result_t result;
+
+	if (tx > pdc_bitrate_848 || rx > pdc_bitrate_848)
+		return STATUS_INVALID;
+	result = rc66x_load_protocol(rc66x, base + rx, base + tx);
+	if (result)
+		return result;
+	rc66x->tx_bitrate = tx;
+	rc66x->rx_bitrate = rx;
+	return STATUS_OK;
 }
 
-rc66x_result_t rc66x_crypto1_begin(bs_pdc_t *rc66x, picc_t *picc) {
+/**
+ * Loads ISO 14443-A or ISO 14443-B at 106 kbps. The field stays on, the
+ * PICCs of the other protocol keep their state.
+ */
+int rc66x_set_protocol(void *pdc, pdc_protocol_t protocol) {
+	rc66x_t *rc66x = pdc;
+	uint8_t number;
+	rc66x_result_t result;
+
+	switch (protocol) {
+	case pdc_protocol_iso14443a:
+		number = RC66X_PROTOCOL_ISO14443A;
+		break;
+	case pdc_protocol_iso14443b:
+		number = RC66X_PROTOCOL_ISO14443B;
+		break;
+	default:
+		return STATUS_INVALID;
+	}
+	result = rc66x_load_protocol(rc66x, number, number);
+	if (result)
+		return result;
+	rc66x->protocol = protocol;
+	rc66x->tx_bitrate = pdc_bitrate_106;
+	rc66x->rx_bitrate = pdc_bitrate_106;
+	return STATUS_OK;
+}
+
+int rc66x_set_parity(void *pdc, bool enable) {
+	rc66x_t *rc66x = pdc;
+	// FrameCon TxParityEn and RxParityEn
+	if (enable)
+		return rc66x_or_reg8(rc66x, RC66X_REG_FrameCon, 0xC0);
+	return rc66x_and_reg8(rc66x, RC66X_REG_FrameCon, (uint8_t)~0xC0);
+}
+
+int rc66x_crypto1_end(void *pdc) {
+	rc66x_t *rc66x = pdc;
+	return rc66x_set_reg8(rc66x, RC66X_REG_Status, ~(1 << 5));
+}
+
+int rc66x_crypto1_begin(void *pdc, void *p) {
+	rc66x_t *rc66x = pdc;
+	picc_t *picc = p;
 	if (!picc)
 		return -1;
-	rc66x_result_t result;
 	switch (picc->mfc_crypto1.key_a_or_b) {
 	case 0x60:
 		// Use Key A
@@ -223,15 +439,18 @@ rc66x_result_t rc66x_crypto1_begin(bs_pdc_t *rc66x, picc_t *picc) {
 	memcpy(buffer, &picc->mfc_crypto1, 2);
 	memcpy(buffer + 2, picc->uid+ picc->uid_size - 4, 4);
 	rc66x_send(rc66x, RC66X_REG_FIFOData, buffer, 6);
+	if (rc66x->wait_irq) {
+		rc66x_set_reg8(rc66x, RC66X_REG_IRQ0En, RC66X_IRQ0_Idle);
+		rc66x_set_reg8(rc66x, RC66X_REG_IRQ1En,
+				RC66X_IRQ1_IRQPushPull | RC66X_IRQ1_IRQPinEn | RC66X_IRQ1_Timer0);
+	}
 	rc66x_set_reg8(rc66x, RC66X_REG_Command, RC66X_CMD_MFAuthent);// Execute the command
 
-	uint8_t status, error;
-	uint32_t timeout = rc66x->get_time_ms() + RC66X_TIMEOUT_ms;
-
-	while ((rc66x->get_time_ms()) < timeout) {
-		rc66x_get_reg8(rc66x, RC66X_REG_Error, &error);
+	uint8_t status, irq0, irq1;
+	if (!rc66x_wait_for_irq(rc66x, RC66X_IRQ0_Idle, &irq0, &irq1)
+			&& (irq0 & RC66X_IRQ0_Idle)) {
 		rc66x_get_reg8(rc66x, RC66X_REG_Status, &status);
-		if (status && (1 << 5)) {
+		if (status & (1 << 5)) {	// Crypto1On
 			return STATUS_OK;
 		}
 	}
@@ -241,3 +460,135 @@ rc66x_result_t rc66x_crypto1_begin(bs_pdc_t *rc66x, picc_t *picc) {
 	return STATUS_ERROR;
 
 }
+
+int rc66x_set_field(void *pdc, bool on) {
+	rc66x_t *rc66x = pdc;
+	if (on)
+		rc66x_antenna_on(rc66x);
+	else
+		rc66x_antenna_off(rc66x);
+	return STATUS_OK;
+}
+
+// Starts the LPCD command. The channels wake the chip when they leave
+// min..max, I is channel 0, Q channel 1. The maximum of I is spread over
+// the upper bits of the three threshold registers.
+static rc66x_result_t rc66x_lpcd_begin(rc66x_t *rc66x, const uint8_t *min,
+		const uint8_t *max, uint16_t t4_reload, uint8_t t4_control,
+		uint8_t command) {
+	int result = 0;
+	uint8_t i_max = max[0] > RC66X_LPCD_RESULT_MASK ?
+			RC66X_LPCD_RESULT_MASK : max[0];
+	uint8_t q_max = max[1] > RC66X_LPCD_RESULT_MASK ?
+			RC66X_LPCD_RESULT_MASK : max[1];
+
+	rc66x->picc_epoch++; // The field is pulsed, the PICCs lose their state
+
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_Command, RC66X_CMD_Idle);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_LPCD_QMin,
+			(min[1] & RC66X_LPCD_RESULT_MASK) | (i_max & 0x30) << 2);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_LPCD_QMax,
+			q_max | (i_max & 0x0C) << 4);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_LPCD_IMin,
+			(min[0] & RC66X_LPCD_RESULT_MASK) | (i_max & 0x03) << 6);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_DrvMode, RC66X_LPCD_DRVMODE);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_T3ReloadHi,
+			RC66X_LPCD_T3_RELOAD >> 8);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_T3ReloadLo,
+			RC66X_LPCD_T3_RELOAD & 0xFF);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_T4ReloadHi, t4_reload >> 8);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_T4ReloadLo, t4_reload & 0xFF);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_T4Control, t4_control);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_LPCD_Q_Result,
+			RC66X_LPCD_Q_Result_Clr);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_Rcv, RC66X_LPCD_RCV);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_RxAna, RC66X_LPCD_RXANA);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_FIFOControl, 0xB0);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ0, 0x7F);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ1, 0x7F);
+	if (rc66x->wait_irq) {
+		result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ0En, RC66X_IRQ0_Idle);
+		result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ1En,
+				RC66X_IRQ1_IRQPushPull | RC66X_IRQ1_IRQPinEn
+						| RC66X_IRQ1_LPCD);
+	}
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_Command, command);
+	return result ? STATUS_ERROR : STATUS_OK;
+}
+
+// Ends the LPCD command and restores the receiver, the field stays off
+static rc66x_result_t rc66x_lpcd_end(rc66x_t *rc66x,
+		pdc_lpcd_sample_t *sample) {
+	int result = 0;
+	uint8_t i, q;
+
+	// Any access wakes the chip from standby
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_Command, RC66X_CMD_Idle);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_T4Control,
+			RC66X_T4CONTROL_StartStopNow);
+	result |= rc66x_get_reg8(rc66x, RC66X_REG_LPCD_I_Result, &i);
+	result |= rc66x_get_reg8(rc66x, RC66X_REG_LPCD_Q_Result, &q);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_Rcv, RC66X_RCV_ISO14443A);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_RxAna, RC66X_RXANA_ISO14443A);
+	// As rc66x_init() sets it, with the field off
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_DrvMode, 0x8E & ~0x03);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ0, 0x7F);
+	result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ1, 0x7F);
+	if (rc66x->wait_irq) {
+		result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ0En, 0x00);
+		result |= rc66x_set_reg8(rc66x, RC66X_REG_IRQ1En,
+				RC66X_IRQ1_IRQPushPull | RC66X_IRQ1_IRQPinEn);
+	}
+
+	memset(sample, 0, sizeof(pdc_lpcd_sample_t));
+	sample->channel[0] = i & RC66X_LPCD_RESULT_MASK;
+	sample->channel[1] = q & RC66X_LPCD_RESULT_MASK;
+	sample->channels = 2;
+	sample->rf_on_us = RC66X_LPCD_MEASURE_us;
+	return result ? STATUS_ERROR : STATUS_OK;
+}
+
+/**
+ * A single LPCD measurement of the I and Q channel, awaited by the host.
+ * The window spans all values, the command ends without LPCD interrupt.
+ */
+int rc66x_lpcd_measure(void *pdc, pdc_lpcd_sample_t *sample) {
+	rc66x_t *rc66x = pdc;
+	static const uint8_t min[PDC_LPCD_CHANNELS] = { 0x00, 0x00 };
+	static const uint8_t max[PDC_LPCD_CHANNELS] = { 0x3F, 0x3F };
+	uint8_t irq0, irq1;
+
+	int result = rc66x_lpcd_begin(rc66x, min, max, 0x0005,
+			RC66X_T4CONTROL_Running | RC66X_T4CONTROL_StartStopNow
+					| RC66X_T4CONTROL_AutoTrimm | RC66X_T4CONTROL_AutoLPCD
+					| RC66X_TCONTROL_AutoRestart, RC66X_CMD_LPCD);
+	if (!result)
+		result = rc66x_wait_for_irq(rc66x, RC66X_IRQ0_Idle, &irq0, &irq1);
+	int end = rc66x_lpcd_end(rc66x, sample);
+	return result ? result : end;
+}
+
+/**
+ * Puts the CLRC663 in standby with autonomous LPCD: timer 4 wakes it every
+ * period_ms, up to 32 s, for a measurement of 150 µs. When a channel is
+ * outside min..max the IRQ pin is raised, the host sleeps meanwhile.
+ */
+int rc66x_lpcd_start(void *pdc, const uint8_t *min, const uint8_t *max,
+		uint32_t period_ms) {
+	rc66x_t *rc66x = pdc;
+	uint32_t reload = 2 * period_ms;
+	if (reload < 1)
+		reload = 1;
+	if (reload > 0x10000)
+		reload = 0x10000;
+	return rc66x_lpcd_begin(rc66x, min, max, reload - 1,
+			RC66X_T4CONTROL_Running | RC66X_T4CONTROL_StartStopNow
+					| RC66X_T4CONTROL_AutoLPCD | RC66X_TCONTROL_AutoRestart
+					| RC66X_T4CONTROL_AutoWakeUp | RC66X_T4CONTROL_Clk2kHz,
+			RC66X_COMMAND_Standby | RC66X_CMD_LPCD);
+}
+
+int rc66x_lpcd_stop(void *pdc, pdc_lpcd_sample_t *sample) {
+	rc66x_t *rc66x = pdc;
+	return rc66x_lpcd_end(rc66x, sample);
+}
@@ -69,6 +69,10 @@ the same, so I am not sure if we can tell them apart.
 typedef  rc52x_t rc66x_t;
 typedef rc52x_result_t rc66x_result_t;
 
+// The FIFO holds 512 bytes, but rc66x_init() selects the 255 byte mode
+// (FIFOSize in FIFOControl), where FIFOLength fits in a single register.
+#define RC66X_FIFO_SIZE		(255)
+
 
 #define RC66X_REG_Command         	(0x00) //  Starts and stops command execution
 #define RC66X_REG_HostCtrl        	(0x01) //  Host control register
@@ -184,7 +188,75 @@ typedef rc52x_result_t rc66x_result_t;
 #define RC66X_CMD_LoadReg			(0x0C)
 #define RC66X_CMD_LoadProtocol		(0x0D)
 
+// IRQ0 / IRQ0En
+#define RC66X_IRQ0_IRQInv			(0x80)	// IRQ0En only
+#define RC66X_IRQ0_HiAlert			(0x40)
+#define RC66X_IRQ0_LoAlert			(0x20)
+#define RC66X_IRQ0_Idle				(0x10)
+#define RC66X_IRQ0_Tx				(0x08)
+#define RC66X_IRQ0_Rx				(0x04)
+#define RC66X_IRQ0_Err				(0x02)
+#define RC66X_IRQ0_RxSOF			(0x01)
+
+// IRQ1 / IRQ1En
+#define RC66X_IRQ1_IRQPushPull		(0x80)	// IRQ1En only
+#define RC66X_IRQ1_IRQPinEn			(0x40)	// IRQ1En only
+#define RC66X_IRQ1_LPCD				(0x20)
+#define RC66X_IRQ1_Timer4			(0x10)
+#define RC66X_IRQ1_Timer3			(0x08)
+#define RC66X_IRQ1_Timer2			(0x04)
+#define RC66X_IRQ1_Timer1			(0x02)
+#define RC66X_IRQ1_Timer0			(0x01)
+
+// T0Control ... T4Control
+#define RC66X_TCONTROL_StopRx		(0x80)	// Stops when a reception starts
+#define RC66X_TCONTROL_StartTxEnd	(0x10)	// Starts at the end of a transmission
+#define RC66X_TCONTROL_AutoRestart	(0x08)
+#define RC66X_TCONTROL_Clk211kHz	(0x01)	// 13.56 MHz / 64, 4.72 µs
+#define RC66X_TCONTROL_ClkUnderflow	(0x02)	// Underflow of the next timer
+
+// T4Control, timer 4 runs from the LFO and drives the LPCD
+#define RC66X_T4CONTROL_Running		(0x80)
+#define RC66X_T4CONTROL_StartStopNow	(0x40)
+#define RC66X_T4CONTROL_AutoTrimm	(0x20)	// Trims the LFO on every wake up
+#define RC66X_T4CONTROL_AutoLPCD	(0x10)	// Starts LPCD on underflow
+#define RC66X_T4CONTROL_AutoWakeUp	(0x04)	// Leaves standby on underflow
+#define RC66X_T4CONTROL_Clk2kHz		(0x03)	// LFO / 8, 0.5 ms
+
+// Command register: standby, until timer 4 or the host wakes the chip
+#define RC66X_COMMAND_Standby		(0x80)
+// LPCD_Q_Result: write to clear the LPCD result
+#define RC66X_LPCD_Q_Result_Clr		(0x40)
+#define RC66X_LPCD_RESULT_MASK		(0x3F)	// I and Q are 6 bit
+
+// Low-power card detection, AN11145. Timer 3 at 13.56 MHz sets the time
+// the field is on for a measurement, 150 µs. The receiver runs in ADC mode
+// at maximum gain for the measurement, and is set back to the values of
+// LoadProtocol ISO 14443-A afterwards.
+#define RC66X_LPCD_MEASURE_us		(150)
+#define RC66X_LPCD_T3_RELOAD		(0x07F2)
+#define RC66X_LPCD_DRVMODE			(0x89)
+#define RC66X_LPCD_RCV				(0x52)	// Rx_ADCmode
+#define RC66X_LPCD_RXANA			(0x03)
+#define RC66X_RCV_ISO14443A			(0x12)
+#define RC66X_RXANA_ISO14443A		(0x0A)
+
 #define RC66X_TIMEOUT_ms			(40)
+// Default of the timer that ends the reception
+#define RC66X_TIMER_us				(25000)
+// Timer 0 counts 4.72 µs up to 309 ms, longer timeouts count 1 ms periods
+// of timer 1
+#define RC66X_TIMER_TICK_ns			(4720)
+#define RC66X_TIMER_1ms_TICKS		(212)
+
+// LoadProtocol numbers at 106 kbps, +1 to +3 for 212 to 848 kbps
+#define RC66X_PROTOCOL_ISO14443A	(0x00)
+#define RC66X_PROTOCOL_ISO14443B	(0x04)
+// TxCrcPreset and RxCrcPreset: preset 6363 (CRC_A) or FFFF inverted
+// (CRC_B), CRC16, and the enable bit
+#define RC66X_CRC_PRESET_ISO14443A	(0x18)
+#define RC66X_CRC_PRESET_ISO14443B	(0x7A)
+#define RC66X_CRC_EN				(0x01)
 
 //------------
 int rc66x_get_chip_version(rc66x_t *rc66x, uint8_t *chip_id);
@@ -192,15 +264,19 @@ int rc66x_get_chip_version(rc66x_t *rc66x, uint8_t *chip_id);
 void rc66x_antenna_on(rc66x_t *rc66x);
 void rc66x_antenna_off(rc66x_t *rc66x);
 
-rc66x_result_t rc66x_transceive(rc66x_t *rc66x,uint8_t *sendData,
-		uint8_t sendLen,
-		uint8_t *backData,
-		uint8_t *backLen,
-		uint8_t *validBits,
-		uint8_t rxAlign,
-		uint8_t * collpos,
-		bool sendCRC ,
-		bool recvCRC
-		);
+int rc66x_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collpos, bool sendCRC, bool recvCRC);
 
 void rc66x_init(rc66x_t *rc66x);
+int rc66x_set_timeout(void *pdc, uint32_t timeout_us);
+int rc66x_set_bitrate(void *pdc, pdc_bitrate_t tx, pdc_bitrate_t rx);
+int rc66x_set_protocol(void *pdc, pdc_protocol_t protocol);
+int rc66x_set_parity(void *pdc, bool enable);
+int rc66x_crypto1_begin(void *pdc, void *p);
+int rc66x_crypto1_end(void *pdc);
+int rc66x_set_field(void *pdc, bool on);
+int rc66x_lpcd_measure(void *pdc, pdc_lpcd_sample_t *sample);
+int rc66x_lpcd_start(void *pdc, const uint8_t *min, const uint8_t *max,
+		uint32_t period_ms);
+int rc66x_lpcd_stop(void *pdc, pdc_lpcd_sample_t *sample);
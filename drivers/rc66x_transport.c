@@ -43,6 +43,70 @@
 #include <string.h>
 
 #include "rc66x.h"
+#include "rc66x_transport.h"
+
+// Registers modified by the chip itself. These are never cached.
+static const uint32_t rc66x_volatile_regs[4] = {
+		// 0x00 - 0x1F: Command, HostCtrl, FIFOControl, FIFOLength, FIFOData,
+		// IRQ0, IRQ1, Error, Status, RxColl, TControl, Timer 0-2 counters
+		0x318C6CF7,
+		// 0x20 - 0x3F: Timer 3-4 counters
+		0x000000C6,
+		// 0x40 - 0x5F: LPCD results, PadIn
+		0x0000004C,
+		// 0x60 - 0x7F: Version
+		0x80000000, };
+
+// Registers with both host written and chip status bits. The host written
+// part is cached for masked updates, but reads always go to the chip.
+static const uint32_t rc66x_mixed_regs[4] = {
+		// 0x00 - 0x1F: RxBitCtrl
+		0x00001000, 0, 0, 0, };
+
+#define RC66X_REG_IN(set, reg)	((set)[(reg) / 32] & (1UL << ((reg) % 32)))
+
+void rc66x_reg_cache_invalidate(rc66x_t *rc66x) {
+	if (rc66x->reg_cache)
+		memset(rc66x->reg_cache->valid, 0, sizeof(rc66x->reg_cache->valid));
+}
+
+static bool rc66x_reg_cache_lookup(rc66x_t *rc66x, uint8_t reg, uint8_t *value,
+		bool for_update) {
+	bs_pdc_reg_cache_t *cache = rc66x->reg_cache;
+	if (!cache || reg >= 0x80)
+		return false;
+	if (RC66X_REG_IN(rc66x_volatile_regs, reg))
+		return false;
+	if (!for_update && RC66X_REG_IN(rc66x_mixed_regs, reg))
+		return false;
+	if (!RC66X_REG_IN(cache->valid, reg))
+		return false;
+	*value = cache->value[reg];
+	return true;
+}
+
+static void rc66x_reg_cache_store(rc66x_t *rc66x, uint8_t reg, uint8_t value) {
+	bs_pdc_reg_cache_t *cache = rc66x->reg_cache;
+	if (!cache || reg >= 0x80)
+		return;
+	if (RC66X_REG_IN(rc66x_volatile_regs, reg))
+		return;
+	cache->value[reg] = value;
+	cache->valid[reg / 32] |= UINT32_C(1) << (reg % 32);
+}
+
+// Debug mode: compare the cached value against the chip
+static void rc66x_reg_cache_verify(rc66x_t *rc66x, uint8_t reg, uint8_t value) {
+	uint8_t chip_value;
+	if (RC66X_REG_IN(rc66x_mixed_regs, reg))
+		return;
+	if (rc66x_recv(rc66x, reg, &chip_value, 1))
+		return;
+	if (chip_value != value) {
+		rc66x->reg_cache->mismatch_count++;
+		rc66x_reg_cache_store(rc66x, reg, chip_value);
+	}
+}
 
 int rc66x_recv(rc66x_t *rc66x, uint8_t reg, uint8_t *data, size_t amount) {
 	uint8_t addr;
@@ -83,6 +147,9 @@ int rc66x_send(rc66x_t *rc66x, uint8_t reg, uint8_t *data, size_t amount) {
 	if (!rc66x->transport_instance.raw)
 		return -1;
 
+	if (amount)
+		rc66x_reg_cache_store(rc66x, reg, data[amount - 1]);
+
 	switch (rc66x->transport_type) {
 	case bshal_transport_spi:
 		addr = (reg << RC66X_SPI_REG_SHIFT) | RC66X_DIR_SEND;
@@ -108,17 +175,46 @@ int rc66x_send(rc66x_t *rc66x, uint8_t reg, uint8_t *data, size_t amount) {
 }
 
 int rc66x_get_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t *value) {
-	return rc66x_recv(rc66x, reg, value, 1);
+	if (rc66x_reg_cache_lookup(rc66x, reg, value, false)) {
+		if (rc66x->reg_cache->verify) {
+			rc66x_reg_cache_verify(rc66x, reg, *value);
+			*value = rc66x->reg_cache->value[reg];
+		}
+		return 0;
+	}
+	int result = rc66x_recv(rc66x, reg, value, 1);
+	if (!result && !RC66X_REG_IN(rc66x_mixed_regs, reg))
+		rc66x_reg_cache_store(rc66x, reg, *value);
+	return result;
 }
 
 int rc66x_set_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value) {
+	uint8_t cached;
+	if (rc66x_reg_cache_lookup(rc66x, reg, &cached, true) && cached == value)
+		return 0; // Register already holds this value
+	if (reg == RC66X_REG_Command
+			&& (value == RC66X_CMD_LoadProtocol || value == RC66X_CMD_LoadReg))
+		// These commands load register values from the EEPROM
+		rc66x_reg_cache_invalidate(rc66x);
 	return rc66x_send(rc66x, reg, &value, 1);
 }
 
+static int rc66x_get_reg8_for_update(rc66x_t *rc66x, uint8_t reg,
+		uint8_t *value) {
+	if (rc66x_reg_cache_lookup(rc66x, reg, value, true)) {
+		if (rc66x->reg_cache->verify) {
+			rc66x_reg_cache_verify(rc66x, reg, *value);
+			*value = rc66x->reg_cache->value[reg];
+		}
+		return 0;
+	}
+	return rc66x_recv(rc66x, reg, value, 1);
+}
+
 int rc66x_or_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value) {
 	uint8_t tmpval;
 	int result;
-	result = rc66x_get_reg8(rc66x, reg, &tmpval);
+	result = rc66x_get_reg8_for_update(rc66x, reg, &tmpval);
 	if (result)
 		return result;
 	tmpval |= value;
@@ -128,10 +224,9 @@ int rc66x_or_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value) {
 int rc66x_and_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value) {
 	uint8_t tmpval;
 	int result;
-	result = rc66x_get_reg8(rc66x, reg, &tmpval);
+	result = rc66x_get_reg8_for_update(rc66x, reg, &tmpval);
 	if (result)
 		return result;
 	tmpval &= value;
 	return rc66x_set_reg8(rc66x, reg, tmpval);
 }
-
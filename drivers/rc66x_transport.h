@@ -14,5 +14,6 @@ int rc66x_get_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t *value);
 int rc66x_set_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value);
 int rc66x_or_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value);
 int rc66x_and_reg8(rc66x_t *rc66x, uint8_t reg, uint8_t value);
+void rc66x_reg_cache_invalidate(rc66x_t *rc66x);
 
 #endif /* ESP32_ESP_IDF_COMPONENTS_UCDEV_BSRFID_DRIVERS_RC66X_TRANSPORT_H_ */
@@ -60,7 +60,8 @@ void THM3060_AntennaOn(thm3060_t *thm3060){
 
 }
 void THM3060_AntennaOff(thm3060_t *thm3060){
-	thm3060_and_reg8(thm3060, THM3060_REG_SCON, ~0x01);
+	thm3060->picc_epoch++; // PICCs lose their state without field
+	thm3060_and_reg8(thm3060, THM3060_REG_SCON, (uint8_t)~0x01);
 }
 
 
@@ -68,59 +69,56 @@ void THM3060_AntennaOff(thm3060_t *thm3060){
 
 rc52x_result_t THM3060_CommunicateWithPICC(thm3060_t *thm3060, uint8_t command,	///< The command to execute. One of the RC52X_Command enums.
 		uint8_t waitIRq,///< The bits in the ComIrqReg register that signals successful completion of the command.
-		uint8_t *sendData,	///< Pointer to the data to transfer to the FIFO.
-		uint8_t sendLen,		///< Number of uint8_ts to transfer to the FIFO.
-		uint8_t *backData,///< nullptr or pointer to buffer if data should be read back after executing the command.
-		uint8_t *backLen,///< In: Max number of uint8_ts to write to *backData. Out: The number of uint8_ts returned.
+		void *sendData,	///< Pointer to the data to transfer to the FIFO.
+		size_t sendLen,		///< Number of uint8_ts to transfer to the FIFO.
+		void *backData,///< nullptr or pointer to buffer if data should be read back after executing the command.
+		size_t *backLen,///< In: Max number of uint8_ts to write to *backData. Out: The number of uint8_ts returned.
 		uint8_t *validBits,	///< In/Out: The number of valid bits in the last uint8_t. 0 for 8 valid bits.
 		uint8_t rxAlign,///< In: Defines the bit position in backData[0] for the first bit received. Default 0.
 		bool sendCRC ,
 		bool recvCRC
 		) {
-	// Prepare values for BitFramingReg
-	uint8_t txLastBits = validBits ? *validBits : 0;
-
 	// Is there a "go to idle" command
 
 	thm3060_set_reg8(thm3060, THM3060_REG_RSTAT, 0x00);	// Clear interrupts
 
 
 	thm3060_or_reg8(thm3060, THM3060_REG_SCON, 0x04);	// Clear buffer
-	thm3060_and_reg8(thm3060, THM3060_REG_SCON, ~0x04);	// Ready buffer,
+	thm3060_and_reg8(thm3060, THM3060_REG_SCON, (uint8_t)~0x04);	// Ready buffer,
 	thm3060_send(thm3060, THM3060_REG_DATA, sendData, sendLen);// Write sendData to the FIFO
 
-	thm3060_set_reg8(thm3060, THM3060_REG_RSCL, sendLen);
-	thm3060_set_reg8(thm3060, THM3060_REG_RSCH, 0);
-	//thm3060_set_reg8(thm3060, THM3060_REG_BPOS, txLastBits);
+	thm3060_set_reg8(thm3060, THM3060_REG_RSCL, sendLen & 0xFF);
+	thm3060_set_reg8(thm3060, THM3060_REG_RSCH, sendLen >> 8);
+	//thm3060_set_reg8(thm3060, THM3060_REG_BPOS, validBits ? *validBits : 0);
 
 	//--------
 
 	if (sendCRC) {
 		thm3060_or_reg8(thm3060,THM3060_REG_CRCSEL, 0x80);
 	} else {
-		thm3060_and_reg8(thm3060,THM3060_REG_CRCSEL, ~0x80);
+		thm3060_and_reg8(thm3060,THM3060_REG_CRCSEL, (uint8_t)~0x80);
 	}
 
 	if (recvCRC) {
 		thm3060_or_reg8(thm3060,THM3060_REG_CRCSEL, 0x40);
 	} else {
-		thm3060_and_reg8(thm3060,THM3060_REG_CRCSEL, ~0x40);
+		thm3060_and_reg8(thm3060,THM3060_REG_CRCSEL, (uint8_t)~0x40);
 	}
 
-	thm3060_or_reg8(thm3060,THM3060_REG_SCON, 0x02); // start
-
-	bshal_delay_ms(5);
+	// Wait for the command to complete, the timeout of the PCD plus the air
+	// time of the frames. One more ms as the tick may advance right away.
+	uint32_t timeout_us = thm3060->timeout_us ?
+			thm3060->timeout_us : THM3060_TIMEOUT_us;
+	timeout_us += THM3060_BYTE_us * (sendLen + (backLen ? *backLen : 0));
+	uint32_t timeout_ms = (timeout_us + 999) / 1000 + 1;
 
-	// Wait for the command to complete.
-	// In RC52X_Init() we set the TAuto flag in TModeReg. This means the timer automatically starts when the PCD stops transmitting.
-	// Each iteration of the do-while-loop takes 17.86μs.
-	// TODO check/modify for other architectures than Arduino Uno 16bit
+	thm3060_or_reg8(thm3060,THM3060_REG_SCON, 0x02); // start
 
-	uint32_t begin = HAL_GetTick(); // TODO replace with get_time_ms();
+	uint32_t begin = thm3060->get_time_ms();
 
 	bool collision = false;
 
-	while ((HAL_GetTick() - begin) < 36) {
+	while ((thm3060->get_time_ms() - begin) < timeout_ms) {
 		uint8_t irq;
 		thm3060_get_reg8(thm3060, THM3060_REG_RSTAT, &irq);
 
@@ -156,7 +154,8 @@ rc52x_result_t THM3060_CommunicateWithPICC(thm3060_t *thm3060, uint8_t command,
 
 		if (irq & 0x40) {
 			collision = true;
-		}	break;
+			break;
+		}
 
 		if (irq & 0x80) {
 			// Interrupt Detected
@@ -166,19 +165,23 @@ rc52x_result_t THM3060_CommunicateWithPICC(thm3060_t *thm3060, uint8_t command,
 
 
 	}
-	// 35.7ms and nothing happend. Communication with the MFRC522 might be down.
-	if ( (HAL_GetTick() - begin) >= 36) {
+	// Nothing received within the timeout, or communication with the
+	// THM3060 is down.
+	if ( (thm3060->get_time_ms() - begin) >= timeout_ms) {
+		thm3060_and_reg8(thm3060,THM3060_REG_SCON, (uint8_t)~0x02); // stop
 		return STATUS_TIMEOUT;
 	}
 
-	thm3060_and_reg8(thm3060,THM3060_REG_SCON, ~0x02); // stop
+	thm3060_and_reg8(thm3060,THM3060_REG_SCON, (uint8_t)~0x02); // stop
 
 	uint8_t _validBits = 0;
 
 	// If the caller wants data back, get it from the MFRC522.
 	if (backData && backLen) {
-		uint8_t fifo_data_len;
-		thm3060_get_reg8(thm3060, THM3060_REG_RSCL, &fifo_data_len);// Number of bytes in the FIFO
+		uint8_t rsch, rscl;
+		thm3060_get_reg8(thm3060, THM3060_REG_RSCH, &rsch);
+		thm3060_get_reg8(thm3060, THM3060_REG_RSCL, &rscl);
+		size_t fifo_data_len = rsch << 8 | rscl;// Number of bytes in the FIFO
 
 		if (fifo_data_len > *backLen) {
 			return STATUS_NO_ROOM;
@@ -213,24 +216,42 @@ rc52x_result_t THM3060_CommunicateWithPICC(thm3060_t *thm3060, uint8_t command,
 	return STATUS_OK;
 } // End RC52X_CommunicateWithPICC()
 
-rc52x_result_t  THM3060_TransceiveData(thm3060_t *thm3060,uint8_t *sendData,
-		uint8_t sendLen,
-		uint8_t *backData,
-		uint8_t *backLen,
-		uint8_t *validBits,
-		uint8_t rxAlign,
-		uint8_t * collpos,
-		bool sendCRC ,
-		bool recvCRC
-		) {
-
+int THM3060_TransceiveData(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
+	thm3060_t *thm3060 = pdc;
+	thm3060->frame_count++;
 	return  THM3060_CommunicateWithPICC(thm3060, 0, 0,
 			sendData, sendLen, backData, backLen, validBits, rxAlign,  sendCRC, recvCRC);
 } // End RC52X_TransceiveData()
 
 
-void THM3060_Init(thm3060_t *thm3060) {
-	thm3060->TransceiveData= THM3060_TransceiveData;
+/**
+ * Sets how long to wait for the answer of the PICC. The wait for the end of
+ * the command is ended by the MCU, the TMR timer of the THM3060 is left at
+ * its setting.
+ *
+ * @param timeout_us	0 restores the default of THM3060_TIMEOUT_us
+ */
+int thm3060_set_timeout(void *pdc, uint32_t timeout_us) {
+	thm3060_t *thm3060 = pdc;
+	thm3060->timeout_us = timeout_us;
+	return STATUS_OK;
+}
+
+/**
+ * Sets up the hooks and the THM3060 for ISO 14443-A, and switches the field
+ * on.
+ *
+ * @return STATUS_INVALID without get_time_ms, the wait for the answer of the
+ * 		   PICC is timed by it
+ */
+int THM3060_Init(thm3060_t *thm3060) {
+	if (!thm3060 || !thm3060->get_time_ms)
+		return STATUS_INVALID;
+	thm3060->TransceiveData = THM3060_TransceiveData;
+	thm3060->SetTimeout = thm3060_set_timeout;
+	thm3060->timeout_us = 0;
 	// 12.6.1	Set the protocol by the PSEL register (TYPE-A)
 	thm3060_set_reg8(thm3060,THM3060_REG_PSEL, 0b00010000); // Type A, 106 kbps
 	// 12.6.2 	Set the CRCSEL register (generate CRC automatically)
@@ -243,4 +264,5 @@ void THM3060_Init(thm3060_t *thm3060) {
 
 	// 12.6.4	Open the RF carrier (SCON)
 	THM3060_AntennaOn(thm3060);
+	return STATUS_OK;
 }
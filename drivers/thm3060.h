@@ -60,3 +60,10 @@ typedef bs_pdc_t thm3060_t;
 #define THM3060_REG_SMOD	(0x10)
 #define THM3060_REG_PWTH	(0x11)
 
+
+// Default wait for the answer of the PICC
+#define THM3060_TIMEOUT_us	(25000)
+// Air time of a byte at 106 kbit/s, 9 bits of 9.44 µs, rounded up
+#define THM3060_BYTE_us		(86)
+
+int THM3060_Init(thm3060_t *thm3060);
@@ -7,78 +7,269 @@
 
 #include "ndef.h"
 
-int ndef_record_parse(void *data, size_t size) {
-	// Note: Proof of Concept implementation
-	// This lacks proper bounds checking
-
-	int offset = 0;
-	while (offset < size) {
-		ndef_record_header_t *header = (ndef_record_header_t*) (data + offset);
-		if (header->sr) {
-			// short record
-			offset++;
-			size_t type_length = *(uint8_t*) (data + offset);
-			offset++;
-			size_t payload_length = *(uint8_t*) (data + offset);
-			offset++;
-			size_t id_length = 0;
-			if (header->il) {
-				id_length = *(uint8_t*) (data + offset);
-				offset++;
-			}
-
-			{
-
-				uint8_t type[type_length];
-				//uint8_t type[64];
-				memcpy(type, data + offset, type_length);
-				offset += type_length;
-
-				uint8_t id[id_length];
-				//uint8_t id[64];
-				memcpy(id, data + offset, id_length);
-				offset += id_length;
-
-				uint8_t payload[payload_length];
-				//uint8_t payload[1024];
-				memcpy(payload, data + offset, payload_length);
-				offset += payload_length;
-
-			}
+void ndef_parser_init(ndef_parser_t *parser, const void *data, size_t size,
+		bool tlv) {
+	parser->data = data;
+	parser->size = size;
+	parser->available = size;
+	parser->offset = 0;
+	parser->needed = 0;
+	parser->message_end = tlv ? 0 : size;
+	parser->tlv = tlv;
+	parser->in_message = !tlv;
+	parser->chunked = false;
+	parser->done = false;
+	parser->record_count = 0;
+}
+
+/**
+ * Informs the parser that the first available bytes of the buffer are valid.
+ * Used when the data arrives in parts: initialise the parser with the total
+ * size, and feed it as the data comes in.
+ */
+void ndef_parser_feed(ndef_parser_t *parser, size_t available) {
+	parser->available = available < parser->size ? available : parser->size;
+}
+
+static ndef_status_t ndef_parser_need(ndef_parser_t *parser, size_t end) {
+	parser->needed = end;
+	return ndef_status_need_more;
+}
+
+// Parses a TLV header, until an NDEF TLV with a message has been found
+static ndef_status_t ndef_parser_tlv(ndef_parser_t *parser) {
+	const uint8_t *data = parser->data;
+	while (!parser->in_message) {
+		size_t offset = parser->offset;
+		if (offset >= parser->size) {
+			// Data area ended without a terminator
+			parser->done = true;
+			return ndef_status_end;
+		}
+		if (offset >= parser->available)
+			return ndef_parser_need(parser, offset + 1);
+
+		uint8_t t = data[offset++];
+		if (t == NFC_TLV_NULL) {
+			parser->offset = offset;
+			continue;
+		}
+		if (t == NFC_TLV_TERMINATOR) {
+			parser->offset = offset;
+			parser->done = true;
+			return ndef_status_end;
+		}
 
+		if (offset + 1 > parser->size)
+			return ndef_status_invalid;
+		if (offset + 1 > parser->available)
+			return ndef_parser_need(parser, offset + 1);
+		size_t length = data[offset++];
+		if (length == 0xFF) {
+			// Three byte length format
+			if (offset + 2 > parser->size)
+				return ndef_status_invalid;
+			if (offset + 2 > parser->available)
+				return ndef_parser_need(parser, offset + 2);
+			length = (data[offset] << 8) | data[offset + 1];
+			offset += 2;
+		}
+		if (length > parser->size - offset)
+			return ndef_status_invalid;
+
+		parser->offset = offset;
+		if (t == NFC_TLV_NDEF && length) {
+			parser->in_message = true;
+			parser->message_end = offset + length;
+			parser->record_count = 0;
+			parser->chunked = false;
 		} else {
-			// long record
-			offset++;
-			size_t type_length = (ndef_record_header_t*) (data + offset);
+			// Lock and Memory Control, Proprietary, empty NDEF: skip
+			parser->offset += length;
 		}
 	}
+	return ndef_status_record;
 }
 
-int ndef_message_parse(void *data, size_t size) {
+/**
+ * Returns the next record. The record points into the buffer.
+ *
+ * @return ndef_status_record when a record was returned,
+ * 		   ndef_status_end when there are no more records,
+ * 		   ndef_status_need_more when the record is not yet available, the
+ * 		   parser needs the first parser->needed bytes of the buffer,
+ * 		   ndef_status_invalid on malformed data.
+ */
+ndef_status_t ndef_parser_next(ndef_parser_t *parser, ndef_record_t *record) {
+	const uint8_t *data = parser->data;
+	ndef_status_t status;
 
-}
+	for (;;) {
+		if (parser->done)
+			return ndef_status_end;
+		if (!parser->in_message) {
+			status = ndef_parser_tlv(parser);
+			if (status != ndef_status_record)
+				return status;
+		}
+		if (parser->offset < parser->message_end)
+			break;
 
-int ndef_tlv_parse(void *data, size_t size) {
-	int offset = 0;
-	while (offset < size) {
-		int t = *(uint8_t*) (data + offset);
-		if (t == 0xFE) {
-			// End marker
-			return 0;
+		// End of the message
+		if (parser->chunked || !parser->record_count)
+			return ndef_status_invalid;
+		if (!parser->tlv) {
+			parser->done = true;
+			return ndef_status_end;
 		}
+		parser->in_message = false;
+	}
+
+	// Record header: flags, type length, payload length (1 or 4 bytes),
+	// id length (when IL is set)
+	size_t offset = parser->offset;
+	size_t end = parser->message_end;
+	if (offset + 3 > end)
+		return ndef_status_invalid;
+	if (offset + 1 > parser->available)
+		return ndef_parser_need(parser, offset + 3);
+	uint8_t flags = data[offset];
+	size_t header_size = 3 + ((flags & NDEF_FLAG_SR) ? 0 : 3)
+			+ ((flags & NDEF_FLAG_IL) ? 1 : 0);
+	if (header_size > end - offset)
+		return ndef_status_invalid;
+	if (offset + header_size > parser->available)
+		return ndef_parser_need(parser, offset + header_size);
+
+	size_t type_length = data[offset + 1];
+	size_t payload_length;
+	size_t pos = offset + 2;
+	if (flags & NDEF_FLAG_SR) {
+		payload_length = data[pos++];
+	} else {
+		payload_length = ((uint32_t) data[pos] << 24)
+				| ((uint32_t) data[pos + 1] << 16)
+				| ((uint32_t) data[pos + 2] << 8) | data[pos + 3];
+		pos += 4;
+	}
+	size_t id_length = (flags & NDEF_FLAG_IL) ? data[pos++] : 0;
 
-		offset++;
-		size_t s = *(uint8_t*) (data + offset);
-		offset++;
-		if (s == 0xFF) {
-			s = *(uint8_t*) (data + offset);
-			s <<= 8;
-			offset++;
-			s |= *(uint8_t*) (data + offset);
-			offset++;
+	// Bounds, without overflowing on a 32 bit payload length
+	size_t room = end - pos;
+	if (type_length > room)
+		return ndef_status_invalid;
+	room -= type_length;
+	if (id_length > room)
+		return ndef_status_invalid;
+	room -= id_length;
+	if (payload_length > room)
+		return ndef_status_invalid;
+	size_t record_end = pos + type_length + id_length + payload_length;
+
+	// Message structure
+	uint8_t tnf = flags & NDEF_TNF_MASK;
+	bool first = !parser->record_count;
+	if (first != !!(flags & NDEF_FLAG_MB))
+		return ndef_status_invalid;
+	switch (tnf) {
+	case ndef_tnf_empty:
+		if (type_length || id_length || payload_length)
+			return ndef_status_invalid;
+		break;
+	case ndef_tnf_unknown:
+		if (type_length)
+			return ndef_status_invalid;
+		break;
+	case ndef_tnf_unchanged:
+		// Only the middle and terminating chunks, without type and id
+		if (!parser->chunked || type_length || id_length)
+			return ndef_status_invalid;
+		break;
+	case ndef_tnf_reserved:
+		return ndef_status_invalid;
+	default:
+		break;
+	}
+	if (parser->chunked && tnf != ndef_tnf_unchanged)
+		return ndef_status_invalid;
+	if ((flags & NDEF_FLAG_CF) && (flags & NDEF_FLAG_ME))
+		return ndef_status_invalid;
+
+	if (record_end > parser->available)
+		return ndef_parser_need(parser, record_end);
+
+	record->tnf = tnf;
+	record->mb = flags & NDEF_FLAG_MB;
+	record->me = flags & NDEF_FLAG_ME;
+	record->cf = flags & NDEF_FLAG_CF;
+	record->type = data + pos;
+	record->type_length = type_length;
+	record->id = data + pos + type_length;
+	record->id_length = id_length;
+	record->payload = data + pos + type_length + id_length;
+	record->payload_length = payload_length;
+	record->offset = offset;
+
+	parser->offset = record_end;
+	parser->chunked = record->cf;
+	parser->record_count++;
+	parser->needed = 0;
+	if (record->me) {
+		// Anything after ME in the NDEF TLV is ignored
+		if (parser->tlv) {
+			parser->offset = parser->message_end;
+			parser->in_message = false;
+		} else {
+			parser->done = true;
 		}
-		ndef_record_parse(data + offset, s);
-		offset += s;
 	}
+	return ndef_status_record;
+}
+
+static int ndef_count_records(ndef_parser_t *parser, bool single) {
+	ndef_record_t record;
+	int count = 0;
+	for (;;) {
+		ndef_status_t status = ndef_parser_next(parser, &record);
+		if (status == ndef_status_end)
+			return count;
+		if (status != ndef_status_record)
+			return ndef_status_invalid;
+		count++;
+		if (single)
+			return parser->offset - record.offset;
+	}
+}
 
+/**
+ * Validates the first record of an NDEF message.
+ *
+ * @return The size of the record, or ndef_status_invalid
+ */
+int ndef_record_parse(void *data, size_t size) {
+	ndef_parser_t parser;
+	ndef_parser_init(&parser, data, size, false);
+	return ndef_count_records(&parser, true);
+}
+
+/**
+ * Validates an NDEF message.
+ *
+ * @return The number of records, or ndef_status_invalid
+ */
+int ndef_message_parse(void *data, size_t size) {
+	ndef_parser_t parser;
+	ndef_parser_init(&parser, data, size, false);
+	return ndef_count_records(&parser, false);
+}
+
+/**
+ * Validates the TLV blocks in the data area of a Type 1/2 tag.
+ *
+ * @return The number of records in all NDEF messages, or ndef_status_invalid
+ */
+int ndef_tlv_parse(void *data, size_t size) {
+	ndef_parser_t parser;
+	ndef_parser_init(&parser, data, size, true);
+	return ndef_count_records(&parser, false);
 }
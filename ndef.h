@@ -11,6 +11,8 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 // T1T http://apps4android.org/nfc-specifications/NFCForum-TS-Type-1-Tag_1.1.pdf
 // T2T https://apps4android.org/nfc-specifications/NFCForum-TS-Type-2-Tag_1.1.pdf
@@ -62,6 +64,22 @@ typedef struct {
 
 #define NFC_CC_MAGIC (0xE1)
 
+// TLV blocks in the data area of Type 1/2 tags
+#define NFC_TLV_NULL			(0x00)
+#define NFC_TLV_LOCK_CONTROL	(0x01)
+#define NFC_TLV_MEMORY_CONTROL	(0x02)
+#define NFC_TLV_NDEF			(0x03)
+#define NFC_TLV_PROPRIETARY		(0xFD)
+#define NFC_TLV_TERMINATOR		(0xFE)
+
+// Flags in the first byte of an NDEF record
+#define NDEF_FLAG_MB			(0x80)
+#define NDEF_FLAG_ME			(0x40)
+#define NDEF_FLAG_CF			(0x20)
+#define NDEF_FLAG_SR			(0x10)
+#define NDEF_FLAG_IL			(0x08)
+#define NDEF_TNF_MASK			(0x07)
+
 typedef struct {
 	unsigned int version_minor : 2;
 	unsigned int version_major : 2;
@@ -75,4 +93,65 @@ typedef struct {
 
 #pragma pack(pop)
 
+typedef enum {
+	ndef_tnf_empty			= 0x00,
+	ndef_tnf_well_known		= 0x01,
+	ndef_tnf_media			= 0x02,
+	ndef_tnf_uri			= 0x03,
+	ndef_tnf_external		= 0x04,
+	ndef_tnf_unknown		= 0x05,
+	ndef_tnf_unchanged		= 0x06,	// Continuation of a chunked record
+	ndef_tnf_reserved		= 0x07,
+} ndef_tnf_t;
+
+typedef enum {
+	ndef_status_record		= 1,	// A record has been returned
+	ndef_status_end			= 0,	// No more records
+	ndef_status_need_more	= -1,	// More data is needed, see ndef_parser_feed()
+	ndef_status_invalid		= -2,	// Malformed TLV or NDEF data
+} ndef_status_t;
+
+// An NDEF record. The type, id and payload point into the buffer passed to
+// the parser, nothing is copied. For a chunked payload, every chunk is
+// returned as a record, cf is set on all but the last chunk.
+typedef struct {
+	uint8_t tnf;
+	bool mb;
+	bool me;
+	bool cf;
+	const uint8_t *type;
+	size_t type_length;
+	const uint8_t *id;
+	size_t id_length;
+	const uint8_t *payload;
+	size_t payload_length;
+	size_t offset;			// Offset of the record header in the buffer
+} ndef_record_t;
+
+// Streaming NDEF parser. The data may arrive in parts, for example page by
+// page from a tag, as long as it is appended to the same buffer. Parsing
+// continues where it stopped when ndef_parser_feed() reports more data.
+typedef struct {
+	const uint8_t *data;
+	size_t size;			// Total size of the data area or message
+	size_t available;		// Bytes available in the buffer
+	size_t offset;			// Parse position
+	size_t needed;			// On need_more: bytes needed to continue
+	size_t message_end;		// End of the current NDEF message
+	bool tlv;				// Data area of a Type 1/2 tag with TLV blocks
+	bool in_message;
+	bool chunked;			// Previous record had CF set
+	bool done;
+	unsigned int record_count;	// Records in the current message
+} ndef_parser_t;
+
+void ndef_parser_init(ndef_parser_t *parser, const void *data, size_t size,
+		bool tlv);
+void ndef_parser_feed(ndef_parser_t *parser, size_t available);
+ndef_status_t ndef_parser_next(ndef_parser_t *parser, ndef_record_t *record);
+
+int ndef_record_parse(void *data, size_t size);
+int ndef_message_parse(void *data, size_t size);
+int ndef_tlv_parse(void *data, size_t size);
+
 #endif /* BSRFID_NDEF_H_ */
@@ -0,0 +1,23 @@
+/*
+ * bench.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_BENCH_H_
+#define BSRFID_TESTS_BENCH_H_
+
+// Host time for the benchmarks. Emulated time comes from pdc_sim or the
+// chip emulators instead.
+
+#include <stdio.h>
+#include <time.h>
+
+static inline double bench_seconds(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#endif /* BSRFID_TESTS_BENCH_H_ */
@@ -0,0 +1,48 @@
+/*
+ * bench_crc.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// CRC throughput of the configured ISO14443_CRC_SLICES against the bitwise
+// reference, for a short frame and a 4 KiB block.
+
+#include <stdlib.h>
+
+#include "bench.h"
+#include "iso14443_crc.h"
+
+#define STR(x)			#x
+#define XSTR(x)			STR(x)
+
+#define BENCH_BYTES		(64 << 20)
+
+typedef uint16_t (*crc_f)(uint16_t crc, const void *data, size_t size);
+
+static double throughput(crc_f crc, const uint8_t *data, size_t size) {
+	volatile uint16_t sink = 0;
+	size_t repeats = BENCH_BYTES / size;
+	double start = bench_seconds();
+
+	for (size_t i = 0; i < repeats; i++)
+		sink += crc(ISO14443_CRC_A_PRESET, data, size);
+	return repeats * size / (bench_seconds() - start) / 1e6;
+}
+
+int main(void) {
+	static uint8_t data[4096];
+	static const size_t sizes[] = { 16, sizeof(data) };
+
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		double bitwise = throughput(iso14443_crc_bitwise, data, sizes[i]);
+		double table = throughput(iso14443_crc_update, data, sizes[i]);
+		printf("crc slices " XSTR(ISO14443_CRC_SLICES)
+		" %4zu bytes: %6.0f MB/s, bitwise %4.0f MB/s (%.1fx)\n", sizes[i],
+				table, bitwise, table / bitwise);
+	}
+	return 0;
+}
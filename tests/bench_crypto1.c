@@ -0,0 +1,34 @@
+/*
+ * bench_crypto1.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Host speed of the software Crypto1: the cipher work of a reader side
+// authentication, key load and the 4 words of nT, nR, aR and aT.
+
+#include "bench.h"
+#include "crypto1.h"
+
+#define AUTHS		(1000000)
+
+int main(void) {
+	static const uint8_t key[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+	volatile uint32_t sink = 0;
+	crypto1_t crypto1;
+	double start, elapsed;
+
+	start = bench_seconds();
+	for (uint32_t i = 0; i < AUTHS; i++) {
+		crypto1_init(&crypto1, key);
+		sink += crypto1_word(&crypto1, 0x9c599b32 ^ i, false);
+		sink += crypto1_word(&crypto1, i, false);
+		sink += crypto1_word(&crypto1, 0, false);
+		sink += crypto1_word(&crypto1, 0, false);
+	}
+	elapsed = bench_seconds() - start;
+
+	printf("crypto1: %.0f k authentications/s host\n", AUTHS / elapsed / 1e3);
+	return 0;
+}
@@ -0,0 +1,129 @@
+/*
+ * bench_desfire.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Reading a 4096 byte DESFire file with one ReadData per 59 bytes, against
+// desfire_read_data() streaming the continuations, on pdc_sim and the rc52x
+// emulator at 106 and 848 kbps. Prints the emulated time.
+
+#include <string.h>
+
+#include "bench.h"
+#include "rc52x_emu.h"
+#include "desfire.h"
+
+#define FILE_SIZE		(4096)
+#define CHUNK_SIZE		(59)
+
+typedef uint64_t (*clock_ns_f)(void *context);
+
+typedef struct {
+	uint8_t *data;
+	size_t size;
+} buffer_t;
+
+static pdc_sim_card_t m_card;
+static uint8_t m_file[FILE_SIZE];
+
+static int collect(void *context, const uint8_t *data, size_t size) {
+	buffer_t *buffer = context;
+	memcpy(buffer->data + buffer->size, data, size);
+	buffer->size += size;
+	return STATUS_OK;
+}
+
+static uint64_t sim_clock_ns(void *context) {
+	return ((pdc_sim_t*) context)->air_time_ns;
+}
+
+static uint64_t emu_clock_ns(void *context) {
+	return rc52x_emu_time_ns();
+}
+
+static int activate(bs_pdc_t *pdc, picc_t *picc, pdc_bitrate_t bitrate) {
+	memset(picc, 0, sizeof(*picc));
+	if (picc_reqa(pdc, picc) || PICC_Select(pdc, picc, 0)
+			|| iso14443_4_rats(pdc, picc))
+		return STATUS_ERROR;
+	return iso14443_4_pps(pdc, picc, bitrate);
+}
+
+static int run(bs_pdc_t *pdc, const char *name, pdc_bitrate_t bitrate,
+		clock_ns_f clock_ns, void *context) {
+	static uint8_t data[FILE_SIZE];
+	buffer_t buffer = { data, 0 };
+	size_t size = sizeof(data);
+	unsigned int commands;
+	desfire_t desfire;
+	uint64_t start, chunked_ns, streamed_ns;
+	picc_t picc;
+
+	if (activate(pdc, &picc, bitrate))
+		return 1;
+	desfire_init(&desfire, pdc, &picc);
+	if (desfire_select_application(&desfire, 1))
+		return 1;
+
+	start = clock_ns(context);
+	for (commands = 0; buffer.size < FILE_SIZE; commands++) {
+		uint32_t offset = buffer.size;
+		uint32_t length = FILE_SIZE - offset < CHUNK_SIZE ?
+				FILE_SIZE - offset : CHUNK_SIZE;
+		uint8_t params[] = { 0, offset, offset >> 8, offset >> 16, length, 0,
+				0 };
+		if (desfire_command(&desfire, desfire_cmd_read_data, params,
+				sizeof(params), collect, &buffer))
+			return 1;
+	}
+	chunked_ns = clock_ns(context) - start;
+	if (memcmp(data, m_file, sizeof(data)))
+		return 1;
+
+	memset(data, 0, sizeof(data));
+	desfire.stats.frames = 0;
+	start = clock_ns(context);
+	if (desfire_read_data(&desfire, 0, 0, 0, data, &size))
+		return 1;
+	streamed_ns = clock_ns(context) - start;
+	if (memcmp(data, m_file, sizeof(data)))
+		return 1;
+
+	printf("%-9s %s kbps: chunked %u cmds %6.1f ms, "
+			"desfire_read_data 1 cmd %u frames %6.1f ms\n", name,
+			bitrate == pdc_bitrate_106 ? "106" : "848", commands,
+			chunked_ns / 1e6, desfire.stats.frames, streamed_ns / 1e6);
+	return 0;
+}
+
+int main(void) {
+	static pdc_sim_t sim;
+	static rc52x_emu_t emu;
+	static rc52x_t rc52x;
+	static const pdc_bitrate_t bitrates[] = { pdc_bitrate_106,
+			pdc_bitrate_848 };
+
+	for (size_t i = 0; i < sizeof(m_file); i++)
+		m_file[i] = i * 7 + 3;
+	pdc_sim_card_init(&m_card, pdc_sim_card_desfire, NULL, 0);
+	pdc_sim_desfire_add_application(&m_card, 1);
+	pdc_sim_desfire_add_file(&m_card, 1, 0, m_file, sizeof(m_file));
+
+	pdc_sim_init(&sim, &m_card, 1);
+	for (size_t i = 0; i < sizeof(bitrates) / sizeof(bitrates[0]); i++) {
+		pdc_sim_field_reset(&sim);
+		if (run(&sim.pdc, "pdc_sim", bitrates[i], sim_clock_ns, &sim))
+			return 1;
+	}
+
+	for (size_t i = 0; i < sizeof(bitrates) / sizeof(bitrates[0]); i++) {
+		rc52x_emu_init(&emu, 0x92, &m_card, 1);
+		rc52x_emu_attach(&emu, &rc52x);
+		rc52x_init(&rc52x);
+		if (run(&rc52x, "rc52x_emu", bitrates[i], emu_clock_ns, NULL))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,54 @@
+/*
+ * bench_fast_read.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Dump of an NTAG216 on the rc52x emulator with READ and with FAST_READ in
+// chunks sized to the FIFO: frames used and emulated throughput.
+
+#include <string.h>
+
+#include "bench.h"
+#include "rc52x_emu.h"
+
+#define PAGES		(231)
+
+static int dump(rc52x_t *rc52x, picc_t *picc, const char *name,
+		uint8_t *data) {
+	unsigned int frames = rc52x->frame_count;
+	uint64_t start = rc52x_emu_time_ns();
+	uint64_t elapsed;
+
+	if (picc_fast_read(rc52x, picc, 0, PAGES - 1, data))
+		return 1;
+	elapsed = rc52x_emu_time_ns() - start;
+	printf("rc52x_emu %-9s %3u frames, %.1f kB/s emulated\n", name,
+			rc52x->frame_count - frames, PAGES * 4 * 1e6 / elapsed);
+	return 0;
+}
+
+int main(void) {
+	static pdc_sim_card_t card;
+	static rc52x_emu_t emu;
+	static rc52x_t rc52x;
+	static uint8_t read[PAGES * 4], fast_read[PAGES * 4];
+	picc_t picc = { 0 };
+
+	pdc_sim_card_init(&card, pdc_sim_card_ntag216, NULL, 0);
+	rc52x_emu_init(&emu, 0x92, &card, 1);
+	rc52x_emu_attach(&emu, &rc52x);
+	rc52x_init(&rc52x);
+	if (picc_reqa(&rc52x, &picc) || PICC_Select(&rc52x, &picc, 0))
+		return 1;
+
+	// Without the version, picc_fast_read() falls back to READ
+	if (dump(&rc52x, &picc, "READ", read))
+		return 1;
+	if (MIFARE_GET_VERSION(&rc52x, &picc))
+		return 1;
+	if (dump(&rc52x, &picc, "FAST_READ", fast_read))
+		return 1;
+	return memcmp(read, fast_read, sizeof(read)) != 0;
+}
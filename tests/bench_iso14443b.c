@@ -0,0 +1,156 @@
+/*
+ * bench_iso14443b.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// ISO 14443-B inventory of 1 to 20 PICCs with 1, 4 and 16 slots, and the
+// inventory followed by ATTRIB and a DESFire read of a 256 byte file from
+// every PICC. Then mixed polling of one type A and one type B PICC, WUPA
+// and HLTA against REQB: the protocol switched by SetProtocol with the
+// field on, against a field reset with a 5 ms guard time per switch. On
+// pdc_sim and on the pn5180 driver with the PN5180 host model, with
+// wait_irq. All time is emulated.
+
+#include <string.h>
+
+#include "bench.h"
+#include "pn5180_model.h"
+#include "iso14443b.h"
+#include "desfire.h"
+
+#define MAX_CARDS		(20)
+#define FILE_SIZE		(256)
+#define CYCLES			(100)
+#define GUARD_ms		(5)
+
+typedef uint64_t (*clock_ns_f)(void);
+
+static pdc_sim_card_t m_cards[MAX_CARDS];
+static uint8_t m_file[FILE_SIZE];
+static pdc_sim_t m_sim;
+static pn5180_model_t m_model;
+static pn5180_t m_pn5180;
+
+static uint64_t sim_clock_ns(void) {
+	return m_sim.air_time_ns;
+}
+
+// Sets up the PICCs on the simulated PCD or on the PN5180 model
+static bs_pdc_t* setup(size_t card_count, bool pn5180, clock_ns_f *clock_ns) {
+	if (pn5180) {
+		pn5180_model_init(&m_model, m_cards, card_count, &m_pn5180);
+		m_pn5180.wait_irq = pn5180_model_wait_irq;
+		*clock_ns = pn5180_model_time_ns;
+		return PN5180_Init(&m_pn5180) ? NULL : &m_pn5180;
+	}
+	pdc_sim_init(&m_sim, m_cards, card_count);
+	*clock_ns = sim_clock_ns;
+	return &m_sim.pdc;
+}
+
+static int read_file(bs_pdc_t *pdc, picc_t *picc) {
+	desfire_t desfire;
+	uint8_t data[FILE_SIZE];
+	size_t size = sizeof(data);
+
+	if (iso14443b_activate(pdc, picc) || desfire_init(&desfire, pdc, picc)
+			|| desfire_select_application(&desfire, 1)
+			|| desfire_read_data(&desfire, 0, 0, FILE_SIZE, data, &size)
+			|| size != FILE_SIZE || memcmp(data, m_file, FILE_SIZE))
+		return 1;
+	return iso14443_4_deselect(pdc, picc);
+}
+
+static int run_inventory(bool pn5180, size_t n, int slots) {
+	static picc_t piccs[MAX_CARDS];
+	iso14443b_stats_t stats;
+	size_t count = MAX_CARDS;
+	uint64_t start, inventory_ns, read_ns;
+	clock_ns_f clock_ns;
+	bs_pdc_t *pdc;
+
+	for (size_t i = 0; i < n; i++) {
+		pdc_sim_card_init(m_cards + i, pdc_sim_card_iso14443b, NULL, 0);
+		pdc_sim_desfire_add_application(m_cards + i, 1);
+		pdc_sim_desfire_add_file(m_cards + i, 1, 0, m_file, FILE_SIZE);
+	}
+	pdc = setup(n, pn5180, &clock_ns);
+	if (!pdc)
+		return 1;
+
+	start = clock_ns();
+	if (iso14443b_inventory(pdc, ISO14443B_AFI_ALL, slots, piccs, &count,
+			&stats) || count != n)
+		return 1;
+	inventory_ns = clock_ns() - start;
+	for (size_t i = 0; i < count; i++)
+		if (read_file(pdc, piccs + i))
+			return 1;
+	read_ns = clock_ns() - start;
+	printf("  %2zu cards %2d slots: inventory %6.1f ms %4.0f cards/s, "
+			"%2u collisions, with read %7.1f ms %3.0f cards/s\n", n, slots,
+			inventory_ns / 1e6, count * 1e9 / inventory_ns, stats.collisions,
+			read_ns / 1e6, count * 1e9 / read_ns);
+	return 0;
+}
+
+static void guard(bs_pdc_t *pdc) {
+	pdc->SetField(pdc, false);
+	pdc->delay_ms(GUARD_ms);
+	pdc->SetField(pdc, true);
+}
+
+static int run_mixed(bool pn5180, bool reset) {
+	clock_ns_f clock_ns;
+	bs_pdc_t *pdc;
+	uint64_t start;
+
+	pdc_sim_card_init(m_cards + 0, pdc_sim_card_ntag213, NULL, 0);
+	pdc_sim_card_init(m_cards + 1, pdc_sim_card_iso14443b, NULL, 0);
+	pdc = setup(2, pn5180, &clock_ns);
+	if (!pdc)
+		return 1;
+
+	start = clock_ns();
+	for (int i = 0; i < CYCLES; i++) {
+		uint8_t atqa[2];
+		size_t size = sizeof(atqa);
+		picc_t b;
+
+		if (reset)
+			guard(pdc);
+		// A PICC in READY does not answer a second REQA. WUPA, and HLTA
+		// returns it from READY* to HALT for the next cycle.
+		if (pdc_set_protocol(pdc, pdc_protocol_iso14443a)
+				|| PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, atqa, &size))
+			return 1;
+		PICC_HaltA(pdc);
+		if (reset)
+			guard(pdc);
+		if (iso14443b_request(pdc, &b, false, ISO14443B_AFI_ALL, 1, NULL))
+			return 1;
+	}
+	printf("  mixed A+B poll, %-22s %5.2f ms per cycle\n",
+			reset ? "field reset per switch:" : "SetProtocol, field on:",
+			(clock_ns() - start) / 1e6 / CYCLES);
+	return 0;
+}
+
+int main(void) {
+	static const size_t counts[] = { 1, 10, 20 };
+
+	for (int i = 0; i < FILE_SIZE; i++)
+		m_file[i] = i;
+	for (int pn5180 = 0; pn5180 <= 1; pn5180++) {
+		printf(pn5180 ? "PN5180 model, wait_irq\n" : "pdc_sim\n");
+		for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++)
+			for (int slots = 1; slots <= 16; slots *= 4)
+				if (run_inventory(pn5180, counts[k], slots))
+					return 1;
+		if (run_mixed(pn5180, false) || run_mixed(pn5180, true))
+			return 1;
+	}
+	return 0;
+}
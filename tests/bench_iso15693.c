@@ -0,0 +1,85 @@
+/*
+ * bench_iso15693.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// ISO 15693 inventory of 1 to 60 ICode SLIX labels with 1 and 16 slots,
+// and the inventory followed by a full read of every label. On pdc_sim,
+// and on the pn5180 driver with the PN5180 host model, with wait_irq.
+// Prints labels per second in emulated time.
+
+#include <string.h>
+
+#include "bench.h"
+#include "pn5180_model.h"
+#include "iso15693.h"
+
+#define MAX_CARDS		(60)
+
+typedef uint64_t (*clock_ns_f)(void);
+
+static pdc_sim_card_t m_cards[MAX_CARDS];
+static pdc_sim_t m_sim;
+static pn5180_model_t m_model;
+static pn5180_t m_pn5180;
+
+static uint64_t sim_clock_ns(void) {
+	return m_sim.air_time_ns;
+}
+
+static int run(bs_pdc_t *pdc, clock_ns_f clock_ns, size_t n, int slots) {
+	static iso15693_vicc_t viccs[MAX_CARDS];
+	iso15693_inventory_stats_t stats;
+	size_t count = MAX_CARDS;
+	uint64_t start, inventory_ns, read_ns;
+
+	start = clock_ns();
+	if (iso15693_inventory(pdc, slots, viccs, &count, &stats) || count != n)
+		return 1;
+	inventory_ns = clock_ns() - start;
+	for (size_t i = 0; i < count; i++) {
+		uint8_t data[256];
+		size_t size = sizeof(data);
+		if (iso15693_read(pdc, viccs + i, data, &size))
+			return 1;
+	}
+	read_ns = clock_ns() - start;
+	printf("  %2zu labels %2d slots: inventory %7.1f ms %4.0f labels/s, "
+			"with read %7.1f ms %3.0f labels/s\n", n, slots,
+			inventory_ns / 1e6, count * 1e9 / inventory_ns, read_ns / 1e6,
+			count * 1e9 / read_ns);
+	return 0;
+}
+
+int main(void) {
+	static const size_t counts[] = { 1, 10, 30, 60 };
+
+	for (int pn5180 = 0; pn5180 <= 1; pn5180++) {
+		printf(pn5180 ? "PN5180 model, wait_irq\n" : "pdc_sim\n");
+		for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+			for (int slots = 1; slots <= 16; slots += 15) {
+				size_t n = counts[k];
+				int result;
+
+				for (size_t i = 0; i < n; i++)
+					pdc_sim_card_init(m_cards + i, pdc_sim_card_icode_slix,
+							NULL, 0);
+				if (pn5180) {
+					pn5180_model_init(&m_model, m_cards, n, &m_pn5180);
+					m_pn5180.wait_irq = pn5180_model_wait_irq;
+					if (PN5180_Init(&m_pn5180))
+						return 1;
+					result = run(&m_pn5180, pn5180_model_time_ns, n, slots);
+				} else {
+					pdc_sim_init(&m_sim, m_cards, n);
+					result = run(&m_sim.pdc, sim_clock_ns, n, slots);
+				}
+				if (result)
+					return 1;
+			}
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * bench_lpcd.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Low-power card detection on pdc_sim, with its simulated I/Q channels,
+// and on the rc52x emulator, with the WUPA pulse fallback. Per period: the
+// duty cycle over 60 s in an empty field, and the latency from a PICC
+// arriving at a random time to it being selected. Then the auto-tuning
+// when the noise rises after the calibration, and continuous REQA for
+// comparison. All time is emulated.
+
+#include <string.h>
+
+#include "bench.h"
+#include "rc52x_emu.h"
+#include "pdc_lpcd.h"
+
+#define TAPS			(20)
+
+static pdc_sim_card_t m_card;
+static delay_ms_f m_delay_ms;
+static get_time_ms_f m_get_time_ms;
+static uint32_t m_arrive_ms;
+
+// The PICC enters the field once the emulated time reaches m_arrive_ms
+static int delay_ms(int ms) {
+	m_delay_ms(ms);
+	if ((uint32_t) m_get_time_ms() >= m_arrive_ms)
+		m_card.present = true;
+	return 0;
+}
+
+static void use_clock(bs_pdc_t *pdc, delay_ms_f base_delay_ms,
+		get_time_ms_f get_time_ms) {
+	m_delay_ms = base_delay_ms;
+	m_get_time_ms = get_time_ms;
+	pdc->delay_ms = delay_ms;
+}
+
+static int run(const char *name, bs_pdc_t *pdc, uint32_t period_ms) {
+	pdc_lpcd_t lpcd;
+	picc_t picc;
+	uint32_t total_ms = 0, max_ms = 0;
+	unsigned int seed = 7;
+
+	pdc_lpcd_init(&lpcd, pdc, period_ms, NULL, NULL);
+	m_card.present = false;
+	m_arrive_ms = UINT32_MAX;
+	if (pdc_lpcd_calibrate(&lpcd))
+		return 1;
+	lpcd.stats.rf_on_us = 0;
+	if (pdc_lpcd_wait(&lpcd, &picc, 60000) != STATUS_TIMEOUT)
+		return 1;
+	unsigned int duty_ppm = pdc_lpcd_duty_cycle_ppm(&lpcd);
+	double on_ms = lpcd.stats.rf_on_us / 1e3 / lpcd.stats.cycles;
+
+	for (int i = 0; i < TAPS; i++) {
+		m_card.present = false;
+		if (pdc->SetField)
+			pdc->SetField(pdc, false);
+		seed = seed * 1103515245 + 12345;
+		m_arrive_ms = m_get_time_ms() + 200 + (seed >> 16) % 3000;
+		if (pdc_lpcd_wait(&lpcd, &picc, 10000))
+			return 1;
+		uint32_t latency_ms = m_get_time_ms() - m_arrive_ms;
+		total_ms += latency_ms;
+		if (latency_ms > max_ms)
+			max_ms = latency_ms;
+	}
+	printf("%-11s period %3u ms: duty %.3f %% (%.2f ms on per cycle), "
+			"latency avg %3u max %3u ms, false wakes %u\n", name, period_ms,
+			duty_ppm / 1e4, on_ms, total_ms / TAPS, max_ms,
+			lpcd.stats.false_wakes);
+	return 0;
+}
+
+static int run_noise(pdc_sim_t *sim) {
+	pdc_lpcd_t lpcd;
+	picc_t picc;
+
+	pdc_lpcd_init(&lpcd, &sim->pdc, 100, NULL, NULL);
+	m_card.present = false;
+	m_arrive_ms = UINT32_MAX;
+	sim->lpcd_noise = 1;
+	if (pdc_lpcd_calibrate(&lpcd))
+		return 1;
+	uint8_t threshold = lpcd.threshold;
+	sim->lpcd_noise = 3;
+	if (pdc_lpcd_wait(&lpcd, &picc, 600000) != STATUS_TIMEOUT)
+		return 1;
+	printf("pdc_sim     noise 1 -> 3, 10 min empty: threshold %u -> %u, "
+			"%u false wakes\n", threshold, lpcd.threshold,
+			lpcd.stats.false_wakes);
+	m_arrive_ms = m_get_time_ms() + 1000;
+	if (pdc_lpcd_wait(&lpcd, &picc, 10000))
+		return 1;
+	printf("pdc_sim     then a PICC, selected after %u ms\n",
+			lpcd.stats.latency_ms);
+	sim->lpcd_noise = 1;
+	return 0;
+}
+
+static int run_reqa(rc52x_t *rc52x) {
+	uint32_t start = m_get_time_ms();
+	unsigned int polls = 0;
+	picc_t picc;
+
+	m_card.present = false;
+	m_arrive_ms = start + 1500;
+	rc52x_set_field(rc52x, true);
+	do {
+		memset(&picc, 0, sizeof(picc));
+		polls++;
+		if ((uint32_t) m_get_time_ms() >= m_arrive_ms)
+			m_card.present = true;
+	} while (picc_reqa(rc52x, &picc));
+	printf("rc52x REQA  continuous: duty 100 %%, latency %u ms, "
+			"%u REQA/s\n", m_get_time_ms() - m_arrive_ms,
+			polls * 1000 / (m_get_time_ms() - start));
+	return 0;
+}
+
+int main(void) {
+	static pdc_sim_t sim;
+	static rc52x_emu_t emu;
+	static rc52x_t rc52x;
+
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag213, NULL, 0);
+	pdc_sim_init(&sim, &m_card, 1);
+	use_clock(&sim.pdc, pdc_sim_delay_ms, pdc_sim_get_time_ms);
+	for (uint32_t period_ms = 50; period_ms <= 800; period_ms *= 2)
+		if (run("pdc_sim I/Q", &sim.pdc, period_ms))
+			return 1;
+	if (run_noise(&sim))
+		return 1;
+
+	rc52x_emu_init(&emu, 0x92, &m_card, 1);
+	rc52x_emu_attach(&emu, &rc52x);
+	use_clock(&rc52x, rc52x_emu_delay_ms, rc52x_emu_get_time_ms);
+	rc52x_init(&rc52x);
+	for (uint32_t period_ms = 50; period_ms <= 800; period_ms *= 2)
+		if (run("rc52x pulse", &rc52x, period_ms))
+			return 1;
+	return run_reqa(&rc52x);
+}
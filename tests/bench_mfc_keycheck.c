@@ -0,0 +1,89 @@
+/*
+ * bench_mfc_keycheck.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Keys per second of the offline key check over a dictionary of random
+// keys, bit-sliced for a nested and a sniffed trace, and scalar. Then the
+// nested trace with 1 to MAX_THREADS worker threads, built with
+// MFC_KEYCHECK_PTHREAD.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "pdc_sim.h"
+#include "mfc_keycheck.h"
+
+#define KEYS			(4000000)
+#define SCALAR_KEYS		(1000000)
+#define MAX_THREADS		(8)
+
+static uint8_t m_keys[KEYS][MFC_KEY_SIZE];
+
+// Nested authentication to sector 5 of a simulated card
+static int capture(mfc_trace_t *trace) {
+	static const uint8_t key[MFC_KEY_SIZE] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+			0xFF };
+	static pdc_sim_card_t card;
+	static pdc_sim_t sim;
+	picc_t picc = { 0 };
+	mfc_t mfc;
+
+	pdc_sim_card_init(&card, pdc_sim_card_mfc_1k, NULL, 0);
+	pdc_sim_init(&sim, &card, 1);
+	if (picc_reqa(&sim.pdc, &picc) || PICC_Select(&sim.pdc, &picc, 0)
+			|| mfc_init(&mfc, &sim.pdc, &picc, true)
+			|| mfc_auth(&mfc, mfc_key_a, 0, key))
+		return 1;
+	return mfc_capture_nested(&mfc, mfc_key_a, 20, trace);
+}
+
+static double keycheck(const mfc_trace_t *trace, unsigned int threads) {
+	mfc_keycheck_stats_t stats;
+	size_t index;
+	double start = bench_seconds();
+
+	mfc_keycheck(trace, 1, m_keys, KEYS, threads, &index, &stats);
+	return stats.keys_tested / (bench_seconds() - start) / 1e6;
+}
+
+int main(void) {
+	mfc_trace_t nested = { 0 }, auth = { 0 };
+	volatile size_t sink = 0;
+	double start;
+
+	srand(1);
+	for (size_t i = 0; i < KEYS; i++)
+		for (int j = 0; j < MFC_KEY_SIZE; j++)
+			m_keys[i][j] = rand();
+
+	if (capture(&nested))
+		return 1;
+	// Published mfkey64 example
+	auth.type = mfc_trace_auth;
+	auth.uid = 0x9c599b32;
+	auth.nt = 0x82a4166c;
+	auth.nr = 0xa1e458ce;
+	auth.ar = 0x6eea41e0;
+	auth.at = 0x5cadf439;
+	auth.has_at = true;
+
+	printf("mfc_keycheck %u lanes, nested trace: %.1f Mkeys/s\n",
+			mfc_keycheck_lanes(), keycheck(&nested, 1));
+	printf("mfc_keycheck %u lanes, sniffed trace: %.1f Mkeys/s\n",
+			mfc_keycheck_lanes(), keycheck(&auth, 1));
+
+	start = bench_seconds();
+	for (size_t i = 0; i < SCALAR_KEYS; i++)
+		sink += mfc_trace_check(&nested, m_keys[i]);
+	printf("mfc_trace_check scalar, nested trace: %.1f Mkeys/s\n",
+			SCALAR_KEYS / (bench_seconds() - start) / 1e6);
+
+	for (unsigned int threads = 1; threads <= MAX_THREADS; threads *= 2)
+		printf("mfc_keycheck %u thread(s), nested trace: %.1f Mkeys/s\n",
+				threads, keycheck(&nested, threads));
+	return 0;
+}
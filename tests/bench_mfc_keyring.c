@@ -0,0 +1,148 @@
+/*
+ * bench_mfc_keyring.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Key trials for a MIFARE Classic card population on pdc_sim: 64 cards in
+// 8 families, 1K and 4K, a dictionary of 48 keys and 512 presentations,
+// every card once and then at random. The keys are tried in list order,
+// then with the keyring. Prints the trials per sector and the emulated
+// air time, the first pass over the unseen cards separately.
+
+#include <string.h>
+
+#include "bench.h"
+#include "pdc_sim.h"
+#include "mfc_keyring.h"
+
+#define CARDS			(64)
+#define FAMILIES		(8)
+#define KEYS			(48)
+#define PRESENTATIONS	(512)
+
+static pdc_sim_card_t m_cards[CARDS];
+static pdc_sim_t m_sim;
+static uint8_t m_keys[KEYS][MFC_KEY_SIZE];
+static int m_order[PRESENTATIONS];
+static uint8_t m_data[4096];
+
+static uint32_t random32(void) {
+	static uint32_t x = 12345;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return x;
+}
+
+// A family shares the UID prefix, the key of sector 0 and the key of the
+// data sectors. Some families leave the last sectors at the default key.
+static void init_cards(void) {
+	for (int i = 0; i < KEYS; i++)
+		for (int j = 0; j < MFC_KEY_SIZE; j++)
+			m_keys[i][j] = random32();
+	memset(m_keys[0], 0xFF, MFC_KEY_SIZE);
+
+	for (int i = 0; i < CARDS; i++) {
+		int family = i % FAMILIES;
+		uint8_t uid[4] = { 0x10 + family, random32(), random32(), random32() };
+		bool large = family < 2;
+		int sectors = large ? 40 : 16;
+		int first_key = 1 + (7 * family) % (KEYS - 1);
+		int data_key = 1 + (13 * family + 20) % (KEYS - 1);
+
+		pdc_sim_card_init(m_cards + i,
+				large ? pdc_sim_card_mfc_4k : pdc_sim_card_mfc_1k, uid, 4);
+		for (int sector = 0; sector < sectors; sector++) {
+			int key = data_key;
+			if (sector == 0)
+				key = first_key;
+			else if (sector >= sectors - 2 * (family % 3))
+				key = 0;
+			pdc_sim_mfc_set_keys(m_cards + i, sector, m_keys[key], NULL);
+		}
+	}
+	pdc_sim_init(&m_sim, m_cards, CARDS);
+
+	for (int i = 0; i < PRESENTATIONS; i++)
+		m_order[i] = i < CARDS ? i : (int) (random32() % CARDS);
+}
+
+static int present(int card, picc_t *picc) {
+	for (int i = 0; i < CARDS; i++)
+		m_cards[i].present = i == card;
+	pdc_sim_field_reset(&m_sim);
+	memset(picc, 0, sizeof(*picc));
+	if (picc_reqa(&m_sim.pdc, picc))
+		return STATUS_ERROR;
+	return PICC_Select(&m_sim.pdc, picc, 0);
+}
+
+// Every key of the dictionary in order, until one opens the sector
+static unsigned int dump_list_order(mfc_t *mfc, uint64_t *sectors_read) {
+	unsigned int trials = 0;
+	int sectors = mfc_sector_count(mfc->picc);
+
+	*sectors_read = 0;
+	for (int sector = 0; sector < sectors; sector++) {
+		uint8_t block = mfc_sector_block(sector);
+		for (int key = 0; key < KEYS; key++) {
+			trials++;
+			if (!mfc_auth(mfc, mfc_key_a, block, m_keys[key])) {
+				for (int i = 0; i < mfc_sector_size(sector); i++)
+					mfc_read(mfc, block + i, m_data);
+				*sectors_read |= UINT64_C(1) << sector;
+				break;
+			}
+			mfc_reselect(mfc);
+		}
+	}
+	return trials;
+}
+
+static int run(bool keyring) {
+	static mfc_keyring_t ring;
+	uint64_t start = m_sim.air_time_ns, first_pass = 0;
+	unsigned int trials = 0, sectors = 0;
+
+	mfc_keyring_init(&ring);
+	for (int i = 0; i < KEYS; i++)
+		mfc_keyring_add(&ring, m_keys[i]);
+
+	for (int i = 0; i < PRESENTATIONS; i++) {
+		uint64_t sectors_read;
+		picc_t picc;
+		mfc_t mfc;
+
+		if (i == CARDS)
+			first_pass = m_sim.air_time_ns - start;
+		if (present(m_order[i], &picc))
+			return 1;
+		mfc_init(&mfc, &m_sim.pdc, &picc, true);
+		if (keyring) {
+			if (mfc_keyring_dump(&ring, &mfc, mfc_key_a, m_data,
+					sizeof(m_data), &sectors_read))
+				return 1;
+		} else {
+			trials += dump_list_order(&mfc, &sectors_read);
+		}
+		sectors += __builtin_popcountll(sectors_read);
+		mfc_stop(&mfc);
+	}
+	if (keyring)
+		trials = ring.stats.trials;
+
+	printf("%-10s %6u trials, %5.2f per sector, %6.1f s air time, "
+			"first pass %5.1f s\n", keyring ? "keyring" : "list order",
+			trials, (double) trials / sectors,
+			(m_sim.air_time_ns - start) / 1e9, first_pass / 1e9);
+	return 0;
+}
+
+int main(void) {
+	init_cards();
+	if (run(false) || run(true))
+		return 1;
+	return 0;
+}
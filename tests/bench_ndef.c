@@ -0,0 +1,70 @@
+/*
+ * bench_ndef.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// NDEF parser throughput: a 1 MiB message of short URI records with 20 to
+// 69 byte payloads, every third record with an id.
+
+#include <string.h>
+
+#include "bench.h"
+#include "ndef.h"
+
+#define MESSAGE_SIZE	(1 << 20)
+#define PASSES			(200)
+
+static uint8_t m_message[MESSAGE_SIZE];
+
+static size_t add_record(uint8_t *record, bool first, size_t payload_length,
+		bool id) {
+	size_t offset = 0;
+	record[offset++] = (first ? NDEF_FLAG_MB : 0) | NDEF_FLAG_SR
+			| (id ? NDEF_FLAG_IL : 0) | ndef_tnf_well_known;
+	record[offset++] = 1;
+	record[offset++] = payload_length;
+	if (id)
+		record[offset++] = 2;
+	record[offset++] = 'U';
+	if (id) {
+		record[offset++] = 'i';
+		record[offset++] = 'd';
+	}
+	for (size_t i = 0; i < payload_length; i++)
+		record[offset++] = i;
+	return offset;
+}
+
+int main(void) {
+	size_t size = 0, last = 0;
+	unsigned int count = 0;
+	ndef_parser_t parser;
+	ndef_record_t record;
+	unsigned long records = 0;
+	double start, elapsed;
+
+	while (size < MESSAGE_SIZE - 80) {
+		last = size;
+		size += add_record(m_message + size, !count, 20 + count % 50,
+				count % 3 == 0);
+		count++;
+	}
+	m_message[last] |= NDEF_FLAG_ME;
+
+	if (ndef_message_parse(m_message, size) != (int) count)
+		return 1;
+
+	start = bench_seconds();
+	for (int i = 0; i < PASSES; i++) {
+		ndef_parser_init(&parser, m_message, size, false);
+		while (ndef_parser_next(&parser, &record) == ndef_status_record)
+			records++;
+	}
+	elapsed = bench_seconds() - start;
+
+	printf("ndef_parser_next: %.1f M records/s, %.0f MB/s\n",
+			records / elapsed / 1e6, (double) size * PASSES / elapsed / 1e6);
+	return 0;
+}
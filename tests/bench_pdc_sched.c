@@ -0,0 +1,127 @@
+/*
+ * bench_pdc_sched.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Poll scheduler on pdc_sim. First one bus, stepped from this thread, with
+// 1 to 4 readers and 0 to 3 PICCs per reader: poll rate and the 50th, 90th
+// and 99th percentile of the poll latency in emulated air time. The
+// readers share the bus, so the time of a poll includes the frames of the
+// other readers. Then the worker threads, one per bus, for 1 to 4 buses of
+// two readers: polls per second of host time, as pdc_sim does not wait.
+
+#include <string.h>
+
+#include "bench.h"
+#include "pdc_sim.h"
+#include "pdc_sched.h"
+
+#define MAX_BUSES			(4)
+#define READERS_PER_BUS		(4)
+#define MAX_READERS			(MAX_BUSES * READERS_PER_BUS)
+#define MAX_CARDS			(3)
+#define POLLS				(1000)
+#define RUN_ms				(200)
+
+static pdc_sim_card_t m_cards[MAX_READERS][MAX_CARDS];
+static pdc_sim_t m_sims[MAX_READERS];
+static pdc_sched_reader_t m_readers[MAX_READERS];
+static pdc_sched_bus_t m_buses[MAX_BUSES];
+static pdc_sched_t m_sched;
+static int m_reader_count;
+static unsigned int m_arrived[MAX_READERS];
+
+static int air_time_ms(void) {
+	uint64_t air_time_ns = 0;
+	for (int i = 0; i < m_reader_count; i++)
+		air_time_ns += m_sims[i].air_time_ns;
+	return air_time_ns / 1000000;
+}
+
+static int host_time_ms(void) {
+	return bench_seconds() * 1000;
+}
+
+static void event(void *context, int reader_id, pdc_sched_event_t event,
+		const picc_t *picc) {
+	if (event == pdc_sched_event_arrived)
+		m_arrived[reader_id]++;
+}
+
+static void init(int buses, int readers_per_bus, int cards,
+		get_time_ms_f get_time_ms) {
+	m_reader_count = buses * readers_per_bus;
+	for (int i = 0; i < m_reader_count; i++) {
+		for (int j = 0; j < cards; j++)
+			pdc_sim_card_init(&m_cards[i][j],
+					j == 0 ? pdc_sim_card_mfc_1k : pdc_sim_card_ntag213, NULL,
+					0);
+		pdc_sim_init(m_sims + i, m_cards[i], cards);
+		m_sims[i].pdc.get_time_ms = get_time_ms;
+		pdc_sched_reader_init(m_readers + i, &m_sims[i].pdc, i);
+		m_arrived[i] = 0;
+	}
+	for (int i = 0; i < buses; i++)
+		pdc_sched_bus_init(m_buses + i, m_readers + i * readers_per_bus,
+				readers_per_bus);
+	pdc_sched_init(&m_sched, m_buses, buses, event, NULL);
+}
+
+static int run_step(int readers, int cards) {
+	init(1, readers, cards, air_time_ms);
+	while (m_readers[0].stats.polls < POLLS)
+		pdc_sched_step(&m_sched);
+
+	pdc_sched_reader_t *reader = m_readers;
+	printf("%d reader(s), %d PICC(s): %4u polls/s per reader, "
+			"latency p50 %2u p90 %2u p99 %2u ms, %5.2f frames per poll\n",
+			readers, cards, pdc_sched_poll_rate(reader),
+			pdc_sched_latency_percentile(reader, 50),
+			pdc_sched_latency_percentile(reader, 90),
+			pdc_sched_latency_percentile(reader, 99),
+			(double) reader->stats.frames / reader->stats.polls);
+	for (int i = 0; i < readers; i++)
+		if (m_arrived[i] != (unsigned int) cards || m_readers[i].stats.errors)
+			return 1;
+	return 0;
+}
+
+static int run_workers(int buses) {
+	struct timespec run = { .tv_nsec = RUN_ms * 1000000 };
+	unsigned int polls = 0;
+	double start;
+
+	init(buses, 2, 2, host_time_ms);
+	start = bench_seconds();
+	if (pdc_sched_start(&m_sched))
+		return 1;
+	nanosleep(&run, NULL);
+	pdc_sched_stop(&m_sched);
+	double elapsed = bench_seconds() - start;
+
+	for (int i = 0; i < m_reader_count; i++) {
+		if (m_arrived[i] != 2 || m_readers[i].stats.errors)
+			return 1;
+		polls += m_readers[i].stats.polls;
+	}
+	printf("%d bus worker(s), 2 readers, 2 PICCs each: %8.0f polls/s host "
+			"time, %8.0f per bus\n", buses, polls / elapsed,
+			polls / elapsed / buses);
+	return 0;
+}
+
+int main(void) {
+	static const int readers[] = { 1, 2, 4 };
+
+	for (size_t i = 0; i < sizeof(readers) / sizeof(readers[0]); i++)
+		for (int cards = 0; cards <= MAX_CARDS; cards++)
+			if (run_step(readers[i], cards))
+				return 1;
+
+	for (int buses = 1; buses <= MAX_BUSES; buses *= 2)
+		if (run_workers(buses))
+			return 1;
+	return 0;
+}
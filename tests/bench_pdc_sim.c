@@ -0,0 +1,42 @@
+/*
+ * bench_pdc_sim.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Host speed of the software PCD: MIFARE READ frames per second through
+// the card layer, and the emulated air time of a READ.
+
+#include <string.h>
+
+#include "bench.h"
+#include "pdc_sim.h"
+
+#define READS		(2000000)
+
+int main(void) {
+	static pdc_sim_card_t card;
+	static pdc_sim_t sim;
+	picc_t picc = { 0 };
+	uint8_t data[16];
+	uint64_t air_time_ns;
+	double start, elapsed;
+
+	pdc_sim_card_init(&card, pdc_sim_card_ntag215, NULL, 0);
+	pdc_sim_init(&sim, &card, 1);
+	if (picc_reqa(&sim.pdc, &picc) || PICC_Select(&sim.pdc, &picc, 0))
+		return 1;
+
+	air_time_ns = sim.air_time_ns;
+	start = bench_seconds();
+	for (int i = 0; i < READS; i++)
+		if (MIFARE_READ(&sim.pdc, &picc, i % 128, data))
+			return 1;
+	elapsed = bench_seconds() - start;
+
+	printf("pdc_sim READ: %.1f M frames/s host, %.2f ms air time per frame\n",
+			READS / elapsed / 1e6,
+			(sim.air_time_ns - air_time_ns) / 1e6 / READS);
+	return 0;
+}
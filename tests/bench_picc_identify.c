@@ -0,0 +1,121 @@
+/*
+ * bench_picc_identify.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// picc_identify() against blind probing after REQA and SELECT, on pdc_sim
+// and the rc52x emulator. Blind probing sends GET_VERSION, then RATS, with
+// a reactivation after every failure and the default timeouts. Then
+// picc_identify_read() of the Type 2 PICCs. Prints frames and emulated
+// time.
+
+#include <string.h>
+
+#include "bench.h"
+#include "rc52x_emu.h"
+#include "iso14443_4.h"
+#include "picc_identify.h"
+
+typedef uint64_t (*clock_ns_f)(void *context);
+
+static const char *m_names[] = { "ntag213", "ntag215", "ntag216",
+		"ultralight", "mfc 1k", "mfc 4k", "desfire" };
+
+static pdc_sim_card_t m_card;
+
+static uint64_t sim_clock_ns(void *context) {
+	return ((pdc_sim_t*) context)->air_time_ns;
+}
+
+static uint64_t emu_clock_ns(void *context) {
+	return rc52x_emu_time_ns();
+}
+
+static int activate(bs_pdc_t *pdc, pdc_sim_t *field, picc_t *picc) {
+	pdc_sim_field_reset(field);
+	memset(picc, 0, sizeof(*picc));
+	if (picc_reqa(pdc, picc))
+		return STATUS_ERROR;
+	return PICC_Select(pdc, picc, 0);
+}
+
+static int reactivate(bs_pdc_t *pdc, picc_t *picc) {
+	size_t size = sizeof(picc->atqa);
+	int result = PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, (uint8_t*) &picc->atqa,
+			&size);
+	if (result)
+		return result;
+	return PICC_Select(pdc, picc, 8 * picc->uid_size);
+}
+
+static void blind(bs_pdc_t *pdc, picc_t *picc) {
+	if (!MIFARE_GET_VERSION(pdc, picc))
+		return;
+	reactivate(pdc, picc);
+	if (iso14443_4_rats(pdc, picc))
+		reactivate(pdc, picc);
+}
+
+static int run(bs_pdc_t *pdc, pdc_sim_t *field, const char *name,
+		pdc_sim_card_type_t type, clock_ns_f clock_ns, void *context) {
+	static uint8_t data[1024];
+	picc_identify_stats_t stats;
+	size_t size = sizeof(data);
+	uint64_t start, identify_ns, blind_ns, read_ns;
+	unsigned int frames, blind_frames;
+	picc_t picc;
+
+	if (activate(pdc, field, &picc))
+		return 1;
+	start = clock_ns(context);
+	frames = pdc->frame_count;
+	blind(pdc, &picc);
+	blind_ns = clock_ns(context) - start;
+	blind_frames = pdc->frame_count - frames;
+
+	if (activate(pdc, field, &picc))
+		return 1;
+	start = clock_ns(context);
+	if (picc_identify(pdc, &picc, &stats))
+		return 1;
+	identify_ns = clock_ns(context) - start;
+
+	printf("%-9s %-10s identify %2u frames %6.2f ms | blind %2u frames "
+			"%6.2f ms\n", name, m_names[type], stats.frames, identify_ns / 1e6,
+			blind_frames, blind_ns / 1e6);
+
+	if (activate(pdc, field, &picc))
+		return 1;
+	start = clock_ns(context);
+	if (picc_identify_read(pdc, &picc, data, &size, &stats))
+		return 1;
+	read_ns = clock_ns(context) - start;
+	if (size)
+		printf("%-9s %-10s identify_read %4zu B in %2u frames %6.2f ms\n",
+				name, m_names[type], size, stats.frames, read_ns / 1e6);
+	return 0;
+}
+
+int main(void) {
+	static pdc_sim_t sim;
+	static rc52x_emu_t emu;
+	static rc52x_t rc52x;
+
+	for (pdc_sim_card_type_t type = pdc_sim_card_ntag213;
+			type <= pdc_sim_card_desfire; type++) {
+		pdc_sim_card_init(&m_card, type, NULL, 0);
+		pdc_sim_init(&sim, &m_card, 1);
+		if (run(&sim.pdc, &sim, "pdc_sim", type, sim_clock_ns, &sim))
+			return 1;
+
+		memset(&rc52x, 0, sizeof(rc52x));
+		rc52x_emu_init(&emu, 0x92, &m_card, 1);
+		rc52x_emu_attach(&emu, &rc52x);
+		rc52x_init(&rc52x);
+		if (run(&rc52x, &emu.field, "rc52x_emu", type, emu_clock_ns, NULL))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+ * bench_pn5180.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// The pn5180 driver on the PN5180 host model: init, polling an empty
+// field, and activating and reading an NTAG213, with and without the
+// wait_irq hook. Prints emulated time and SPI frames.
+
+#include <string.h>
+
+#include "bench.h"
+#include "pn5180_model.h"
+
+#define POLLS		(100)
+
+static pn5180_model_t m_model;
+static pn5180_t m_pn5180;
+static pdc_sim_card_t m_card;
+
+static int setup(size_t card_count, bool irq) {
+	pn5180_model_init(&m_model, &m_card, card_count, &m_pn5180);
+	if (irq)
+		m_pn5180.wait_irq = pn5180_model_wait_irq;
+	return PN5180_Init(&m_pn5180);
+}
+
+static int run(bool irq) {
+	const char *name = irq ? "wait_irq" : "polled";
+	uint64_t start;
+	unsigned int frames;
+	uint8_t data[18];
+	picc_t picc;
+
+	start = pn5180_model_time_ns();
+	if (setup(0, irq))
+		return 1;
+	printf("%-8s init:        %5.2f ms, %3u SPI frames\n", name,
+			(pn5180_model_time_ns() - start) / 1e6, m_model.stats.frames);
+
+	// The first poll sets the timeout
+	memset(&picc, 0, sizeof(picc));
+	picc_reqa(&m_pn5180, &picc);
+	start = pn5180_model_time_ns();
+	frames = m_model.stats.frames;
+	for (int i = 0; i < POLLS; i++) {
+		memset(&picc, 0, sizeof(picc));
+		if (picc_reqa(&m_pn5180, &picc) != STATUS_TIMEOUT)
+			return 1;
+	}
+	printf("%-8s empty field: %5.2f ms, %5.1f SPI frames per poll\n", name,
+			(pn5180_model_time_ns() - start) / 1e6 / POLLS,
+			(double) (m_model.stats.frames - frames) / POLLS);
+
+	if (setup(1, irq))
+		return 1;
+	memset(&picc, 0, sizeof(picc));
+	start = pn5180_model_time_ns();
+	frames = m_model.stats.frames;
+	if (picc_reqa(&m_pn5180, &picc) || PICC_Select(&m_pn5180, &picc, 0))
+		return 1;
+	printf("%-8s NTAG213 REQA and select: %5.2f ms, %3u SPI frames\n", name,
+			(pn5180_model_time_ns() - start) / 1e6,
+			m_model.stats.frames - frames);
+	start = pn5180_model_time_ns();
+	frames = m_model.stats.frames;
+	if (MIFARE_READ(&m_pn5180, &picc, 4, data))
+		return 1;
+	printf("%-8s NTAG213 READ:            %5.2f ms, %3u SPI frames\n", name,
+			(pn5180_model_time_ns() - start) / 1e6,
+			m_model.stats.frames - frames);
+	return m_model.stats.violations != 0;
+}
+
+int main(void) {
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag213, NULL, 0);
+	if (run(false))
+		return 1;
+	return run(true);
+}
@@ -0,0 +1,79 @@
+/*
+ * bench_poll.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// REQA polling of an empty field on the rc52x emulator and pdc_sim, with
+// the timeout profiles and with the default timer of the driver. The
+// latter has the SetTimeout hook cleared, as the drivers were before the
+// profiles. Prints time, register writes and SPI bytes per poll.
+
+#include <string.h>
+
+#include "bench.h"
+#include "rc52x_emu.h"
+
+#define POLLS		(100)
+
+static rc52x_emu_t m_emu;
+static rc52x_t m_rc52x;
+
+static int poll_rc52x(const char *name, bool profiles) {
+	rc52x_emu_stats_t stats;
+	uint64_t start;
+	picc_t picc;
+
+	memset(&m_rc52x, 0, sizeof(m_rc52x));
+	rc52x_emu_init(&m_emu, 0x92, NULL, 0);
+	rc52x_emu_attach(&m_emu, &m_rc52x);
+	rc52x_init(&m_rc52x);
+	if (!profiles)
+		m_rc52x.SetTimeout = NULL;
+
+	// The first poll programs the timer
+	memset(&picc, 0, sizeof(picc));
+	picc_reqa(&m_rc52x, &picc);
+	start = rc52x_emu_time_ns();
+	stats = m_emu.stats;
+	for (int i = 0; i < POLLS; i++) {
+		memset(&picc, 0, sizeof(picc));
+		if (picc_reqa(&m_rc52x, &picc) != STATUS_TIMEOUT)
+			return 1;
+	}
+	uint64_t ns = rc52x_emu_time_ns() - start;
+	printf("rc52x_emu %-8s %6.2f ms/poll %7.1f polls/s, %4.1f register "
+			"writes, %5.0f SPI bytes per poll\n", name, ns / 1e6 / POLLS,
+			POLLS * 1e9 / ns,
+			(double) (m_emu.stats.reg_writes - stats.reg_writes) / POLLS,
+			(double) (m_emu.stats.bus_bytes - stats.bus_bytes) / POLLS);
+	return 0;
+}
+
+static int poll_sim(const char *name, bool profiles) {
+	static pdc_sim_t sim;
+	uint64_t start;
+	picc_t picc;
+
+	pdc_sim_init(&sim, NULL, 0);
+	if (!profiles)
+		sim.pdc.SetTimeout = NULL;
+	memset(&picc, 0, sizeof(picc));
+	picc_reqa(&sim.pdc, &picc);
+	start = sim.air_time_ns;
+	for (int i = 0; i < POLLS; i++) {
+		memset(&picc, 0, sizeof(picc));
+		if (picc_reqa(&sim.pdc, &picc) != STATUS_TIMEOUT)
+			return 1;
+	}
+	printf("pdc_sim   %-8s %6.2f ms/poll\n", name,
+			(sim.air_time_ns - start) / 1e6 / POLLS);
+	return 0;
+}
+
+int main(void) {
+	if (poll_rc52x("default", false) || poll_rc52x("profiles", true))
+		return 1;
+	return poll_sim("default", false) || poll_sim("profiles", true);
+}
@@ -0,0 +1,149 @@
+/*
+ * fuzz_ndef.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Fuzz target for the NDEF parser.
+//
+// libFuzzer: build with -DFUZZ_LIBFUZZER -fsanitize=fuzzer,address
+//            (make -C tests fuzz), then run build/fuzz_ndef corpus/
+// AFL:       build with afl-cc, run with @@ as the argument
+// Otherwise: every argument is parsed as an input file. Without arguments
+//            a fixed number of mutations of built-in seeds is run, which is
+//            what make check does.
+//
+// Every input is parsed as a TLV data area, as a message and as a single
+// record. The streaming parser is then fed the input in steps, the step
+// size taken from the first byte, and has to return the same records as
+// with all data available at once. The input is copied to a buffer of its
+// exact size, so a sanitizer catches any read beyond it.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ndef.h"
+
+#define FUZZ_MAX_RECORDS		(1024)
+#define FUZZ_MUTATIONS			(200000)
+#define FUZZ_MAX_INPUT			(4096)
+
+static size_t fuzz_parse_all(const uint8_t *data, size_t size, bool tlv,
+		ndef_record_t *records) {
+	ndef_parser_t parser;
+	size_t count = 0;
+
+	ndef_parser_init(&parser, data, size, tlv);
+	while (count < FUZZ_MAX_RECORDS
+			&& ndef_parser_next(&parser, records + count) == ndef_status_record)
+		count++;
+	return count;
+}
+
+static void fuzz_streaming(const uint8_t *data, size_t size, bool tlv,
+		size_t step) {
+	static ndef_record_t expected[FUZZ_MAX_RECORDS];
+	size_t expected_count = fuzz_parse_all(data, size, tlv, expected);
+
+	ndef_parser_t parser;
+	ndef_record_t record;
+	ndef_status_t status;
+	size_t available = step < size ? step : size;
+	size_t count = 0;
+
+	ndef_parser_init(&parser, data, size, tlv);
+	ndef_parser_feed(&parser, available);
+	while (count < expected_count) {
+		status = ndef_parser_next(&parser, &record);
+		if (status == ndef_status_need_more) {
+			if (available == size || parser.needed == 0)
+				abort();	// Needs more than the input holds
+			available = available + step < size ? available + step : size;
+			ndef_parser_feed(&parser, available);
+			continue;
+		}
+		if (status != ndef_status_record
+				|| record.offset != expected[count].offset
+				|| record.payload != expected[count].payload
+				|| record.payload_length != expected[count].payload_length)
+			abort();	// Streaming differs from parsing at once
+		count++;
+	}
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size) {
+	uint8_t *data = malloc(size ? size : 1);
+	if (!data)
+		return 0;
+	memcpy(data, input, size);
+
+	ndef_tlv_parse(data, size);
+	ndef_message_parse(data, size);
+	ndef_record_parse(data, size);
+
+	size_t step = size ? (data[0] % 16) + 1 : 1;
+	fuzz_streaming(data, size, true, step);
+	fuzz_streaming(data, size, false, step);
+
+	free(data);
+	return 0;
+}
+
+#ifndef FUZZ_LIBFUZZER
+
+// Type 2 data area: Lock Control TLV, NDEF TLV with a URI record, terminator
+static const uint8_t fuzz_seed_tlv[] = { 0x01, 0x03, 0xA0, 0x0C, 0x34, 0x03,
+		0x10, 0xD1, 0x01, 0x0C, 0x55, 0x04, 'e', 'x', 'a', 'm', 'p', 'l', 'e',
+		'.', 'o', 'r', 'g', 0xFE, 0x00, 0x00, 0x00, 0x00 };
+
+// Message: text record with an id in three chunks, the last one in the long
+// format, then an external record
+static const uint8_t fuzz_seed_message[] = { 0xB9, 0x01, 0x03, 0x02, 'T',
+		'i', 'd', 0x02, 'e', 'n', 0x36, 0x00, 0x02, 'a', 'b', 0x06, 0x00,
+		0x00, 0x00, 0x00, 0x01, 'c', 0x54, 0x03, 0x02, 'x', ':', 'y', 0x01,
+		0x02 };
+
+static int fuzz_file(const char *name) {
+	static uint8_t buffer[FUZZ_MAX_INPUT];
+	FILE *file = fopen(name, "rb");
+	if (!file) {
+		perror(name);
+		return 1;
+	}
+	size_t size = fread(buffer, 1, sizeof(buffer), file);
+	fclose(file);
+	LLVMFuzzerTestOneInput(buffer, size);
+	return 0;
+}
+
+static void fuzz_mutations(const uint8_t *seed, size_t seed_size) {
+	uint8_t buffer[64];
+	srand(1);
+	for (int i = 0; i < FUZZ_MUTATIONS; i++) {
+		size_t size = rand() % (seed_size + 1);
+		memcpy(buffer, seed, seed_size);
+		for (int k = rand() % 4; k >= 0; k--)
+			buffer[rand() % seed_size] = rand();
+		LLVMFuzzerTestOneInput(buffer, size);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int result = 0;
+
+	if (argc > 1) {
+		for (int i = 1; i < argc; i++)
+			result |= fuzz_file(argv[i]);
+		return result;
+	}
+
+	fuzz_mutations(fuzz_seed_tlv, sizeof(fuzz_seed_tlv));
+	fuzz_mutations(fuzz_seed_message, sizeof(fuzz_seed_message));
+	printf("fuzz_ndef: ok\n");
+	return 0;
+}
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * bshal_mock.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "bshal_mock.h"
+#include "bshal_spim.h"
+#include "bshal_gpio.h"
+#include "bshal_i2cm.h"
+#include "rc52x_emu.h"
+
+bshal_mock_spim_stats_t bshal_mock_spim_stats;
+
+void bshal_mock_spim_reset(void) {
+	memset(&bshal_mock_spim_stats, 0, sizeof(bshal_mock_spim_stats));
+}
+
+static void bshal_mock_spim_transfer(bshal_spim_instance_t *spim,
+		uint8_t *data, size_t amount, bool nostop, bool keep_mosi) {
+	// The instance is the first member of the emulator
+	rc52x_emu_t *emu = (rc52x_emu_t*) spim;
+
+	bshal_mock_spim_stats.transfers++;
+	if (!emu->spi_selected) {
+		bshal_mock_spim_stats.transactions++;
+		rc52x_emu_spi_select(emu, true);
+	}
+	for (size_t i = 0; i < amount; i++) {
+		uint8_t miso = rc52x_emu_spi_byte(emu, data[i]);
+		if (!keep_mosi)
+			data[i] = miso;
+	}
+	bshal_mock_spim_stats.bytes += amount;
+	if (!nostop)
+		rc52x_emu_spi_select(emu, false);
+}
+
+int bshal_spim_transmit(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop) {
+	bshal_mock_spim_transfer(spim, data, amount, nostop, true);
+	return 0;
+}
+
+int bshal_spim_receive(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop) {
+	memset(data, 0, amount);
+	bshal_mock_spim_transfer(spim, data, amount, nostop, false);
+	return 0;
+}
+
+int bshal_spim_transceive(bshal_spim_instance_t *spim, void *data,
+		size_t amount, bool nostop) {
+	bshal_mock_spim_transfer(spim, data, amount, nostop, false);
+	return 0;
+}
+
+// The rc52x driver references the pins and the I²C transport. Neither is
+// used over the emulated SPI bus.
+
+int bshal_gpio_write_pin(int pin, bool value) {
+	return 0;
+}
+
+bool bshal_gpio_read_pin(int pin) {
+	return false;
+}
+
+int bshal_i2cm_send(bshal_i2cm_instance_t *i2cm, uint8_t address, void *data,
+		size_t amount, bool nostop) {
+	return -1;
+}
+
+int bshal_i2cm_recv(bshal_i2cm_instance_t *i2cm, uint8_t address, void *data,
+		size_t amount, bool nostop) {
+	return -1;
+}
+
+int bshal_i2cm_send_reg(bshal_i2cm_instance_t *i2cm, uint8_t address,
+		uint8_t reg, void *data, size_t amount) {
+	return -1;
+}
+
+int bshal_i2cm_recv_reg(bshal_i2cm_instance_t *i2cm, uint8_t address,
+		uint8_t reg, void *data, size_t amount) {
+	return -1;
+}
@@ -0,0 +1,30 @@
+/*
+ * bshal_mock.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_MOCK_BSHAL_MOCK_H_
+#define BSRFID_TESTS_MOCK_BSHAL_MOCK_H_
+
+// Transaction counting SPI master. The bytes are forwarded to the rc52x
+// emulator the instance belongs to. A transaction is one chip select
+// assertion: it starts with the first transfer and ends with a transfer
+// without nostop.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	unsigned int transactions;	// Chip select assertions
+	unsigned int transfers;		// bshal_spim_* calls
+	unsigned int bytes;			// Bytes clocked, in both directions
+} bshal_mock_spim_stats_t;
+
+extern bshal_mock_spim_stats_t bshal_mock_spim_stats;
+
+void bshal_mock_spim_reset(void);
+
+#endif /* BSRFID_TESTS_MOCK_BSHAL_MOCK_H_ */
@@ -0,0 +1,337 @@
+/*
+ * pn5180_model.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#include <string.h>
+
+#include "pn5180_model.h"
+#include "bshal_spim.h"
+#include "bshal_gpio.h"
+#include "bshal_i2cm.h"
+
+// Answer bytes still to come when the SOF is detected, an estimate
+#define PN5180_MODEL_ANSWER_BYTE_ns		(10620)
+// ISO 15693, 26.48 kbps: request SOF and bit, t1, answer SOF
+#define PN5180_MODEL_15693_SOF_ns		(75520)
+#define PN5180_MODEL_15693_BIT_ns		(37760)
+#define PN5180_MODEL_15693_T1_ns		(320900)
+// ISO 14443-B, 106 kbps: etu, request SOF and EOF, TR0 plus TR1
+#define PN5180_MODEL_14443B_ETU_ns		(9440)
+#define PN5180_MODEL_14443B_SOF_ns		(122720)
+#define PN5180_MODEL_14443B_EOF_ns		(103840)
+#define PN5180_MODEL_14443B_TR_ns		(169900)
+
+// All models share one clock, like the rc52x emulator
+static uint64_t pn5180_model_time;
+// The BUSY pin has no instance, it belongs to the last initialised model
+static pn5180_model_t *m_model;
+
+uint64_t pn5180_model_time_ns(void) {
+	return pn5180_model_time;
+}
+
+int pn5180_model_get_time_ms(void) {
+	return pn5180_model_time / 1000000;
+}
+
+int pn5180_model_delay_ms(int ms) {
+	pn5180_model_time += (uint64_t) ms * 1000000;
+	return 0;
+}
+
+// Makes the interrupts of a pending answer visible
+static void pn5180_model_update(pn5180_model_t *model) {
+	if (!model->pending_irq)
+		return;
+	if (pn5180_model_time >= model->sof_ns)
+		model->regs[PN5180_REG_IRQ_STATUS] |= PN5180_IRQ_RX_SOF_DET;
+	if (pn5180_model_time < model->done_ns)
+		return;
+	model->regs[PN5180_REG_IRQ_STATUS] |= model->pending_irq;
+	model->regs[PN5180_REG_RX_STATUS] = model->pending_rx_status;
+	model->pending_irq = 0;
+}
+
+/**
+ * wait_irq hook: sleeps until the answer of the PICC is complete, or until
+ * the timeout passed.
+ */
+int pn5180_model_wait_irq(void *pdc, int timeout_ms) {
+	pn5180_model_t *model =
+			(pn5180_model_t*) ((bs_pdc_t*) pdc)->transport_instance.spim;
+	if (!model)
+		return -1;
+	uint64_t timeout_ns = pn5180_model_time + (uint64_t) timeout_ms * 1000000;
+	if (model->pending_irq && model->done_ns < timeout_ns)
+		timeout_ns = model->done_ns;
+	if (timeout_ns > pn5180_model_time)
+		pn5180_model_time = timeout_ns;
+	pn5180_model_update(model);
+	return 0;
+}
+
+static uint32_t pn5180_model_get_le32(const uint8_t *data) {
+	return data[0] | (data[1] << 8) | ((uint32_t) data[2] << 16)
+			| ((uint32_t) data[3] << 24);
+}
+
+static void pn5180_model_write_reg(pn5180_model_t *model, uint8_t reg,
+		uint8_t action, uint32_t value) {
+	if (reg >= sizeof(model->regs) / sizeof(model->regs[0]))
+		return;
+	pn5180_model_update(model);
+	if (reg == PN5180_REG_IRQ_CLEAR) {
+		model->regs[PN5180_REG_IRQ_STATUS] &= ~value;
+		return;
+	}
+	switch (action) {
+	case PN5180_REG_ACTION_WRITE:
+		model->regs[reg] = value;
+		break;
+	case PN5180_REG_ACTION_OR:
+		model->regs[reg] |= value;
+		break;
+	case PN5180_REG_ACTION_AND:
+		model->regs[reg] &= value;
+		break;
+	}
+	// Idle aborts the transceive state, an answer is no longer received
+	if (reg == PN5180_REG_SYSTEM_CONFIG
+			&& !(model->regs[reg] & PN5180_SYSTEM_CONFIG_COMMAND_MASK))
+		model->pending_irq = 0;
+}
+
+static void pn5180_model_read_regs(pn5180_model_t *model, const uint8_t *regs,
+		size_t count) {
+	pn5180_model_update(model);
+	for (size_t i = 0; i < count; i++) {
+		uint32_t value = 0;
+		if (regs[i] < sizeof(model->regs) / sizeof(model->regs[0]))
+			value = model->regs[regs[i]];
+		model->response[4 * i + 0] = value;
+		model->response[4 * i + 1] = value >> 8;
+		model->response[4 * i + 2] = value >> 16;
+		model->response[4 * i + 3] = value >> 24;
+	}
+	model->response_size = 4 * count;
+}
+
+// SEND_DATA: the first byte holds the valid bits of the last byte
+static void pn5180_model_send_data(pn5180_model_t *model, const uint8_t *data,
+		size_t size) {
+	uint8_t answer[PN5180_RX_BUFFER_SIZE];
+	size_t answer_size = sizeof(answer);
+	uint8_t valid_bits = data[0];
+	uint8_t collision = 0;
+	bool send_crc = model->regs[PN5180_REG_CRC_TX_CONFIG] & PN5180_CRC_ENABLE;
+	bool recv_crc = model->regs[PN5180_REG_CRC_RX_CONFIG] & PN5180_CRC_ENABLE;
+	uint8_t align = (model->regs[PN5180_REG_CRC_RX_CONFIG]
+			& PN5180_CRC_RX_BIT_ALIGN_MASK) >> PN5180_CRC_RX_BIT_ALIGN_SHIFT;
+
+	if ((model->regs[PN5180_REG_SYSTEM_CONFIG]
+			& PN5180_SYSTEM_CONFIG_COMMAND_MASK)
+			!= PN5180_SYSTEM_CONFIG_COMMAND_TRANSCEIVE || !model->rf_on)
+		return;
+	data++;
+	size--;
+	// Without TX_DATA_ENABLE only the EOF is sent, the slot marker
+	if (!(model->regs[PN5180_REG_TX_CONFIG] & PN5180_TX_CONFIG_DATA_ENABLE))
+		size = 0;
+
+	uint64_t start_ns = model->field.air_time_ns;
+	int result = pdc_sim_transceive(&model->field.pdc, (void*) data, size,
+			answer, &answer_size, &valid_bits, align, &collision, send_crc,
+			recv_crc);
+	uint64_t air_ns = model->field.air_time_ns - start_ns;
+	model->regs[PN5180_REG_IRQ_STATUS] |= PN5180_IRQ_TX;
+	if (result != STATUS_OK && result != STATUS_COLLISION
+			&& result != STATUS_CRC_WRONG) {
+		// No answer, the PN5180 stays in WAIT_RECEIVE
+		model->pending_irq = 0;
+		return;
+	}
+
+	memcpy(model->rx, answer, answer_size);
+	model->rx_size = answer_size;
+	uint32_t rx_status = answer_size
+			| ((uint32_t) (valid_bits & PN5180_RX_STATUS_LAST_BITS_MASK)
+					<< PN5180_RX_STATUS_LAST_BITS_SHIFT);
+	if (result == STATUS_COLLISION)
+		rx_status |= PN5180_RX_STATUS_COLLISION
+				| PN5180_RX_STATUS_INTEGRITY_ERROR
+				| (uint32_t) ((collision - 1) & PN5180_RX_STATUS_COLL_POS_MASK)
+						<< PN5180_RX_STATUS_COLL_POS_SHIFT;
+	// The CRC check fails on a frame that does not end on a byte boundary
+	if (result == STATUS_CRC_WRONG || (recv_crc && result == STATUS_OK
+			&& valid_bits))
+		rx_status |= PN5180_RX_STATUS_INTEGRITY_ERROR;
+
+	uint64_t rx_ns = (uint64_t) (answer_size + 2) * PN5180_MODEL_ANSWER_BYTE_ns;
+	model->pending_rx_status = rx_status;
+	model->pending_irq = PN5180_IRQ_RX;
+	model->done_ns = pn5180_model_time + air_ns;
+	model->sof_ns = pn5180_model_time + (air_ns > rx_ns ? air_ns - rx_ns : 0);
+	if (model->field.protocol == pdc_protocol_iso15693)
+		model->sof_ns = pn5180_model_time
+				+ (size ? PN5180_MODEL_15693_SOF_ns
+								+ 8 * (size + 2) * PN5180_MODEL_15693_BIT_ns : 0)
+				+ PN5180_MODEL_15693_BIT_ns + PN5180_MODEL_15693_T1_ns;
+	if (model->field.protocol == pdc_protocol_iso14443b)
+		model->sof_ns = pn5180_model_time + PN5180_MODEL_14443B_SOF_ns
+				+ 10 * (size + (send_crc ? 2 : 0)) * PN5180_MODEL_14443B_ETU_ns
+				+ PN5180_MODEL_14443B_EOF_ns + PN5180_MODEL_14443B_TR_ns;
+}
+
+// Loading a configuration sets TX_DATA_ENABLE again
+static void pn5180_model_load_rf_config(pn5180_model_t *model, uint8_t tx,
+		uint8_t rx) {
+	model->regs[PN5180_REG_TX_CONFIG] |= PN5180_TX_CONFIG_DATA_ENABLE;
+	if (tx == PN5180_RF_CONFIG_ISO15693_TX) {
+		pdc_sim_set_protocol(&model->field.pdc, pdc_protocol_iso15693);
+	} else if (tx >= PN5180_RF_CONFIG_ISO14443B_TX
+			&& tx <= PN5180_RF_CONFIG_ISO14443B_TX + pdc_bitrate_848) {
+		pdc_sim_set_protocol(&model->field.pdc, pdc_protocol_iso14443b);
+	} else if (tx <= PN5180_RF_CONFIG_ISO14443A_TX + pdc_bitrate_848) {
+		pdc_sim_set_protocol(&model->field.pdc, pdc_protocol_iso14443a);
+		model->field.tx_rate = tx - PN5180_RF_CONFIG_ISO14443A_TX;
+		model->field.rx_rate = rx - PN5180_RF_CONFIG_ISO14443A_RX;
+	}
+}
+
+// Decodes a command frame. BUSY rises until it is processed.
+static void pn5180_model_command(pn5180_model_t *model, const uint8_t *frame,
+		size_t size) {
+	uint64_t busy_ns = PN5180_MODEL_COMMAND_ns;
+
+	model->response_size = 0;
+	switch (frame[0]) {
+	case PN5180_CMD_WRITE_REGISTER:
+		pn5180_model_write_reg(model, frame[1], PN5180_REG_ACTION_WRITE,
+				pn5180_model_get_le32(frame + 2));
+		break;
+	case PN5180_CMD_WRITE_REGISTER_OR_MASK:
+		pn5180_model_write_reg(model, frame[1], PN5180_REG_ACTION_OR,
+				pn5180_model_get_le32(frame + 2));
+		break;
+	case PN5180_CMD_WRITE_REGISTER_AND_MASK:
+		pn5180_model_write_reg(model, frame[1], PN5180_REG_ACTION_AND,
+				pn5180_model_get_le32(frame + 2));
+		break;
+	case PN5180_CMD_WRITE_REGISTER_MULTIPLE:
+		for (size_t i = 1; i + 6 <= size; i += 6)
+			pn5180_model_write_reg(model, frame[i], frame[i + 1],
+					pn5180_model_get_le32(frame + i + 2));
+		break;
+	case PN5180_CMD_READ_REGISTER:
+		pn5180_model_read_regs(model, frame + 1, 1);
+		break;
+	case PN5180_CMD_READ_REGISTER_MULTIPLE:
+		pn5180_model_read_regs(model, frame + 1, size - 1);
+		break;
+	case PN5180_CMD_READ_EEPROM:
+		memset(model->response, 0x5A, frame[2]);
+		model->response_size = frame[2];
+		break;
+	case PN5180_CMD_SEND_DATA:
+		pn5180_model_send_data(model, frame + 1, size - 1);
+		break;
+	case PN5180_CMD_READ_DATA:
+		memcpy(model->response, model->rx, model->rx_size);
+		model->response_size = model->rx_size;
+		break;
+	case PN5180_CMD_LOAD_RF_CONFIG:
+		pn5180_model_load_rf_config(model, frame[1], frame[2]);
+		busy_ns = PN5180_MODEL_RF_CONFIG_ns;
+		break;
+	case PN5180_CMD_RF_ON:
+		model->rf_on = true;
+		pdc_sim_set_field(&model->field.pdc, true);
+		busy_ns = PN5180_MODEL_RF_ON_ns;
+		break;
+	case PN5180_CMD_RF_OFF:
+		model->rf_on = false;
+		pdc_sim_set_field(&model->field.pdc, false);
+		break;
+	}
+	model->busy_until_ns = pn5180_model_time + busy_ns;
+}
+
+static void pn5180_model_clock(pn5180_model_t *model, size_t size) {
+	if (pn5180_model_time < model->busy_until_ns)
+		model->stats.violations++;
+	pn5180_model_time += PN5180_MODEL_FRAME_ns
+			+ (uint64_t) size * 8 * 1000000 / PN5180_MODEL_SPI_kHz;
+	model->stats.frames++;
+	model->stats.bytes += size;
+}
+
+void pn5180_model_init(pn5180_model_t *model, pdc_sim_card_t *cards,
+		size_t card_count, pn5180_t *pn5180) {
+	memset(model, 0, sizeof(pn5180_model_t));
+	pdc_sim_init(&model->field, cards, card_count);
+	// The host ends the wait, pdc_sim does not add the timeout
+	model->field.timeout_us = 0;
+	m_model = model;
+
+	memset(pn5180, 0, sizeof(pn5180_t));
+	pn5180->transport_type = bshal_transport_spi;
+	pn5180->transport_instance.spim = &model->spim;
+	pn5180->get_time_ms = pn5180_model_get_time_ms;
+	pn5180->delay_ms = pn5180_model_delay_ms;
+	pn5180->busy_pin = 1;
+}
+
+//------------------------------------------------------------------------------
+// bshal
+//------------------------------------------------------------------------------
+
+int bshal_spim_transmit(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop) {
+	// The instance is the first member of the model
+	pn5180_model_t *model = (pn5180_model_t*) spim;
+	pn5180_model_clock(model, amount);
+	pn5180_model_command(model, data, amount);
+	return 0;
+}
+
+int bshal_spim_transceive(bshal_spim_instance_t *spim, void *data,
+		size_t amount, bool nostop) {
+	pn5180_model_t *model = (pn5180_model_t*) spim;
+	pn5180_model_clock(model, amount);
+	if (!model->response_size)
+		model->stats.violations++;	// No command with a response before
+	memcpy(data, model->response, amount);
+	model->response_size = 0;
+	model->busy_until_ns = pn5180_model_time + PN5180_MODEL_RESPONSE_ns;
+	return 0;
+}
+
+int bshal_spim_receive(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop) {
+	return bshal_spim_transceive(spim, data, amount, nostop);
+}
+
+bool bshal_gpio_read_pin(int pin) {
+	pn5180_model_time += PN5180_MODEL_PIN_ns;
+	if (!m_model)
+		return false;
+	m_model->stats.busy_reads++;
+	return pn5180_model_time < m_model->busy_until_ns;
+}
+
+int bshal_gpio_write_pin(int pin, bool value) {
+	return 0;
+}
+
+int bshal_i2cm_send_reg(bshal_i2cm_instance_t *i2cm, uint8_t address,
+		uint8_t reg, void *data, size_t amount) {
+	return -1;
+}
+
+int bshal_i2cm_recv_reg(bshal_i2cm_instance_t *i2cm, uint8_t address,
+		uint8_t reg, void *data, size_t amount) {
+	return -1;
+}
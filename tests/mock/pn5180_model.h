@@ -0,0 +1,80 @@
+/*
+ * pn5180_model.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_MOCK_PN5180_MODEL_H_
+#define BSRFID_TESTS_MOCK_PN5180_MODEL_H_
+
+// Host model of the PN5180 host interface, for the unmodified pn5180
+// driver. It provides the SPI master and the BUSY line: every frame is
+// decoded as a PN5180 command, the RF side is a pdc_sim_t with its virtual
+// PICCs. Modelled are the registers the driver uses, the transceive state
+// with IRQ_STATUS and RX_STATUS, SEND_DATA, READ_DATA, LOAD_RF_CONFIG for
+// ISO 14443-A, ISO 14443-B and ISO 15693, and RF_ON/RF_OFF. A SEND_DATA with
+// TX_DATA_ENABLE cleared is the EOF of an ISO 15693 slot marker.
+//
+// Time advances with the bytes clocked over SPI, the BUSY time of every
+// command and the air time of the frames. Link it instead of bshal_mock.c,
+// both provide the bshal functions.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "bshal_spim.h"
+
+#include "pn5180.h"
+#include "pdc_sim.h"
+
+#define PN5180_MODEL_SPI_kHz			(7000)
+// Chip select and the rise of BUSY around every frame
+#define PN5180_MODEL_FRAME_ns			(2000)
+// BUSY stays high while a command is processed
+#define PN5180_MODEL_COMMAND_ns			(15000)
+#define PN5180_MODEL_RESPONSE_ns		(2000)
+#define PN5180_MODEL_RF_CONFIG_ns		(200000)
+#define PN5180_MODEL_RF_ON_ns			(500000)
+// Reading the BUSY pin
+#define PN5180_MODEL_PIN_ns				(200)
+
+typedef struct {
+	unsigned int frames;		// SPI frames, commands and responses
+	unsigned int bytes;
+	unsigned int busy_reads;	// Reads of the BUSY line
+	unsigned int violations;	// Frames clocked while BUSY was high
+} pn5180_model_stats_t;
+
+// The bshal_spim_instance_t must be the first member, the SPI master casts
+// the instance back to the model.
+typedef struct {
+	bshal_spim_instance_t spim;
+	uint32_t regs[0x30];
+	bool rf_on;
+	pdc_sim_t field;			// The RF side
+
+	uint8_t rx[PN5180_RX_BUFFER_SIZE];
+	size_t rx_size;
+	uint8_t response[PN5180_RX_BUFFER_SIZE];
+	size_t response_size;		// Response to clock out, 0 when none
+
+	uint64_t busy_until_ns;
+	uint64_t sof_ns;			// Pending answer: RX_SOF_DET at
+	uint64_t done_ns;			// and the IRQ at
+	uint32_t pending_irq;
+	uint32_t pending_rx_status;
+
+	pn5180_model_stats_t stats;
+} pn5180_model_t;
+
+void pn5180_model_init(pn5180_model_t *model, pdc_sim_card_t *cards,
+		size_t card_count, pn5180_t *pn5180);
+
+int pn5180_model_wait_irq(void *pdc, int timeout_ms);
+uint64_t pn5180_model_time_ns(void);
+int pn5180_model_get_time_ms(void);
+int pn5180_model_delay_ms(int ms);
+
+#endif /* BSRFID_TESTS_MOCK_PN5180_MODEL_H_ */
@@ -0,0 +1,19 @@
+/*
+ * bshal_gpio.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_STUBS_BSHAL_GPIO_H_
+#define BSRFID_TESTS_STUBS_BSHAL_GPIO_H_
+
+// Host stand-in for the bshal GPIO functions
+
+#include <stdint.h>
+#include <stdbool.h>
+
+int bshal_gpio_write_pin(int pin, bool value);
+bool bshal_gpio_read_pin(int pin);
+
+#endif /* BSRFID_TESTS_STUBS_BSHAL_GPIO_H_ */
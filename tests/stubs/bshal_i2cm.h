@@ -0,0 +1,31 @@
+/*
+ * bshal_i2cm.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_STUBS_BSHAL_I2CM_H_
+#define BSRFID_TESTS_STUBS_BSHAL_I2CM_H_
+
+// Host stand-in for the bshal I²C master. The tests run over SPI, the
+// functions are stubs in tests/mock that fail.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	int unused;
+} bshal_i2cm_instance_t;
+
+int bshal_i2cm_send(bshal_i2cm_instance_t *i2cm, uint8_t address, void *data,
+		size_t amount, bool nostop);
+int bshal_i2cm_recv(bshal_i2cm_instance_t *i2cm, uint8_t address, void *data,
+		size_t amount, bool nostop);
+int bshal_i2cm_send_reg(bshal_i2cm_instance_t *i2cm, uint8_t address,
+		uint8_t reg, void *data, size_t amount);
+int bshal_i2cm_recv_reg(bshal_i2cm_instance_t *i2cm, uint8_t address,
+		uint8_t reg, void *data, size_t amount);
+
+#endif /* BSRFID_TESTS_STUBS_BSHAL_I2CM_H_ */
@@ -0,0 +1,32 @@
+/*
+ * bshal_spim.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_STUBS_BSHAL_SPIM_H_
+#define BSRFID_TESTS_STUBS_BSHAL_SPIM_H_
+
+// Host stand-in for the bshal SPI master, with the members the drivers use.
+// The functions are provided by tests/mock or by a chip emulator, which
+// embeds the instance as its first member.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+	int cs_pin;
+	int rs_pin;					// Reset pin, as used by rc66x
+	bool rs_pol;
+} bshal_spim_instance_t;
+
+int bshal_spim_transmit(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop);
+int bshal_spim_receive(bshal_spim_instance_t *spim, void *data, size_t amount,
+		bool nostop);
+int bshal_spim_transceive(bshal_spim_instance_t *spim, void *data,
+		size_t amount, bool nostop);
+
+#endif /* BSRFID_TESTS_STUBS_BSHAL_SPIM_H_ */
@@ -0,0 +1,28 @@
+/*
+ * bshal_transport.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_STUBS_BSHAL_TRANSPORT_H_
+#define BSRFID_TESTS_STUBS_BSHAL_TRANSPORT_H_
+
+// Host stand-in for the bshal transport selection used by bs_pdc_t
+
+#include "bshal_spim.h"
+#include "bshal_i2cm.h"
+
+typedef enum {
+	bshal_transport_spi,
+	bshal_transport_i2c,
+	bshal_transport_uart,
+} bshal_transport_type_t;
+
+typedef union {
+	void *raw;
+	bshal_spim_instance_t *spim;
+	bshal_i2cm_instance_t *i2cm;
+} bshal_transport_instance_t;
+
+#endif /* BSRFID_TESTS_STUBS_BSHAL_TRANSPORT_H_ */
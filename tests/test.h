@@ -0,0 +1,40 @@
+/*
+ * test.h
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+#ifndef BSRFID_TESTS_TEST_H_
+#define BSRFID_TESTS_TEST_H_
+
+// Minimal assertions for the host tests. A failed check is reported and
+// counted, the test continues. main() returns test_result().
+
+#include <stdio.h>
+
+static int test_failures;
+
+#define TEST_ASSERT(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+		test_failures++; \
+	} \
+} while (0)
+
+#define TEST_EQUAL(actual, expected) do { \
+	long long test_a = (long long) (actual); \
+	long long test_e = (long long) (expected); \
+	if (test_a != test_e) { \
+		fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, \
+				__LINE__, #actual, test_a, test_e); \
+		test_failures++; \
+	} \
+} while (0)
+
+static inline int test_result(const char *name) {
+	printf("%s: %s\n", name, test_failures ? "FAIL" : "ok");
+	return test_failures ? 1 : 0;
+}
+
+#endif /* BSRFID_TESTS_TEST_H_ */
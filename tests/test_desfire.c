@@ -0,0 +1,173 @@
+/*
+ * test_desfire.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// DESFire native commands against the DESFire PICC of pdc_sim: version,
+// applications, file settings, values, records, and ReadData streamed over
+// the continuations with one command.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "desfire.h"
+
+#define FILE_SIZE		(4096)
+#define RECORD_SIZE		(16)
+#define RECORDS			(10)
+
+static pdc_sim_card_t m_card;
+static pdc_sim_t m_sim;
+static uint8_t m_file[FILE_SIZE];
+static uint8_t m_records[RECORD_SIZE * RECORDS];
+
+static void activate(picc_t *picc, desfire_t *desfire) {
+	// A PICC left in the protocol state ignores REQA, a field reset
+	// returns it to IDLE
+	memset(picc, 0, sizeof(*picc));
+	pdc_sim_set_field(&m_sim, false);
+	pdc_sim_set_field(&m_sim, true);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, picc, 0), STATUS_OK);
+	TEST_EQUAL(iso14443_4_rats(&m_sim.pdc, picc), STATUS_OK);
+	TEST_EQUAL(desfire_init(desfire, &m_sim.pdc, picc), STATUS_OK);
+}
+
+static void init_card(void) {
+	for (size_t i = 0; i < sizeof(m_file); i++)
+		m_file[i] = i * 7 + 3;
+	for (size_t i = 0; i < sizeof(m_records); i++)
+		m_records[i] = i;
+	pdc_sim_card_init(&m_card, pdc_sim_card_desfire, NULL, 0);
+	pdc_sim_desfire_add_application(&m_card, 0x000001);
+	pdc_sim_desfire_add_application(&m_card, 0x123456);
+	pdc_sim_desfire_add_file(&m_card, 1, 0, m_file, sizeof(m_file));
+	pdc_sim_desfire_add_value_file(&m_card, 1, 1, -1234);
+	pdc_sim_desfire_add_record_file(&m_card, 1, 2, m_records, RECORD_SIZE,
+			RECORDS);
+	pdc_sim_init(&m_sim, &m_card, 1);
+}
+
+static void test_card(void) {
+	desfire_version_t version;
+	desfire_t desfire;
+	uint32_t aids[8];
+	uint8_t files[8];
+	size_t count;
+	picc_t picc;
+
+	activate(&picc, &desfire);
+	TEST_EQUAL(desfire_get_version(&desfire, &version), STATUS_OK);
+	TEST_EQUAL(version.hardware.vendor_id, 0x04);
+	TEST_EQUAL(version.hardware.type, 0x01);
+	TEST_EQUAL(version.hardware.storage_size, 0x18);
+	TEST_EQUAL(memcmp(version.uid, m_card.uid, 7), 0);
+	TEST_EQUAL(desfire.stats.exchanges, 3);
+
+	count = 8;
+	TEST_EQUAL(desfire_get_application_ids(&desfire, aids, &count),
+			STATUS_OK);
+	TEST_EQUAL(count, 2);
+	TEST_EQUAL(aids[0], 0x000001);
+	TEST_EQUAL(aids[1], 0x123456);
+
+	TEST_ASSERT(desfire_select_application(&desfire, 0x777777) != STATUS_OK);
+	TEST_EQUAL(desfire.status, desfire_status_application_not_found);
+
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+	count = 8;
+	TEST_EQUAL(desfire_get_file_ids(&desfire, files, &count), STATUS_OK);
+	TEST_EQUAL(count, 3);
+}
+
+static void test_files(void) {
+	desfire_file_settings_t settings;
+	uint8_t data[200];
+	desfire_t desfire;
+	int32_t value;
+	size_t size;
+	picc_t picc;
+
+	activate(&picc, &desfire);
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+
+	TEST_EQUAL(desfire_get_file_settings(&desfire, 0, &settings), STATUS_OK);
+	TEST_EQUAL(settings.type, desfire_file_standard);
+	TEST_EQUAL(settings.data.size, FILE_SIZE);
+	TEST_EQUAL(desfire_get_file_settings(&desfire, 1, &settings), STATUS_OK);
+	TEST_EQUAL(settings.type, desfire_file_value);
+	TEST_EQUAL(desfire_get_file_settings(&desfire, 2, &settings), STATUS_OK);
+	TEST_EQUAL(settings.type, desfire_file_cyclic_record);
+	TEST_EQUAL(settings.record.record_size, RECORD_SIZE);
+	TEST_EQUAL(settings.record.records, RECORDS);
+
+	TEST_EQUAL(desfire_get_value(&desfire, 1, &value), STATUS_OK);
+	TEST_EQUAL(value, -1234);
+	TEST_ASSERT(desfire_get_value(&desfire, 0, &value) != STATUS_OK);
+	TEST_EQUAL(desfire.status, desfire_status_parameter_error);
+
+	// The newest 3 records, then all from the third newest on
+	size = sizeof(data);
+	TEST_EQUAL(desfire_read_records(&desfire, 2, 0, 3, data, &size),
+			STATUS_OK);
+	TEST_EQUAL(size, 3 * RECORD_SIZE);
+	TEST_EQUAL(memcmp(data, m_records + 7 * RECORD_SIZE, size), 0);
+	size = sizeof(data);
+	TEST_EQUAL(desfire_read_records(&desfire, 2, 2, 0, data, &size),
+			STATUS_OK);
+	TEST_EQUAL(size, 8 * RECORD_SIZE);
+	TEST_EQUAL(memcmp(data, m_records, size), 0);
+
+	// Length 0 reads to the end of the file
+	size = 100;
+	TEST_EQUAL(desfire_read_data(&desfire, 0, 4000, 0, data, &size),
+			STATUS_OK);
+	TEST_EQUAL(size, FILE_SIZE - 4000);
+	TEST_EQUAL(memcmp(data, m_file + 4000, size), 0);
+	size = 100;
+	TEST_ASSERT(desfire_read_data(&desfire, 0, 4000, 200, data, &size)
+			!= STATUS_OK);
+	TEST_EQUAL(desfire.status, desfire_status_boundary_error);
+	size = 50;
+	TEST_EQUAL(desfire_read_data(&desfire, 0, 0, 0, data, &size),
+			STATUS_NO_ROOM);
+}
+
+static void test_read_data(void) {
+	static uint8_t data[FILE_SIZE];
+	size_t size = sizeof(data);
+	desfire_t desfire;
+	unsigned int commands;
+	picc_t picc;
+
+	activate(&picc, &desfire);
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+	commands = desfire.stats.commands;
+	TEST_EQUAL(desfire_read_data(&desfire, 0, 0, 0, data, &size), STATUS_OK);
+	TEST_EQUAL(size, sizeof(data));
+	TEST_EQUAL(memcmp(data, m_file, sizeof(data)), 0);
+	// One command, one frame of 59 bytes per continuation
+	TEST_EQUAL(desfire.stats.commands - commands, 1);
+	TEST_EQUAL(desfire.stats.frames, (FILE_SIZE + 58) / 59);
+
+	// The application is still selected
+	commands = desfire.stats.commands;
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+	TEST_EQUAL(desfire.stats.commands, commands);
+	// Not after the PICC was reactivated, desfire_init() forgets it
+	activate(&picc, &desfire);
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+	TEST_EQUAL(desfire.stats.commands, 1);
+}
+
+int main(void) {
+	init_card();
+	test_card();
+	test_files();
+	test_read_data();
+
+	return test_result("test_desfire");
+}
@@ -0,0 +1,310 @@
+/*
+ * test_iso14443_4.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// T=CL block protocol against the DESFire PICC of pdc_sim and on the rc52x
+// emulator: chaining in both directions, waiting time extensions, lost and
+// corrupted frames, the FWT when the PICC left the field, and the bit rate
+// negotiated with PPS.
+
+#include <string.h>
+
+#include "test.h"
+#include "rc52x_emu.h"
+#include "iso14443_4.h"
+
+#define FILE_SIZE		(1024)
+#define LARGE_FILE_SIZE	(4000)
+
+static uint8_t m_file[LARGE_FILE_SIZE];
+static pdc_sim_card_t m_card;
+
+// Every n-th frame is lost, alternating between no answer and an answer
+// with a CRC error
+static TransceiveData_f m_transceive;
+static unsigned int m_lose_every, m_frames, m_lost;
+
+static int lossy_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
+	if (++m_frames % m_lose_every)
+		return m_transceive(pdc, sendData, sendLen, backData, backLen,
+				validBits, rxAlign, collisionPos, sendCRC, recvCRC);
+	if (m_lost++ & 1) {
+		m_transceive(pdc, sendData, sendLen, backData, backLen, validBits,
+				rxAlign, collisionPos, sendCRC, recvCRC);
+		return STATUS_CRC_WRONG;
+	}
+	return STATUS_TIMEOUT;
+}
+
+static void init_card(size_t file_size) {
+	for (size_t i = 0; i < sizeof(m_file); i++)
+		m_file[i] = i * 7 + 3;
+	pdc_sim_card_init(&m_card, pdc_sim_card_desfire, NULL, 0);
+	m_card.memory_size = PDC_SIM_MEMORY_SIZE;
+	pdc_sim_desfire_add_application(&m_card, 1);
+	TEST_EQUAL(pdc_sim_desfire_add_file(&m_card, 1, 0, m_file, file_size),
+			STATUS_OK);
+}
+
+static int activate(bs_pdc_t *pdc, picc_t *picc) {
+	uint8_t atqa[2];
+	size_t size = sizeof(atqa);
+
+	// A PICC left in the protocol state ignores WUPA, a field reset returns
+	// it to IDLE
+	memset(picc, 0, sizeof(*picc));
+	pdc->SetField(pdc, false);
+	pdc->SetField(pdc, true);
+	PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, atqa, &size);
+	if (PICC_Select(pdc, picc, 0))
+		return STATUS_ERROR;
+	return iso14443_4_rats(pdc, picc);
+}
+
+// Selects the application and reads the file with ADDITIONAL FRAME, returns
+// the frames used
+static unsigned int read_file_size(bs_pdc_t *pdc, picc_t *picc,
+		size_t file_size) {
+	static const uint8_t select[] = { 0x90, 0x5A, 0x00, 0x00, 0x03, 0x01,
+			0x00, 0x00, 0x00 };
+	static const uint8_t more[] = { 0x90, 0xAF, 0x00, 0x00, 0x00 };
+	uint8_t read[] = { 0x90, 0xBD, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x00,
+			file_size & 0xFF, file_size >> 8, 0x00, 0x00 };
+	static uint8_t data[LARGE_FILE_SIZE];
+	unsigned int frames = pdc->frame_count;
+	uint8_t response[300];
+	size_t size = sizeof(response), read_size = 0;
+
+	TEST_EQUAL(iso14443_4_transceive(pdc, picc, select, sizeof(select),
+			response, &size), STATUS_OK);
+	TEST_EQUAL(size, 2);
+	TEST_EQUAL(response[1], 0x00);
+
+	size = sizeof(response);
+	TEST_EQUAL(iso14443_4_transceive(pdc, picc, read, sizeof(read),
+			response, &size), STATUS_OK);
+	for (;;) {
+		TEST_ASSERT(size >= 2 && read_size + size - 2 <= sizeof(data));
+		if (size < 2 || read_size + size - 2 > sizeof(data))
+			break;
+		memcpy(data + read_size, response, size - 2);
+		read_size += size - 2;
+		if (response[size - 1] != 0xAF)
+			break;
+		size = sizeof(response);
+		if (iso14443_4_transceive(pdc, picc, more, sizeof(more), response,
+				&size)) {
+			TEST_ASSERT(false);
+			break;
+		}
+	}
+	TEST_EQUAL(read_size, file_size);
+	TEST_EQUAL(memcmp(data, m_file, file_size), 0);
+	return pdc->frame_count - frames;
+}
+
+static unsigned int read_file(bs_pdc_t *pdc, picc_t *picc) {
+	return read_file_size(pdc, picc, FILE_SIZE);
+}
+
+static void test_rats(void) {
+	static pdc_sim_t sim;
+	picc_t picc;
+
+	init_card(FILE_SIZE);
+	pdc_sim_init(&sim, &m_card, 1);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.fsc, 64);
+	TEST_EQUAL(picc.iso14443_4.fsd, 256);
+	TEST_EQUAL(picc.iso14443_4.fwt_us, ISO14443_4_FWT_us(8));
+	TEST_EQUAL(picc.iso14443_4.ta, 0x77);
+
+	// The FSD announced fits the reader FIFO
+	sim.pdc.rx_fifo_size = 32;
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.fsd, 32);
+}
+
+static void test_chaining(void) {
+	static pdc_sim_t sim;
+	uint8_t command[261], response[64];
+	size_t size = sizeof(response);
+	unsigned int frames;
+	picc_t picc;
+
+	init_card(FILE_SIZE);
+	pdc_sim_init(&sim, &m_card, 1);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(read_file(&sim.pdc, &picc), 19);
+
+	// Chained answers at FSD 16
+	sim.pdc.rx_fifo_size = 16;
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.fsd, 16);
+	TEST_EQUAL(read_file(&sim.pdc, &picc), 88);
+
+	// A 261 byte command in 5 chained I-blocks at FSC 64
+	sim.pdc.rx_fifo_size = PDC_SIM_FRAME_SIZE;
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	memset(command, 0x55, sizeof(command));
+	command[0] = 0x90;
+	command[1] = 0x3D;
+	command[4] = 0xFF;
+	frames = sim.pdc.frame_count;
+	TEST_EQUAL(iso14443_4_transceive(&sim.pdc, &picc, command,
+			sizeof(command), response, &size), STATUS_OK);
+	TEST_EQUAL(sim.pdc.frame_count - frames, 5);
+	TEST_EQUAL(size, 2);
+	TEST_EQUAL(m_card.chain_size, 0);
+
+	TEST_EQUAL(iso14443_4_deselect(&sim.pdc, &picc), STATUS_OK);
+}
+
+static void test_wtx(void) {
+	static pdc_sim_t sim;
+	picc_t picc;
+
+	init_card(FILE_SIZE);
+	pdc_sim_init(&sim, &m_card, 1);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	m_card.wtx = 3;
+	TEST_EQUAL(read_file(&sim.pdc, &picc), 19 * 4);
+	TEST_EQUAL(picc.iso14443_4.wtx, 19 * 3);
+}
+
+static void test_lossy(void) {
+	static pdc_sim_t sim;
+	picc_t picc;
+
+	init_card(FILE_SIZE);
+	pdc_sim_init(&sim, &m_card, 1);
+	for (unsigned int every = 3; every <= 7; every += 2) {
+		for (size_t fifo = 16; fifo <= 64; fifo *= 4) {
+			sim.pdc.rx_fifo_size = fifo;
+			TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+			m_transceive = sim.pdc.TransceiveData;
+			sim.pdc.TransceiveData = lossy_transceive;
+			m_lose_every = every;
+			m_frames = m_lost = 0;
+			read_file(&sim.pdc, &picc);
+			TEST_ASSERT(picc.iso14443_4.retransmissions > 0);
+			sim.pdc.TransceiveData = m_transceive;
+		}
+	}
+}
+
+static void test_rc52x_emu(void) {
+	static const uint8_t command[] = { 0x90, 0x60, 0x00, 0x00, 0x00 };
+	static rc52x_emu_t emu;
+	static rc52x_t rc52x;
+	uint8_t response[64];
+	size_t size = sizeof(response);
+	uint64_t start, elapsed_us;
+	picc_t picc;
+
+	init_card(FILE_SIZE);
+	rc52x_emu_init(&emu, 0x92, &m_card, 1);
+	memset(&rc52x, 0, sizeof(rc52x));
+	rc52x_emu_attach(&emu, &rc52x);
+	rc52x_init(&rc52x);
+	TEST_EQUAL(activate(&rc52x, &picc), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.fsd, 64);
+	TEST_EQUAL(read_file(&rc52x, &picc), 19);
+
+	m_card.wtx = 2;
+	TEST_EQUAL(read_file(&rc52x, &picc), 19 * 3);
+	m_card.wtx = 0;
+
+	// The PICC left the field: the command and two retries each wait the
+	// FWT of the ATS, not the default timeout of the driver
+	m_card.present = false;
+	start = rc52x_emu_time_ns();
+	TEST_EQUAL(iso14443_4_transceive(&rc52x, &picc, command, sizeof(command),
+			response, &size), STATUS_TIMEOUT);
+	elapsed_us = (rc52x_emu_time_ns() - start) / 1000;
+	TEST_ASSERT(elapsed_us >= 3 * picc.iso14443_4.fwt_us);
+	TEST_ASSERT(elapsed_us < 3 * (picc.iso14443_4.fwt_us
+					+ ISO14443_4_DELTA_FWT_us) + 5000);
+}
+
+static void test_pps(void) {
+	static const char *rates[] = { "106", "212", "424", "848" };
+	static const uint8_t command[] = { 0x90, 0x60, 0x00, 0x00, 0x00 };
+	static pdc_sim_t sim;
+	uint64_t air_time_ns[pdc_bitrate_848 + 1];
+	uint8_t response[64];
+	size_t size = sizeof(response);
+	picc_t picc;
+
+	init_card(LARGE_FILE_SIZE);
+	pdc_sim_init(&sim, &m_card, 1);
+	for (pdc_bitrate_t max = pdc_bitrate_106; max <= pdc_bitrate_848; max++) {
+		uint64_t start;
+
+		TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+		TEST_EQUAL(iso14443_4_pps(&sim.pdc, &picc, max), STATUS_OK);
+		TEST_EQUAL(picc.iso14443_4.dsi, max);
+		TEST_EQUAL(picc.iso14443_4.dri, max);
+		start = sim.air_time_ns;
+		TEST_EQUAL(read_file_size(&sim.pdc, &picc, LARGE_FILE_SIZE), 69);
+		air_time_ns[max] = sim.air_time_ns - start;
+		printf("%s kbps: %.1f ms air time for %d bytes\n", rates[max],
+				air_time_ns[max] / 1e6, LARGE_FILE_SIZE);
+		// Back to 106 kbps for the next activation
+		TEST_EQUAL(iso14443_4_deselect(&sim.pdc, &picc), STATUS_OK);
+	}
+	TEST_ASSERT(air_time_ns[pdc_bitrate_848] * 6 < air_time_ns[pdc_bitrate_106]);
+
+	// TA(1) with the same D required and DS up to 424 kbps
+	m_card.ats[2] = 0x80 | 0x20 | 0x02;
+	pdc_sim_field_reset(&sim);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(iso14443_4_pps(&sim.pdc, &picc, pdc_bitrate_848), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.dsi, pdc_bitrate_424);
+	TEST_EQUAL(picc.iso14443_4.dri, pdc_bitrate_424);
+	// Different D allowed, DS 424 and DR 212 kbps
+	m_card.ats[2] = 0x20 | 0x01;
+	pdc_sim_field_reset(&sim);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(iso14443_4_pps(&sim.pdc, &picc, pdc_bitrate_848), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.dsi, pdc_bitrate_424);
+	TEST_EQUAL(picc.iso14443_4.dri, pdc_bitrate_212);
+	// 106 kbps only, no PPS sent
+	m_card.ats[2] = 0x00;
+	pdc_sim_field_reset(&sim);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(iso14443_4_pps(&sim.pdc, &picc, pdc_bitrate_848), STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.dsi, pdc_bitrate_106);
+	m_card.ats[2] = 0x77;
+
+	// The PICC fell back to 106 kbps: the PCD gives up, deselects and
+	// returns to 106 kbps, then the PICC can be activated again
+	pdc_sim_field_reset(&sim);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(iso14443_4_pps(&sim.pdc, &picc, pdc_bitrate_848), STATUS_OK);
+	m_card.dsi = m_card.dri = pdc_bitrate_106;
+	TEST_ASSERT(iso14443_4_transceive(&sim.pdc, &picc, command,
+			sizeof(command), response, &size) != STATUS_OK);
+	TEST_EQUAL(picc.iso14443_4.fallbacks, 1);
+	TEST_EQUAL(sim.pdc.tx_bitrate, pdc_bitrate_106);
+	TEST_EQUAL(sim.pdc.rx_bitrate, pdc_bitrate_106);
+	pdc_sim_field_reset(&sim);
+	TEST_EQUAL(activate(&sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(read_file(&sim.pdc, &picc), 19);
+}
+
+int main(void) {
+	test_rats();
+	test_chaining();
+	test_wtx();
+	test_lossy();
+	test_rc52x_emu();
+	test_pps();
+
+	return test_result("test_iso14443_4");
+}
@@ -0,0 +1,119 @@
+/*
+ * test_iso14443b.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// ISO 14443-B on pdc_sim: the inventory with 1, 4 and 16 slots has to find
+// every PICC once, HLTB and WUPB, ATTRIB and a DESFire read over T=CL with
+// CRC_B, and a type A PICC that stays selected while type B is polled.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "iso14443b.h"
+#include "desfire.h"
+
+#define MAX_CARDS		(10)
+#define FILE_SIZE		(256)
+
+static pdc_sim_card_t m_cards[MAX_CARDS];
+static uint8_t m_file[FILE_SIZE];
+static pdc_sim_t m_sim;
+
+static void setup(int count) {
+	for (int i = 0; i < count; i++) {
+		pdc_sim_card_init(m_cards + i, pdc_sim_card_iso14443b, NULL, 0);
+		pdc_sim_desfire_add_application(m_cards + i, 1);
+		pdc_sim_desfire_add_file(m_cards + i, 1, 0, m_file, FILE_SIZE);
+	}
+	pdc_sim_init(&m_sim, m_cards, count);
+}
+
+static int found(const picc_t *piccs, size_t count) {
+	int matches = 0;
+	for (size_t i = 0; i < count; i++)
+		for (int j = 0; j < MAX_CARDS; j++)
+			if (!memcmp(piccs[i].uid, m_cards[j].uid, ISO14443B_PUPI_SIZE))
+				matches++;
+	return matches;
+}
+
+static void test_inventory(void) {
+	static picc_t piccs[MAX_CARDS];
+
+	for (int slots = 1; slots <= 16; slots *= 4) {
+		iso14443b_stats_t stats;
+		size_t count = MAX_CARDS;
+
+		setup(MAX_CARDS);
+		TEST_EQUAL(iso14443b_inventory(&m_sim.pdc, ISO14443B_AFI_ALL, slots,
+				piccs, &count, &stats), STATUS_OK);
+		TEST_EQUAL(count, MAX_CARDS);
+		TEST_EQUAL(found(piccs, count), MAX_CARDS);
+		TEST_ASSERT(stats.requests > 1);
+	}
+}
+
+static void test_read(void) {
+	picc_t picc;
+	desfire_t desfire;
+	uint8_t data[FILE_SIZE];
+	size_t size = sizeof(data);
+
+	setup(1);
+	memset(&picc, 0, sizeof(picc));
+	TEST_EQUAL(iso14443b_request(&m_sim.pdc, &picc, false, ISO14443B_AFI_ALL,
+			1, NULL), STATUS_OK);
+	TEST_EQUAL(picc.protocol, picc_protocol_iso14443b);
+	TEST_EQUAL(memcmp(picc.uid, m_cards[0].uid, ISO14443B_PUPI_SIZE), 0);
+
+	// A halted PICC answers WUPB only, activate sends WUPB and ATTRIB
+	TEST_EQUAL(iso14443b_halt(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(iso14443b_request(&m_sim.pdc, &picc, false, ISO14443B_AFI_ALL,
+			1, NULL), STATUS_TIMEOUT);
+	TEST_EQUAL(iso14443b_activate(&m_sim.pdc, &picc), STATUS_OK);
+
+	TEST_EQUAL(desfire_init(&desfire, &m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+	TEST_EQUAL(desfire_read_data(&desfire, 0, 0, FILE_SIZE, data, &size),
+			STATUS_OK);
+	TEST_EQUAL(size, FILE_SIZE);
+	TEST_EQUAL(memcmp(data, m_file, FILE_SIZE), 0);
+	TEST_EQUAL(iso14443_4_deselect(&m_sim.pdc, &picc), STATUS_OK);
+}
+
+static void test_mixed(void) {
+	picc_t a, b;
+	uint8_t data[16];
+
+	pdc_sim_card_init(m_cards + 0, pdc_sim_card_ntag213, NULL, 0);
+	pdc_sim_card_init(m_cards + 1, pdc_sim_card_iso14443b, NULL, 0);
+	pdc_sim_init(&m_sim, m_cards, 2);
+
+	memset(&a, 0, sizeof(a));
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &a), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, &a, 0), STATUS_OK);
+	memset(&b, 0, sizeof(b));
+	TEST_EQUAL(iso14443b_request(&m_sim.pdc, &b, false, ISO14443B_AFI_ALL, 1,
+			NULL), STATUS_OK);
+	TEST_EQUAL(m_sim.pdc.protocol, pdc_protocol_iso14443b);
+
+	// The field stayed on, the type A PICC is still selected
+	TEST_EQUAL(pdc_set_protocol(&m_sim.pdc, pdc_protocol_iso14443a),
+			STATUS_OK);
+	TEST_EQUAL(MIFARE_READ(&m_sim.pdc, &a, 3, data), STATUS_OK);
+	TEST_EQUAL(data[0], 0xE1);
+}
+
+int main(void) {
+	for (int i = 0; i < FILE_SIZE; i++)
+		m_file[i] = i;
+	test_inventory();
+	test_read();
+	test_mixed();
+
+	return test_result("test_iso14443b");
+}
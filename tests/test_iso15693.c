@@ -0,0 +1,122 @@
+/*
+ * test_iso15693.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// ISO 15693 on pdc_sim: the inventory with 1 and 16 slots has to find
+// every VICC once, full reads, WRITE SINGLE BLOCK, STAY QUIET, and the
+// switch back to ISO 14443-A by REQA.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "iso15693.h"
+
+#define MAX_CARDS		(60)
+#define SLIX_SIZE		(112)
+
+static pdc_sim_card_t m_cards[MAX_CARDS];
+static pdc_sim_t m_sim;
+
+static int found(const iso15693_vicc_t *viccs, size_t count, int card_count) {
+	int matches = 0;
+	for (size_t i = 0; i < count; i++)
+		for (int j = 0; j < card_count; j++)
+			if (!memcmp(viccs[i].uid, m_cards[j].uid, ISO15693_UID_SIZE))
+				matches++;
+	return matches;
+}
+
+static void test_inventory(void) {
+	static const int counts[] = { 1, 10, 30, 60 };
+	static iso15693_vicc_t viccs[MAX_CARDS];
+
+	for (size_t k = 0; k < sizeof(counts) / sizeof(counts[0]); k++) {
+		int n = counts[k];
+		for (int slots = 1; slots <= 16; slots += 15) {
+			iso15693_inventory_stats_t stats;
+			size_t count = MAX_CARDS;
+
+			for (int i = 0; i < n; i++)
+				pdc_sim_card_init(m_cards + i, pdc_sim_card_icode_slix, NULL,
+						0);
+			pdc_sim_init(&m_sim, m_cards, n);
+			TEST_EQUAL(iso15693_inventory(&m_sim.pdc, slots, viccs, &count,
+					&stats), STATUS_OK);
+			TEST_EQUAL(count, n);
+			TEST_EQUAL(found(viccs, count, n), n);
+			TEST_EQUAL(stats.overflows, 0);
+			TEST_EQUAL(stats.errors, 0);
+			if (n == 1)
+				TEST_EQUAL(stats.collisions, 0);
+
+			for (size_t i = 0; i < count; i++) {
+				uint8_t data[256];
+				size_t size = sizeof(data);
+				TEST_EQUAL(iso15693_read(&m_sim.pdc, viccs + i, data, &size),
+						STATUS_OK);
+				TEST_EQUAL(size, SLIX_SIZE);
+				TEST_EQUAL(viccs[i].block_size, 4);
+				TEST_EQUAL(viccs[i].block_count, SLIX_SIZE / 4);
+			}
+		}
+	}
+}
+
+static void test_no_room(void) {
+	iso15693_vicc_t viccs[4];
+	size_t count = 4;
+
+	for (int i = 0; i < 8; i++)
+		pdc_sim_card_init(m_cards + i, pdc_sim_card_icode_slix, NULL, 0);
+	pdc_sim_init(&m_sim, m_cards, 8);
+	TEST_EQUAL(iso15693_inventory(&m_sim.pdc, 16, viccs, &count, NULL),
+			STATUS_NO_ROOM);
+	TEST_EQUAL(count, 4);
+	TEST_EQUAL(found(viccs, count, 8), 4);
+}
+
+static void test_commands(void) {
+	static const uint8_t block[4] = { 1, 2, 3, 4 };
+	iso15693_vicc_t viccs[4];
+	uint8_t data[4];
+	size_t count = 4;
+	picc_t picc;
+
+	pdc_sim_card_init(m_cards + 0, pdc_sim_card_icode_slix, NULL, 0);
+	pdc_sim_card_init(m_cards + 1, pdc_sim_card_ntag213, NULL, 0);
+	pdc_sim_init(&m_sim, m_cards, 2);
+	TEST_EQUAL(iso15693_inventory(&m_sim.pdc, 16, viccs, &count, NULL),
+			STATUS_OK);
+	TEST_EQUAL(count, 1);
+
+	TEST_EQUAL(iso15693_write_single_block(&m_sim.pdc, viccs, 3, block),
+			STATUS_OK);
+	TEST_EQUAL(iso15693_read_single_block(&m_sim.pdc, viccs, 3, data),
+			STATUS_OK);
+	TEST_EQUAL(memcmp(data, block, sizeof(block)), 0);
+	TEST_EQUAL(memcmp(m_cards[0].memory + 12, block, sizeof(block)), 0);
+
+	// A quiet VICC does not answer the inventory
+	TEST_EQUAL(iso15693_stay_quiet(&m_sim.pdc, viccs), STATUS_OK);
+	count = 4;
+	TEST_EQUAL(iso15693_inventory(&m_sim.pdc, 16, viccs, &count, NULL),
+			STATUS_TIMEOUT);
+	TEST_EQUAL(count, 0);
+
+	// REQA switches back to ISO 14443-A
+	memset(&picc, 0, sizeof(picc));
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(m_sim.pdc.protocol, pdc_protocol_iso14443a);
+}
+
+int main(void) {
+	test_inventory();
+	test_no_room();
+	test_commands();
+
+	return test_result("test_iso15693");
+}
@@ -0,0 +1,191 @@
+/*
+ * test_iso7816_4.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// APDUs over T=CL against the DESFire PICC of pdc_sim: continued responses
+// with 91AF and 61xx streamed as one, extended APDUs from segments, a
+// receiver aborting the exchange, and a PICC that never stops continuing.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "iso7816_4.h"
+
+#define FILE_SIZE		(4000)
+
+static uint8_t m_file[FILE_SIZE];
+
+typedef struct {
+	size_t offset;
+	size_t limit;			// Abort beyond, 0 for no limit
+	unsigned int mismatches;
+	size_t largest;			// Largest piece passed at once
+} check_t;
+
+// Compares the streamed response with the file
+static int check(void *context, const uint8_t *data, size_t size) {
+	check_t *check = context;
+	if (check->limit && check->offset + size > check->limit)
+		return STATUS_NO_ROOM;
+	if (check->offset + size > sizeof(m_file)
+			|| memcmp(data, m_file + check->offset, size))
+		check->mismatches++;
+	check->offset += size;
+	if (size > check->largest)
+		check->largest = size;
+	return STATUS_OK;
+}
+
+static void activate(pdc_sim_t *sim, pdc_sim_card_t *card, picc_t *picc) {
+	static const uint8_t aid[] = { 0x01, 0x00, 0x00 };
+	static const iso14443_4_segment_t data = { aid, sizeof(aid) };
+	static const iso7816_4_command_t select = { .cla = 0x90, .ins = 0x5A,
+			.data = &data, .data_count = 1, .ne = ISO7816_4_NE_SHORT };
+	iso7816_4_response_t response;
+
+	pdc_sim_init(sim, card, 1);
+	memset(picc, 0, sizeof(*picc));
+	TEST_EQUAL(picc_reqa(&sim->pdc, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&sim->pdc, picc, 0), STATUS_OK);
+	TEST_EQUAL(iso14443_4_rats(&sim->pdc, picc), STATUS_OK);
+	TEST_EQUAL(iso7816_4_transceive(&sim->pdc, picc, &select, NULL, NULL,
+			&response), STATUS_OK);
+	TEST_EQUAL(response.sw, ISO7816_4_SW_DESFIRE_OK);
+}
+
+static void test_continuation(void) {
+	static const uint8_t read[] = { 0x00, 0x00, 0x00, 0x00, FILE_SIZE & 0xFF,
+			FILE_SIZE >> 8, 0x00 };
+	static const iso14443_4_segment_t data = { read, sizeof(read) };
+	static pdc_sim_card_t card;
+	static pdc_sim_t sim;
+	iso7816_4_command_t command = { .cla = 0x90, .ins = 0xBD, .data = &data,
+			.data_count = 1, .ne = ISO7816_4_NE_SHORT,
+			.flags = iso7816_4_continue_af };
+	iso7816_4_response_t response;
+	check_t result = { 0 };
+	picc_t picc;
+
+	for (size_t i = 0; i < sizeof(m_file); i++)
+		m_file[i] = i * 7 + 3;
+	pdc_sim_card_init(&card, pdc_sim_card_desfire, NULL, 0);
+	pdc_sim_desfire_add_application(&card, 1);
+	pdc_sim_desfire_add_file(&card, 1, 0, m_file, sizeof(m_file));
+	activate(&sim, &card, &picc);
+
+	// DESFire ReadData, continued with ADDITIONAL FRAME
+	TEST_EQUAL(iso7816_4_transceive(&sim.pdc, &picc, &command, check, &result,
+			&response), STATUS_OK);
+	TEST_EQUAL(response.sw, ISO7816_4_SW_DESFIRE_OK);
+	TEST_EQUAL(response.size, sizeof(m_file));
+	TEST_EQUAL(response.exchanges, 68);
+	TEST_EQUAL(result.offset, sizeof(m_file));
+	TEST_EQUAL(result.mismatches, 0);
+
+	// READ BINARY with an extended Le, continued with GET RESPONSE
+	command = (iso7816_4_command_t ) { .cla = 0x00, .ins = 0xB0,
+			.ne = FILE_SIZE, .flags = iso7816_4_get_response };
+	result = (check_t ) { 0 };
+	TEST_EQUAL(iso7816_4_transceive(&sim.pdc, &picc, &command, check, &result,
+			&response), STATUS_OK);
+	TEST_EQUAL(response.sw, ISO7816_4_SW_OK);
+	TEST_EQUAL(response.size, sizeof(m_file));
+	TEST_EQUAL(result.mismatches, 0);
+	// One frame of the block protocol buffered, no more
+	TEST_ASSERT(result.largest < ISO14443_4_MAX_FRAME);
+
+	// Without the flag, the 61xx is returned
+	command.flags = 0;
+	TEST_EQUAL(iso7816_4_transceive(&sim.pdc, &picc, &command, NULL, NULL,
+			&response), STATUS_OK);
+	TEST_EQUAL(response.sw >> 8, 0x61);
+	TEST_EQUAL(response.exchanges, 1);
+
+	// The receiver aborts
+	command.flags = iso7816_4_get_response;
+	result = (check_t ) { .limit = 1000 };
+	TEST_EQUAL(iso7816_4_transceive(&sim.pdc, &picc, &command, check, &result,
+			&response), STATUS_NO_ROOM);
+	TEST_EQUAL(result.offset, 1000);
+}
+
+static void test_segments(void) {
+	static pdc_sim_card_t card;
+	static pdc_sim_t sim;
+	static uint8_t a[300], b[400], c[200];
+	const iso14443_4_segment_t data[] = { { a, sizeof(a) }, { b, sizeof(b) },
+			{ c, sizeof(c) } };
+	iso7816_4_command_t command = { .cla = 0x00, .ins = 0xD6, .p2 = 100,
+			.data = data, .data_count = 3 };
+	iso7816_4_response_t response;
+	check_t result = { 0 };
+	picc_t picc;
+
+	pdc_sim_card_init(&card, pdc_sim_card_desfire, NULL, 0);
+	pdc_sim_desfire_add_application(&card, 1);
+	pdc_sim_desfire_add_file(&card, 1, 0, m_file, sizeof(m_file));
+	activate(&sim, &card, &picc);
+
+	// UPDATE BINARY of 900 bytes, an extended APDU from three segments
+	for (size_t i = 0; i < sizeof(a) + sizeof(b) + sizeof(c); i++)
+		m_file[100 + i] ^= 0x5A;
+	memcpy(a, m_file + 100, sizeof(a));
+	memcpy(b, m_file + 100 + sizeof(a), sizeof(b));
+	memcpy(c, m_file + 100 + sizeof(a) + sizeof(b), sizeof(c));
+	TEST_EQUAL(iso7816_4_transceive(&sim.pdc, &picc, &command, NULL, NULL,
+			&response), STATUS_OK);
+	TEST_EQUAL(response.sw, ISO7816_4_SW_OK);
+
+	command = (iso7816_4_command_t ) { .cla = 0x00, .ins = 0xB0,
+			.ne = FILE_SIZE, .flags = iso7816_4_get_response };
+	TEST_EQUAL(iso7816_4_transceive(&sim.pdc, &picc, &command, check, &result,
+			&response), STATUS_OK);
+	TEST_EQUAL(response.size, sizeof(m_file));
+	TEST_EQUAL(result.mismatches, 0);
+}
+
+// A PICC answering every I-block with 91AF
+static int endless_transceive(void *pdc, void *sendData, size_t sendLen,
+		void *backData, size_t *backLen, uint8_t *validBits, uint8_t rxAlign,
+		uint8_t *collisionPos, bool sendCRC, bool recvCRC) {
+	const uint8_t *send = sendData;
+	uint8_t *back = backData;
+
+	back[0] = send[0];
+	back[1] = 0x91;
+	back[2] = 0xAF;
+	*backLen = 3;
+	((bs_pdc_t*) pdc)->frame_count++;
+	return STATUS_OK;
+}
+
+static void test_endless(void) {
+	iso7816_4_command_t command = { .cla = 0x90, .ins = 0xBD,
+			.ne = ISO7816_4_NE_SHORT, .flags = iso7816_4_continue_af };
+	iso7816_4_response_t response;
+	bs_pdc_t pdc = { 0 };
+	picc_t picc = { 0 };
+
+	pdc.TransceiveData = endless_transceive;
+	pdc.rx_fifo_size = 64;
+	picc.iso14443_4.fsc = 64;
+	picc.iso14443_4.fwt_us = ISO14443_4_FWT_us(ISO14443_4_DEFAULT_FWI);
+	iso14443_4_begin(&picc, iso14443_4_fsdi(&pdc));
+
+	TEST_EQUAL(iso7816_4_transceive(&pdc, &picc, &command, NULL, NULL,
+			&response), STATUS_ERROR);
+	TEST_EQUAL(response.exchanges, ISO7816_4_MAX_EXCHANGES);
+	TEST_EQUAL(response.sw, ISO7816_4_SW_DESFIRE_AF);
+}
+
+int main(void) {
+	test_continuation();
+	test_segments();
+	test_endless();
+
+	return test_result("test_iso7816_4");
+}
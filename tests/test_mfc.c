@@ -0,0 +1,316 @@
+/*
+ * test_mfc.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// MIFARE Classic sessions with Crypto1 on the host and in the reader IC,
+// on pdc_sim and on the rc52x emulator: authentication, data and value
+// blocks, nested authentication and a wrong key. Then the session cache on
+// pdc_sim: authentications skipped, the sector order of the block lists,
+// dumps with a rejected key, and the end of the session by HLTA, REQA and
+// the field.
+
+#include <string.h>
+
+#include "test.h"
+#include "rc52x_emu.h"
+#include "mfc.h"
+
+static const uint8_t m_key[MFC_KEY_SIZE] = { 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF };
+
+static void activate(bs_pdc_t *pdc, picc_t *picc, mfc_t *mfc,
+		bool software) {
+	uint8_t atqa[2];
+	size_t size = sizeof(atqa);
+
+	// WUPA, the PICC may be halted
+	memset(picc, 0, sizeof(*picc));
+	PICC_REQA_or_WUPA(pdc, PICC_CMD_WUPA, atqa, &size);
+	TEST_EQUAL(PICC_Select(pdc, picc, 0), STATUS_OK);
+	TEST_EQUAL(mfc_init(mfc, pdc, picc, software), STATUS_OK);
+	TEST_EQUAL(mfc->software, software);
+}
+
+static void session(bs_pdc_t *pdc, bool software) {
+	static const uint8_t bad_key[MFC_KEY_SIZE] = { 1, 2, 3, 4, 5, 6 };
+	uint8_t data[MFC_BLOCK_SIZE], block[MFC_BLOCK_SIZE];
+	int32_t value;
+	picc_t picc;
+	mfc_t mfc;
+
+	for (int i = 0; i < MFC_BLOCK_SIZE; i++)
+		block[i] = i * 7;
+
+	activate(pdc, &picc, &mfc, software);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 4, m_key), STATUS_OK);
+
+	// Sector trailer: key A reads as zeroes, transport access bits
+	TEST_EQUAL(mfc_read(&mfc, 7, data), STATUS_OK);
+	TEST_EQUAL(data[0], 0x00);
+	TEST_EQUAL(data[6], 0xFF);
+	TEST_EQUAL(data[7], 0x07);
+	TEST_EQUAL(data[8], 0x80);
+
+	TEST_EQUAL(mfc_write(&mfc, 5, block), STATUS_OK);
+	TEST_EQUAL(mfc_read(&mfc, 5, data), STATUS_OK);
+	TEST_EQUAL(memcmp(data, block, sizeof(block)), 0);
+
+	TEST_EQUAL(mfc_set_value(&mfc, 6, 100), STATUS_OK);
+	TEST_EQUAL(mfc_increment(&mfc, 6, 23), STATUS_OK);
+	TEST_EQUAL(mfc_transfer(&mfc, 6), STATUS_OK);
+	TEST_EQUAL(mfc_get_value(&mfc, 6, &value), STATUS_OK);
+	TEST_EQUAL(value, 123);
+	TEST_EQUAL(mfc_decrement(&mfc, 6, 3), STATUS_OK);
+	TEST_EQUAL(mfc_transfer(&mfc, 6), STATUS_OK);
+	TEST_EQUAL(mfc_get_value(&mfc, 6, &value), STATUS_OK);
+	TEST_EQUAL(value, 120);
+	TEST_EQUAL(mfc_restore(&mfc, 6), STATUS_OK);
+	TEST_EQUAL(mfc_transfer(&mfc, 5), STATUS_OK);
+	TEST_EQUAL(mfc_get_value(&mfc, 5, &value), STATUS_OK);
+	TEST_EQUAL(value, 120);
+	// Block 5 no longer holds a value after a plain write
+	TEST_EQUAL(mfc_write(&mfc, 5, block), STATUS_OK);
+	TEST_EQUAL(mfc_get_value(&mfc, 5, &value), STATUS_INVALID);
+
+	// Nested authentication to another sector, with key B
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_b, 9, m_key), STATUS_OK);
+	TEST_EQUAL(mfc_read(&mfc, 9, data), STATUS_OK);
+	TEST_EQUAL(mfc_halt(&mfc), STATUS_OK);
+
+	// A sector that is not authenticated is refused
+	activate(pdc, &picc, &mfc, software);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 4, m_key), STATUS_OK);
+	TEST_EQUAL(mfc_read(&mfc, 9, data), STATUS_MIFARE_NACK);
+
+	activate(pdc, &picc, &mfc, software);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 4, bad_key), STATUS_AUTH_ERROR);
+	mfc_stop(&mfc);
+}
+
+static void test_pdc_sim(void) {
+	static pdc_sim_card_t card;
+	static pdc_sim_t sim;
+	unsigned int frames;
+	picc_t picc;
+	mfc_t mfc;
+
+	pdc_sim_card_init(&card, pdc_sim_card_mfc_1k, NULL, 0);
+	pdc_sim_init(&sim, &card, 1);
+	session(&sim.pdc, true);
+	session(&sim.pdc, false);
+
+	// Nested authentication on the host takes 2 frames: AUTH with {nT},
+	// {nR} {aR} with {aT}. Through the Crypto1 unit it takes 4.
+	for (int software = 1; software >= 0; software--) {
+		activate(&sim.pdc, &picc, &mfc, software);
+		TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 0, m_key), STATUS_OK);
+		frames = sim.pdc.frame_count;
+		TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 4, m_key), STATUS_OK);
+		TEST_EQUAL(sim.pdc.frame_count - frames, software ? 2 : 4);
+		mfc_halt(&mfc);
+	}
+}
+
+static pdc_sim_card_t m_card;
+static pdc_sim_t m_sim;
+static mfc_key_t m_keys[MFC_MAX_SECTORS];
+
+static void init_sim(pdc_sim_card_type_t type) {
+	pdc_sim_card_init(&m_card, type, NULL, 0);
+	pdc_sim_init(&m_sim, &m_card, 1);
+	for (int i = 0; i < MFC_MAX_SECTORS; i++) {
+		m_keys[i].key_type = mfc_key_a;
+		memcpy(m_keys[i].key, m_key, MFC_KEY_SIZE);
+	}
+}
+
+static void test_auth_cache(void) {
+	picc_t picc;
+	mfc_t mfc;
+
+	init_sim(pdc_sim_card_mfc_1k);
+	activate(&m_sim.pdc, &picc, &mfc, true);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 4, m_key), STATUS_OK);
+	// Same sector and key: nothing is sent
+	unsigned int frames = m_sim.pdc.frame_count;
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 6, m_key), STATUS_OK);
+	TEST_EQUAL(m_sim.pdc.frame_count, frames);
+	TEST_EQUAL(mfc.stats.auth_count, 1);
+	TEST_EQUAL(mfc.stats.auth_skipped, 1);
+	// The other key of the sector is an authentication
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_b, 5, m_key), STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 2);
+	TEST_EQUAL(mfc.stats.auth_skipped, 1);
+
+	// HLTA ends the session
+	TEST_ASSERT(mfc_is_authenticated(&mfc));
+	TEST_EQUAL(PICC_HaltA(&m_sim.pdc), STATUS_OK);
+	TEST_ASSERT(!mfc_is_authenticated(&mfc));
+	TEST_EQUAL(mfc_reselect(&mfc), STATUS_OK);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_b, 5, m_key), STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 3);
+
+	// So does a REQA, the ACTIVE PICC returns to IDLE
+	picc_t other;
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &other), STATUS_TIMEOUT);
+	TEST_ASSERT(!mfc_is_authenticated(&mfc));
+	TEST_EQUAL(mfc_reselect(&mfc), STATUS_OK);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_b, 5, m_key), STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 4);
+
+	// And the field
+	TEST_EQUAL(m_sim.pdc.SetField(&m_sim.pdc, false), STATUS_OK);
+	TEST_ASSERT(!mfc_is_authenticated(&mfc));
+	TEST_EQUAL(m_sim.pdc.SetField(&m_sim.pdc, true), STATUS_OK);
+	TEST_EQUAL(mfc_reselect(&mfc), STATUS_OK);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_b, 5, m_key), STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 5);
+	TEST_EQUAL(mfc.stats.auth_skipped, 1);
+	TEST_EQUAL(mfc.stats.auth_failed, 0);
+	mfc_halt(&mfc);
+}
+
+static void test_blocks(void) {
+	// Sectors 2, 1, 2, 1, 0, 2
+	static const uint8_t blocks[] = { 9, 4, 10, 5, 1, 8 };
+	static const uint8_t writes[] = { 6, 2, 5, 1 };
+	uint8_t data[sizeof(blocks)][MFC_BLOCK_SIZE];
+	uint8_t back[sizeof(blocks)][MFC_BLOCK_SIZE];
+	picc_t picc;
+	mfc_t mfc;
+
+	init_sim(pdc_sim_card_mfc_1k);
+	for (size_t i = 0; i < sizeof(blocks); i++)
+		memset(data[i], blocks[i], MFC_BLOCK_SIZE);
+
+	// Sector 2 is authenticated, it goes first, then sector 0 and 1: one
+	// authentication per sector, the other blocks skip it
+	activate(&m_sim.pdc, &picc, &mfc, true);
+	TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 8, m_key), STATUS_OK);
+	TEST_EQUAL(mfc_write_blocks(&mfc, m_keys, blocks, sizeof(blocks),
+			data[0]), STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 3);
+	TEST_EQUAL(mfc.stats.auth_skipped, 4);
+	TEST_EQUAL(mfc.sector, 1);
+	for (size_t i = 0; i < sizeof(blocks); i++)
+		TEST_EQUAL(memcmp(m_card.memory + MFC_BLOCK_SIZE * blocks[i], data[i],
+				MFC_BLOCK_SIZE), 0);
+
+	// Sector 1 is authenticated now, the data is stored in list order
+	TEST_EQUAL(mfc_read_blocks(&mfc, m_keys, blocks, sizeof(blocks), back[0]),
+			STATUS_OK);
+	TEST_EQUAL(memcmp(back, data, sizeof(data)), 0);
+	TEST_EQUAL(mfc.stats.auth_count, 5);
+	TEST_EQUAL(mfc.stats.auth_skipped, 8);
+	TEST_EQUAL(mfc.sector, 2);
+
+	TEST_EQUAL(mfc_write_blocks(&mfc, m_keys, writes, sizeof(writes),
+			data[0]), STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 7);
+	TEST_EQUAL(mfc.sector, 1);
+	for (size_t i = 0; i < sizeof(writes); i++)
+		TEST_EQUAL(memcmp(m_card.memory + MFC_BLOCK_SIZE * writes[i], data[i],
+				MFC_BLOCK_SIZE), 0);
+
+	// Sector 3 has another key, the list stops there
+	m_card.memory[MFC_BLOCK_SIZE * 15] ^= 1;
+	static const uint8_t rejected[] = { 12, 1 };
+	TEST_EQUAL(mfc_read_blocks(&mfc, m_keys, rejected, sizeof(rejected),
+			back[0]), STATUS_AUTH_ERROR);
+	TEST_EQUAL(mfc.stats.auth_failed, 1);
+	mfc_reselect(&mfc);
+	mfc_halt(&mfc);
+}
+
+// Compares the blocks of the sectors read with the card, the keys of the
+// trailers read as zeroes
+static bool dumped(const uint8_t *data, int sectors, uint64_t sectors_read) {
+	for (int sector = 0; sector < sectors; sector++) {
+		uint8_t first = mfc_sector_block(sector);
+		int count = mfc_sector_size(sector);
+		const uint8_t *block = data + MFC_BLOCK_SIZE * first;
+		if (!(sectors_read >> sector & 1)) {
+			for (int i = 0; i < MFC_BLOCK_SIZE * count; i++)
+				if (block[i])
+					return false;
+			continue;
+		}
+		if (memcmp(block, m_card.memory + MFC_BLOCK_SIZE * first,
+				MFC_BLOCK_SIZE * (count - 1)))
+			return false;
+		if (memcmp(block + MFC_BLOCK_SIZE * (count - 1) + 6,
+				m_card.memory + MFC_BLOCK_SIZE * (first + count - 1) + 6, 4))
+			return false;
+	}
+	return true;
+}
+
+static void test_dump(void) {
+	static uint8_t data[MFC_MAX_BLOCKS * MFC_BLOCK_SIZE];
+	uint64_t sectors_read;
+	picc_t picc;
+	mfc_t mfc;
+
+	// One authentication per sector: 16 for a 1K, 40 for a 4K
+	init_sim(pdc_sim_card_mfc_1k);
+	activate(&m_sim.pdc, &picc, &mfc, true);
+	TEST_EQUAL(mfc_dump(&mfc, m_keys, data, sizeof(data), &sectors_read),
+			STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 16);
+	TEST_EQUAL(mfc.stats.blocks_read, 64);
+	TEST_EQUAL(sectors_read, 0xFFFF);
+	TEST_ASSERT(dumped(data, 16, sectors_read));
+	TEST_EQUAL(mfc_dump(&mfc, m_keys, data, 64 * MFC_BLOCK_SIZE - 1, NULL),
+			STATUS_NO_ROOM);
+	mfc_halt(&mfc);
+
+	init_sim(pdc_sim_card_mfc_4k);
+	activate(&m_sim.pdc, &picc, &mfc, false);
+	TEST_EQUAL(mfc_dump(&mfc, m_keys, data, sizeof(data), &sectors_read),
+			STATUS_OK);
+	TEST_EQUAL(mfc.stats.auth_count, 40);
+	TEST_EQUAL(mfc.stats.blocks_read, 256);
+	TEST_EQUAL(sectors_read, (1ull << 40) - 1);
+	TEST_ASSERT(dumped(data, 40, sectors_read));
+	mfc_halt(&mfc);
+
+	// Key A of sector 3 and 35 differs: both are left zero, the PICC is
+	// selected again and the dump continues
+	m_card.memory[MFC_BLOCK_SIZE * 15] ^= 1;
+	m_card.memory[MFC_BLOCK_SIZE * (mfc_sector_block(35) + 15)] ^= 1;
+	activate(&m_sim.pdc, &picc, &mfc, true);
+	TEST_EQUAL(mfc_dump(&mfc, m_keys, data, sizeof(data), &sectors_read),
+			STATUS_AUTH_ERROR);
+	TEST_EQUAL(mfc.stats.auth_count, 40);
+	TEST_EQUAL(mfc.stats.auth_failed, 2);
+	TEST_EQUAL(sectors_read, ((1ull << 40) - 1) & ~(1ull << 3 | 1ull << 35));
+	TEST_ASSERT(dumped(data, 40, sectors_read));
+	mfc_halt(&mfc);
+}
+
+static void test_rc52x_emu(void) {
+	static pdc_sim_card_t card;
+	static rc52x_emu_t emu;
+	static rc52x_t rc52x;
+
+	pdc_sim_card_init(&card, pdc_sim_card_mfc_4k, NULL, 1);
+	rc52x_emu_init(&emu, 0x92, &card, 1);
+	memset(&rc52x, 0, sizeof(rc52x));
+	rc52x_emu_attach(&emu, &rc52x);
+	rc52x_init(&rc52x);
+	session(&rc52x, true);
+	session(&rc52x, false);
+}
+
+int main(void) {
+	test_pdc_sim();
+	test_auth_cache();
+	test_blocks();
+	test_dump();
+	test_rc52x_emu();
+
+	return test_result("test_mfc");
+}
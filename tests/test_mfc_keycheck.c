@@ -0,0 +1,170 @@
+/*
+ * test_mfc_keycheck.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Offline key check: nested traces captured from pdc_sim and the published
+// mfkey64 trace, searched in a dictionary with the bit-sliced cipher, which
+// has to agree with the scalar check.
+//
+// Built again as test_mfc_keycheck_pthread, with MFC_KEYCHECK_PTHREAD. Then
+// every search runs with 2 to THREADS threads as well, which have to
+// return what a single thread returns: the lowest matching key.
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "mfc_keycheck.h"
+
+#define KEYS			(100000)
+#define KEY_POSITION	(KEYS * 7 / 10)
+
+#ifdef MFC_KEYCHECK_PTHREAD
+#define THREADS			(8)
+#else
+#define THREADS			(1)
+#endif
+
+static const uint8_t m_default_key[MFC_KEY_SIZE] = { 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF };
+static const uint8_t m_secret_key[MFC_KEY_SIZE] = { 0x4D, 0x3A, 0x99, 0xC3,
+		0x51, 0xDD };
+static uint8_t m_keys[KEYS][MFC_KEY_SIZE];
+
+static void capture(mfc_trace_t *traces, size_t count) {
+	static pdc_sim_card_t card;
+	static pdc_sim_t sim;
+
+	// Key A of sector 5 differs from the default key
+	pdc_sim_card_init(&card, pdc_sim_card_mfc_1k, NULL, 3);
+	memcpy(card.memory + 16 * (4 * 5 + 3), m_secret_key, MFC_KEY_SIZE);
+	pdc_sim_init(&sim, &card, 1);
+
+	for (size_t i = 0; i < count; i++) {
+		picc_t picc = { 0 };
+		mfc_t mfc;
+
+		pdc_sim_field_reset(&sim);
+		TEST_EQUAL(picc_reqa(&sim.pdc, &picc), STATUS_OK);
+		TEST_EQUAL(PICC_Select(&sim.pdc, &picc, 0), STATUS_OK);
+		TEST_EQUAL(mfc_init(&mfc, &sim.pdc, &picc, true), STATUS_OK);
+		TEST_EQUAL(mfc_auth(&mfc, mfc_key_a, 0, m_default_key), STATUS_OK);
+		TEST_EQUAL(mfc_capture_nested(&mfc, mfc_key_a, 20, traces + i),
+				STATUS_OK);
+		TEST_EQUAL(traces[i].type, mfc_trace_nested);
+	}
+}
+
+static int keycheck(const mfc_trace_t *traces, size_t trace_count,
+		size_t *index, mfc_keycheck_stats_t *stats) {
+	int result = mfc_keycheck(traces, trace_count, m_keys, KEYS, 1, index,
+			stats);
+	TEST_EQUAL(stats->threads, 1);
+
+	for (unsigned int threads = 2; threads <= THREADS; threads *= 2) {
+		mfc_keycheck_stats_t mt_stats;
+		size_t mt_index = KEYS;
+
+		TEST_EQUAL(mfc_keycheck(traces, trace_count, m_keys, KEYS, threads,
+				&mt_index, &mt_stats), result);
+		TEST_EQUAL(mt_stats.threads, threads);
+		if (result == STATUS_OK)
+			TEST_EQUAL(mt_index, *index);
+		else
+			TEST_EQUAL(mt_stats.keys_tested, KEYS);
+	}
+	return result;
+}
+
+static void init_keys(void) {
+	srand(1);
+	for (size_t i = 0; i < KEYS; i++)
+		for (int j = 0; j < MFC_KEY_SIZE; j++)
+			m_keys[i][j] = rand();
+}
+
+static void test_nested(void) {
+	mfc_trace_t traces[2];
+	mfc_keycheck_stats_t stats;
+	size_t index, first = KEYS, passes = 0;
+
+	capture(traces, 2);
+	TEST_ASSERT(mfc_trace_check(traces, m_secret_key));
+	TEST_ASSERT(mfc_trace_check(traces + 1, m_secret_key));
+	TEST_ASSERT(!mfc_trace_check(traces, m_default_key));
+
+	// One nested trace leaves false positives, the bit-sliced check has to
+	// return the first key the scalar check accepts
+	init_keys();
+	for (size_t i = 0; i < KEYS; i++)
+		if (mfc_trace_check(traces, m_keys[i]) && !passes++)
+			first = i;
+	TEST_EQUAL(keycheck(traces, 1, &index, &stats),
+			passes ? STATUS_OK : STATUS_ERROR);
+	if (passes)
+		TEST_EQUAL(index, first);
+	TEST_ASSERT(stats.candidates >= passes);
+
+	// Two traces leave the key
+	memcpy(m_keys[KEY_POSITION], m_secret_key, MFC_KEY_SIZE);
+	TEST_EQUAL(keycheck(traces, 2, &index, &stats),
+			STATUS_OK);
+	TEST_EQUAL(index, KEY_POSITION);
+
+	// The key a few times, in other chunks of the dictionary: the lowest
+	// one has to be returned, whichever thread finds one first
+	memcpy(m_keys[KEYS - 1], m_secret_key, MFC_KEY_SIZE);
+	memcpy(m_keys[KEY_POSITION - 3 * MFC_KEYCHECK_CHUNK + 5], m_secret_key,
+			MFC_KEY_SIZE);
+	TEST_EQUAL(keycheck(traces, 2, &index, &stats), STATUS_OK);
+	TEST_EQUAL(index, KEY_POSITION - 3 * MFC_KEYCHECK_CHUNK + 5);
+
+	m_keys[KEY_POSITION][0] ^= 1;
+	m_keys[KEYS - 1][0] ^= 1;
+	m_keys[KEY_POSITION - 3 * MFC_KEYCHECK_CHUNK + 5][0] ^= 1;
+	TEST_EQUAL(keycheck(traces, 2, &index, &stats),
+			STATUS_ERROR);
+	TEST_EQUAL(stats.keys_tested, KEYS);
+}
+
+static void test_auth(void) {
+	mfc_trace_t trace = { 0 };
+	mfc_keycheck_stats_t stats;
+	size_t index;
+
+	// Published mfkey64 example, key FFFFFFFFFFFF
+	trace.type = mfc_trace_auth;
+	trace.uid = 0x9c599b32;
+	trace.nt = 0x82a4166c;
+	trace.nr = 0xa1e458ce;
+	trace.ar = 0x6eea41e0;
+	trace.at = 0x5cadf439;
+	trace.has_at = true;
+	TEST_ASSERT(mfc_trace_check(&trace, m_default_key));
+
+	init_keys();
+	memcpy(m_keys[KEY_POSITION], m_default_key, MFC_KEY_SIZE);
+	TEST_EQUAL(keycheck(&trace, 1, &index, &stats),
+			STATUS_OK);
+	TEST_EQUAL(index, KEY_POSITION);
+	// 64 bits to check, no false positives in the dictionary
+	TEST_EQUAL(stats.candidates, 1);
+
+	TEST_EQUAL(mfc_keycheck(&trace, 0, m_keys, KEYS, 1, &index, &stats),
+			STATUS_INVALID);
+}
+
+int main(void) {
+	test_nested();
+	test_auth();
+
+#ifdef MFC_KEYCHECK_PTHREAD
+	return test_result("test_mfc_keycheck_pthread");
+#else
+	return test_result("test_mfc_keycheck");
+#endif
+}
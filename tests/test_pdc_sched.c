@@ -0,0 +1,182 @@
+/*
+ * test_pdc_sched.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Poll scheduler on pdc_sim: two buses with two readers each, with one,
+// two, three and no PICCs in their fields. Every PICC has to arrive once,
+// also when several PICCs answer the WUPA of a poll, and has to leave once
+// it is taken out of the field.
+//
+// Built twice: stepped from this thread, and with PDC_SCHED_PTHREAD by one
+// worker thread per bus. The readers of a bus are only accessed by its
+// worker, the results are checked after pdc_sched_stop().
+
+#include <string.h>
+#include <time.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "pdc_sched.h"
+
+#define BUSES				(2)
+#define READERS_PER_BUS		(2)
+#define READERS				(BUSES * READERS_PER_BUS)
+#define CARDS_PER_READER	(3)
+#define MIN_POLLS			(20)
+
+static pdc_sim_card_t m_cards[READERS][CARDS_PER_READER];
+static const int m_card_count[READERS] = { 1, 2, 3, 0 };
+static pdc_sim_t m_sims[READERS];
+static pdc_sched_reader_t m_readers[READERS];
+static pdc_sched_bus_t m_buses[BUSES];
+static pdc_sched_t m_sched;
+
+// Written by the event callback, every reader is served by one thread only
+static int m_arrived[READERS];
+static int m_left[READERS];
+
+#ifdef PDC_SCHED_PTHREAD
+static int clock_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+#else
+// The readers share the bus, the time is the air time of all of them
+static int clock_ms(void) {
+	uint64_t air_time_ns = 0;
+	for (int i = 0; i < READERS; i++)
+		air_time_ns += m_sims[i].air_time_ns;
+	return air_time_ns / 1000000;
+}
+#endif
+
+static void event(void *context, int reader_id, pdc_sched_event_t event,
+		const picc_t *picc) {
+	if (event == pdc_sched_event_arrived)
+		m_arrived[reader_id]++;
+	else
+		m_left[reader_id]++;
+}
+
+static void init(void) {
+	for (int i = 0; i < READERS; i++) {
+		// A 4 byte MIFARE Classic UID, a 7 byte NTAG UID and a 10 byte UID
+		for (int j = 0; j < m_card_count[i]; j++)
+			pdc_sim_card_init(&m_cards[i][j],
+					j == 0 ? pdc_sim_card_mfc_1k : pdc_sim_card_ntag213, NULL,
+					j == 2 ? 10 : 0);
+		pdc_sim_init(m_sims + i, m_cards[i], m_card_count[i]);
+		m_sims[i].pdc.get_time_ms = clock_ms;
+		pdc_sched_reader_init(m_readers + i, &m_sims[i].pdc, i);
+	}
+	for (int i = 0; i < BUSES; i++)
+		pdc_sched_bus_init(m_buses + i, m_readers + i * READERS_PER_BUS,
+				READERS_PER_BUS);
+	pdc_sched_init(&m_sched, m_buses, BUSES, event, NULL);
+}
+
+static unsigned int min_polls(void) {
+	unsigned int polls = m_readers[0].stats.polls;
+	for (int i = 1; i < READERS; i++)
+		if (m_readers[i].stats.polls < polls)
+			polls = m_readers[i].stats.polls;
+	return polls;
+}
+
+// Runs until every reader did at least MIN_POLLS more polls
+static void run(void) {
+	unsigned int polls = min_polls() + MIN_POLLS;
+	while (min_polls() < polls) {
+#ifdef PDC_SCHED_PTHREAD
+		struct timespec ts = { .tv_nsec = 5000000 };
+		TEST_EQUAL(pdc_sched_start(&m_sched), STATUS_OK);
+		nanosleep(&ts, NULL);
+		pdc_sched_stop(&m_sched);
+#else
+		pdc_sched_step(&m_sched);
+#endif
+	}
+}
+
+static bool tracked(int reader, const pdc_sim_card_t *card) {
+	for (int i = 0; i < m_readers[reader].picc_count; i++) {
+		const picc_t *picc = m_readers[reader].piccs + i;
+		if (picc->uid_size == card->uid_size
+				&& !memcmp(picc->uid, card->uid, card->uid_size))
+			return true;
+	}
+	return false;
+}
+
+// A PICC entering the field powers up in IDLE
+static void enter(pdc_sim_card_t *card) {
+	card->state = pdc_sim_state_idle;
+	card->from_halt = false;
+	card->present = true;
+}
+
+static void test_arrive(void) {
+	run();
+	for (int i = 0; i < READERS; i++) {
+		TEST_EQUAL(m_arrived[i], m_card_count[i]);
+		TEST_EQUAL(m_left[i], 0);
+		TEST_EQUAL(m_readers[i].picc_count, m_card_count[i]);
+		for (int j = 0; j < m_card_count[i]; j++)
+			TEST_ASSERT(tracked(i, &m_cards[i][j]));
+		TEST_EQUAL(m_readers[i].stats.errors, 0);
+	}
+}
+
+static void test_leave(void) {
+	// One of the two PICCs, and the single PICC
+	m_cards[1][0].present = false;
+	m_cards[0][0].present = false;
+	run();
+	TEST_EQUAL(m_left[1], 1);
+	TEST_EQUAL(m_left[0], 1);
+	TEST_EQUAL(m_readers[1].picc_count, 1);
+	TEST_ASSERT(tracked(1, &m_cards[1][1]));
+	TEST_EQUAL(m_readers[0].picc_count, 0);
+	TEST_EQUAL(m_arrived[1], 2);
+	TEST_EQUAL(m_left[2], 0);
+
+	// Back in the field, they arrive again
+	enter(&m_cards[1][0]);
+	enter(&m_cards[0][0]);
+	run();
+	TEST_EQUAL(m_arrived[1], 3);
+	TEST_EQUAL(m_arrived[0], 2);
+	TEST_EQUAL(m_readers[1].picc_count, 2);
+	TEST_EQUAL(m_left[1], 1);
+}
+
+static void test_stats(void) {
+	for (int i = 0; i < READERS; i++) {
+		pdc_sched_reader_t *reader = m_readers + i;
+		unsigned int p50 = pdc_sched_latency_percentile(reader, 50);
+		unsigned int p99 = pdc_sched_latency_percentile(reader, 99);
+		TEST_ASSERT(reader->stats.polls >= 3 * MIN_POLLS);
+		TEST_ASSERT(reader->stats.frames >= reader->stats.polls);
+		TEST_ASSERT(p50 <= p99);
+		TEST_ASSERT(p99 <= pdc_sched_latency_percentile(reader, 100));
+		TEST_ASSERT(p99 < PDC_SCHED_LATENCY_BUCKETS);
+		TEST_ASSERT(pdc_sched_poll_rate(reader) > 0);
+	}
+}
+
+int main(void) {
+	init();
+	test_arrive();
+	test_leave();
+	test_stats();
+
+#ifdef PDC_SCHED_PTHREAD
+	return test_result("test_pdc_sched_pthread");
+#else
+	return test_result("test_pdc_sched");
+#endif
+}
@@ -0,0 +1,220 @@
+/*
+ * test_pdc_sim.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// Regression test of the software PCD and its virtual PICCs: activation,
+// NTAG, MIFARE Classic, the DESFire over T=CL and the ISO 14443-3 state
+// machine.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "iso14443_4.h"
+
+static pdc_sim_t m_sim;
+
+static void activate(pdc_sim_card_t *card, picc_t *picc) {
+	pdc_sim_init(&m_sim, card, 1);
+	memset(picc, 0, sizeof(*picc));
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, picc, 0), STATUS_OK);
+	TEST_EQUAL(picc->uid_size, card->uid_size);
+	TEST_EQUAL(memcmp(picc->uid, card->uid, card->uid_size), 0);
+}
+
+static void test_ntag(void) {
+	static pdc_sim_card_t card;
+	picc_t picc;
+	uint8_t data[16];
+	uint8_t page[4] = { 1, 2, 3, 4 };
+
+	pdc_sim_card_init(&card, pdc_sim_card_ntag215, NULL, 0);
+	activate(&card, &picc);
+	TEST_EQUAL(picc.uid_size, 7);
+	TEST_EQUAL(picc.sak.as_uint8, 0x00);
+
+	// Capability container and the empty NDEF TLV
+	TEST_EQUAL(MIFARE_READ(&m_sim.pdc, &picc, 3, data), STATUS_OK);
+	TEST_EQUAL(data[0], 0xE1);
+	TEST_EQUAL(data[2], 0x3E);
+	TEST_EQUAL(data[4], 0x03);
+	TEST_EQUAL(data[5], 0x00);
+
+	TEST_EQUAL(MIFARE_GET_VERSION(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(picc.version_response.storage_size, 0x11);
+
+	TEST_EQUAL(MFU_Write(&m_sim.pdc, &picc, 5, page), STATUS_OK);
+	TEST_EQUAL(MIFARE_READ(&m_sim.pdc, &picc, 5, data), STATUS_OK);
+	TEST_EQUAL(memcmp(data, page, 4), 0);
+	TEST_EQUAL(memcmp(card.memory + 20, page, 4), 0);
+
+	// Beyond the last page the PICC answers with a NAK
+	TEST_ASSERT(MIFARE_READ(&m_sim.pdc, &picc, 200, data) != STATUS_OK);
+	TEST_EQUAL(m_sim.stats.collisions, 0);
+}
+
+static void test_mfc(void) {
+	static pdc_sim_card_t card;
+	picc_t picc;
+	uint8_t data[16];
+
+	pdc_sim_card_init(&card, pdc_sim_card_mfc_1k, NULL, 0);
+	activate(&card, &picc);
+	TEST_EQUAL(picc.sak.as_uint8, 0x08);
+
+	// Not authenticated
+	TEST_ASSERT(MIFARE_READ(&m_sim.pdc, &picc, 4, data) != STATUS_OK);
+
+	activate(&card, &picc);
+	picc.mfc_crypto1.key_a_or_b = 0x60;
+	picc.mfc_crypto1.block_address = 4;
+	memset(picc.mfc_crypto1.key, 0xFF, 6);
+	TEST_EQUAL(pdc_sim_crypto1_begin(&m_sim.pdc, &picc), STATUS_OK);
+
+	// Key A reads as zeroes, the transport configuration allows key B
+	TEST_EQUAL(MIFARE_READ(&m_sim.pdc, &picc, 7, data), STATUS_OK);
+	TEST_EQUAL(data[0], 0x00);
+	TEST_EQUAL(data[6], 0xFF);
+	TEST_EQUAL(data[10], 0xFF);
+
+	// A wrong key fails, the PICC does not answer
+	activate(&card, &picc);
+	picc.mfc_crypto1.key_a_or_b = 0x60;
+	picc.mfc_crypto1.block_address = 4;
+	memset(picc.mfc_crypto1.key, 0xFF, 6);
+	picc.mfc_crypto1.key[0] = 0x00;
+	TEST_ASSERT(pdc_sim_crypto1_begin(&m_sim.pdc, &picc) != STATUS_OK);
+}
+
+static void test_desfire(void) {
+	static pdc_sim_card_t card;
+	static const uint8_t select[] = { 0x90, 0x5A, 0x00, 0x00, 0x03, 0x56, 0x34,
+			0x12, 0x00 };
+	static const uint8_t read[] = { 0x90, 0xBD, 0x00, 0x00, 0x07, 0x01, 0x00,
+			0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+	static const uint8_t more[] = { 0x90, 0xAF, 0x00, 0x00, 0x00 };
+	uint8_t file[100];
+	uint8_t response[64];
+	size_t size;
+	picc_t picc;
+
+	for (size_t i = 0; i < sizeof(file); i++)
+		file[i] = i;
+	pdc_sim_card_init(&card, pdc_sim_card_desfire, NULL, 0);
+	pdc_sim_desfire_add_application(&card, 0x123456);
+	pdc_sim_desfire_add_file(&card, 0x123456, 1, file, sizeof(file));
+
+	activate(&card, &picc);
+	TEST_EQUAL(picc.sak.as_uint8, 0x20);
+	TEST_EQUAL(iso14443_4_rats(&m_sim.pdc, &picc), STATUS_OK);
+
+	size = sizeof(response);
+	TEST_EQUAL(iso14443_4_transceive(&m_sim.pdc, &picc, select, sizeof(select),
+			response, &size), STATUS_OK);
+	TEST_EQUAL(size, 2);
+	TEST_EQUAL(response[0], 0x91);
+	TEST_EQUAL(response[1], 0x00);
+
+	// One frame of data per ADDITIONAL FRAME, 59 bytes at FSC 64
+	size = sizeof(response);
+	TEST_EQUAL(iso14443_4_transceive(&m_sim.pdc, &picc, read, sizeof(read),
+			response, &size), STATUS_OK);
+	TEST_EQUAL(size, 59 + 2);
+	TEST_EQUAL(response[size - 1], 0xAF);
+	TEST_EQUAL(memcmp(response, file, 59), 0);
+
+	size = sizeof(response);
+	TEST_EQUAL(iso14443_4_transceive(&m_sim.pdc, &picc, more, sizeof(more),
+			response, &size), STATUS_OK);
+	TEST_EQUAL(size, sizeof(file) - 59 + 2);
+	TEST_EQUAL(response[size - 1], 0x00);
+	TEST_EQUAL(memcmp(response, file + 59, sizeof(file) - 59), 0);
+}
+
+static int wupa(void) {
+	uint8_t atqa[2];
+	size_t size = sizeof(atqa);
+	return PICC_REQA_or_WUPA(&m_sim.pdc, PICC_CMD_WUPA, atqa, &size);
+}
+
+// ISO 14443-3 6.3: REQA is only answered in IDLE, WUPA also in HALT. An
+// unexpected frame returns READY and ACTIVE to IDLE, READY* and ACTIVE* to
+// HALT.
+static void test_states(void) {
+	static pdc_sim_card_t cards[2];
+	uint8_t data[16], select[7], sak[3];
+	picc_t picc = { 0 };
+	size_t size;
+
+	pdc_sim_card_init(cards, pdc_sim_card_ntag213, NULL, 0);
+	pdc_sim_card_init(cards + 1, pdc_sim_card_ntag213, NULL, 1);
+	pdc_sim_init(&m_sim, cards, 1);
+
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_ready);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_TIMEOUT);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_idle);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, &picc, 0), STATUS_OK);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_active);
+	TEST_EQUAL(wupa(), STATUS_TIMEOUT);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_idle);
+
+	// HALT: only WUPA, READY* falls back to HALT
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, &picc, 0), STATUS_OK);
+	PICC_HaltA(&m_sim.pdc);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_halt);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_TIMEOUT);
+	TEST_EQUAL(wupa(), STATUS_OK);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_ready);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_TIMEOUT);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_halt);
+
+	// A READ in READY*, a NAK in ACTIVE*
+	TEST_EQUAL(wupa(), STATUS_OK);
+	TEST_ASSERT(MIFARE_READ(&m_sim.pdc, &picc, 4, data) != STATUS_OK);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_halt);
+	TEST_EQUAL(wupa(), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, &picc, 0), STATUS_OK);
+	TEST_ASSERT(MIFARE_READ(&m_sim.pdc, &picc, 200, data) != STATUS_OK);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_halt);
+
+	// The SELECT of another PICC
+	pdc_sim_card_init(cards, pdc_sim_card_mfc_1k, NULL, 0);
+	pdc_sim_card_init(cards + 1, pdc_sim_card_mfc_1k, NULL, 1);
+	pdc_sim_init(&m_sim, cards, 2);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_OK);
+	select[0] = PICC_CMD_SEL_CL1;
+	select[1] = 0x70;
+	memcpy(select + 2, cards[0].cl[0], 5);
+	size = sizeof(sak);
+	TEST_EQUAL(m_sim.pdc.TransceiveData(&m_sim.pdc, select, sizeof(select),
+			sak, &size, NULL, 0, NULL, true, false), STATUS_OK);
+	TEST_EQUAL(cards[0].state, pdc_sim_state_active);
+	TEST_EQUAL(cards[1].state, pdc_sim_state_idle);
+}
+
+static void test_empty_field(void) {
+	picc_t picc = { 0 };
+
+	pdc_sim_init(&m_sim, NULL, 0);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_TIMEOUT);
+	TEST_EQUAL(m_sim.stats.timeouts, 1);
+	TEST_EQUAL(m_sim.stats.frames, 1);
+	TEST_ASSERT(m_sim.air_time_ns > 0);
+}
+
+int main(void) {
+	test_ntag();
+	test_mfc();
+	test_desfire();
+	test_states();
+	test_empty_field();
+
+	return test_result("test_pdc_sim");
+}
@@ -0,0 +1,141 @@
+/*
+ * test_picc_identify.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// picc_identify() on every ISO 14443-A PICC of pdc_sim: the type, the
+// memory and the probes it costs. Also a picc_t reused for another
+// activation, and picc_identify_read() of the Type 2 user memory.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "picc_identify.h"
+#include "desfire.h"
+
+typedef struct {
+	pdc_sim_card_type_t card;
+	picc_type_t type;
+	nfc_type_t nfc_type;
+	uint16_t pages;
+	uint8_t page_size;
+	unsigned int frames;
+	unsigned int timeouts;
+} expected_t;
+
+static const expected_t m_expected[] = {
+	{ pdc_sim_card_ntag213, picc_type_ntag, nfc_type_2, 36, 4, 1, 0 },
+	{ pdc_sim_card_ntag215, picc_type_ntag, nfc_type_2, 126, 4, 1, 0 },
+	{ pdc_sim_card_ntag216, picc_type_ntag, nfc_type_2, 222, 4, 1, 0 },
+	// GET_VERSION and the Ultralight C authentication both time out
+	{ pdc_sim_card_ultralight, picc_type_mfu, nfc_type_2, 12, 4, 8, 2 },
+	{ pdc_sim_card_mfc_1k, picc_type_mfc, nfc_type_mfc, 63, 16, 0, 0 },
+	{ pdc_sim_card_mfc_4k, picc_type_mfc_4k, nfc_type_mfc, 255, 16, 0, 0 },
+	// RATS and the first part of GetVersion
+	{ pdc_sim_card_desfire, picc_type_desfire, nfc_type_4, 0, 0, 2, 0 },
+};
+
+static pdc_sim_card_t m_card;
+static pdc_sim_t m_sim;
+
+static void activate(picc_t *picc) {
+	// An ACTIVE PICC ignores REQA, a field reset returns it to IDLE
+	memset(picc, 0, sizeof(*picc));
+	pdc_sim_field_reset(&m_sim);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, picc, 0), STATUS_OK);
+}
+
+static void test_types(void) {
+	for (size_t i = 0; i < sizeof(m_expected) / sizeof(m_expected[0]); i++) {
+		const expected_t *expected = m_expected + i;
+		picc_identify_stats_t stats;
+		uint8_t data[16];
+		picc_t picc;
+
+		pdc_sim_card_init(&m_card, expected->card, NULL, 0);
+		pdc_sim_init(&m_sim, &m_card, 1);
+		activate(&picc);
+		TEST_EQUAL(picc_identify(&m_sim.pdc, &picc, &stats), STATUS_OK);
+		TEST_EQUAL(picc.card_type, expected->type);
+		TEST_EQUAL(picc.nfc_type, expected->nfc_type);
+		TEST_EQUAL(picc.memory_stucture.page_count, expected->pages);
+		TEST_EQUAL(picc.memory_stucture.page_size, expected->page_size);
+		TEST_EQUAL(stats.frames, expected->frames);
+		TEST_EQUAL(stats.timeouts, expected->timeouts);
+
+		// Still selected
+		if (expected->nfc_type == nfc_type_2)
+			TEST_EQUAL(MIFARE_READ(&m_sim.pdc, &picc, 4, data), STATUS_OK);
+	}
+}
+
+static void test_reused_picc(void) {
+	picc_identify_stats_t stats;
+	desfire_t desfire;
+	picc_t picc;
+
+	pdc_sim_card_init(&m_card, pdc_sim_card_desfire, NULL, 0);
+	pdc_sim_desfire_add_application(&m_card, 1);
+	pdc_sim_init(&m_sim, &m_card, 1);
+	activate(&picc);
+	TEST_EQUAL(iso14443_4_rats(&m_sim.pdc, &picc), STATUS_OK);
+
+	// Selected again into the same picc_t, its ISO 14443-4 state is stale
+	pdc_sim_field_reset(&m_sim);
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, &picc, 0), STATUS_OK);
+	TEST_ASSERT(picc.iso14443_4.fsd != 0);
+	TEST_EQUAL(picc_identify(&m_sim.pdc, &picc, &stats), STATUS_OK);
+	TEST_EQUAL(picc.card_type, picc_type_desfire);
+	TEST_EQUAL(stats.frames, 2);
+
+	TEST_EQUAL(desfire_init(&desfire, &m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+}
+
+static void test_read(void) {
+	picc_identify_stats_t stats;
+	uint8_t data[888];
+	size_t size;
+	picc_t picc;
+
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag216, NULL, 0);
+	pdc_sim_init(&m_sim, &m_card, 1);
+	activate(&picc);
+	size = sizeof(data);
+	TEST_EQUAL(picc_identify_read(&m_sim.pdc, &picc, data, &size, &stats),
+			STATUS_OK);
+	TEST_EQUAL(size, sizeof(data));
+	TEST_EQUAL(stats.bytes_read, sizeof(data));
+	TEST_EQUAL(memcmp(data, m_card.memory + 4 * 4, sizeof(data)), 0);
+	// GET_VERSION and a single FAST_READ
+	TEST_EQUAL(stats.frames, 2);
+
+	activate(&picc);
+	size = sizeof(data) - 1;
+	TEST_EQUAL(picc_identify_read(&m_sim.pdc, &picc, data, &size, &stats),
+			STATUS_NO_ROOM);
+	TEST_EQUAL(size, 0);
+
+	// Nothing is read from a Mifare Classic
+	pdc_sim_card_init(&m_card, pdc_sim_card_mfc_1k, NULL, 0);
+	pdc_sim_init(&m_sim, &m_card, 1);
+	activate(&picc);
+	size = sizeof(data);
+	TEST_EQUAL(picc_identify_read(&m_sim.pdc, &picc, data, &size, &stats),
+			STATUS_OK);
+	TEST_EQUAL(size, 0);
+	TEST_EQUAL(stats.frames, 0);
+}
+
+int main(void) {
+	test_types();
+	test_reused_picc();
+	test_read();
+
+	return test_result("test_picc_identify");
+}
@@ -0,0 +1,163 @@
+/*
+ * test_pn5180.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// The unmodified pn5180 driver against the PN5180 host model: init, an
+// empty field, activation and READ of every ISO 14443-A PICC of pdc_sim,
+// anticollision of two PICCs, the bit rate, an ISO 15693 inventory with
+// the switch back to ISO 14443-A, and an ISO 14443-B inventory with a
+// DESFire read. No frame may be clocked while BUSY is high.
+
+#include <string.h>
+
+#include "test.h"
+#include "pn5180_model.h"
+#include "iso15693.h"
+#include "iso14443b.h"
+#include "desfire.h"
+
+static pn5180_model_t m_model;
+static pn5180_t m_pn5180;
+static pdc_sim_card_t m_cards[2];
+
+static void setup(size_t card_count, bool irq) {
+	pn5180_model_init(&m_model, m_cards, card_count, &m_pn5180);
+	if (irq)
+		m_pn5180.wait_irq = pn5180_model_wait_irq;
+	TEST_EQUAL(PN5180_Init(&m_pn5180), STATUS_OK);
+}
+
+static void test_init(void) {
+	picc_t picc;
+
+	setup(0, false);
+	// LOAD_RF_CONFIG, one register batch, RF_ON
+	TEST_EQUAL(m_model.stats.frames, 3);
+	TEST_ASSERT(m_model.rf_on);
+
+	memset(&picc, 0, sizeof(picc));
+	TEST_EQUAL(picc_reqa(&m_pn5180, &picc), STATUS_TIMEOUT);
+	TEST_EQUAL(m_model.stats.violations, 0);
+}
+
+static void test_types(void) {
+	static const uint8_t sak[] = { 0x00, 0x00, 0x00, 0x00, 0x08, 0x18, 0x20 };
+
+	for (pdc_sim_card_type_t type = pdc_sim_card_ntag213;
+			type <= pdc_sim_card_desfire; type++) {
+		uint8_t data[18];
+		picc_t picc;
+
+		pdc_sim_card_init(m_cards, type, NULL, 0);
+		setup(1, true);
+		memset(&picc, 0, sizeof(picc));
+		TEST_EQUAL(picc_reqa(&m_pn5180, &picc), STATUS_OK);
+		TEST_EQUAL(PICC_Select(&m_pn5180, &picc, 0), STATUS_OK);
+		TEST_EQUAL(picc.sak.as_uint8, sak[type]);
+		TEST_EQUAL(picc.uid_size, m_cards[0].uid_size);
+		TEST_EQUAL(memcmp(picc.uid, m_cards[0].uid, picc.uid_size), 0);
+		if (type <= pdc_sim_card_ultralight) {
+			TEST_EQUAL(MIFARE_READ(&m_pn5180, &picc, 4, data), STATUS_OK);
+			TEST_EQUAL(memcmp(data, m_cards[0].memory + 16, 16), 0);
+		}
+		TEST_EQUAL(m_model.stats.violations, 0);
+	}
+}
+
+static void test_collision(void) {
+	static const uint8_t uid_a[7] = { 0x04, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66 };
+	static const uint8_t uid_b[7] = { 0x04, 0x11, 0x22, 0xB3, 0x44, 0x55, 0x67 };
+	int found = 0;
+
+	pdc_sim_card_init(m_cards + 0, pdc_sim_card_ntag213, uid_a, 7);
+	pdc_sim_card_init(m_cards + 1, pdc_sim_card_ntag213, uid_b, 7);
+	setup(2, true);
+	for (int i = 0; i < 2; i++) {
+		picc_t picc;
+
+		memset(&picc, 0, sizeof(picc));
+		TEST_EQUAL(picc_reqa(&m_pn5180, &picc), STATUS_OK);
+		TEST_EQUAL(PICC_Select(&m_pn5180, &picc, 0), STATUS_OK);
+		TEST_EQUAL(picc.uid_size, 7);
+		if (!memcmp(picc.uid, uid_a, 7))
+			found |= 1;
+		if (!memcmp(picc.uid, uid_b, 7))
+			found |= 2;
+		TEST_EQUAL(PICC_HaltA(&m_pn5180), STATUS_OK);
+	}
+	TEST_EQUAL(found, 3);
+	TEST_ASSERT(m_model.field.stats.collisions > 0);
+	TEST_EQUAL(m_model.stats.violations, 0);
+}
+
+static void test_bitrate(void) {
+	setup(0, false);
+	TEST_EQUAL(m_pn5180.SetBitRate(&m_pn5180, pdc_bitrate_424,
+			pdc_bitrate_848), STATUS_OK);
+	TEST_EQUAL(m_model.field.tx_rate, pdc_bitrate_424);
+	TEST_EQUAL(m_model.field.rx_rate, pdc_bitrate_848);
+	TEST_EQUAL(m_pn5180.tx_bitrate, pdc_bitrate_424);
+}
+
+static void test_iso15693(void) {
+	iso15693_vicc_t viccs[4];
+	uint8_t data[256];
+	size_t count = 4, size = sizeof(data);
+	picc_t picc;
+
+	pdc_sim_card_init(m_cards + 0, pdc_sim_card_icode_slix, NULL, 0);
+	pdc_sim_card_init(m_cards + 1, pdc_sim_card_ntag213, NULL, 0);
+	setup(2, true);
+	TEST_EQUAL(iso15693_inventory(&m_pn5180, 16, viccs, &count, NULL),
+			STATUS_OK);
+	TEST_EQUAL(count, 1);
+	TEST_EQUAL(memcmp(viccs[0].uid, m_cards[0].uid, ISO15693_UID_SIZE), 0);
+	TEST_EQUAL(iso15693_read(&m_pn5180, viccs, data, &size), STATUS_OK);
+	TEST_EQUAL(size, m_cards[0].memory_size);
+	TEST_EQUAL(memcmp(data, m_cards[0].memory, size), 0);
+
+	memset(&picc, 0, sizeof(picc));
+	TEST_EQUAL(picc_reqa(&m_pn5180, &picc), STATUS_OK);
+	TEST_EQUAL(m_pn5180.protocol, pdc_protocol_iso14443a);
+	TEST_EQUAL(m_model.stats.violations, 0);
+}
+
+static void test_iso14443b(void) {
+	static const uint8_t file[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+	picc_t piccs[2];
+	desfire_t desfire;
+	uint8_t data[sizeof(file)];
+	size_t count = 2, size = sizeof(data);
+
+	for (int i = 0; i < 2; i++) {
+		pdc_sim_card_init(m_cards + i, pdc_sim_card_iso14443b, NULL, 0);
+		pdc_sim_desfire_add_application(m_cards + i, 1);
+		pdc_sim_desfire_add_file(m_cards + i, 1, 0, file, sizeof(file));
+	}
+	setup(2, true);
+	TEST_EQUAL(iso14443b_inventory(&m_pn5180, ISO14443B_AFI_ALL, 4, piccs,
+			&count, NULL), STATUS_OK);
+	TEST_EQUAL(count, 2);
+	TEST_EQUAL(iso14443b_activate(&m_pn5180, piccs + 1), STATUS_OK);
+	TEST_EQUAL(desfire_init(&desfire, &m_pn5180, piccs + 1), STATUS_OK);
+	TEST_EQUAL(desfire_select_application(&desfire, 1), STATUS_OK);
+	TEST_EQUAL(desfire_read_data(&desfire, 0, 0, sizeof(file), data, &size),
+			STATUS_OK);
+	TEST_EQUAL(size, sizeof(file));
+	TEST_EQUAL(memcmp(data, file, sizeof(file)), 0);
+	TEST_EQUAL(m_model.stats.violations, 0);
+}
+
+int main(void) {
+	test_init();
+	test_types();
+	test_collision();
+	test_bitrate();
+	test_iso15693();
+	test_iso14443b();
+
+	return test_result("test_pn5180");
+}
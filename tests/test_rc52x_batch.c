@@ -0,0 +1,168 @@
+/*
+ * test_rc52x_batch.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// SPI transactions of the rc52x driver, counted by the bshal_spim mock on
+// the rc52x emulator. A transaction is one chip select assertion.
+
+#include <string.h>
+
+#include "test.h"
+#include "bshal_mock.h"
+#include "rc52x_emu.h"
+
+// Loading and starting a Transceive: one read burst for the masked updates
+// of TxModeReg/RxModeReg, then one transaction per register write and one
+// for the FIFO. With wait_irq, ComIEnReg is written as well. Before the
+// batch API this took 14 chip selects.
+#define MAX_START_TRANSACTIONS			(9)
+#define MAX_START_TRANSACTIONS_IRQ		(10)
+
+// With a register cache the masked updates need no read burst
+#define MAX_START_TRANSACTIONS_CACHED	(MAX_START_TRANSACTIONS - 1)
+
+// With wait_irq the answer costs one ComIrqReg read and four more reads
+#define MAX_TRANSCEIVE_TRANSACTIONS_IRQ	(MAX_START_TRANSACTIONS_IRQ + 5)
+
+static rc52x_emu_t m_emu;
+static pdc_sim_card_t m_card;
+
+static void setup(rc52x_t *rc52x, picc_t *picc, bool irq) {
+	rc52x_emu_init(&m_emu, 0x92, &m_card, 1);
+	memset(rc52x, 0, sizeof(*rc52x));
+	rc52x_emu_attach(&m_emu, rc52x);
+	if (irq)
+		rc52x->wait_irq = rc52x_emu_wait_irq;
+	rc52x_init(rc52x);
+
+	memset(picc, 0, sizeof(*picc));
+	TEST_EQUAL(picc_reqa(rc52x, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(rc52x, picc, 0), STATUS_OK);
+}
+
+static void test_transceive_start(bool irq) {
+	static rc52x_t rc52x;
+	picc_t picc;
+	uint8_t read[] = { 0x30, 4 };
+	uint8_t data[18];
+	size_t size = sizeof(data);
+	uint8_t valid_bits = 0;
+	unsigned int emu_before;
+	int result;
+
+	setup(&rc52x, &picc, irq);
+
+	bshal_mock_spim_reset();
+	emu_before = m_emu.stats.transactions;
+	TEST_EQUAL(rc52x_transceive_start(&rc52x, read, sizeof(read), 0, 0, true,
+			true), STATUS_OK);
+	TEST_ASSERT(bshal_mock_spim_stats.transactions
+			<= (irq ? MAX_START_TRANSACTIONS_IRQ : MAX_START_TRANSACTIONS));
+	// The mock and the emulator agree on what a transaction is
+	TEST_EQUAL(bshal_mock_spim_stats.transactions,
+			m_emu.stats.transactions - emu_before);
+
+	do {
+		result = rc52x_transceive_poll(&rc52x, data, &size, &valid_bits, NULL);
+	} while (result == STATUS_BUSY);
+	TEST_EQUAL(result, STATUS_OK);
+	TEST_EQUAL(size, 16);
+	TEST_EQUAL(memcmp(data, m_card.memory + 16, 16), 0);
+
+	// The whole TransceiveData, as the card layer sees it
+	if (irq) {
+		bshal_mock_spim_reset();
+		TEST_EQUAL(MIFARE_READ(&rc52x, &picc, 0, data), STATUS_OK);
+		TEST_EQUAL(memcmp(data, m_card.memory, 16), 0);
+		TEST_ASSERT(bshal_mock_spim_stats.transactions
+				<= MAX_TRANSCEIVE_TRANSACTIONS_IRQ);
+	}
+}
+
+static void test_batch_flush(void) {
+	static rc52x_t rc52x;
+	picc_t picc;
+	rc52x_batch_t batch;
+	unsigned int reads_before;
+	uint8_t value;
+
+	setup(&rc52x, &picc, false);
+
+	// Three masked updates: one read burst, then the three writes
+	rc52x_batch_begin(&batch, &rc52x);
+	rc52x_batch_or_reg8(&batch, RC52X_REG_TxControlReg, 0x03);
+	rc52x_batch_and_reg8(&batch, RC52X_REG_TxModeReg, 0x7F);
+	rc52x_batch_or_reg8(&batch, RC52X_REG_RxModeReg, 0x08);
+	bshal_mock_spim_reset();
+	TEST_EQUAL(rc52x_batch_flush(&batch), 0);
+	TEST_ASSERT(bshal_mock_spim_stats.transactions <= 4);
+
+	// Updates that do not change the register are skipped
+	rc52x_batch_begin(&batch, &rc52x);
+	rc52x_batch_or_reg8(&batch, RC52X_REG_TxControlReg, 0x03);
+	rc52x_batch_or_reg8(&batch, RC52X_REG_RxModeReg, 0x08);
+	bshal_mock_spim_reset();
+	TEST_EQUAL(rc52x_batch_flush(&batch), 0);
+	TEST_EQUAL(bshal_mock_spim_stats.transactions, 1);
+
+	// A register written earlier in the batch is not read back
+	rc52x_batch_begin(&batch, &rc52x);
+	rc52x_batch_set_reg8(&batch, RC52X_REG_ModWidthReg, 0x26);
+	rc52x_batch_or_reg8(&batch, RC52X_REG_ModWidthReg, 0x01);
+	reads_before = m_emu.stats.reg_reads;
+	TEST_EQUAL(rc52x_batch_flush(&batch), 0);
+	TEST_EQUAL(m_emu.stats.reg_reads - reads_before, 0);
+	rc52x_get_reg8(&rc52x, RC52X_REG_ModWidthReg, &value);
+	TEST_EQUAL(value, 0x27);
+}
+
+static void test_reg_cache(void) {
+	static rc52x_t rc52x;
+	static bs_pdc_reg_cache_t cache;
+	picc_t picc;
+	uint8_t data[18];
+
+	setup(&rc52x, &picc, false);
+	memset(&cache, 0, sizeof(cache));
+	rc52x.reg_cache = &cache;
+
+	// The first READ fills the cache, the next ones use it
+	for (int i = 0; i < 3; i++) {
+		uint8_t read[] = { 0x30, 4 };
+		size_t size = sizeof(data);
+		uint8_t valid_bits = 0;
+		int result;
+
+		bshal_mock_spim_reset();
+		TEST_EQUAL(rc52x_transceive_start(&rc52x, read, sizeof(read), 0, 0,
+				true, true), STATUS_OK);
+		if (i)
+			TEST_ASSERT(bshal_mock_spim_stats.transactions
+					<= MAX_START_TRANSACTIONS_CACHED);
+		do {
+			result = rc52x_transceive_poll(&rc52x, data, &size, &valid_bits,
+					NULL);
+		} while (result == STATUS_BUSY);
+		TEST_EQUAL(result, STATUS_OK);
+	}
+
+	// In verify mode every cached value used is checked against the chip
+	cache.verify = true;
+	TEST_EQUAL(MIFARE_READ(&rc52x, &picc, 0, data), STATUS_OK);
+	TEST_EQUAL(memcmp(data, m_card.memory, 16), 0);
+	TEST_EQUAL(cache.mismatch_count, 0);
+}
+
+int main(void) {
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag213, NULL, 0);
+
+	test_transceive_start(false);
+	test_transceive_start(true);
+	test_batch_flush();
+	test_reg_cache();
+
+	return test_result("test_rc52x_batch");
+}
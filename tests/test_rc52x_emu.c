@@ -0,0 +1,157 @@
+/*
+ * test_rc52x_emu.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// The unmodified rc52x driver against the register level emulator: self
+// test, inventory, NTAG and MIFARE Classic with the Crypto1 unit of the
+// chip, an empty field, and the LPCD by a WUPA pulse.
+
+#include <string.h>
+
+#include "test.h"
+#include "rc52x_emu.h"
+
+#define MAX_CARDS		(16)
+
+static rc52x_emu_t m_emu;
+static rc52x_t m_rc52x;
+static pdc_sim_card_t m_cards[MAX_CARDS];
+
+static void setup(pdc_sim_card_t *cards, size_t count) {
+	rc52x_emu_init(&m_emu, 0x92, cards, count);
+	memset(&m_rc52x, 0, sizeof(m_rc52x));
+	rc52x_emu_attach(&m_emu, &m_rc52x);
+	m_rc52x.wait_irq = rc52x_emu_wait_irq;
+	rc52x_init(&m_rc52x);
+}
+
+static void activate(picc_t *picc) {
+	memset(picc, 0, sizeof(*picc));
+	TEST_EQUAL(picc_reqa(&m_rc52x, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_rc52x, picc, 0), STATUS_OK);
+}
+
+static void test_self_test(void) {
+	setup(NULL, 0);
+	TEST_EQUAL(rc52x_self_test(&m_rc52x), rc52x_ref_status_success);
+	TEST_EQUAL(strcmp(rc52x_get_chip_name(&m_rc52x), "MFRC522 V2"), 0);
+}
+
+static void test_inventory(void) {
+	for (int n = 1; n <= MAX_CARDS; n *= 2) {
+		picc_t piccs[MAX_CARDS];
+		int count = MAX_CARDS;
+		int matches = 0;
+
+		for (int i = 0; i < n; i++)
+			pdc_sim_card_init(m_cards + i, i % (pdc_sim_card_desfire + 1),
+					NULL, (i % 3 == 0) ? 10 : 0);
+		setup(m_cards, n);
+		TEST_EQUAL(picc_anticol_iso14443a(&m_rc52x, piccs, &count, PICC_CMD_REQA, NULL),
+				STATUS_OK);
+		TEST_EQUAL(count, n);
+		for (int i = 0; i < count; i++)
+			for (int j = 0; j < n; j++)
+				if (piccs[i].uid_size == m_cards[j].uid_size
+						&& !memcmp(piccs[i].uid, m_cards[j].uid,
+								piccs[i].uid_size))
+					matches++;
+		TEST_EQUAL(matches, n);
+	}
+}
+
+static void test_ntag(void) {
+	picc_t picc;
+	uint8_t data[18];
+	uint8_t page[4] = { 1, 2, 3, 4 };
+
+	pdc_sim_card_init(m_cards, pdc_sim_card_ntag215, NULL, 0);
+	setup(m_cards, 1);
+	activate(&picc);
+	TEST_EQUAL(picc.uid_size, 7);
+
+	TEST_EQUAL(MIFARE_READ(&m_rc52x, &picc, 3, data), STATUS_OK);
+	TEST_EQUAL(memcmp(data, m_cards[0].memory + 12, 16), 0);
+	TEST_EQUAL(MFU_Write(&m_rc52x, &picc, 5, page), STATUS_OK);
+	TEST_EQUAL(MIFARE_READ(&m_rc52x, &picc, 5, data), STATUS_OK);
+	TEST_EQUAL(memcmp(data, page, 4), 0);
+}
+
+static void test_mfc(void) {
+	picc_t picc;
+	uint8_t data[18];
+
+	pdc_sim_card_init(m_cards, pdc_sim_card_mfc_1k, NULL, 0);
+	setup(m_cards, 1);
+	activate(&picc);
+	TEST_EQUAL(picc.sak.as_uint8, 0x08);
+
+	picc.mfc_crypto1.key_a_or_b = 0x60;
+	picc.mfc_crypto1.block_address = 4;
+	memset(picc.mfc_crypto1.key, 0xFF, 6);
+	TEST_EQUAL(rc52x_crypto1_begin(&m_rc52x, &picc), STATUS_OK);
+	TEST_EQUAL(MIFARE_READ(&m_rc52x, &picc, 7, data), STATUS_OK);
+	TEST_EQUAL(data[0], 0x00);
+	TEST_EQUAL(data[6], 0xFF);
+	rc52x_crypto1_end(&m_rc52x);
+
+	// An ACTIVE PICC does not answer REQA, it returns to IDLE
+	TEST_EQUAL(picc_reqa(&m_rc52x, &picc), STATUS_TIMEOUT);
+
+	// The PICC does not answer {aR} with a wrong key
+	activate(&picc);
+	picc.mfc_crypto1.key_a_or_b = 0x60;
+	picc.mfc_crypto1.block_address = 4;
+	memset(picc.mfc_crypto1.key, 0xFF, 6);
+	picc.mfc_crypto1.key[0] = 0x00;
+	TEST_EQUAL(rc52x_crypto1_begin(&m_rc52x, &picc), STATUS_TIMEOUT);
+}
+
+static void test_empty_field(void) {
+	picc_t picc = { 0 };
+	uint64_t start;
+
+	setup(NULL, 0);
+	start = rc52x_emu_time_ns();
+	TEST_EQUAL(picc_reqa(&m_rc52x, &picc), STATUS_TIMEOUT);
+	// The activation timeout, not the 25 ms default of the timer
+	TEST_ASSERT(rc52x_emu_time_ns() - start < 1000000);
+}
+
+static void test_lpcd(void) {
+	pdc_lpcd_sample_t sample;
+
+	// An ATQA, and the collision of two different ones
+	pdc_sim_card_init(m_cards, pdc_sim_card_mfc_1k, NULL, 0);
+	pdc_sim_card_init(m_cards + 1, pdc_sim_card_ntag213, NULL, 0);
+	for (size_t n = 1; n <= 2; n++) {
+		setup(m_cards, n);
+		TEST_EQUAL(rc52x_lpcd_measure(&m_rc52x, &sample), STATUS_OK);
+		TEST_ASSERT(sample.present);
+	}
+
+	// Every pulse ends with the field off, the sessions are lost
+	unsigned int epoch = m_rc52x.picc_epoch;
+	TEST_EQUAL(rc52x_lpcd_measure(&m_rc52x, &sample), STATUS_OK);
+	TEST_ASSERT(sample.present);
+	TEST_ASSERT(m_rc52x.picc_epoch != epoch);
+
+	m_cards[0].present = m_cards[1].present = false;
+	TEST_EQUAL(rc52x_lpcd_measure(&m_rc52x, &sample), STATUS_OK);
+	TEST_ASSERT(!sample.present);
+	m_cards[0].present = m_cards[1].present = true;
+}
+
+int main(void) {
+	test_self_test();
+	test_inventory();
+	test_ntag();
+	test_mfc();
+	test_empty_field();
+	test_lpcd();
+
+	return test_result("test_rc52x_emu");
+}
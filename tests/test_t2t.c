@@ -0,0 +1,166 @@
+/*
+ * test_t2t.c
+ *
+ *  Created on: 17 okt. 2026
+ *      Author: andre
+ */
+
+// NDEF read from a Type 2 Tag on pdc_sim: only the pages covering the
+// message are read, and a message beyond page 255 is refused rather than
+// read from a wrapped page address.
+
+#include <string.h>
+
+#include "test.h"
+#include "pdc_sim.h"
+#include "t2t.h"
+
+static pdc_sim_t m_sim;
+static pdc_sim_card_t m_card;
+static uint8_t m_buffer[1024];
+
+static void activate(picc_t *picc) {
+	pdc_sim_init(&m_sim, &m_card, 1);
+	memset(picc, 0, sizeof(*picc));
+	TEST_EQUAL(picc_reqa(&m_sim.pdc, picc), STATUS_OK);
+	TEST_EQUAL(PICC_Select(&m_sim.pdc, picc, 0), STATUS_OK);
+}
+
+// NTAG216 holding an NDEF TLV with a single URI record
+static void init_uri(const char *uri) {
+	size_t length = strlen(uri);
+	uint8_t *data = m_card.memory + T2T_DATA_PAGE * T2T_PAGE_SIZE;
+
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag216, NULL, 0);
+	data[0] = 0x03;
+	data[1] = length + 5;
+	data[2] = 0xD1;
+	data[3] = 0x01;
+	data[4] = length + 1;
+	data[5] = 'U';
+	data[6] = 0x04;
+	memcpy(data + 7, uri, length);
+	data[7 + length] = 0xFE;
+}
+
+// NTAG216 holding an NDEF TLV in the 3 byte length format
+static void init_long(size_t payload_length) {
+	uint8_t *data = m_card.memory + T2T_DATA_PAGE * T2T_PAGE_SIZE;
+	size_t message_length = 7 + payload_length;
+
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag216, NULL, 0);
+	data[0] = 0x03;
+	data[1] = 0xFF;
+	data[2] = message_length >> 8;
+	data[3] = message_length;
+	data[4] = 0xC1;
+	data[5] = 0x01;
+	data[6] = payload_length >> 24;
+	data[7] = payload_length >> 16;
+	data[8] = payload_length >> 8;
+	data[9] = payload_length;
+	data[10] = 'T';
+	if (4 + message_length < m_card.memory_size - 16)
+		data[4 + message_length] = 0xFE;
+}
+
+static void test_empty(void) {
+	t2t_ndef_info_t info;
+	picc_t picc;
+
+	pdc_sim_card_init(&m_card, pdc_sim_card_ntag216, NULL, 0);
+	activate(&picc);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_OK);
+	TEST_EQUAL(info.data_size, 872);
+	TEST_EQUAL(info.message_size, 0);
+	TEST_EQUAL(info.frames, 1);
+}
+
+static void test_uri(void) {
+	t2t_ndef_info_t info;
+	picc_t picc;
+
+	// Fits the first READ with the CC
+	init_uri("");
+	activate(&picc);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_OK);
+	TEST_EQUAL(info.message_offset, 2);
+	TEST_EQUAL(info.message_size, 5);
+	TEST_EQUAL(info.frames, 1);
+	TEST_EQUAL(ndef_message_parse(m_buffer + info.message_offset,
+			info.message_size), 1);
+
+	init_uri("blaatschaap.be/a/somewhat/longer/path/to/test");
+	activate(&picc);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_OK);
+	TEST_EQUAL(info.message_offset, 2);
+	TEST_EQUAL(info.message_size, 50);
+	TEST_EQUAL(info.read_size, 60);
+	TEST_EQUAL(info.frames, 4);
+	TEST_EQUAL(ndef_message_parse(m_buffer + info.message_offset,
+			info.message_size), 1);
+}
+
+static void test_long(void) {
+	t2t_ndef_info_t info;
+	unsigned int frames;
+	picc_t picc;
+
+	init_long(300);
+	activate(&picc);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_OK);
+	TEST_EQUAL(info.message_offset, 4);
+	TEST_EQUAL(info.message_size, 307);
+	TEST_EQUAL(ndef_message_parse(m_buffer + info.message_offset,
+			info.message_size), 1);
+	frames = info.frames;
+
+	// FAST_READ once the version is known
+	activate(&picc);
+	TEST_EQUAL(MIFARE_GET_VERSION(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_OK);
+	TEST_EQUAL(info.message_size, 307);
+	TEST_ASSERT(info.frames < frames);
+
+	activate(&picc);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, 40, &info),
+			STATUS_NO_ROOM);
+}
+
+static void test_beyond_sector(void) {
+	t2t_ndef_info_t info;
+	picc_t picc;
+
+	// The CC declares 2040 bytes, 510 pages. A message ending beyond page
+	// 255 would be read from page 0 onwards.
+	init_long(T2T_MAX_DATA_SIZE);
+	m_card.memory[T2T_CC_PAGE * T2T_PAGE_SIZE + 2] = 0xFF;
+	activate(&picc);
+	TEST_EQUAL(MIFARE_GET_VERSION(&m_sim.pdc, &picc), STATUS_OK);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_INVALID);
+	TEST_EQUAL(info.data_size, 2040);
+	TEST_ASSERT(info.read_size <= T2T_MAX_DATA_SIZE);
+
+	// A message in the first sector reads
+	init_uri("example.com");
+	m_card.memory[T2T_CC_PAGE * T2T_PAGE_SIZE + 2] = 0xFF;
+	activate(&picc);
+	TEST_EQUAL(t2t_ndef_read(&m_sim.pdc, &picc, m_buffer, sizeof(m_buffer),
+			&info), STATUS_OK);
+	TEST_EQUAL(info.message_size, 16);
+}
+
+int main(void) {
+	test_empty();
+	test_uri();
+	test_long();
+	test_beyond_sector();
+
+	return test_result("test_t2t");
+}